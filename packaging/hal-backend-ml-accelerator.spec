@@ -76,6 +76,7 @@ Test Binary for hal-backend
 
 %files halbackendtest
 %manifest packaging/hal-backend-ml-accelerator.manifest
+%{_testdir}hal-backend-ml-util-test
 %if 0%{?dummy_support}
 %{_testdir}%{_module_name_dummypassthrough}-test
 %endif
@@ -0,0 +1,276 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "hal-backend-ml-alloc.h"
+
+#define ML_ALLOC_CACHE_LINE (64U)
+
+/**
+ * @brief An allocated buffer. The mapping may start before the buffer to align it to the huge page.
+ */
+typedef struct {
+  void *base;
+  gsize map_size;
+  ml_alloc_info_s info;
+} ml_alloc_entry_s;
+
+/**
+ * @brief Page sizes of the system, read once.
+ */
+typedef struct {
+  gsize page_size;
+  gsize hugepage_size; /* 0 if huge pages are not supported */
+  gboolean thp_enabled; /* transparent huge pages are not disabled */
+} ml_alloc_system_s;
+
+static gsize
+_alloc_read_hugepage_size (void)
+{
+  gchar *contents = NULL;
+  gsize hugepage_size = 0;
+
+  if (g_file_get_contents ("/proc/meminfo", &contents, NULL, NULL)) {
+    const gchar *line = strstr (contents, "Hugepagesize:");
+
+    if (line) {
+      /* Hugepagesize:       2048 kB */
+      hugepage_size = (gsize) g_ascii_strtoull (line + strlen ("Hugepagesize:"), NULL, 10) * 1024U;
+    }
+  }
+
+  g_free (contents);
+  return hugepage_size;
+}
+
+static gboolean
+_alloc_read_thp_enabled (void)
+{
+  gchar *contents = NULL;
+  gboolean enabled = FALSE;
+
+  /* always [madvise] never */
+  if (g_file_get_contents ("/sys/kernel/mm/transparent_hugepage/enabled", &contents, NULL, NULL))
+    enabled = (strstr (contents, "[never]") == NULL);
+
+  g_free (contents);
+  return enabled;
+}
+
+static const ml_alloc_system_s &
+_alloc_get_system (void)
+{
+  static const ml_alloc_system_s sys = [] {
+    ml_alloc_system_s s;
+    long page = sysconf (_SC_PAGESIZE);
+
+    s.page_size = (page > 0) ? (gsize) page : 4096U;
+    s.hugepage_size = _alloc_read_hugepage_size ();
+    s.thp_enabled = (s.hugepage_size > 0) && _alloc_read_thp_enabled ();
+    return s;
+  }();
+
+  return sys;
+}
+
+/** @brief Table of the allocated buffers, never destroyed so that buffers can be freed at exit. */
+static std::unordered_map<const void *, ml_alloc_entry_s> &
+_alloc_get_table (std::unique_lock<std::mutex> &lk)
+{
+  static std::mutex *lock = new std::mutex ();
+  static auto *table = new std::unordered_map<const void *, ml_alloc_entry_s> ();
+
+  lk = std::unique_lock<std::mutex> (*lock);
+  return *table;
+}
+
+static inline gsize
+_alloc_round_up (gsize size, gsize align)
+{
+  return (size + align - 1) / align * align;
+}
+
+/**
+ * @brief Map the buffer backed by huge pages. Tries explicit huge pages first, then
+ *        maps a region aligned to the huge page and asks for transparent huge pages.
+ */
+static gboolean
+_alloc_map_hugepage (gsize size, ml_alloc_entry_s *entry)
+{
+  const ml_alloc_system_s &sys = _alloc_get_system ();
+  gsize hp = sys.hugepage_size;
+  gsize map_size = _alloc_round_up (size, hp);
+  void *p;
+
+#if defined(MAP_HUGETLB)
+  p = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    entry->base = p;
+    entry->map_size = map_size;
+    entry->info.size = map_size;
+    entry->info.page_size = hp;
+    entry->info.hugetlb = TRUE;
+    return TRUE;
+  }
+#endif
+
+#if defined(MADV_HUGEPAGE)
+  if (!sys.thp_enabled)
+    return FALSE;
+
+  /* Over-map and trim, so that the buffer starts at the huge page boundary. */
+  p = mmap (NULL, map_size + hp, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return FALSE;
+
+  guint8 *start = (guint8 *) p;
+  guint8 *aligned = (guint8 *) _alloc_round_up ((gsize) (guintptr) start, hp);
+  gsize head = (gsize) (aligned - start);
+
+  if (head > 0)
+    munmap (start, head);
+  if (hp - head > 0)
+    munmap (aligned + map_size, hp - head);
+
+  entry->base = aligned;
+  entry->map_size = map_size;
+  entry->info.size = map_size;
+  entry->info.page_size = sys.page_size;
+  entry->info.thp = (madvise (aligned, map_size, MADV_HUGEPAGE) == 0);
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+static gboolean
+_alloc_map (gsize size, guint flags, ml_alloc_entry_s *entry)
+{
+  const ml_alloc_system_s &sys = _alloc_get_system ();
+  void *p;
+
+  entry->info.mapped = TRUE;
+
+  /* Huge pages are not worth it for a buffer smaller than a huge page. */
+  if ((flags & ML_ALLOC_FLAG_HUGEPAGE) && sys.hugepage_size > 0 && size >= sys.hugepage_size
+      && _alloc_map_hugepage (size, entry))
+    return TRUE;
+
+  entry->map_size = _alloc_round_up (size, sys.page_size);
+  p = mmap (NULL, entry->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return FALSE;
+
+  entry->base = p;
+  entry->info.size = entry->map_size;
+  entry->info.page_size = sys.page_size;
+  return TRUE;
+}
+
+void *
+ml_alloc (gsize size, guint flags, ml_alloc_info_s *info)
+{
+  ml_alloc_entry_s entry;
+
+  if (size == 0)
+    return NULL;
+
+  memset (&entry, 0, sizeof (entry));
+
+  if (flags == ML_ALLOC_FLAG_NONE && size < ML_ALLOC_MMAP_THRESHOLD) {
+    void *p = NULL;
+
+    if (posix_memalign (&p, ML_ALLOC_CACHE_LINE, size) != 0)
+      return NULL;
+
+    memset (p, 0, size);
+    entry.base = p;
+    entry.map_size = size;
+    entry.info.size = size;
+    entry.info.page_size = _alloc_get_system ().page_size;
+  } else {
+    if (!_alloc_map (size, flags, &entry)) {
+      g_critical ("[alloc] Failed to map a buffer of %zu bytes.", size);
+      return NULL;
+    }
+
+    if (flags & ML_ALLOC_FLAG_LOCK) {
+      /* mlock() also faults in the pages. It fails if RLIMIT_MEMLOCK is too small. */
+      entry.info.locked = (mlock (entry.base, entry.map_size) == 0);
+      entry.info.prefaulted = entry.info.locked;
+
+      if (!entry.info.locked)
+        g_info ("[alloc] Failed to lock a buffer of %zu bytes.", entry.map_size);
+    }
+
+    if ((flags & ML_ALLOC_FLAG_PREFAULT) && !entry.info.prefaulted) {
+      volatile guint8 *p = (volatile guint8 *) entry.base;
+
+      for (gsize off = 0; off < entry.map_size; off += entry.info.page_size)
+        p[off] = 0;
+      entry.info.prefaulted = TRUE;
+    }
+  }
+
+  if (info)
+    *info = entry.info;
+
+  std::unique_lock<std::mutex> lk;
+  _alloc_get_table (lk)[entry.base] = entry;
+
+  return entry.base;
+}
+
+void
+ml_alloc_free (void *data)
+{
+  ml_alloc_entry_s entry;
+
+  if (!data)
+    return;
+
+  {
+    std::unique_lock<std::mutex> lk;
+    auto &table = _alloc_get_table (lk);
+    auto it = table.find (data);
+
+    if (it == table.end ()) {
+      g_critical ("[alloc] The buffer %p is not allocated with ml_alloc.", data);
+      return;
+    }
+
+    entry = it->second;
+    table.erase (it);
+  }
+
+  if (!entry.info.mapped) {
+    free (entry.base);
+    return;
+  }
+
+  if (entry.info.locked)
+    munlock (entry.base, entry.map_size);
+  munmap (entry.base, entry.map_size);
+}
+
+gboolean
+ml_alloc_get_info (const void *data, ml_alloc_info_s *info)
+{
+  g_return_val_if_fail (info != NULL, FALSE);
+
+  std::unique_lock<std::mutex> lk;
+  auto &table = _alloc_get_table (lk);
+  auto it = table.find (data);
+
+  if (it == table.end ())
+    return FALSE;
+
+  *info = it->second.info;
+  return TRUE;
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_ALLOC_H__
+#define __HAL_BACKEND_ML_ALLOC_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Buffers of this size or larger are mapped, smaller ones are allocated from the heap without flags. */
+#define ML_ALLOC_MMAP_THRESHOLD (64U * 1024U)
+
+/**
+ * @brief Flags of the tensor buffer allocator.
+ */
+typedef enum {
+  ML_ALLOC_FLAG_NONE = 0,
+  ML_ALLOC_FLAG_HUGEPAGE = (1 << 0), /**< Use explicit huge pages if reserved, otherwise transparent huge pages */
+  ML_ALLOC_FLAG_LOCK = (1 << 1), /**< Lock the buffer in memory with mlock() */
+  ML_ALLOC_FLAG_PREFAULT = (1 << 2), /**< Fault in all pages at allocation time */
+} ml_alloc_flags_e;
+
+/**
+ * @brief What the allocator actually got for a buffer.
+ */
+typedef struct {
+  gsize size; /**< Allocated size, rounded up to the page size */
+  gsize page_size; /**< Size of the pages backing the buffer */
+  gboolean mapped; /**< The buffer is mapped with mmap(), otherwise allocated from the heap */
+  gboolean hugetlb; /**< Backed by explicit huge pages (MAP_HUGETLB) */
+  gboolean thp; /**< Transparent huge pages are requested with madvise() and enabled in the system */
+  gboolean locked; /**< Locked in memory */
+  gboolean prefaulted; /**< All pages are faulted in */
+} ml_alloc_info_s;
+
+/**
+ * @brief Allocate a zero-filled tensor buffer aligned to the cache line.
+ *        Buffers of 64KB or larger, or with any flag, are mapped and aligned to the page.
+ *        Each flag is best effort, check the info to see what is actually applied.
+ * @param size The size of the buffer.
+ * @param flags Bitwise OR of ml_alloc_flags_e.
+ * @param info Nullable, the properties of the allocated buffer.
+ * @return The buffer, NULL if failed to allocate.
+ */
+void *ml_alloc (gsize size, guint flags, ml_alloc_info_s *info);
+
+/**
+ * @brief Free the buffer allocated with ml_alloc().
+ */
+void ml_alloc_free (void *data);
+
+/**
+ * @brief Get the properties of the buffer allocated with ml_alloc().
+ * @return FALSE if the buffer is not allocated with ml_alloc().
+ */
+gboolean ml_alloc_get_info (const void *data, ml_alloc_info_s *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_ALLOC_H__ */
@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-buffer-pool.h"
+
+/** @brief Smallest size class. */
+#define ML_BUFFER_POOL_MIN_CLASS (4096U)
+
+/** @brief Buffers of this size or larger are prefaulted and use huge pages if possible. */
+#define ML_BUFFER_POOL_LARGE_SIZE (ML_ALLOC_MMAP_THRESHOLD)
+
+struct _ml_buffer_pool_s {
+  std::mutex lock;
+  guint max_cached;
+  std::unordered_map<gsize, std::vector<void *>> free_lists; /* size class -> free buffers */
+  std::unordered_map<void *, gsize> outstanding; /* buffer -> size class */
+  guint num_cached;
+  guint64 num_allocated; /* number of buffers allocated from the system */
+  gboolean closed; /* freed by the owner, destroyed by the last release */
+  GDestroyNotify notify; /* called when destroyed */
+  gpointer user_data;
+};
+
+/**
+ * @brief Round up the size to the size class. There are 4 classes between powers of two,
+ *        so at most 25% of a buffer is wasted.
+ */
+static gsize
+_pool_get_class (gsize size)
+{
+  gsize pow2, step;
+
+  if (size <= ML_BUFFER_POOL_MIN_CLASS)
+    return ML_BUFFER_POOL_MIN_CLASS;
+
+  pow2 = (gsize) 1 << (63 - __builtin_clzll ((unsigned long long) (size - 1)));
+  step = pow2 / 4;
+
+  return (size + step - 1) / step * step;
+}
+
+static void *
+_pool_alloc (gsize class_size)
+{
+  guint flags = ML_ALLOC_FLAG_NONE;
+
+  /* The pool keeps the buffers, so pay the page faults once at allocation. */
+  if (class_size >= ML_BUFFER_POOL_LARGE_SIZE)
+    flags = ML_ALLOC_FLAG_HUGEPAGE | ML_ALLOC_FLAG_PREFAULT;
+
+  return ml_alloc (class_size, flags, NULL);
+}
+
+ml_buffer_pool_s *
+ml_buffer_pool_new (guint max_cached)
+{
+  ml_buffer_pool_s *pool = new ml_buffer_pool_s ();
+
+  pool->max_cached = max_cached;
+  pool->num_cached = 0;
+  pool->num_allocated = 0;
+  pool->closed = FALSE;
+  pool->notify = NULL;
+  pool->user_data = NULL;
+
+  return pool;
+}
+
+/**
+ * @brief Destroy the closed pool without outstanding buffers, then notify the owner.
+ */
+static void
+_pool_destroy (ml_buffer_pool_s *pool)
+{
+  GDestroyNotify notify = pool->notify;
+  gpointer user_data = pool->user_data;
+
+  delete pool;
+
+  if (notify)
+    notify (user_data);
+}
+
+void
+ml_buffer_pool_free (ml_buffer_pool_s *pool)
+{
+  ml_buffer_pool_free_full (pool, NULL, NULL);
+}
+
+void
+ml_buffer_pool_free_full (ml_buffer_pool_s *pool, GDestroyNotify notify, gpointer user_data)
+{
+  if (!pool) {
+    if (notify)
+      notify (user_data);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk (pool->lock);
+
+    for (auto &it : pool->free_lists) {
+      for (void *data : it.second)
+        ml_alloc_free (data);
+    }
+    pool->free_lists.clear ();
+    pool->num_cached = 0;
+
+    pool->closed = TRUE;
+    pool->notify = notify;
+    pool->user_data = user_data;
+
+    /* Destroyed by the last release. */
+    if (!pool->outstanding.empty ())
+      return;
+  }
+
+  _pool_destroy (pool);
+}
+
+void *
+ml_buffer_pool_acquire (ml_buffer_pool_s *pool, gsize size)
+{
+  gsize class_size;
+  void *data = NULL;
+
+  g_return_val_if_fail (pool != NULL, NULL);
+
+  class_size = _pool_get_class (size);
+
+  std::lock_guard<std::mutex> lk (pool->lock);
+
+  if (pool->closed) {
+    g_critical ("[buffer pool] The pool is already freed.");
+    return NULL;
+  }
+
+  auto it = pool->free_lists.find (class_size);
+  if (it != pool->free_lists.end () && !it->second.empty ()) {
+    data = it->second.back ();
+    it->second.pop_back ();
+    pool->num_cached--;
+  } else {
+    data = _pool_alloc (class_size);
+    if (!data) {
+      g_critical ("[buffer pool] Failed to allocate a buffer of %zu bytes.", class_size);
+      return NULL;
+    }
+    pool->num_allocated++;
+  }
+
+  pool->outstanding[data] = class_size;
+  return data;
+}
+
+gboolean
+ml_buffer_pool_acquire_tensors (ml_buffer_pool_s *pool, const ml_tensors_info_s *info, GstTensorMemory *mem)
+{
+  g_return_val_if_fail (pool != NULL, FALSE);
+  g_return_val_if_fail (info != NULL, FALSE);
+  g_return_val_if_fail (mem != NULL, FALSE);
+
+  for (guint i = 0; i < info->num_tensors; i++) {
+    mem[i].size = gst_tensor_info_get_size (&info->info[i]);
+    mem[i].data = ml_buffer_pool_acquire (pool, mem[i].size);
+
+    if (!mem[i].data) {
+      ml_buffer_pool_release_tensors (pool, i, mem);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+gboolean
+ml_buffer_pool_release (ml_buffer_pool_s *pool, void *data)
+{
+  gboolean destroy;
+
+  g_return_val_if_fail (pool != NULL, FALSE);
+
+  if (!data)
+    return FALSE;
+
+  {
+    std::lock_guard<std::mutex> lk (pool->lock);
+
+    auto it = pool->outstanding.find (data);
+    if (it == pool->outstanding.end ())
+      return FALSE;
+
+    gsize class_size = it->second;
+    pool->outstanding.erase (it);
+
+    if (!pool->closed && pool->free_lists[class_size].size () < pool->max_cached) {
+      pool->free_lists[class_size].push_back (data);
+      pool->num_cached++;
+    } else {
+      ml_alloc_free (data);
+    }
+
+    destroy = (pool->closed && pool->outstanding.empty ());
+  }
+
+  if (destroy)
+    _pool_destroy (pool);
+
+  return TRUE;
+}
+
+void
+ml_buffer_pool_release_tensors (ml_buffer_pool_s *pool, guint num, GstTensorMemory *mem)
+{
+  g_return_if_fail (pool != NULL);
+  g_return_if_fail (mem != NULL);
+
+  for (guint i = 0; i < num; i++) {
+    ml_buffer_pool_release (pool, mem[i].data);
+    mem[i].data = NULL;
+    mem[i].size = 0;
+  }
+}
+
+void
+ml_buffer_pool_get_stats (ml_buffer_pool_s *pool, guint *outstanding, guint *cached, guint64 *allocated)
+{
+  g_return_if_fail (pool != NULL);
+
+  std::lock_guard<std::mutex> lk (pool->lock);
+
+  if (outstanding)
+    *outstanding = (guint) pool->outstanding.size ();
+  if (cached)
+    *cached = pool->num_cached;
+  if (allocated)
+    *allocated = pool->num_allocated;
+}
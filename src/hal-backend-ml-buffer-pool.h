@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_BUFFER_POOL_H__
+#define __HAL_BACKEND_ML_BUFFER_POOL_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pool of output buffers owned by a backend.
+ *
+ * Buffers are rounded up to size classes (4 classes per power of two), allocated with
+ * ml_alloc() (large buffers are prefaulted and use huge pages if possible), and
+ * recycled when released. A backend
+ * uses it with allocate_in_invoke: acquire the output buffers in invoke and release
+ * them on DESTROY_NOTIFY. Thread-safe. Buffers may be released after the pool is freed,
+ * the pool is kept until the last one is released.
+ */
+typedef struct _ml_buffer_pool_s ml_buffer_pool_s;
+
+/** @brief Default number of free buffers kept for each size class. */
+#define ML_BUFFER_POOL_DEFAULT_MAX_CACHED (8U)
+
+/**
+ * @brief Create a buffer pool.
+ * @param max_cached Max number of free buffers kept for each size class.
+ */
+ml_buffer_pool_s *ml_buffer_pool_new (guint max_cached);
+
+/**
+ * @brief Free the pool and all cached buffers. If buffers are not yet released, the pool is
+ *        freed when the last one is released.
+ */
+void ml_buffer_pool_free (ml_buffer_pool_s *pool);
+
+/**
+ * @brief Free the pool as ml_buffer_pool_free(), and call notify when the pool is freed. The
+ *        backend frees its handle in notify, so that the handle is alive while a buffer is out.
+ * @note notify may be called before this returns, or by the last ml_buffer_pool_release().
+ *       The caller of ml_buffer_pool_release() should not touch user_data if it returns TRUE.
+ */
+void ml_buffer_pool_free_full (ml_buffer_pool_s *pool, GDestroyNotify notify, gpointer user_data);
+
+/**
+ * @brief Get a buffer with the given size from the pool.
+ * @return The buffer, NULL if failed to allocate.
+ */
+void *ml_buffer_pool_acquire (ml_buffer_pool_s *pool, gsize size);
+
+/**
+ * @brief Get the buffers for all tensors in the info, and set them to the tensor memories.
+ * @return TRUE if all buffers are acquired. Otherwise nothing is acquired.
+ */
+gboolean ml_buffer_pool_acquire_tensors (ml_buffer_pool_s *pool, const ml_tensors_info_s *info, GstTensorMemory *mem);
+
+/**
+ * @brief Give the buffer back to the pool.
+ * @return TRUE if the buffer was acquired from this pool.
+ */
+gboolean ml_buffer_pool_release (ml_buffer_pool_s *pool, void *data);
+
+/**
+ * @brief Give the buffers of the tensor memories back to the pool and clear them.
+ */
+void ml_buffer_pool_release_tensors (ml_buffer_pool_s *pool, guint num, GstTensorMemory *mem);
+
+/**
+ * @brief Get the statistics of the pool.
+ */
+void ml_buffer_pool_get_stats (ml_buffer_pool_s *pool, guint *outstanding, guint *cached, guint64 *allocated);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_BUFFER_POOL_H__ */
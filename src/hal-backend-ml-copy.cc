@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <condition_variable>
+#include <deque>
+#include <glib.h>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hal-backend-ml-copy.h"
+
+/** @brief Max number of worker threads. Memory bandwidth saturates with a few cores. */
+#define ML_COPY_MAX_WORKERS (3U)
+
+/** @brief Lower bound of the parallel threshold. */
+#define ML_COPY_MIN_PARALLEL_SIZE (256U * 1024U)
+
+/** @brief Default LLC size if it cannot be detected. */
+#define ML_COPY_DEFAULT_LLC_SIZE (1024U * 1024U)
+
+/** @brief Alignment of the chunks given to the workers (cache line). */
+#define ML_COPY_CHUNK_ALIGN (64U)
+
+/**
+ * @brief Copy with non-temporal stores. Falls back to memcpy if not supported.
+ */
+static void
+_copy_nontemporal (void *dest, const void *src, gsize size)
+{
+  guint8 *d = (guint8 *) dest;
+  const guint8 *s = (const guint8 *) src;
+
+#if defined(__SSE2__)
+  gsize head = (16U - ((guintptr) d & 15U)) & 15U;
+
+  if (size < head + 64U) {
+    memcpy (d, s, size);
+    return;
+  }
+
+  memcpy (d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+
+  for (; size >= 64U; size -= 64U, d += 64U, s += 64U) {
+    __m128i v0 = _mm_loadu_si128 ((const __m128i *) (s + 0));
+    __m128i v1 = _mm_loadu_si128 ((const __m128i *) (s + 16));
+    __m128i v2 = _mm_loadu_si128 ((const __m128i *) (s + 32));
+    __m128i v3 = _mm_loadu_si128 ((const __m128i *) (s + 48));
+    _mm_stream_si128 ((__m128i *) (d + 0), v0);
+    _mm_stream_si128 ((__m128i *) (d + 16), v1);
+    _mm_stream_si128 ((__m128i *) (d + 32), v2);
+    _mm_stream_si128 ((__m128i *) (d + 48), v3);
+  }
+
+  _mm_sfence ();
+#elif defined(__aarch64__)
+  for (; size >= 64U; size -= 64U, d += 64U, s += 64U) {
+    __asm__ __volatile__ ("ldp q0, q1, [%1]\n\t"
+                          "ldp q2, q3, [%1, #32]\n\t"
+                          "stnp q0, q1, [%0]\n\t"
+                          "stnp q2, q3, [%0, #32]\n\t"
+                          :
+                          : "r"(d), "r"(s)
+                          : "v0", "v1", "v2", "v3", "memory");
+  }
+
+  __asm__ __volatile__ ("dmb ishst" ::: "memory");
+#endif
+
+  if (size > 0)
+    memcpy (d, s, size);
+}
+
+/**
+ * @brief A part of a bulk copy processed by a worker.
+ */
+struct ml_copy_task {
+  void *dest;
+  const void *src;
+  gsize size;
+  gboolean nontemporal;
+  struct ml_copy_request *request;
+};
+
+/**
+ * @brief A bulk copy request. The caller waits until all tasks are done.
+ */
+struct ml_copy_request {
+  std::mutex lock;
+  std::condition_variable done;
+  guint remaining;
+};
+
+static void
+_copy_run_task (const ml_copy_task &task)
+{
+  if (task.nontemporal)
+    _copy_nontemporal (task.dest, task.src, task.size);
+  else
+    memcpy (task.dest, task.src, task.size);
+}
+
+/**
+ * @brief The copy engine with its worker pool.
+ */
+class ml_copy_engine
+{
+  public:
+  ml_copy_engine () : stop_ (false)
+  {
+    detect_config ();
+
+    for (guint i = 0; i < config_.num_workers; i++)
+      workers_.emplace_back (&ml_copy_engine::worker_loop, this);
+
+    calibrate ();
+  }
+
+  ~ml_copy_engine ()
+  {
+    {
+      std::lock_guard<std::mutex> lk (lock_);
+      stop_ = true;
+    }
+    cond_.notify_all ();
+
+    for (auto &w : workers_)
+      w.join ();
+  }
+
+  const ml_copy_config_s &config () const
+  {
+    return config_;
+  }
+
+  void copy (void *dest, const void *src, gsize size)
+  {
+    gboolean nontemporal = (size > config_.nontemporal_threshold);
+
+    if (config_.num_workers == 0 || size <= config_.parallel_threshold) {
+      _copy_run_task ({ dest, src, size, nontemporal, nullptr });
+      return;
+    }
+
+    parallel_copy (dest, src, size, nontemporal);
+  }
+
+  private:
+  /** @brief Split the copy into cache-line aligned chunks, the caller takes the first one. */
+  void parallel_copy (void *dest, const void *src, gsize size, gboolean nontemporal)
+  {
+    ml_copy_request request;
+    guint parts = config_.num_workers + 1;
+    gsize chunk = (size / parts + ML_COPY_CHUNK_ALIGN - 1) & ~((gsize) ML_COPY_CHUNK_ALIGN - 1);
+    gsize offset = chunk;
+
+    request.remaining = 0;
+
+    {
+      std::lock_guard<std::mutex> lk (lock_);
+      for (; offset < size; offset += chunk) {
+        queue_.push_back ({ (guint8 *) dest + offset, (const guint8 *) src + offset,
+            MIN (chunk, size - offset), nontemporal, &request });
+        request.remaining++;
+      }
+    }
+    cond_.notify_all ();
+
+    _copy_run_task ({ dest, src, MIN (chunk, size), nontemporal, nullptr });
+
+    std::unique_lock<std::mutex> lk (request.lock);
+    request.done.wait (lk, [&request] { return request.remaining == 0; });
+  }
+
+  void worker_loop ()
+  {
+    for (;;) {
+      ml_copy_task task;
+
+      {
+        std::unique_lock<std::mutex> lk (lock_);
+        cond_.wait (lk, [this] { return stop_ || !queue_.empty (); });
+        if (stop_)
+          return;
+
+        task = queue_.front ();
+        queue_.pop_front ();
+      }
+
+      _copy_run_task (task);
+
+      std::lock_guard<std::mutex> lk (task.request->lock);
+      if (--task.request->remaining == 0)
+        task.request->done.notify_one ();
+    }
+  }
+
+  /** @brief Read the size of the last level cache from sysfs. */
+  static gsize detect_llc_size ()
+  {
+    gsize llc = 0;
+    guint best_level = 0;
+
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    long l3 = sysconf (_SC_LEVEL3_CACHE_SIZE);
+    if (l3 > 0)
+      return (gsize) l3;
+#endif
+
+    for (guint i = 0; i < 8U; i++) {
+      gchar *path, *contents = NULL;
+      guint level = 0;
+
+      path = g_strdup_printf ("/sys/devices/system/cpu/cpu0/cache/index%u/level", i);
+      if (g_file_get_contents (path, &contents, NULL, NULL))
+        level = (guint) g_ascii_strtoull (contents, NULL, 10);
+      g_free (path);
+      g_free (contents);
+
+      if (level == 0)
+        break;
+      if (level < best_level)
+        continue;
+
+      path = g_strdup_printf ("/sys/devices/system/cpu/cpu0/cache/index%u/size", i);
+      if (g_file_get_contents (path, &contents, NULL, NULL)) {
+        gchar *end = NULL;
+        guint64 val = g_ascii_strtoull (contents, &end, 10);
+
+        if (end && (*end == 'K' || *end == 'k'))
+          val *= 1024U;
+        else if (end && (*end == 'M' || *end == 'm'))
+          val *= 1024U * 1024U;
+
+        if (val > 0) {
+          llc = (gsize) val;
+          best_level = level;
+        }
+      }
+      g_free (path);
+      g_free (contents);
+    }
+
+    return (llc > 0) ? llc : ML_COPY_DEFAULT_LLC_SIZE;
+  }
+
+  void detect_config ()
+  {
+    guint num_cpus = g_get_num_processors ();
+    const gchar *env = g_getenv ("HAL_ML_COPY_THREADS");
+
+    config_.llc_size = detect_llc_size ();
+    config_.nontemporal_threshold = config_.llc_size;
+    config_.num_workers = MIN (num_cpus > 1 ? num_cpus - 1 : 0, ML_COPY_MAX_WORKERS);
+
+    /* HAL_ML_COPY_THREADS is the total number of threads including the caller. */
+    if (env) {
+      guint64 threads = g_ascii_strtoull (env, NULL, 10);
+      config_.num_workers = (guint) MIN (threads > 0 ? threads - 1 : 0, (guint64) ML_COPY_MAX_WORKERS);
+    }
+
+    config_.parallel_threshold = G_MAXSIZE;
+  }
+
+  /**
+   * @brief Measure the dispatch latency of the pool and the copy bandwidth.
+   *        Splitting pays off only if copying a chunk takes longer than waking up the workers.
+   */
+  void calibrate ()
+  {
+    const gsize probe_size = ML_COPY_MIN_PARALLEL_SIZE;
+    gint64 start, copy_us, dispatch_us;
+    guint8 *src, *dest;
+
+    if (config_.num_workers == 0)
+      return;
+
+    src = (guint8 *) g_malloc0 (probe_size);
+    dest = (guint8 *) g_malloc (probe_size);
+
+    /* warm up the buffers, then measure the in-cache copy time */
+    memcpy (dest, src, probe_size);
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < 4U; i++)
+      memcpy (dest, src, probe_size);
+    copy_us = MAX ((g_get_monotonic_time () - start) / 4, (gint64) 1);
+
+    /* round trip of a minimal parallel copy */
+    parallel_copy (dest, src, ML_COPY_CHUNK_ALIGN * (config_.num_workers + 1), FALSE);
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < 4U; i++)
+      parallel_copy (dest, src, ML_COPY_CHUNK_ALIGN * (config_.num_workers + 1), FALSE);
+    dispatch_us = MAX ((g_get_monotonic_time () - start) / 4, (gint64) 1);
+
+    g_free (src);
+    g_free (dest);
+
+    /* Copy time per worker chunk should be a few times larger than the dispatch latency. */
+    gsize threshold = (gsize) (probe_size * 4 * (config_.num_workers + 1) * dispatch_us / copy_us);
+    config_.parallel_threshold = MAX (threshold, (gsize) ML_COPY_MIN_PARALLEL_SIZE);
+
+    g_info ("[copy] workers %u, llc %zu, parallel > %zu, non-temporal > %zu",
+        config_.num_workers, config_.llc_size, config_.parallel_threshold,
+        config_.nontemporal_threshold);
+  }
+
+  ml_copy_config_s config_;
+  std::vector<std::thread> workers_;
+  std::deque<ml_copy_task> queue_;
+  std::mutex lock_;
+  std::condition_variable cond_;
+  bool stop_;
+};
+
+/** @brief Get the engine, created at the first use. */
+static ml_copy_engine &
+_copy_get_engine (void)
+{
+  static ml_copy_engine engine;
+  return engine;
+}
+
+void
+ml_copy (void *dest, const void *src, gsize size)
+{
+  if (G_UNLIKELY (!dest || !src || size == 0))
+    return;
+
+  _copy_get_engine ().copy (dest, src, size);
+}
+
+void
+ml_copy_get_config (ml_copy_config_s *config)
+{
+  g_return_if_fail (config != NULL);
+
+  *config = _copy_get_engine ().config ();
+}
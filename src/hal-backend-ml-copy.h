@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_COPY_H__
+#define __HAL_BACKEND_ML_COPY_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Thresholds of the bulk copy engine, determined once at the first use.
+ */
+typedef struct {
+  guint num_workers; /**< Number of worker threads helping the caller, 0 if parallel copy is disabled */
+  gsize llc_size; /**< Size of the last level cache in bytes */
+  gsize parallel_threshold; /**< Copies larger than this are split across the workers */
+  gsize nontemporal_threshold; /**< Copies larger than this bypass the cache with non-temporal stores */
+} ml_copy_config_s;
+
+/**
+ * @brief Copy a tensor buffer. Same as memcpy() but large buffers are split across
+ *        a small worker pool and buffers larger than the LLC are written with
+ *        non-temporal stores, so they do not evict the working set of the caller.
+ * @note The buffers must not overlap.
+ */
+void ml_copy (void *dest, const void *src, gsize size);
+
+/**
+ * @brief Get the thresholds of the copy engine.
+ * @note The number of workers can be limited with the environment variable HAL_ML_COPY_THREADS.
+ */
+void ml_copy_get_config (ml_copy_config_s *config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_COPY_H__ */
@@ -0,0 +1,571 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <algorithm>
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-detect.h"
+#include "hal-backend-ml-tensor-view.h"
+
+/**
+ * @brief A box above the score threshold.
+ */
+typedef struct {
+  guint32 index;
+  gint32 cls;
+  float score;
+} detect_candidate_s;
+
+struct _ml_detect_s {
+  ml_detect_config_s config; /* without the anchors path */
+  tensor_type box_type; /* type of the model output of the boxes */
+  tensor_type score_type; /* type of the model output of the scores */
+  gsize num_boxes;
+  gsize num_classes;
+  gboolean box_planar; /* [N, 4], each coordinate is a plane */
+  gboolean score_planar; /* [N, C], each class is a plane */
+  double threshold; /* score threshold in the stored values */
+  std::vector<float> anchors; /* ycenter, xcenter, h, w of each box */
+  void *box_buffer;
+  void *score_buffer;
+
+  /* Scratch of each run */
+  std::vector<guint8> max_score; /* max of the classes of each box, 8-bit planar scores */
+  std::vector<detect_candidate_s> candidates;
+  std::vector<float> x1, y1, x2, y2, area, cls; /* decoded candidates, in the score order */
+  std::vector<guint8> suppressed;
+};
+
+void
+ml_detect_config_init (ml_detect_config_s *config)
+{
+  g_return_if_fail (config != NULL);
+
+  memset (config, 0, sizeof (*config));
+  config->box_type = ML_DETECT_BOX_NONE;
+  config->box_index = 0;
+  config->score_index = 1;
+  config->score_threshold = 0.5f;
+  config->iou_threshold = 0.5f;
+  config->max_detections = 100;
+  config->background_class = -1;
+  config->box_scale = 1.0f;
+  config->score_scale = 1.0f;
+}
+
+gboolean
+ml_detect_parse_box_type (const gchar *str, ml_detect_box_e *box_type)
+{
+  g_return_val_if_fail (str != NULL && box_type != NULL, FALSE);
+
+  if (g_ascii_strcasecmp (str, "XYXY") == 0)
+    *box_type = ML_DETECT_BOX_XYXY;
+  else if (g_ascii_strcasecmp (str, "CXCYWH") == 0)
+    *box_type = ML_DETECT_BOX_CXCYWH;
+  else if (g_ascii_strcasecmp (str, "SSD") == 0)
+    *box_type = ML_DETECT_BOX_SSD;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+ml_detect_config_is_enabled (const ml_detect_config_s *config)
+{
+  return (config && config->box_type != ML_DETECT_BOX_NONE);
+}
+
+/** @brief Load the anchors, 4 values of each box separated by spaces, commas or new lines. */
+static gboolean
+_detect_load_anchors (ml_detect_s *det, const gchar *path)
+{
+  gchar *contents = NULL;
+  const gchar *p;
+  GError *err = NULL;
+
+  if (!path) {
+    g_critical ("[detect] SSD boxes require the anchors file.");
+    return FALSE;
+  }
+
+  if (!g_file_get_contents (path, &contents, NULL, &err)) {
+    g_critical ("[detect] Failed to read the anchors file '%s': %s", path,
+        err ? err->message : "Unknown error");
+    g_clear_error (&err);
+    return FALSE;
+  }
+
+  for (p = contents; *p != '\0';) {
+    gchar *end = NULL;
+    double v;
+
+    if (g_ascii_isspace (*p) || *p == ',' || *p == ';' || *p == '[' || *p == ']') {
+      p++;
+      continue;
+    }
+
+    v = g_ascii_strtod (p, &end);
+    if (end == p) {
+      g_critical ("[detect] Invalid value in the anchors file '%s'.", path);
+      g_free (contents);
+      return FALSE;
+    }
+
+    det->anchors.push_back ((float) v);
+    p = end;
+  }
+
+  g_free (contents);
+
+  if (det->anchors.size () != det->num_boxes * 4) {
+    g_critical ("[detect] The anchors file has %zu values, but %zu boxes need %zu.",
+        det->anchors.size (), det->num_boxes, det->num_boxes * 4);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+ml_detect_s *
+ml_detect_new (const ml_detect_config_s *config, const GstTensorInfo *box_info,
+    const GstTensorInfo *score_info)
+{
+  ml_detect_s *det;
+  gsize box_elements, score_elements, num_boxes, num_classes;
+  gboolean box_planar;
+
+  g_return_val_if_fail (config != NULL && box_info != NULL && score_info != NULL, NULL);
+
+  if (!ml_detect_config_is_enabled (config))
+    return NULL;
+
+  if (ml_tensor_get_element_bits (box_info->type) < 8
+      || ml_tensor_get_element_bits (score_info->type) < 8) {
+    g_critical ("[detect] Unsupported type of the boxes (%d) or the scores (%d).",
+        (int) box_info->type, (int) score_info->type);
+    return NULL;
+  }
+
+  if (config->max_detections == 0 || config->iou_threshold <= 0.0f || config->iou_threshold > 1.0f) {
+    g_critical ("[detect] Invalid max detections (%u) or IoU threshold (%f).",
+        config->max_detections, config->iou_threshold);
+    return NULL;
+  }
+
+  if ((config->box_quantized && config->box_scale == 0.0f)
+      || (config->score_quantized && config->score_scale <= 0.0f)) {
+    g_critical ("[detect] Invalid quantization scale of the boxes or the scores.");
+    return NULL;
+  }
+
+  /* One batch only, [4, N] or [N, 4] */
+  box_elements = gst_tensor_info_get_size (box_info) / gst_tensor_get_element_size (box_info->type);
+  score_elements = gst_tensor_info_get_size (score_info) / gst_tensor_get_element_size (score_info->type);
+
+  if (box_info->dimension[0] == 4) {
+    box_planar = FALSE;
+    num_boxes = box_elements / 4;
+  } else if (box_info->dimension[1] == 4) {
+    box_planar = TRUE;
+    num_boxes = box_info->dimension[0];
+  } else {
+    num_boxes = 0;
+  }
+
+  if (num_boxes == 0 || num_boxes * 4 != box_elements || score_elements % num_boxes != 0) {
+    g_critical ("[detect] The boxes should be [4, N] or [N, 4], and the scores [C, N] or [N, C].");
+    return NULL;
+  }
+
+  num_classes = score_elements / num_boxes;
+  if (score_info->dimension[0] != num_boxes && score_info->dimension[0] != num_classes) {
+    g_critical ("[detect] The scores should be [C, N] or [N, C] for %zu boxes.", num_boxes);
+    return NULL;
+  }
+
+  if (config->background_class >= (gint) num_classes
+      || (config->background_class >= 0 && num_classes == 1)) {
+    g_critical ("[detect] Invalid background class (%d) for %zu classes.",
+        config->background_class, num_classes);
+    return NULL;
+  }
+
+  det = new ml_detect_s ();
+  det->config = *config;
+  det->config.anchors_path = NULL;
+  det->box_type = box_info->type;
+  det->score_type = score_info->type;
+  det->num_boxes = num_boxes;
+  det->num_classes = num_classes;
+  det->box_planar = box_planar;
+  det->score_planar = (score_info->dimension[0] == num_boxes);
+
+  /* score >= threshold, q >= threshold / scale + zero_point with a positive scale */
+  if (config->score_quantized)
+    det->threshold = ceil ((double) config->score_threshold / config->score_scale
+                           + config->score_zero_point);
+  else
+    det->threshold = config->score_threshold;
+
+  if (config->box_type == ML_DETECT_BOX_SSD && !_detect_load_anchors (det, config->anchors_path)) {
+    ml_detect_free (det);
+    return NULL;
+  }
+
+  det->box_buffer = ml_alloc (gst_tensor_info_get_size (box_info), ML_ALLOC_FLAG_NONE, NULL);
+  det->score_buffer = ml_alloc (gst_tensor_info_get_size (score_info), ML_ALLOC_FLAG_NONE, NULL);
+  if (!det->box_buffer || !det->score_buffer) {
+    g_critical ("[detect] Failed to allocate the buffers of the output tensors.");
+    ml_detect_free (det);
+    return NULL;
+  }
+
+  if (det->score_planar && ml_tensor_get_element_bits (det->score_type) == 8)
+    det->max_score.resize (num_boxes);
+
+  return det;
+}
+
+void
+ml_detect_free (ml_detect_s *det)
+{
+  if (!det)
+    return;
+
+  ml_alloc_free (det->box_buffer);
+  ml_alloc_free (det->score_buffer);
+  delete det;
+}
+
+void
+ml_detect_get_output_info (const ml_detect_s *det, GstTensorInfo *box_info, GstTensorInfo *score_info)
+{
+  g_return_if_fail (det != NULL && box_info != NULL && score_info != NULL);
+
+  box_info->type = _NNS_FLOAT32;
+  memset (box_info->dimension, 0, sizeof (tensor_dim));
+  box_info->dimension[0] = ML_DETECT_VALUES;
+  box_info->dimension[1] = det->config.max_detections;
+
+  score_info->type = _NNS_UINT32;
+  memset (score_info->dimension, 0, sizeof (tensor_dim));
+  score_info->dimension[0] = 1;
+}
+
+void *
+ml_detect_get_box_buffer (const ml_detect_s *det)
+{
+  g_return_val_if_fail (det != NULL, NULL);
+
+  return det->box_buffer;
+}
+
+void *
+ml_detect_get_score_buffer (const ml_detect_s *det)
+{
+  g_return_val_if_fail (det != NULL, NULL);
+
+  return det->score_buffer;
+}
+
+/** @brief dest[i] = max (dest[i], src[i]) of the 8-bit scores, signed if is_signed. */
+static void
+_detect_max8 (guint8 *dest, const guint8 *src, gsize n, gboolean is_signed)
+{
+  gsize i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  if (is_signed) {
+    for (; i + 16 <= n; i += 16)
+      vst1q_s8 ((int8_t *) dest + i,
+          vmaxq_s8 (vld1q_s8 ((const int8_t *) dest + i), vld1q_s8 ((const int8_t *) src + i)));
+  } else {
+    for (; i + 16 <= n; i += 16)
+      vst1q_u8 (dest + i, vmaxq_u8 (vld1q_u8 (dest + i), vld1q_u8 (src + i)));
+  }
+#elif defined(__SSE2__)
+  /* SSE2 has no signed max of bytes, flip the sign bit and use the unsigned one */
+  const __m128i sign = _mm_set1_epi8 (is_signed ? (char) 0x80 : 0);
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i d = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) (dest + i)), sign);
+    __m128i s = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) (src + i)), sign);
+
+    _mm_storeu_si128 ((__m128i *) (dest + i), _mm_xor_si128 (_mm_max_epu8 (d, s), sign));
+  }
+#endif
+
+  if (is_signed) {
+    for (; i < n; i++)
+      dest[i] = (guint8) MAX ((gint8) dest[i], (gint8) src[i]);
+  } else {
+    for (; i < n; i++)
+      dest[i] = MAX (dest[i], src[i]);
+  }
+}
+
+/** @brief Best class of the box above the threshold, or -1. Scores are compared as stored. */
+template <typename T>
+static inline gint32
+_detect_best_class (const ml_detect_s *det, const T *scores, gsize index, double *best)
+{
+  const gsize stride = det->score_planar ? det->num_boxes : 1;
+  const T *s = det->score_planar ? scores + index : scores + index * det->num_classes;
+  gint32 cls = -1;
+
+  *best = det->threshold;
+  for (gsize c = 0; c < det->num_classes; c++) {
+    double v = (double) ml_tensor_to_float (s[c * stride]);
+
+    if ((gint) c != det->config.background_class && v >= *best && (cls < 0 || v > *best)) {
+      *best = v;
+      cls = (gint32) c;
+    }
+  }
+
+  return cls;
+}
+
+/** @brief Collect the boxes above the score threshold. */
+template <typename T>
+static void
+_detect_filter (ml_detect_s *det, const T *scores)
+{
+  const gsize n = det->num_boxes;
+  const gint bg = det->config.background_class;
+  double best;
+
+  if (!det->max_score.empty ()) {
+    /* 8-bit planar scores, max of the class planes with SIMD, then check the threshold */
+    const gboolean is_signed = std::is_signed<T>::value;
+    gsize first = (bg == 0) ? 1 : 0;
+
+    memcpy (det->max_score.data (), scores + first * n, n);
+    for (gsize c = first + 1; c < det->num_classes; c++) {
+      if ((gint) c != bg)
+        _detect_max8 (det->max_score.data (), (const guint8 *) (scores + c * n), n, is_signed);
+    }
+
+    for (gsize i = 0; i < n; i++) {
+      double m = is_signed ? (double) (gint8) det->max_score[i] : (double) det->max_score[i];
+      gint32 cls;
+
+      if (m < det->threshold)
+        continue;
+
+      cls = _detect_best_class (det, scores, i, &best);
+      if (cls >= 0)
+        det->candidates.push_back ({ (guint32) i, cls, (float) best });
+    }
+    return;
+  }
+
+  for (gsize i = 0; i < n; i++) {
+    gint32 cls = _detect_best_class (det, scores, i, &best);
+
+    if (cls >= 0)
+      det->candidates.push_back ({ (guint32) i, cls, (float) best });
+  }
+}
+
+/** @brief Decode the box into the corners. */
+template <typename T>
+static void
+_detect_decode (const ml_detect_s *det, const T *boxes, gsize index, float *corners)
+{
+  const ml_detect_config_s *config = &det->config;
+  float v[4];
+
+  for (guint k = 0; k < 4; k++) {
+    T q = det->box_planar ? boxes[k * det->num_boxes + index] : boxes[index * 4 + k];
+
+    v[k] = ml_tensor_to_float (q);
+    if (config->box_quantized)
+      v[k] = (v[k] - (float) config->box_zero_point) * config->box_scale;
+  }
+
+  switch (config->box_type) {
+    case ML_DETECT_BOX_CXCYWH:
+      corners[0] = v[0] - v[2] * 0.5f;
+      corners[1] = v[1] - v[3] * 0.5f;
+      corners[2] = v[0] + v[2] * 0.5f;
+      corners[3] = v[1] + v[3] * 0.5f;
+      break;
+    case ML_DETECT_BOX_SSD:
+      {
+        const float *a = &det->anchors[index * 4];
+        float yc = v[0] / 10.0f * a[2] + a[0];
+        float xc = v[1] / 10.0f * a[3] + a[1];
+        float h = expf (v[2] / 5.0f) * a[2];
+        float w = expf (v[3] / 5.0f) * a[3];
+
+        corners[0] = xc - w * 0.5f;
+        corners[1] = yc - h * 0.5f;
+        corners[2] = xc + w * 0.5f;
+        corners[3] = yc + h * 0.5f;
+        break;
+      }
+    case ML_DETECT_BOX_XYXY:
+    default:
+      memcpy (corners, v, sizeof (v));
+      break;
+  }
+}
+
+/** @brief Suppress the candidates from start to the end overlapping the candidate i of the same class. */
+static void
+_detect_suppress (ml_detect_s *det, gsize i, gsize start)
+{
+  const gsize n = det->candidates.size ();
+  const float thr = det->config.iou_threshold;
+  const float *x1 = det->x1.data (), *y1 = det->y1.data ();
+  const float *x2 = det->x2.data (), *y2 = det->y2.data ();
+  const float *area = det->area.data (), *cls = det->cls.data ();
+  guint8 *suppressed = det->suppressed.data ();
+  gsize j = start;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const float32x4_t bx1 = vdupq_n_f32 (x1[i]), by1 = vdupq_n_f32 (y1[i]);
+  const float32x4_t bx2 = vdupq_n_f32 (x2[i]), by2 = vdupq_n_f32 (y2[i]);
+  const float32x4_t barea = vdupq_n_f32 (area[i]), bcls = vdupq_n_f32 (cls[i]);
+  const float32x4_t zero = vdupq_n_f32 (0.0f);
+
+  for (; j + 4 <= n; j += 4) {
+    float32x4_t w = vmaxq_f32 (vsubq_f32 (vminq_f32 (bx2, vld1q_f32 (x2 + j)),
+                                   vmaxq_f32 (bx1, vld1q_f32 (x1 + j))), zero);
+    float32x4_t h = vmaxq_f32 (vsubq_f32 (vminq_f32 (by2, vld1q_f32 (y2 + j)),
+                                   vmaxq_f32 (by1, vld1q_f32 (y1 + j))), zero);
+    float32x4_t inter = vmulq_f32 (w, h);
+    float32x4_t uni = vsubq_f32 (vaddq_f32 (barea, vld1q_f32 (area + j)), inter);
+    uint32x4_t m = vandq_u32 (vcgtq_f32 (inter, vmulq_n_f32 (uni, thr)),
+        vceqq_f32 (bcls, vld1q_f32 (cls + j)));
+    guint32 mask[4];
+
+    vst1q_u32 (mask, m);
+    for (guint b = 0; b < 4; b++)
+      suppressed[j + b] |= (mask[b] != 0);
+  }
+#elif defined(__SSE2__)
+  const __m128 bx1 = _mm_set1_ps (x1[i]), by1 = _mm_set1_ps (y1[i]);
+  const __m128 bx2 = _mm_set1_ps (x2[i]), by2 = _mm_set1_ps (y2[i]);
+  const __m128 barea = _mm_set1_ps (area[i]), bcls = _mm_set1_ps (cls[i]);
+  const __m128 vthr = _mm_set1_ps (thr), zero = _mm_setzero_ps ();
+
+  for (; j + 4 <= n; j += 4) {
+    __m128 w = _mm_max_ps (_mm_sub_ps (_mm_min_ps (bx2, _mm_loadu_ps (x2 + j)),
+                               _mm_max_ps (bx1, _mm_loadu_ps (x1 + j))), zero);
+    __m128 h = _mm_max_ps (_mm_sub_ps (_mm_min_ps (by2, _mm_loadu_ps (y2 + j)),
+                               _mm_max_ps (by1, _mm_loadu_ps (y1 + j))), zero);
+    __m128 inter = _mm_mul_ps (w, h);
+    __m128 uni = _mm_sub_ps (_mm_add_ps (barea, _mm_loadu_ps (area + j)), inter);
+    int mask = _mm_movemask_ps (_mm_and_ps (_mm_cmpgt_ps (inter, _mm_mul_ps (uni, vthr)),
+        _mm_cmpeq_ps (bcls, _mm_loadu_ps (cls + j))));
+
+    for (guint b = 0; b < 4; b++)
+      suppressed[j + b] |= (mask >> b) & 1;
+  }
+#endif
+
+  for (; j < n; j++) {
+    float w = MAX (MIN (x2[i], x2[j]) - MAX (x1[i], x1[j]), 0.0f);
+    float h = MAX (MIN (y2[i], y2[j]) - MAX (y1[i], y1[j]), 0.0f);
+    float inter = w * h;
+
+    if (cls[i] == cls[j] && inter > (area[i] + area[j] - inter) * thr)
+      suppressed[j] = 1;
+  }
+}
+
+guint
+ml_detect_run (ml_detect_s *det, void *detections, void *count, const void *boxes, const void *scores)
+{
+  float *out = (float *) detections;
+  const guint max_detections = det ? det->config.max_detections : 0;
+  gsize n;
+  guint kept = 0;
+
+  g_return_val_if_fail (det != NULL && detections != NULL && count != NULL, 0);
+  g_return_val_if_fail (boxes != NULL && scores != NULL, 0);
+
+  det->candidates.clear ();
+  ml_tensor_dispatch (det->score_type, [&] (auto tag) {
+    typedef typename decltype (tag)::type T;
+
+    _detect_filter<T> (det, (const T *) scores);
+    return TRUE;
+  });
+
+  /* The highest score first, the lower index first on ties */
+  std::sort (det->candidates.begin (), det->candidates.end (),
+      [] (const detect_candidate_s &a, const detect_candidate_s &b) {
+        return (a.score > b.score) || (a.score == b.score && a.index < b.index);
+      });
+
+  n = det->candidates.size ();
+  det->x1.resize (n);
+  det->y1.resize (n);
+  det->x2.resize (n);
+  det->y2.resize (n);
+  det->area.resize (n);
+  det->cls.resize (n);
+  det->suppressed.assign (n, 0);
+
+  ml_tensor_dispatch (det->box_type, [&] (auto tag) {
+    typedef typename decltype (tag)::type T;
+
+    for (gsize i = 0; i < n; i++) {
+      float c[4];
+
+      _detect_decode<T> (det, (const T *) boxes, det->candidates[i].index, c);
+      det->x1[i] = c[0];
+      det->y1[i] = c[1];
+      det->x2[i] = c[2];
+      det->y2[i] = c[3];
+      det->area[i] = MAX (c[2] - c[0], 0.0f) * MAX (c[3] - c[1], 0.0f);
+      det->cls[i] = (float) det->candidates[i].cls;
+    }
+    return TRUE;
+  });
+
+  /* Greedy NMS, in the score order */
+  for (gsize i = 0; i < n && kept < max_detections; i++) {
+    float *d;
+
+    if (det->suppressed[i])
+      continue;
+
+    d = out + kept * ML_DETECT_VALUES;
+    d[0] = det->x1[i];
+    d[1] = det->y1[i];
+    d[2] = det->x2[i];
+    d[3] = det->y2[i];
+    d[4] = det->config.score_quantized ?
+        (det->candidates[i].score - (float) det->config.score_zero_point) * det->config.score_scale :
+        det->candidates[i].score;
+    d[5] = det->cls[i];
+    kept++;
+
+    _detect_suppress (det, i, i + 1);
+  }
+
+  for (guint i = kept; i < max_detections; i++) {
+    float *d = out + i * ML_DETECT_VALUES;
+
+    memset (d, 0, ML_DETECT_VALUES * sizeof (float));
+    d[5] = -1.0f;
+  }
+
+  *(guint32 *) count = kept;
+  return kept;
+}
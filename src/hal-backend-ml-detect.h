@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_DETECT_H__
+#define __HAL_BACKEND_ML_DETECT_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Number of values of a detection, x1, y1, x2, y2, score and class. */
+#define ML_DETECT_VALUES (6U)
+
+/**
+ * @brief Encoding of the boxes in the model output.
+ */
+typedef enum {
+  ML_DETECT_BOX_NONE = 0, /**< No detection post-processing */
+  ML_DETECT_BOX_XYXY, /**< Corners x1, y1, x2, y2 */
+  ML_DETECT_BOX_CXCYWH, /**< Center and size cx, cy, w, h, e.g. YOLO */
+  ML_DETECT_BOX_SSD, /**< Offsets ty, tx, th, tw from the anchors, scaled by 10, 10, 5, 5 as TF object detection API */
+} ml_detect_box_e;
+
+/**
+ * @brief Configuration of the detection post-processing, usually parsed from the custom properties.
+ */
+typedef struct {
+  ml_detect_box_e box_type;
+  guint box_index; /**< Index of the output tensor of the boxes */
+  guint score_index; /**< Index of the output tensor of the class scores */
+  float score_threshold; /**< Min score of a detection */
+  float iou_threshold; /**< Max IoU with a detection of the same class with a higher score */
+  guint max_detections; /**< Number of detections of the output tensor */
+  gint background_class; /**< Class ignored in the scores, -1 for none */
+  const gchar *anchors_path; /**< Anchors of ML_DETECT_BOX_SSD, 4 values (ycenter, xcenter, h, w) of each box */
+
+  /* Quantization of the model outputs, filled by the backend */
+  gboolean box_quantized; /**< real = (q - zero_point) * scale */
+  float box_scale;
+  gint32 box_zero_point;
+  gboolean score_quantized;
+  float score_scale;
+  gint32 score_zero_point;
+} ml_detect_config_s;
+
+/**
+ * @brief Detection post-processing of a backend.
+ *
+ * Decodes the boxes and class scores of an SSD or YOLO-like model into a fixed number of
+ * detections. The score threshold is applied to the stored values before anything is
+ * dequantized or decoded, so most boxes are dropped with a SIMD max over the classes. The
+ * remaining boxes are decoded and go through a class-aware greedy NMS, with the IoU of a box
+ * against the others computed 4 at a time.
+ *
+ * The boxes tensor is [4, N] or [N, 4], and the scores tensor is [C, N] or [N, C] for N boxes
+ * and C classes, with one batch. If the innermost dimension is 4, the boxes are [4, N], and if
+ * it is N, the scores are [N, C]. The scores are probabilities, i.e. the model ends with
+ * sigmoid or softmax.
+ *
+ * The box output becomes float32 [6, max_detections], (x1, y1, x2, y2, score, class) in the
+ * coordinates of the model, the highest score first. Unused detections are 0 with class -1.
+ * The score output becomes uint32 [1], the number of detections.
+ */
+typedef struct _ml_detect_s ml_detect_s;
+
+/**
+ * @brief Initialize the configuration, no detection post-processing.
+ */
+void ml_detect_config_init (ml_detect_config_s *config);
+
+/**
+ * @brief Parse the encoding of the boxes, XYXY, CXCYWH or SSD.
+ */
+gboolean ml_detect_parse_box_type (const gchar *str, ml_detect_box_e *box_type);
+
+/**
+ * @brief Check if the configuration asks for the detection post-processing.
+ */
+gboolean ml_detect_config_is_enabled (const ml_detect_config_s *config);
+
+/**
+ * @brief Create the detection post-processing of the model outputs.
+ * @param box_info The output tensor of the boxes.
+ * @param score_info The output tensor of the class scores.
+ * @return The post-processing, NULL if the configuration does not match the tensors.
+ */
+ml_detect_s *ml_detect_new (const ml_detect_config_s *config,
+    const GstTensorInfo *box_info, const GstTensorInfo *score_info);
+
+/**
+ * @brief Free the post-processing and its buffers.
+ */
+void ml_detect_free (ml_detect_s *det);
+
+/**
+ * @brief Set the type and dimension of the detections and the number of them. The names are kept.
+ */
+void ml_detect_get_output_info (const ml_detect_s *det, GstTensorInfo *box_info, GstTensorInfo *score_info);
+
+/**
+ * @brief Get the buffer for the model output of the boxes.
+ */
+void *ml_detect_get_box_buffer (const ml_detect_s *det);
+
+/**
+ * @brief Get the buffer for the model output of the class scores.
+ */
+void *ml_detect_get_score_buffer (const ml_detect_s *det);
+
+/**
+ * @brief Decode the model outputs into the detections.
+ * @param detections float32 [6, max_detections].
+ * @param count uint32 [1], the number of detections.
+ * @return The number of detections.
+ */
+guint ml_detect_run (ml_detect_s *det, void *detections, void *count,
+    const void *boxes, const void *scores);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_DETECT_H__ */
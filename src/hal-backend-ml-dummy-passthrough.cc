@@ -1,30 +1,93 @@
 /* SPDX-License-Identifier: Apache-2.0 */
 
 #include <glib.h>
+#include <math.h>
 #include <stdexcept>
 
 #include <hal-common-interface.h>
 #include <hal-ml-interface.h>
 
+#include "hal-backend-ml-buffer-pool.h"
+#include "hal-backend-ml-copy.h"
+#include "hal-backend-ml-result-cache.h"
+#include "hal-backend-ml-trace.h"
 #include "hal-backend-ml-util.h"
 
 
+/**
+ * @brief Distribution of the service time jitter in synthetic-accelerator mode.
+ */
+typedef enum {
+  PASS_JITTER_UNIFORM = 0, /* uniform in [-jitter, +jitter] */
+  PASS_JITTER_NORMAL, /* gaussian with stddev jitter */
+  PASS_JITTER_EXPONENTIAL, /* exponential with mean jitter, always positive */
+} pass_jitter_dist_e;
+
 typedef struct _pass_handle_s {
-  GstTensorsInfo inputInfo;
-  GstTensorsInfo outputInfo;
+  ml_tensors_info_s inputInfo;
+  ml_tensors_info_s outputInfo;
+  ml_model_info_s *model_info; /* shared with the callers of get_model_info */
+
+  /* Synthetic-accelerator mode */
+  gint64 service_time_us; /* fixed service time per invoke */
+  gint64 jitter_us; /* amplitude of the jitter added to the service time */
+  pass_jitter_dist_e jitter_dist;
+  gboolean busy_wait; /* spin the CPU instead of sleeping */
+  guint queue_depth; /* max number of concurrent invokes, 0 for unlimited */
+  guint active; /* number of running invokes */
+  GRand *rand;
+  GMutex lock;
+  GCond cond;
+
+  gboolean in_place; /* framework may give the same memory for input and output */
+  gboolean use_pool; /* allocate the output from the pool (allocate_in_invoke) */
+  ml_buffer_pool_s *pool;
+
+  ml_result_cache_config_s result_cache_config;
+  ml_result_cache_s *result_cache; /* outputs of the recent inputs, NULL if not needed */
 } pass_handle_s;
 
+/** @brief Reset the synthetic-accelerator options to pure passthrough. */
+static void
+_pass_reset_options (pass_handle_s *pass)
+{
+  pass->service_time_us = 0;
+  pass->jitter_us = 0;
+  pass->jitter_dist = PASS_JITTER_UNIFORM;
+  pass->busy_wait = FALSE;
+  pass->queue_depth = 0;
+  pass->in_place = FALSE;
+  pass->use_pool = FALSE;
+  ml_result_cache_config_init (&pass->result_cache_config);
+}
+
 static int
 ml_dummy_passthrough_init (void **backend_private)
 {
   pass_handle_s *pass = g_new0 (pass_handle_s, 1);
-  gst_tensors_info_init (&pass->inputInfo);
-  gst_tensors_info_init (&pass->outputInfo);
+  ml_tensors_info_init (&pass->inputInfo);
+  ml_tensors_info_init (&pass->outputInfo);
+  _pass_reset_options (pass);
+  pass->rand = g_rand_new ();
+  pass->pool = ml_buffer_pool_new (ML_BUFFER_POOL_DEFAULT_MAX_CACHED);
+  g_mutex_init (&pass->lock);
+  g_cond_init (&pass->cond);
   *backend_private = pass;
 
   return HAL_ML_ERROR_NONE;
 }
 
+/** @brief Frees the handle once the last output of the pool is released. */
+static void
+_pass_handle_free (gpointer data)
+{
+  pass_handle_s *pass = (pass_handle_s *) data;
+
+  g_mutex_clear (&pass->lock);
+  g_cond_clear (&pass->cond);
+  g_free (pass);
+}
+
 static int
 ml_dummy_passthrough_deinit (void *backend_private)
 {
@@ -34,27 +97,182 @@ ml_dummy_passthrough_deinit (void *backend_private)
     return HAL_ML_ERROR_INVALID_PARAMETER;
   }
 
-  gst_tensors_info_free (&pass->inputInfo);
-  gst_tensors_info_free (&pass->outputInfo);
+  ml_tensors_info_free (&pass->inputInfo);
+  ml_tensors_info_free (&pass->outputInfo);
+  ml_model_info_unref (pass->model_info);
+  ml_result_cache_free (pass->result_cache);
 
-  g_free (pass);
+  g_rand_free (pass->rand);
+  pass->use_pool = FALSE;
+
+  /* DESTROY_NOTIFY of the outputs still in use needs the handle. */
+  ml_buffer_pool_free_full (pass->pool, _pass_handle_free, pass);
 
   return HAL_ML_ERROR_NONE;
 }
 
+/** @brief Parse custom properties for the synthetic-accelerator mode. */
+static int
+_pass_parse_custom_prop (pass_handle_s *pass, const char *custom_prop)
+{
+  gchar **out_dims = NULL, **out_types = NULL;
+  int ret = HAL_ML_ERROR_NONE;
+
+  if (!custom_prop)
+    return HAL_ML_ERROR_NONE;
+
+  gchar **options = g_strsplit (custom_prop, ",", -1);
+
+  for (guint op = 0; op < g_strv_length (options); ++op) {
+    gchar **option = g_strsplit (options[op], ":", -1);
+
+    if (g_strv_length (option) > 1) {
+      g_strstrip (option[0]);
+      g_strstrip (option[1]);
+
+      if (g_ascii_strcasecmp (option[0], "ServiceTime") == 0) {
+        pass->service_time_us = MAX (g_ascii_strtoll (option[1], NULL, 10), 0);
+      } else if (g_ascii_strcasecmp (option[0], "Jitter") == 0) {
+        pass->jitter_us = MAX (g_ascii_strtoll (option[1], NULL, 10), 0);
+      } else if (g_ascii_strcasecmp (option[0], "JitterDist") == 0) {
+        if (g_ascii_strcasecmp (option[1], "uniform") == 0) {
+          pass->jitter_dist = PASS_JITTER_UNIFORM;
+        } else if (g_ascii_strcasecmp (option[1], "normal") == 0) {
+          pass->jitter_dist = PASS_JITTER_NORMAL;
+        } else if (g_ascii_strcasecmp (option[1], "exponential") == 0) {
+          pass->jitter_dist = PASS_JITTER_EXPONENTIAL;
+        } else {
+          g_warning ("Unknown jitter distribution (%s), set uniform as default.", option[1]);
+        }
+      } else if (g_ascii_strcasecmp (option[0], "ServiceMode") == 0) {
+        if (g_ascii_strcasecmp (option[1], "busy") == 0) {
+          pass->busy_wait = TRUE;
+        } else if (g_ascii_strcasecmp (option[1], "sleep") == 0) {
+          pass->busy_wait = FALSE;
+        } else {
+          g_warning ("Unknown service mode (%s), set sleep as default.", option[1]);
+        }
+      } else if (g_ascii_strcasecmp (option[0], "QueueDepth") == 0) {
+        pass->queue_depth = (guint) CLAMP (g_ascii_strtoll (option[1], NULL, 10), 0, G_MAXINT);
+      } else if (g_ascii_strcasecmp (option[0], "OutputDim") == 0) {
+        /* the dimension string contains ':' */
+        gchar *_dim_str = g_strjoinv (":", &option[1]);
+        g_strfreev (out_dims);
+        out_dims = g_strsplit (_dim_str, ";", -1);
+        g_free (_dim_str);
+      } else if (g_ascii_strcasecmp (option[0], "OutputType") == 0) {
+        g_strfreev (out_types);
+        out_types = g_strsplit (option[1], ";", -1);
+      } else if (g_ascii_strcasecmp (option[0], "InPlace") == 0
+                 || g_ascii_strcasecmp (option[0], "ZeroCopy") == 0) {
+        /* The input buffer is released by the framework right after invoke, so the
+           output cannot alias it unless the framework owns the aliasing (in-place). */
+        pass->in_place = (g_ascii_strcasecmp (option[1], "true") == 0);
+      } else if (g_ascii_strcasecmp (option[0], "OutputPool") == 0) {
+        pass->use_pool = (g_ascii_strcasecmp (option[1], "true") == 0);
+      } else if (g_ascii_strcasecmp (option[0], "ResultCache") == 0) {
+        pass->result_cache_config.max_entries = (guint) g_ascii_strtoull (option[1], NULL, 10);
+      } else if (g_ascii_strcasecmp (option[0], "ResultCacheMemory") == 0) {
+        if (!ml_result_cache_parse_size (option[1], &pass->result_cache_config.max_bytes))
+          g_warning ("Ignore invalid memory limit of the result cache (%s).", option[1]);
+      } else if (g_ascii_strcasecmp (option[0], "ResultCacheStats") == 0) {
+        pass->result_cache_config.stats_interval = (guint) g_ascii_strtoull (option[1], NULL, 10);
+      } else {
+        g_warning ("Unknown option (%s).", options[op]);
+      }
+    }
+
+    g_strfreev (option);
+  }
+
+  g_strfreev (options);
+
+  /* Emulate a model with output shape and type different from the input */
+  if (out_dims || out_types) {
+    guint num_dims = out_dims ? g_strv_length (out_dims) : 0;
+    guint num_types = out_types ? g_strv_length (out_types) : 0;
+    guint num = MAX (num_dims, num_types);
+
+    if (num_dims == 0)
+      num = MIN (num, pass->inputInfo.num_tensors);
+
+    if (num == 0 || num > NNS_TENSOR_SIZE_LIMIT) {
+      g_critical ("[dummy backend] Invalid number of output tensors (%u).", num);
+      ret = HAL_ML_ERROR_INVALID_PARAMETER;
+      goto done;
+    }
+
+    ml_tensors_info_alloc (&pass->outputInfo, num);
+
+    for (guint i = 0; i < num; i++) {
+      GstTensorInfo *info = ml_tensors_info_get_nth_info (&pass->outputInfo, i);
+      GstTensorInfo *in = (i < pass->inputInfo.num_tensors) ?
+          ml_tensors_info_get_nth_info (&pass->inputInfo, i) : NULL;
+
+      if (in)
+        gst_tensor_info_copy (info, in);
+
+      if (i < num_dims && gst_tensor_parse_dimension (out_dims[i], info->dimension) == 0) {
+        g_critical ("[dummy backend] Invalid output dimension (%s).", out_dims[i]);
+        ret = HAL_ML_ERROR_INVALID_PARAMETER;
+        goto done;
+      }
+
+      if (i < num_types) {
+        info->type = gst_tensor_get_type (g_strstrip (out_types[i]));
+      } else if (!in) {
+        /* use the type of the last given one */
+        info->type = (num_types > 0) ? gst_tensor_get_type (out_types[num_types - 1]) : _NNS_UINT8;
+      }
+
+      if (ml_tensor_type_to_gst (info->type) == _NNS_END || gst_tensor_info_get_size (info) == 0) {
+        g_critical ("[dummy backend] Invalid output tensor info at index %u.", i);
+        ret = HAL_ML_ERROR_INVALID_PARAMETER;
+        goto done;
+      }
+    }
+  }
+
+done:
+  g_strfreev (out_dims);
+  g_strfreev (out_types);
+  return ret;
+}
+
 static int
 ml_dummy_passthrough_configure_instance (void *backend_private, const void *prop_)
 {
   const GstTensorFilterProperties *prop = (const GstTensorFilterProperties *) prop_;
   pass_handle_s *pass = (pass_handle_s *) backend_private;
-  if (!pass) {
+  if (!pass || !prop) {
     g_critical ("[dummy backend] ml_dummy_passthrough_configure_instance called with invalid backend_private");
     return HAL_ML_ERROR_INVALID_PARAMETER;
   }
 
-  gst_tensors_info_copy (&pass->inputInfo, &prop->input_meta);
-  gst_tensors_info_copy (&pass->outputInfo, &prop->output_meta);
+  ML_TRACE_SCOPE ("dummy:configure_instance");
+
+  ml_tensors_info_free (&pass->inputInfo);
+  ml_tensors_info_free (&pass->outputInfo);
+  ml_model_info_unref (pass->model_info);
+  pass->model_info = NULL;
+  ml_result_cache_free (pass->result_cache);
+  pass->result_cache = NULL;
+  _pass_reset_options (pass);
+
+  ml_tensors_info_from_gst (&pass->inputInfo, &prop->input_meta);
+  ml_tensors_info_from_gst (&pass->outputInfo, &prop->output_meta);
 
+  int ret = _pass_parse_custom_prop (pass, prop->custom_properties);
+  if (ret != HAL_ML_ERROR_NONE)
+    return ret;
+
+  if (ml_result_cache_config_is_enabled (&pass->result_cache_config)) {
+    pass->result_cache = ml_result_cache_new (&pass->result_cache_config, &pass->inputInfo, &pass->outputInfo);
+    if (!pass->result_cache)
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  pass->model_info = ml_model_info_new (&pass->inputInfo, &pass->outputInfo);
   return HAL_ML_ERROR_NONE;
 }
 
@@ -62,15 +280,72 @@ static int
 ml_dummy_passthrough_get_framework_info (void *backend_private, void *fw_info)
 {
   GstTensorFilterFrameworkInfo *info = (GstTensorFilterFrameworkInfo *) fw_info;
+  pass_handle_s *pass = (pass_handle_s *) backend_private;
+
   info->name = "dummy-passthrough";
-  info->allow_in_place = FALSE;
-  info->allocate_in_invoke = FALSE;
+  /* backend_private can be NULL if the framework is not opened yet. */
+  info->allow_in_place = (pass && pass->in_place) ? TRUE : FALSE;
+  info->allocate_in_invoke = (pass && pass->use_pool) ? TRUE : FALSE;
   info->run_without_model = FALSE;
   info->verify_model_path = FALSE;
 
   return HAL_ML_ERROR_NONE;
 }
 
+/** @brief Get the service time of this invoke including the jitter. Called with lock. */
+static gint64
+_pass_get_service_time (pass_handle_s *pass)
+{
+  gdouble jitter = 0.0;
+
+  if (pass->jitter_us > 0) {
+    switch (pass->jitter_dist) {
+      case PASS_JITTER_NORMAL:
+        {
+          /* Box-Muller transform */
+          gdouble u1 = 1.0 - g_rand_double (pass->rand);
+          gdouble u2 = g_rand_double (pass->rand);
+          jitter = sqrt (-2.0 * log (u1)) * cos (2.0 * G_PI * u2) * pass->jitter_us;
+          break;
+        }
+      case PASS_JITTER_EXPONENTIAL:
+        jitter = -log (1.0 - g_rand_double (pass->rand)) * pass->jitter_us;
+        break;
+      case PASS_JITTER_UNIFORM:
+      default:
+        jitter = g_rand_double_range (pass->rand, -1.0, 1.0) * pass->jitter_us;
+        break;
+    }
+  }
+
+  return MAX ((gint64) (pass->service_time_us + jitter), 0);
+}
+
+/** @brief Occupy the emulated device for the given time. */
+static void
+_pass_emulate_service (pass_handle_s *pass, gint64 service_us)
+{
+  gint64 deadline;
+
+  if (service_us <= 0)
+    return;
+
+  ML_TRACE_SCOPE ("dummy:service");
+
+  if (!pass->busy_wait) {
+    g_usleep (service_us);
+    return;
+  }
+
+  deadline = g_get_monotonic_time () + service_us;
+  do {
+    /* keep the core busy like a compute kernel */
+    volatile guint32 acc = 0;
+    for (guint i = 0; i < 1024U; i++)
+      acc = acc * 1664525U + 1013904223U;
+  } while (g_get_monotonic_time () < deadline);
+}
+
 static int
 ml_dummy_passthrough_invoke (void *backend_private, const void *input_, void *output_)
 {
@@ -82,11 +357,56 @@ ml_dummy_passthrough_invoke (void *backend_private, const void *input_, void *ou
     return HAL_ML_ERROR_INVALID_PARAMETER;
   }
 
-  for (unsigned int i = 0; i < pass->inputInfo.num_tensors; i++) {
-    GstTensorInfo *info = gst_tensors_info_get_nth_info (&pass->inputInfo, i);
-    memcpy (output[i].data, input[i].data, gst_tensor_info_get_size (info));
+  ML_TRACE_SCOPE ("dummy:invoke");
+
+  if (pass->use_pool) {
+    if (!ml_buffer_pool_acquire_tensors (pass->pool, &pass->outputInfo, output)) {
+      g_critical ("[dummy backend] Failed to get the output buffers from the pool.");
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+  }
+
+  /* Same inputs as a recent invoke, skip the emulated device. */
+  guint64 cache_key = 0;
+  if (pass->result_cache && ml_result_cache_lookup (pass->result_cache, input, output, &cache_key))
+    return HAL_ML_ERROR_NONE;
+
+  /* Wait for a free slot of the emulated device queue */
+  g_mutex_lock (&pass->lock);
+  while (pass->queue_depth > 0 && pass->active >= pass->queue_depth)
+    g_cond_wait (&pass->cond, &pass->lock);
+  pass->active++;
+  gint64 service_us = _pass_get_service_time (pass);
+  g_mutex_unlock (&pass->lock);
+
+  _pass_emulate_service (pass, service_us);
+
+  for (unsigned int i = 0; i < pass->outputInfo.num_tensors; i++) {
+    GstTensorInfo *info = ml_tensors_info_get_nth_info (&pass->outputInfo, i);
+    gsize out_size = gst_tensor_info_get_size (info);
+    gsize copied = 0;
+
+    if (i < pass->inputInfo.num_tensors) {
+      GstTensorInfo *in_info = ml_tensors_info_get_nth_info (&pass->inputInfo, i);
+      copied = MIN (out_size, gst_tensor_info_get_size (in_info));
+
+      /* In-place, the data is already there. */
+      if (output[i].data != input[i].data)
+        ml_copy (output[i].data, input[i].data, copied);
+    }
+
+    if (copied < out_size)
+      memset ((guint8 *) output[i].data + copied, 0, out_size - copied);
   }
 
+  g_mutex_lock (&pass->lock);
+  pass->active--;
+  g_cond_signal (&pass->cond);
+  g_mutex_unlock (&pass->lock);
+
+  if (pass->result_cache)
+    ml_result_cache_insert (pass->result_cache, cache_key, input, output);
+
   return HAL_ML_ERROR_NONE;
 }
 
@@ -104,9 +424,19 @@ ml_dummy_passthrough_get_model_info (
   }
 
   if (ops == GET_IN_OUT_INFO) {
-    gst_tensors_info_copy (in_info, &pass->inputInfo);
-    gst_tensors_info_copy (out_info, &pass->outputInfo);
+    ml_tensors_info_to_gst (in_info, &pass->inputInfo);
+    ml_tensors_info_to_gst (out_info, &pass->outputInfo);
+
+    return HAL_ML_ERROR_NONE;
+  }
+
+  if (ops == ML_GET_IN_OUT_INFO_BORROWED) {
+    if (!pass->model_info || !in_info_) {
+      g_critical ("[dummy backend] The model info is not available.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
 
+    *(ml_model_info_s **) in_info_ = ml_model_info_ref (pass->model_info);
     return HAL_ML_ERROR_NONE;
   }
 
@@ -116,6 +446,22 @@ ml_dummy_passthrough_get_model_info (
 static int
 ml_dummy_passthrough_event_handler (void *backend_private, int ops_, void *data_)
 {
+  event_ops ops = (event_ops) ops_;
+  GstTensorFilterFrameworkEventData *data = (GstTensorFilterFrameworkEventData *) data_;
+  pass_handle_s *pass = (pass_handle_s *) backend_private;
+
+  /* Outputs may outlive a reconfigure without OutputPool, so release them whatever the option is now. */
+  if (ops == DESTROY_NOTIFY && pass) {
+    /* The handle may be freed by the release of the last output after deinit. */
+    if (data && ml_buffer_pool_release (pass->pool, data->data))
+      return HAL_ML_ERROR_NONE;
+
+    if (pass->use_pool) {
+      g_critical ("[dummy backend] The buffer to be destroyed is not from the output pool.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+  }
+
   return HAL_ML_ERROR_NOT_SUPPORTED;
 }
 
@@ -0,0 +1,207 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hal-backend-ml-int4.h"
+
+/** @brief Below this count, building the dequantization table costs more than it saves. */
+#define ML_INT4_TABLE_THRESHOLD (512U)
+
+static inline gboolean
+_int4_is_valid_type (tensor_type type)
+{
+  if (type == _NNS_INT4 || type == _NNS_UINT4)
+    return TRUE;
+
+  g_critical ("[int4] Not a 4-bit tensor type (%d).", (int) type);
+  return FALSE;
+}
+
+/** @brief Get the 4-bit value of the element, sign-extended if signed. */
+static inline gint
+_int4_get (const guint8 *src, gsize index, gboolean is_signed)
+{
+  gint n = (index & 1) ? (src[index / 2] >> 4) : (src[index / 2] & 0x0f);
+
+  return is_signed ? ((n ^ 0x8) - 0x8) : n;
+}
+
+static inline guint8
+_int4_saturate (gint v, gboolean is_signed)
+{
+  if (is_signed)
+    return (guint8) (CLAMP (v, -8, 7) & 0x0f);
+
+  return (guint8) CLAMP (v, 0, 15);
+}
+
+gboolean
+ml_int4_unpack (void *dest, tensor_type type, const guint8 *src, gsize count)
+{
+  const gboolean is_signed = (type == _NNS_INT4);
+  guint8 *d = (guint8 *) dest;
+  gsize i = 0;
+
+  if (!_int4_is_valid_type (type))
+    return FALSE;
+
+  g_return_val_if_fail (count == 0 || (dest != NULL && src != NULL), FALSE);
+
+  /* 16 bytes to 32 elements in each iteration */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; i + 32 <= count; i += 32) {
+    uint8x16_t v = vld1q_u8 (src + i / 2);
+    uint8x16x2_t r;
+
+    if (is_signed) {
+      int8x16_t s = vreinterpretq_s8_u8 (v);
+
+      r.val[0] = vreinterpretq_u8_s8 (vshrq_n_s8 (vshlq_n_s8 (s, 4), 4));
+      r.val[1] = vreinterpretq_u8_s8 (vshrq_n_s8 (s, 4));
+    } else {
+      r.val[0] = vandq_u8 (v, vdupq_n_u8 (0x0f));
+      r.val[1] = vshrq_n_u8 (v, 4);
+    }
+
+    r = vzipq_u8 (r.val[0], r.val[1]);
+    vst1q_u8 (d + i, r.val[0]);
+    vst1q_u8 (d + i + 16, r.val[1]);
+  }
+#elif defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi8 (0x0f);
+  const __m128i sign = _mm_set1_epi8 (0x08);
+
+  for (; i + 32 <= count; i += 32) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i / 2));
+    __m128i lo = _mm_and_si128 (v, mask);
+    __m128i hi = _mm_and_si128 (_mm_srli_epi16 (v, 4), mask);
+
+    if (is_signed) {
+      lo = _mm_sub_epi8 (_mm_xor_si128 (lo, sign), sign);
+      hi = _mm_sub_epi8 (_mm_xor_si128 (hi, sign), sign);
+    }
+
+    _mm_storeu_si128 ((__m128i *) (d + i), _mm_unpacklo_epi8 (lo, hi));
+    _mm_storeu_si128 ((__m128i *) (d + i + 16), _mm_unpackhi_epi8 (lo, hi));
+  }
+#endif
+
+  for (; i < count; i++)
+    d[i] = (guint8) _int4_get (src, i, is_signed);
+
+  return TRUE;
+}
+
+gboolean
+ml_int4_pack (guint8 *dest, tensor_type type, const void *src, gsize count)
+{
+  const gboolean is_signed = (type == _NNS_INT4);
+  const guint8 *s = (const guint8 *) src;
+  gsize i = 0;
+
+  if (!_int4_is_valid_type (type))
+    return FALSE;
+
+  g_return_val_if_fail (count == 0 || (dest != NULL && src != NULL), FALSE);
+
+  /* 32 elements to 16 bytes in each iteration */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; i + 32 <= count; i += 32) {
+    uint8x16_t even, odd;
+
+    if (is_signed) {
+      int8x16x2_t v = vld2q_s8 ((const int8_t *) (s + i));
+
+      even = vreinterpretq_u8_s8 (vmaxq_s8 (vminq_s8 (v.val[0], vdupq_n_s8 (7)), vdupq_n_s8 (-8)));
+      odd = vreinterpretq_u8_s8 (vmaxq_s8 (vminq_s8 (v.val[1], vdupq_n_s8 (7)), vdupq_n_s8 (-8)));
+    } else {
+      uint8x16x2_t v = vld2q_u8 (s + i);
+
+      even = vminq_u8 (v.val[0], vdupq_n_u8 (15));
+      odd = vminq_u8 (v.val[1], vdupq_n_u8 (15));
+    }
+
+    vst1q_u8 (dest + i / 2, vorrq_u8 (vandq_u8 (even, vdupq_n_u8 (0x0f)), vshlq_n_u8 (odd, 4)));
+  }
+#elif defined(__SSE2__)
+  const __m128i lo_mask = _mm_set1_epi16 (0x000f);
+  const __m128i hi_mask = _mm_set1_epi16 (0x00f0);
+  const __m128i bias = _mm_set1_epi8 (120);
+  const __m128i max_u4 = _mm_set1_epi8 (15);
+
+  for (; i + 32 <= count; i += 32) {
+    __m128i v[2];
+
+    v[0] = _mm_loadu_si128 ((const __m128i *) (s + i));
+    v[1] = _mm_loadu_si128 ((const __m128i *) (s + i + 16));
+
+    for (guint k = 0; k < 2; k++) {
+      if (is_signed) {
+        /* SSE2 has no signed byte min/max, saturate to [-8, 7] with saturating add and sub. */
+        v[k] = _mm_subs_epi8 (_mm_adds_epi8 (v[k], bias), bias);
+        v[k] = _mm_adds_epi8 (_mm_subs_epi8 (v[k], bias), bias);
+      } else {
+        v[k] = _mm_min_epu8 (v[k], max_u4);
+      }
+
+      /* Each 16-bit lane holds an even and an odd element, merge them in the low byte. */
+      v[k] = _mm_or_si128 (_mm_and_si128 (v[k], lo_mask), _mm_and_si128 (_mm_srli_epi16 (v[k], 4), hi_mask));
+    }
+
+    _mm_storeu_si128 ((__m128i *) (dest + i / 2), _mm_packus_epi16 (v[0], v[1]));
+  }
+#endif
+
+  for (; i + 1 < count; i += 2) {
+    gint even = is_signed ? (gint) (gint8) s[i] : (gint) s[i];
+    gint odd = is_signed ? (gint) (gint8) s[i + 1] : (gint) s[i + 1];
+
+    dest[i / 2] = (guint8) (_int4_saturate (even, is_signed) | (_int4_saturate (odd, is_signed) << 4));
+  }
+
+  if (i < count)
+    dest[i / 2] = _int4_saturate (is_signed ? (gint) (gint8) s[i] : (gint) s[i], is_signed);
+
+  return TRUE;
+}
+
+gboolean
+ml_int4_dequantize (float *dest, tensor_type type, const guint8 *src, gsize count,
+    float scale, gint32 zero_point)
+{
+  const gboolean is_signed = (type == _NNS_INT4);
+  gsize i = 0;
+
+  if (!_int4_is_valid_type (type))
+    return FALSE;
+
+  g_return_val_if_fail (count == 0 || (dest != NULL && src != NULL), FALSE);
+
+  if (count >= ML_INT4_TABLE_THRESHOLD) {
+    float value[16];
+    float table[256][2];
+
+    for (gint n = 0; n < 16; n++)
+      value[n] = (float) ((is_signed ? ((n ^ 0x8) - 0x8) : n) - zero_point) * scale;
+
+    for (guint b = 0; b < 256; b++) {
+      table[b][0] = value[b & 0x0f];
+      table[b][1] = value[b >> 4];
+    }
+
+    for (; i + 1 < count; i += 2)
+      memcpy (dest + i, table[src[i / 2]], sizeof (table[0]));
+  }
+
+  for (; i < count; i++)
+    dest[i] = (float) (_int4_get (src, i, is_signed) - zero_point) * scale;
+
+  return TRUE;
+}
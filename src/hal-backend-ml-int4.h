@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_INT4_H__
+#define __HAL_BACKEND_ML_INT4_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Kernels for the packed 4-bit tensor types (_NNS_INT4 and _NNS_UINT4).
+ *
+ * Two elements are packed in a byte, the even element in the low nibble. The whole
+ * tensor is packed as a flat array, so a tensor of N elements takes (N + 1) / 2 bytes
+ * and the high nibble of the last byte is unused if N is odd.
+ * Pack and unpack are vectorized with SSE2 or NEON if available.
+ */
+
+/**
+ * @brief Unpack 4-bit elements to a byte each. _NNS_INT4 is sign-extended to gint8.
+ * @param dest gint8 for _NNS_INT4 or guint8 for _NNS_UINT4, count elements.
+ * @return FALSE if the type is not a 4-bit type.
+ */
+gboolean ml_int4_unpack (void *dest, tensor_type type, const guint8 *src, gsize count);
+
+/**
+ * @brief Pack bytes to 4-bit elements. Values out of the range of the type are saturated.
+ * @param src gint8 for _NNS_INT4 or guint8 for _NNS_UINT4, count elements.
+ * @return FALSE if the type is not a 4-bit type.
+ */
+gboolean ml_int4_pack (guint8 *dest, tensor_type type, const void *src, gsize count);
+
+/**
+ * @brief Dequantize 4-bit elements to float32, (q - zero_point) * scale.
+ *        Uses a table of the 256 possible bytes, so each byte is a single lookup.
+ * @return FALSE if the type is not a 4-bit type.
+ */
+gboolean ml_int4_dequantize (float *dest, tensor_type type, const guint8 *src, gsize count,
+    float scale, gint32 zero_point);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_INT4_H__ */
@@ -0,0 +1,302 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-layout.h"
+
+/** @brief Size of the square block in elements, a block of 4-byte elements fits in L1. */
+#define ML_LAYOUT_BLOCK (32U)
+
+struct _ml_layout_stage_s {
+  std::vector<ml_layout_transform_s> transforms;
+  std::vector<gboolean> active;
+  std::vector<void *> buffers;
+};
+
+static inline gboolean
+_layout_is_known (tensor_layout layout)
+{
+  return (layout == _NNS_LAYOUT_NHWC || layout == _NNS_LAYOUT_NCHW);
+}
+
+/** @brief Transpose a 4x4 tile of 4-byte elements. */
+static inline void
+_transpose_4x4_32 (uint32_t *d, gsize d_stride, const uint32_t *s, gsize s_stride)
+{
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  uint32x4_t r0 = vld1q_u32 (s);
+  uint32x4_t r1 = vld1q_u32 (s + s_stride);
+  uint32x4_t r2 = vld1q_u32 (s + 2 * s_stride);
+  uint32x4_t r3 = vld1q_u32 (s + 3 * s_stride);
+  uint32x4x2_t t01 = vtrnq_u32 (r0, r1);
+  uint32x4x2_t t23 = vtrnq_u32 (r2, r3);
+
+  vst1q_u32 (d, vcombine_u32 (vget_low_u32 (t01.val[0]), vget_low_u32 (t23.val[0])));
+  vst1q_u32 (d + d_stride, vcombine_u32 (vget_low_u32 (t01.val[1]), vget_low_u32 (t23.val[1])));
+  vst1q_u32 (d + 2 * d_stride, vcombine_u32 (vget_high_u32 (t01.val[0]), vget_high_u32 (t23.val[0])));
+  vst1q_u32 (d + 3 * d_stride, vcombine_u32 (vget_high_u32 (t01.val[1]), vget_high_u32 (t23.val[1])));
+#elif defined(__SSE2__)
+  __m128i r0 = _mm_loadu_si128 ((const __m128i *) s);
+  __m128i r1 = _mm_loadu_si128 ((const __m128i *) (s + s_stride));
+  __m128i r2 = _mm_loadu_si128 ((const __m128i *) (s + 2 * s_stride));
+  __m128i r3 = _mm_loadu_si128 ((const __m128i *) (s + 3 * s_stride));
+  __m128i t0 = _mm_unpacklo_epi32 (r0, r1);
+  __m128i t1 = _mm_unpacklo_epi32 (r2, r3);
+  __m128i t2 = _mm_unpackhi_epi32 (r0, r1);
+  __m128i t3 = _mm_unpackhi_epi32 (r2, r3);
+
+  _mm_storeu_si128 ((__m128i *) d, _mm_unpacklo_epi64 (t0, t1));
+  _mm_storeu_si128 ((__m128i *) (d + d_stride), _mm_unpackhi_epi64 (t0, t1));
+  _mm_storeu_si128 ((__m128i *) (d + 2 * d_stride), _mm_unpacklo_epi64 (t2, t3));
+  _mm_storeu_si128 ((__m128i *) (d + 3 * d_stride), _mm_unpackhi_epi64 (t2, t3));
+#else
+  for (guint r = 0; r < 4; r++)
+    for (guint c = 0; c < 4; c++)
+      d[c * d_stride + r] = s[r * s_stride + c];
+#endif
+}
+
+template <typename T>
+static void
+_transpose_block (T *d, const T *s, gsize rows, gsize cols, gsize r0, gsize r1, gsize c0, gsize c1)
+{
+  for (gsize r = r0; r < r1; r++)
+    for (gsize c = c0; c < c1; c++)
+      d[c * rows + r] = s[r * cols + c];
+}
+
+template <typename T>
+static void
+_transpose (T *d, const T *s, gsize rows, gsize cols)
+{
+  for (gsize r0 = 0; r0 < rows; r0 += ML_LAYOUT_BLOCK) {
+    gsize r1 = MIN (r0 + ML_LAYOUT_BLOCK, rows);
+
+    for (gsize c0 = 0; c0 < cols; c0 += ML_LAYOUT_BLOCK) {
+      gsize c1 = MIN (c0 + ML_LAYOUT_BLOCK, cols);
+      gsize r = r0, c = c0;
+
+      if (sizeof (T) == 4) {
+        /* 4x4 tiles, then the edges of the block */
+        gsize r4 = r0 + (r1 - r0) / 4 * 4;
+        gsize c4 = c0 + (c1 - c0) / 4 * 4;
+
+        for (r = r0; r < r4; r += 4)
+          for (c = c0; c < c4; c += 4)
+            _transpose_4x4_32 ((uint32_t *) (d + c * rows + r), rows,
+                (const uint32_t *) (s + r * cols + c), cols);
+
+        _transpose_block (d, s, rows, cols, r0, r4, c4, c1);
+        r = r4;
+      }
+
+      _transpose_block (d, s, rows, cols, r, r1, c0, c1);
+    }
+  }
+}
+
+void
+ml_transpose_2d (void *dest, const void *src, gsize rows, gsize cols, gsize elem_size)
+{
+  g_return_if_fail (dest != NULL && src != NULL);
+
+  switch (elem_size) {
+    case 1:
+      _transpose ((uint8_t *) dest, (const uint8_t *) src, rows, cols);
+      break;
+    case 2:
+      _transpose ((uint16_t *) dest, (const uint16_t *) src, rows, cols);
+      break;
+    case 4:
+      _transpose ((uint32_t *) dest, (const uint32_t *) src, rows, cols);
+      break;
+    case 8:
+      _transpose ((uint64_t *) dest, (const uint64_t *) src, rows, cols);
+      break;
+    default:
+      for (gsize r = 0; r < rows; r++)
+        for (gsize c = 0; c < cols; c++)
+          memcpy ((guint8 *) dest + (c * rows + r) * elem_size,
+              (const guint8 *) src + (r * cols + c) * elem_size, elem_size);
+      break;
+  }
+}
+
+gboolean
+ml_layout_transform_init (ml_layout_transform_s *t, const GstTensorInfo *info,
+    tensor_layout info_layout, tensor_layout from, tensor_layout to)
+{
+  const uint32_t *dim;
+
+  g_return_val_if_fail (t != NULL && info != NULL, FALSE);
+
+  memset (t, 0, sizeof (*t));
+
+  if (!_layout_is_known (info_layout) || !_layout_is_known (from)
+      || !_layout_is_known (to) || from == to)
+    return FALSE;
+
+  dim = info->dimension;
+  if (dim[0] == 0 || dim[1] == 0 || dim[2] == 0) {
+    g_warning ("The layout of a tensor with rank less than 3 cannot be transformed.");
+    return FALSE;
+  }
+
+  if (ml_tensor_get_element_bits (info->type) < 8) {
+    g_warning ("The layout of a packed tensor cannot be transformed.");
+    return FALSE;
+  }
+
+  t->from = from;
+  t->to = to;
+  t->elem_size = gst_tensor_get_element_size (info->type);
+  t->batch = 1;
+  for (guint i = 3; i < NNS_TENSOR_RANK_LIMIT && dim[i] > 0; i++)
+    t->batch *= dim[i];
+
+  if (info_layout == _NNS_LAYOUT_NHWC) {
+    t->channels = dim[0];
+    t->spatial = (gsize) dim[1] * dim[2];
+  } else {
+    t->spatial = (gsize) dim[0] * dim[1];
+    t->channels = dim[2];
+  }
+
+  return TRUE;
+}
+
+void
+ml_layout_transform_run (const ml_layout_transform_s *t, void *dest, const void *src)
+{
+  gsize plane;
+
+  g_return_if_fail (t != NULL);
+
+  plane = t->spatial * t->channels * t->elem_size;
+
+  for (gsize n = 0; n < t->batch; n++) {
+    guint8 *d = (guint8 *) dest + n * plane;
+    const guint8 *s = (const guint8 *) src + n * plane;
+
+    /* NHWC is a matrix of HW rows of C, NCHW is C rows of HW. */
+    if (t->from == _NNS_LAYOUT_NHWC)
+      ml_transpose_2d (d, s, t->spatial, t->channels, t->elem_size);
+    else
+      ml_transpose_2d (d, s, t->channels, t->spatial, t->elem_size);
+  }
+}
+
+void
+ml_layout_permute_dimension (tensor_dim dim, tensor_layout from, tensor_layout to)
+{
+  uint32_t d0, d1, d2;
+
+  g_return_if_fail (dim != NULL);
+
+  if (!_layout_is_known (from) || !_layout_is_known (to) || from == to)
+    return;
+
+  d0 = dim[0];
+  d1 = dim[1];
+  d2 = dim[2];
+
+  if (from == _NNS_LAYOUT_NHWC) {
+    /* [C, W, H] to [W, H, C] */
+    dim[0] = d1;
+    dim[1] = d2;
+    dim[2] = d0;
+  } else {
+    /* [W, H, C] to [C, W, H] */
+    dim[0] = d2;
+    dim[1] = d0;
+    dim[2] = d1;
+  }
+}
+
+gboolean
+ml_layout_stage_create (ml_tensors_info_s *info, tensor_layout model_layout,
+    const tensor_layout *layout, gboolean is_input, ml_layout_stage_s **stage_)
+{
+  ml_layout_stage_s *stage = NULL;
+
+  g_return_val_if_fail (info != NULL && layout != NULL && stage_ != NULL, FALSE);
+
+  *stage_ = NULL;
+
+  for (guint i = 0; i < info->num_tensors; i++) {
+    GstTensorInfo *tinfo = ml_tensors_info_get_nth_info (info, i);
+    ml_layout_transform_s t;
+    gboolean needed;
+
+    if (is_input)
+      needed = ml_layout_transform_init (&t, tinfo, model_layout, layout[i], model_layout);
+    else
+      needed = ml_layout_transform_init (&t, tinfo, model_layout, model_layout, layout[i]);
+
+    if (!needed)
+      continue;
+
+    if (!stage) {
+      stage = new ml_layout_stage_s ();
+      stage->transforms.resize (info->num_tensors);
+      stage->active.resize (info->num_tensors, FALSE);
+      stage->buffers.resize (info->num_tensors, NULL);
+    }
+
+    stage->buffers[i] = ml_alloc (gst_tensor_info_get_size (tinfo), ML_ALLOC_FLAG_NONE, NULL);
+    if (!stage->buffers[i]) {
+      g_critical ("Failed to allocate the staging buffer of the tensor #%u.", i);
+      ml_layout_stage_free (stage);
+      return FALSE;
+    }
+
+    stage->transforms[i] = t;
+    stage->active[i] = TRUE;
+
+    g_info ("Transform the layout of the %s tensor #%u.", is_input ? "input" : "output", i);
+    ml_layout_permute_dimension (tinfo->dimension, model_layout, layout[i]);
+  }
+
+  *stage_ = stage;
+  return TRUE;
+}
+
+void
+ml_layout_stage_free (ml_layout_stage_s *stage)
+{
+  if (!stage)
+    return;
+
+  for (void *buffer : stage->buffers)
+    ml_alloc_free (buffer);
+
+  delete stage;
+}
+
+const ml_layout_transform_s *
+ml_layout_stage_get (const ml_layout_stage_s *stage, guint index)
+{
+  if (!stage || index >= stage->active.size () || !stage->active[index])
+    return NULL;
+
+  return &stage->transforms[index];
+}
+
+void *
+ml_layout_stage_get_buffer (const ml_layout_stage_s *stage, guint index)
+{
+  if (!ml_layout_stage_get (stage, index))
+    return NULL;
+
+  return stage->buffers[index];
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_LAYOUT_H__
+#define __HAL_BACKEND_ML_LAYOUT_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Transform of a tensor between NHWC and NCHW.
+ *
+ * Dimensions follow the nnstreamer order, the innermost first: NHWC is [C, W, H, N]
+ * and NCHW is [W, H, C, N]. Dimensions after N are folded into the batch.
+ */
+typedef struct {
+  tensor_layout from; /**< Layout of the source */
+  tensor_layout to; /**< Layout of the destination */
+  gsize batch; /**< N */
+  gsize spatial; /**< H * W */
+  gsize channels; /**< C */
+  gsize elem_size; /**< Size of an element in bytes */
+} ml_layout_transform_s;
+
+/**
+ * @brief Set up the transform of a tensor.
+ * @param info The tensor info, with the dimension in info_layout.
+ * @return TRUE if the layouts are NHWC and NCHW and differ. FALSE if no transform is needed
+ *         or possible (ANY or NONE layout, rank less than 3, packed type).
+ */
+gboolean ml_layout_transform_init (ml_layout_transform_s *t, const GstTensorInfo *info,
+    tensor_layout info_layout, tensor_layout from, tensor_layout to);
+
+/**
+ * @brief Transform the tensor, a cache-blocked transpose of each batch.
+ * @note The buffers must not overlap.
+ */
+void ml_layout_transform_run (const ml_layout_transform_s *t, void *dest, const void *src);
+
+/**
+ * @brief Reorder the dimension of a tensor from one layout to the other.
+ */
+void ml_layout_permute_dimension (tensor_dim dim, tensor_layout from, tensor_layout to);
+
+/**
+ * @brief Transpose a row-major matrix of rows x cols elements. Cache-blocked, and
+ *        4x4 tiles of 4-byte elements are transposed with SSE2 or NEON if available.
+ * @note The buffers must not overlap.
+ */
+void ml_transpose_2d (void *dest, const void *src, gsize rows, gsize cols, gsize elem_size);
+
+/**
+ * @brief Layout transforms of the tensors of a backend, between the layout requested
+ *        by the pipeline (input_layout or output_layout) and the native layout of the model.
+ *        Each transformed tensor has a staging buffer in the model layout.
+ */
+typedef struct _ml_layout_stage_s ml_layout_stage_s;
+
+/**
+ * @brief Create the layout stage of the tensors.
+ * @param info The tensors info in the model layout. The dimension of each transformed
+ *        tensor is reordered to the pipeline layout, so the reported info matches the data.
+ * @param model_layout The native layout of the model.
+ * @param layout The layouts requested by the pipeline, for each tensor.
+ * @param is_input TRUE to transform from the pipeline to the model, FALSE for the opposite.
+ * @param stage The stage, set to NULL if no tensor needs a transform.
+ * @return FALSE if failed to allocate the staging buffers.
+ */
+gboolean ml_layout_stage_create (ml_tensors_info_s *info, tensor_layout model_layout,
+    const tensor_layout *layout, gboolean is_input, ml_layout_stage_s **stage);
+
+/**
+ * @brief Free the stage and the staging buffers.
+ */
+void ml_layout_stage_free (ml_layout_stage_s *stage);
+
+/**
+ * @brief Get the transform of the nth tensor.
+ * @return The transform, NULL if the stage is NULL or the tensor is not transformed.
+ */
+const ml_layout_transform_s *ml_layout_stage_get (const ml_layout_stage_s *stage, guint index);
+
+/**
+ * @brief Get the staging buffer of the nth tensor, in the model layout.
+ * @return The buffer, NULL if the stage is NULL or the tensor is not transformed.
+ */
+void *ml_layout_stage_get_buffer (const ml_layout_stage_s *stage, guint index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_LAYOUT_H__ */
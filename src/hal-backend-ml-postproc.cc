@@ -0,0 +1,306 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <string.h>
+#include <type_traits>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-postproc.h"
+#include "hal-backend-ml-tensor-view.h"
+
+/** @brief Number of scores of a block, skipped at once if none is above the K-th score. */
+#define POSTPROC_BLOCK (16U)
+
+struct _ml_postproc_s {
+  ml_postproc_type_e type;
+  tensor_type model_type; /* type of the model output */
+  gsize classes; /* innermost dimension of the model output */
+  gsize rows;
+  guint k;
+  tensor_dim out_dimension;
+  void *buffer;
+};
+
+void
+ml_postproc_config_init (ml_postproc_config_s *config)
+{
+  g_return_if_fail (config != NULL);
+
+  memset (config, 0, sizeof (*config));
+  config->type = ML_POSTPROC_NONE;
+}
+
+gboolean
+ml_postproc_parse (const gchar *str, ml_postproc_config_s *config)
+{
+  gchar **strv;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (str != NULL && config != NULL, FALSE);
+
+  strv = g_strsplit (str, ":", -1);
+
+  if (g_strv_length (strv) == 1 && g_ascii_strcasecmp (g_strstrip (strv[0]), "argmax") == 0) {
+    config->type = ML_POSTPROC_ARGMAX;
+    config->k = 1;
+    ret = TRUE;
+  } else if (g_strv_length (strv) == 2 && g_ascii_strcasecmp (g_strstrip (strv[0]), "topk") == 0) {
+    gchar *end = NULL;
+    gchar *s = g_strstrip (strv[1]);
+    guint64 k = g_ascii_strtoull (s, &end, 10);
+
+    if (end != s && *end == '\0' && k > 0 && k <= ML_POSTPROC_MAX_K) {
+      config->type = ML_POSTPROC_TOPK;
+      config->k = (guint) k;
+      ret = TRUE;
+    }
+  }
+
+  g_strfreev (strv);
+  return ret;
+}
+
+gboolean
+ml_postproc_config_is_enabled (const ml_postproc_config_s *config)
+{
+  return (config && config->type != ML_POSTPROC_NONE);
+}
+
+ml_postproc_s *
+ml_postproc_new (const ml_postproc_config_s *config, const GstTensorInfo *info)
+{
+  ml_postproc_s *pp;
+  gsize classes, rows = 1;
+
+  g_return_val_if_fail (config != NULL && info != NULL, NULL);
+
+  if (!ml_postproc_config_is_enabled (config))
+    return NULL;
+
+  if (ml_tensor_get_element_bits (info->type) < 8) {
+    g_critical ("[postproc] Unsupported type of the output tensor (%d).", (int) info->type);
+    return NULL;
+  }
+
+  classes = info->dimension[0];
+  for (guint i = 1; i < NNS_TENSOR_RANK_LIMIT && info->dimension[i] > 0; i++)
+    rows *= info->dimension[i];
+
+  if (config->k == 0 || config->k > classes || config->k > ML_POSTPROC_MAX_K) {
+    g_critical ("[postproc] Invalid K (%u) for %zu classes.", config->k, classes);
+    return NULL;
+  }
+
+  pp = new ml_postproc_s ();
+  pp->type = config->type;
+  pp->model_type = info->type;
+  pp->classes = classes;
+  pp->rows = rows;
+  pp->k = config->k;
+  memcpy (pp->out_dimension, info->dimension, sizeof (tensor_dim));
+  pp->out_dimension[0] = config->k;
+
+  pp->buffer = ml_alloc (gst_tensor_info_get_size (info), ML_ALLOC_FLAG_NONE, NULL);
+  if (!pp->buffer) {
+    g_critical ("[postproc] Failed to allocate the buffer of the output tensor.");
+    ml_postproc_free (pp);
+    return NULL;
+  }
+
+  return pp;
+}
+
+void
+ml_postproc_free (ml_postproc_s *pp)
+{
+  if (!pp)
+    return;
+
+  ml_alloc_free (pp->buffer);
+  delete pp;
+}
+
+void
+ml_postproc_get_output_info (const ml_postproc_s *pp, GstTensorInfo *info)
+{
+  g_return_if_fail (pp != NULL && info != NULL);
+
+  info->type = _NNS_UINT32;
+  memcpy (info->dimension, pp->out_dimension, sizeof (tensor_dim));
+}
+
+void *
+ml_postproc_get_buffer (const ml_postproc_s *pp)
+{
+  g_return_val_if_fail (pp != NULL, NULL);
+
+  return pp->buffer;
+}
+
+/** @brief Score to compare, half precision types are compared as float. */
+template <typename T>
+static inline T
+_postproc_score (T v)
+{
+  return v;
+}
+
+static inline float
+_postproc_score (ml_float16_s v)
+{
+  return ml_tensor_to_float (v);
+}
+
+static inline float
+_postproc_score (ml_bfloat16_s v)
+{
+  return ml_tensor_to_float (v);
+}
+
+/** @brief Max score of a block, scalar for the types without a SIMD kernel. */
+template <typename T>
+static inline auto
+_postproc_block_max (const T *p) -> decltype (_postproc_score (p[0]))
+{
+  auto m = _postproc_score (p[0]);
+
+  for (guint i = 1; i < POSTPROC_BLOCK; i++)
+    m = MAX (m, _postproc_score (p[i]));
+  return m;
+}
+
+static inline uint8_t
+_postproc_block_max (const uint8_t *p)
+{
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  uint8x16_t v = vld1q_u8 (p);
+  uint8x8_t m = vmax_u8 (vget_low_u8 (v), vget_high_u8 (v));
+
+  m = vpmax_u8 (m, m);
+  m = vpmax_u8 (m, m);
+  m = vpmax_u8 (m, m);
+  return vget_lane_u8 (m, 0);
+#elif defined(__SSE2__)
+  __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 8));
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 4));
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 2));
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 1));
+  return (uint8_t) _mm_cvtsi128_si32 (v);
+#else
+  uint8_t m = p[0];
+
+  for (guint i = 1; i < POSTPROC_BLOCK; i++)
+    m = MAX (m, p[i]);
+  return m;
+#endif
+}
+
+static inline int8_t
+_postproc_block_max (const int8_t *p)
+{
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  int8x16_t v = vld1q_s8 (p);
+  int8x8_t m = vmax_s8 (vget_low_s8 (v), vget_high_s8 (v));
+
+  m = vpmax_s8 (m, m);
+  m = vpmax_s8 (m, m);
+  m = vpmax_s8 (m, m);
+  return vget_lane_s8 (m, 0);
+#elif defined(__SSE2__)
+  /* SSE2 has no signed max of bytes, flip the sign bit and use the unsigned one */
+  const __m128i sign = _mm_set1_epi8 ((char) 0x80);
+  __m128i v = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) p), sign);
+
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 8));
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 4));
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 2));
+  v = _mm_max_epu8 (v, _mm_srli_si128 (v, 1));
+  return (int8_t) (_mm_cvtsi128_si32 (v) ^ 0x80);
+#else
+  int8_t m = p[0];
+
+  for (guint i = 1; i < POSTPROC_BLOCK; i++)
+    m = MAX (m, p[i]);
+  return m;
+#endif
+}
+
+/** @brief Insert the score into the sorted top-K, after the equal ones. */
+template <typename S>
+static inline void
+_postproc_insert (S *scores, guint32 *indices, guint &n, guint k, S s, guint32 index)
+{
+  guint pos = (n < k) ? n++ : k - 1;
+
+  while (pos > 0 && s > scores[pos - 1]) {
+    scores[pos] = scores[pos - 1];
+    indices[pos] = indices[pos - 1];
+    pos--;
+  }
+
+  scores[pos] = s;
+  indices[pos] = index;
+}
+
+/**
+ * @brief Top-K of a row. Once K scores are selected, a score enters only if it is above the
+ *        K-th one, so the 8-bit rows are scanned by blocks and most blocks are skipped by their max.
+ */
+template <typename T>
+static void
+_postproc_topk_row (const ml_postproc_s *pp, guint32 *dest, const T *src)
+{
+  typedef decltype (_postproc_score (src[0])) S;
+  const gboolean by_block = std::is_integral<T>::value && sizeof (T) == 1;
+  S scores[ML_POSTPROC_MAX_K];
+  const guint k = pp->k;
+  guint n = 0;
+  gsize i = 0;
+
+  for (; i < pp->classes && n < k; i++)
+    _postproc_insert (scores, dest, n, k, _postproc_score (src[i]), (guint32) i);
+
+  if (by_block) {
+    for (; i + POSTPROC_BLOCK <= pp->classes; i += POSTPROC_BLOCK) {
+      if (!(_postproc_block_max (src + i) > scores[k - 1]))
+        continue;
+
+      for (guint j = 0; j < POSTPROC_BLOCK; j++) {
+        S s = _postproc_score (src[i + j]);
+
+        if (s > scores[k - 1])
+          _postproc_insert (scores, dest, n, k, s, (guint32) (i + j));
+      }
+    }
+  }
+
+  for (; i < pp->classes; i++) {
+    S s = _postproc_score (src[i]);
+
+    if (s > scores[k - 1])
+      _postproc_insert (scores, dest, n, k, s, (guint32) i);
+  }
+}
+
+void
+ml_postproc_run (const ml_postproc_s *pp, void *dest, const void *src)
+{
+  g_return_if_fail (pp != NULL && dest != NULL && src != NULL);
+
+  ml_tensor_dispatch (pp->model_type, [&] (auto tag) {
+    typedef typename decltype (tag)::type T;
+
+    for (gsize r = 0; r < pp->rows; r++) {
+      _postproc_topk_row<T> (pp, (guint32 *) dest + r * pp->k, (const T *) src + r * pp->classes);
+    }
+    return TRUE;
+  });
+}
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_POSTPROC_H__
+#define __HAL_BACKEND_ML_POSTPROC_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Max number of classes selected by top-K. */
+#define ML_POSTPROC_MAX_K (256U)
+
+/**
+ * @brief Type of the output post-processing.
+ */
+typedef enum {
+  ML_POSTPROC_NONE = 0,
+  ML_POSTPROC_TOPK, /**< Indices of the K highest scores, the highest first */
+  ML_POSTPROC_ARGMAX, /**< Index of the highest score, same as top-1 */
+} ml_postproc_type_e;
+
+/**
+ * @brief Configuration of the output post-processing, usually parsed from the custom properties.
+ */
+typedef struct {
+  ml_postproc_type_e type;
+  guint output_index; /**< Index of the post-processed output tensor */
+  guint k; /**< Number of classes selected by top-K */
+} ml_postproc_config_s;
+
+/**
+ * @brief Output post-processing of a backend.
+ *
+ * Reduces a classifier output to a small tensor of class indices, directly on the model type,
+ * so a quantized output is neither converted nor copied out as a whole. The scores are the
+ * innermost dimension, and each index of the other dimensions (e.g. the batch) is a separate row.
+ * The output is uint32 with the innermost dimension K, and the other dimensions unchanged.
+ * Equal scores are ordered by the lower index first.
+ *
+ * Scores are compared as stored, so a quantized output must have a positive scale, which is
+ * the case of the classifiers in practice.
+ */
+typedef struct _ml_postproc_s ml_postproc_s;
+
+/**
+ * @brief Initialize the configuration, no post-processing.
+ */
+void ml_postproc_config_init (ml_postproc_config_s *config);
+
+/**
+ * @brief Parse the post-processing, "topk:<K>" or "argmax".
+ * @return FALSE if the string is invalid, or K is 0 or larger than ML_POSTPROC_MAX_K.
+ */
+gboolean ml_postproc_parse (const gchar *str, ml_postproc_config_s *config);
+
+/**
+ * @brief Check if the configuration asks for the post-processing.
+ */
+gboolean ml_postproc_config_is_enabled (const ml_postproc_config_s *config);
+
+/**
+ * @brief Create the post-processing of the model output.
+ * @param info The model output tensor.
+ * @return The post-processing, NULL if the configuration does not match the tensor.
+ *         K should not be larger than the innermost dimension, and packed types are not supported.
+ */
+ml_postproc_s *ml_postproc_new (const ml_postproc_config_s *config, const GstTensorInfo *info);
+
+/**
+ * @brief Free the post-processing and its buffer.
+ */
+void ml_postproc_free (ml_postproc_s *pp);
+
+/**
+ * @brief Set the type and dimension of the post-processed output to the tensor info. The name is kept.
+ */
+void ml_postproc_get_output_info (const ml_postproc_s *pp, GstTensorInfo *info);
+
+/**
+ * @brief Get the buffer for the model output, in the type and dimension of the model.
+ */
+void *ml_postproc_get_buffer (const ml_postproc_s *pp);
+
+/**
+ * @brief Post-process the model output into the output tensor.
+ * @note The buffers must not overlap.
+ */
+void ml_postproc_run (const ml_postproc_s *pp, void *dest, const void *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_POSTPROC_H__ */
@@ -0,0 +1,582 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-layout.h"
+#include "hal-backend-ml-preproc.h"
+#include "hal-backend-ml-tensor-view.h"
+
+struct _ml_preproc_s {
+  GstTensorInfo input_info; /* raw frame accepted by the preprocessing */
+  tensor_type type; /* type of the model input */
+  ml_preproc_format_e format;
+  gsize batch;
+  gsize width;
+  gsize height;
+  gsize channels;
+  gsize src_width;
+  gsize src_height;
+  gboolean src_channel_last;
+  gboolean dest_channel_last;
+  std::vector<guint8> table; /* 256 values of the model type for each channel */
+  std::vector<gsize> x_map; /* source column of each column of the model input */
+  std::vector<gsize> y_map; /* source row of each row of the model input */
+  guint8 *rgb_row; /* R, G and B planes of a source row, for YUV formats */
+  void *buffer;
+};
+
+void
+ml_preproc_config_init (ml_preproc_config_s *config)
+{
+  g_return_if_fail (config != NULL);
+
+  memset (config, 0, sizeof (*config));
+  config->format = ML_PREPROC_FORMAT_RGB;
+  config->scale = 1.0f;
+}
+
+gboolean
+ml_preproc_parse_values (const gchar *str, float *values, guint *num)
+{
+  gchar **strv;
+  guint n;
+  gboolean ret = TRUE;
+
+  g_return_val_if_fail (str != NULL && values != NULL && num != NULL, FALSE);
+
+  strv = g_strsplit (str, ";", -1);
+  n = g_strv_length (strv);
+
+  if (n == 0 || n > ML_PREPROC_MAX_CHANNELS) {
+    ret = FALSE;
+    goto done;
+  }
+
+  for (guint i = 0; i < n; i++) {
+    gchar *end = NULL;
+    gchar *s = g_strstrip (strv[i]);
+
+    values[i] = (float) g_ascii_strtod (s, &end);
+    if (end == s || *end != '\0') {
+      ret = FALSE;
+      goto done;
+    }
+  }
+
+  *num = n;
+
+done:
+  g_strfreev (strv);
+  return ret;
+}
+
+gboolean
+ml_preproc_parse_format (const gchar *str, ml_preproc_format_e *format)
+{
+  g_return_val_if_fail (str != NULL && format != NULL, FALSE);
+
+  if (g_ascii_strcasecmp (str, "RGB") == 0)
+    *format = ML_PREPROC_FORMAT_RGB;
+  else if (g_ascii_strcasecmp (str, "NV12") == 0)
+    *format = ML_PREPROC_FORMAT_NV12;
+  else if (g_ascii_strcasecmp (str, "I420") == 0)
+    *format = ML_PREPROC_FORMAT_I420;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+ml_preproc_parse_size (const gchar *str, guint *width, guint *height)
+{
+  gchar *end = NULL;
+  guint64 w, h;
+
+  g_return_val_if_fail (str != NULL && width != NULL && height != NULL, FALSE);
+
+  w = g_ascii_strtoull (str, &end, 10);
+  if (end == str || (*end != 'x' && *end != 'X'))
+    return FALSE;
+
+  str = end + 1;
+  h = g_ascii_strtoull (str, &end, 10);
+  if (end == str || *end != '\0')
+    return FALSE;
+
+  if (w == 0 || h == 0 || w > G_MAXUINT32 || h > G_MAXUINT32)
+    return FALSE;
+
+  *width = (guint) w;
+  *height = (guint) h;
+  return TRUE;
+}
+
+gboolean
+ml_preproc_config_is_enabled (const ml_preproc_config_s *config)
+{
+  return (config && (config->num_mean > 0 || config->num_std > 0
+                        || config->format != ML_PREPROC_FORMAT_RGB || config->width > 0));
+}
+
+static inline gboolean
+_preproc_is_channel_last (tensor_layout layout)
+{
+  return (layout != _NNS_LAYOUT_NCHW);
+}
+
+static inline gboolean
+_preproc_is_yuv (const ml_preproc_s *pp)
+{
+  return (pp->format != ML_PREPROC_FORMAT_RGB);
+}
+
+template <typename T>
+static void
+_preproc_fill_table (ml_preproc_s *pp, const ml_preproc_config_s *config)
+{
+  T *table = (T *) pp->table.data ();
+
+  for (gsize c = 0; c < pp->channels; c++) {
+    float mean = (config->num_mean == 0) ? 0.0f : config->mean[(config->num_mean == 1) ? 0 : c];
+    float std = (config->num_std == 0) ? 1.0f : config->std[(config->num_std == 1) ? 0 : c];
+
+    for (guint v = 0; v < 256U; v++) {
+      float x = ((float) v - mean) / std;
+
+      if (config->quantized)
+        x = x / config->scale + (float) config->zero_point;
+
+      table[c * 256U + v] = ml_tensor_from_float<T> (x);
+    }
+  }
+}
+
+/** @brief Nearest source index of each destination index, sampled at the pixel centers. */
+static void
+_preproc_fill_map (std::vector<gsize> &map, gsize dest, gsize src)
+{
+  map.resize (dest);
+
+  for (gsize i = 0; i < dest; i++)
+    map[i] = MIN ((2 * i + 1) * src / (2 * dest), src - 1);
+}
+
+ml_preproc_s *
+ml_preproc_new (const ml_preproc_config_s *config, const GstTensorInfo *info,
+    tensor_layout model_layout, tensor_layout data_layout)
+{
+  ml_preproc_s *pp;
+  const uint32_t *dim;
+  gsize channels, width, height, batch = 1;
+  gsize src_width, src_height;
+  gboolean is_yuv;
+  guint i;
+
+  g_return_val_if_fail (config != NULL && info != NULL, NULL);
+
+  dim = info->dimension;
+  if (dim[0] == 0) {
+    g_critical ("[preproc] Invalid dimension of the input tensor.");
+    return NULL;
+  }
+
+  if (_preproc_is_channel_last (model_layout)) {
+    channels = dim[0];
+    width = MAX (dim[1], 1U);
+    height = MAX (dim[2], 1U);
+  } else {
+    if (dim[1] == 0 || dim[2] == 0) {
+      g_critical ("[preproc] NCHW input requires rank 3 or more.");
+      return NULL;
+    }
+    width = dim[0];
+    height = dim[1];
+    channels = dim[2];
+  }
+
+  for (i = 3; i < NNS_TENSOR_RANK_LIMIT && dim[i] > 0; i++)
+    batch *= dim[i];
+
+  if (channels > ML_PREPROC_MAX_CHANNELS) {
+    g_critical ("[preproc] Too many channels of the input tensor (%zu).", channels);
+    return NULL;
+  }
+
+  if ((config->num_mean > 1 && config->num_mean != channels)
+      || (config->num_std > 1 && config->num_std != channels)) {
+    g_critical ("[preproc] The number of mean and std values should be 1 or %zu.", channels);
+    return NULL;
+  }
+
+  for (i = 0; i < config->num_std; i++) {
+    if (config->std[i] == 0.0f) {
+      g_critical ("[preproc] Std should not be 0.");
+      return NULL;
+    }
+  }
+
+  if (config->quantized && config->scale == 0.0f) {
+    g_critical ("[preproc] Invalid quantization scale of the input tensor.");
+    return NULL;
+  }
+
+  if (ml_tensor_get_element_bits (info->type) < 8) {
+    g_critical ("[preproc] Unsupported type of the input tensor (%d).", (int) info->type);
+    return NULL;
+  }
+
+  src_width = (config->width > 0) ? config->width : width;
+  src_height = (config->height > 0) ? config->height : height;
+  is_yuv = (config->format != ML_PREPROC_FORMAT_RGB);
+
+  if (is_yuv && (channels != 3 || (src_width % 2) != 0 || (src_height % 2) != 0)) {
+    g_critical ("[preproc] YUV input requires 3 channels and an even frame size (%zux%zu).",
+        src_width, src_height);
+    return NULL;
+  }
+
+  if (data_layout == _NNS_LAYOUT_ANY || data_layout == _NNS_LAYOUT_NONE)
+    data_layout = model_layout;
+
+  pp = new ml_preproc_s ();
+  pp->type = info->type;
+  pp->format = config->format;
+  pp->batch = batch;
+  pp->width = width;
+  pp->height = height;
+  pp->channels = channels;
+  pp->src_width = src_width;
+  pp->src_height = src_height;
+  pp->dest_channel_last = _preproc_is_channel_last (model_layout);
+  pp->src_channel_last = _preproc_is_channel_last (data_layout);
+  pp->table.resize (channels * 256U * gst_tensor_get_element_size (info->type));
+
+  ml_tensor_dispatch (info->type, [&] (auto tag) {
+    typedef typename decltype (tag)::type T;
+
+    _preproc_fill_table<T> (pp, config);
+    return TRUE;
+  });
+
+  _preproc_fill_map (pp->x_map, width, src_width);
+  _preproc_fill_map (pp->y_map, height, src_height);
+
+  /* The raw frame is uint8, in the layout of the pipeline if not YUV */
+  gst_tensor_info_init (&pp->input_info);
+  pp->input_info.type = _NNS_UINT8;
+  memcpy (pp->input_info.dimension, info->dimension, sizeof (tensor_dim));
+
+  if (is_yuv) {
+    memset (pp->input_info.dimension, 0, sizeof (tensor_dim));
+    pp->input_info.dimension[0] = (uint32_t) src_width;
+    pp->input_info.dimension[1] = (uint32_t) (src_height * 3 / 2);
+    pp->input_info.dimension[2] = 1;
+    pp->input_info.dimension[3] = (uint32_t) batch;
+
+    pp->rgb_row = (guint8 *) g_malloc (src_width * 3);
+  } else {
+    guint w = pp->dest_channel_last ? 1 : 0;
+
+    pp->input_info.dimension[w] = (uint32_t) src_width;
+    pp->input_info.dimension[w + 1] = (uint32_t) src_height;
+
+    if (pp->src_channel_last != pp->dest_channel_last)
+      ml_layout_permute_dimension (pp->input_info.dimension, model_layout, data_layout);
+  }
+
+  pp->buffer = ml_alloc (gst_tensor_info_get_size (info), ML_ALLOC_FLAG_NONE, NULL);
+  if (!pp->buffer) {
+    g_critical ("[preproc] Failed to allocate the buffer of the input tensor.");
+    ml_preproc_free (pp);
+    return NULL;
+  }
+
+  return pp;
+}
+
+void
+ml_preproc_free (ml_preproc_s *pp)
+{
+  if (!pp)
+    return;
+
+  ml_alloc_free (pp->buffer);
+  g_free (pp->rgb_row);
+  delete pp;
+}
+
+void
+ml_preproc_get_input_info (const ml_preproc_s *pp, GstTensorInfo *info)
+{
+  g_return_if_fail (pp != NULL && info != NULL);
+
+  info->type = pp->input_info.type;
+  memcpy (info->dimension, pp->input_info.dimension, sizeof (tensor_dim));
+}
+
+void *
+ml_preproc_get_buffer (const ml_preproc_s *pp)
+{
+  g_return_val_if_fail (pp != NULL, NULL);
+
+  return pp->buffer;
+}
+
+static inline guint8
+_yuv_clamp (gint v)
+{
+  return (guint8) CLAMP (v, 0, 255);
+}
+
+/**
+ * @brief Convert a row of YUV to R, G and B planes, BT.601 limited range. Computed in 6-bit
+ *        fixed point, Y scaled by 1 + 10774 / 65536 (1.1644) with a high multiply, so that
+ *        the SIMD paths work in 16-bit lanes and give the same result as the scalar path.
+ */
+static void
+_yuv_to_rgb_row (guint8 *r, guint8 *g, guint8 *b, const guint8 *y, const guint8 *u,
+    const guint8 *v, gsize uv_step, gsize width)
+{
+  gsize x = 0;
+
+  /* 16 pixels in each iteration */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; x + 16 <= width; x += 16) {
+    uint8x8_t u8, v8;
+    uint8x8_t rr[2], gg[2], bb[2];
+    uint8x16_t y8 = vld1q_u8 (y + x);
+
+    if (uv_step == 2) {
+      uint8x8x2_t uv = vld2_u8 (u + x);
+
+      u8 = uv.val[0];
+      v8 = uv.val[1];
+    } else {
+      u8 = vld1_u8 (u + x / 2);
+      v8 = vld1_u8 (v + x / 2);
+    }
+
+    int16x8_t uu = vreinterpretq_s16_u16 (vsubl_u8 (u8, vdup_n_u8 (128)));
+    int16x8_t vv = vreinterpretq_s16_u16 (vsubl_u8 (v8, vdup_n_u8 (128)));
+    int16x8x2_t uz = vzipq_s16 (uu, uu);
+    int16x8x2_t vz = vzipq_s16 (vv, vv);
+
+    for (guint h = 0; h < 2; h++) {
+      uint8x8_t yh = h ? vget_high_u8 (y8) : vget_low_u8 (y8);
+      int16x8_t yy = vreinterpretq_s16_u16 (vsubl_u8 (yh, vdup_n_u8 (16)));
+
+      yy = vshlq_n_s16 (yy, 6);
+      yy = vaddq_s16 (vaddq_s16 (yy, vqdmulhq_n_s16 (yy, 5387)), vdupq_n_s16 (32));
+      rr[h] = vqshrun_n_s16 (vqaddq_s16 (yy, vmulq_n_s16 (vz.val[h], 102)), 6);
+      gg[h] = vqshrun_n_s16 (vqsubq_s16 (yy, vaddq_s16 (vmulq_n_s16 (uz.val[h], 25),
+                                                vmulq_n_s16 (vz.val[h], 52))), 6);
+      bb[h] = vqshrun_n_s16 (vqaddq_s16 (yy, vmulq_n_s16 (uz.val[h], 129)), 6);
+    }
+
+    vst1q_u8 (r + x, vcombine_u8 (rr[0], rr[1]));
+    vst1q_u8 (g + x, vcombine_u8 (gg[0], gg[1]));
+    vst1q_u8 (b + x, vcombine_u8 (bb[0], bb[1]));
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i c16 = _mm_set1_epi16 (16);
+  const __m128i c32 = _mm_set1_epi16 (32);
+  const __m128i c128 = _mm_set1_epi16 (128);
+  const __m128i cy = _mm_set1_epi16 (10774);
+  const __m128i c102 = _mm_set1_epi16 (102);
+  const __m128i c25 = _mm_set1_epi16 (25);
+  const __m128i c52 = _mm_set1_epi16 (52);
+  const __m128i c129 = _mm_set1_epi16 (129);
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i uu, vv;
+    __m128i rr[2], gg[2], bb[2];
+    __m128i y8 = _mm_loadu_si128 ((const __m128i *) (y + x));
+
+    if (uv_step == 2) {
+      __m128i uv = _mm_loadu_si128 ((const __m128i *) (u + x));
+
+      uu = _mm_and_si128 (uv, _mm_set1_epi16 (0x00ff));
+      vv = _mm_srli_epi16 (uv, 8);
+    } else {
+      uu = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (u + x / 2)), zero);
+      vv = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (v + x / 2)), zero);
+    }
+
+    uu = _mm_sub_epi16 (uu, c128);
+    vv = _mm_sub_epi16 (vv, c128);
+
+    for (guint h = 0; h < 2; h++) {
+      __m128i yy = h ? _mm_unpackhi_epi8 (y8, zero) : _mm_unpacklo_epi8 (y8, zero);
+      __m128i uh = h ? _mm_unpackhi_epi16 (uu, uu) : _mm_unpacklo_epi16 (uu, uu);
+      __m128i vh = h ? _mm_unpackhi_epi16 (vv, vv) : _mm_unpacklo_epi16 (vv, vv);
+
+      /* B may exceed 16 bits before the shift, saturate since it is clamped anyway. */
+      yy = _mm_slli_epi16 (_mm_sub_epi16 (yy, c16), 6);
+      yy = _mm_add_epi16 (_mm_add_epi16 (yy, _mm_mulhi_epi16 (yy, cy)), c32);
+      rr[h] = _mm_srai_epi16 (_mm_adds_epi16 (yy, _mm_mullo_epi16 (vh, c102)), 6);
+      gg[h] = _mm_srai_epi16 (_mm_subs_epi16 (yy, _mm_add_epi16 (_mm_mullo_epi16 (uh, c25),
+                                                      _mm_mullo_epi16 (vh, c52))), 6);
+      bb[h] = _mm_srai_epi16 (_mm_adds_epi16 (yy, _mm_mullo_epi16 (uh, c129)), 6);
+    }
+
+    _mm_storeu_si128 ((__m128i *) (r + x), _mm_packus_epi16 (rr[0], rr[1]));
+    _mm_storeu_si128 ((__m128i *) (g + x), _mm_packus_epi16 (gg[0], gg[1]));
+    _mm_storeu_si128 ((__m128i *) (b + x), _mm_packus_epi16 (bb[0], bb[1]));
+  }
+#endif
+
+  for (; x < width; x++) {
+    gint a = (y[x] - 16) * 64;
+    gint c = a + ((a * 10774) >> 16) + 32;
+    gint d = u[(x / 2) * uv_step] - 128;
+    gint e = v[(x / 2) * uv_step] - 128;
+
+    r[x] = _yuv_clamp ((c + 102 * e) >> 6);
+    g[x] = _yuv_clamp ((c - 25 * d - 52 * e) >> 6);
+    b[x] = _yuv_clamp ((c + 129 * d) >> 6);
+  }
+}
+
+/** @brief Convert a row of the YUV frame to the R, G and B planes of the preprocessing. */
+static void
+_preproc_yuv_row (const ml_preproc_s *pp, const guint8 *frame, gsize row)
+{
+  const gsize sw = pp->src_width, sh = pp->src_height;
+  const guint8 *chroma = frame + sw * sh;
+  const guint8 *u, *v;
+  gsize uv_step;
+
+  if (pp->format == ML_PREPROC_FORMAT_NV12) {
+    u = chroma + (row / 2) * sw;
+    v = u + 1;
+    uv_step = 2;
+  } else {
+    u = chroma + (row / 2) * (sw / 2);
+    v = chroma + (sw / 2) * (sh / 2) + (row / 2) * (sw / 2);
+    uv_step = 1;
+  }
+
+  _yuv_to_rgb_row (pp->rgb_row, pp->rgb_row + sw, pp->rgb_row + 2 * sw,
+      frame + row * sw, u, v, uv_step, sw);
+}
+
+/** @brief Same size RGB, each element of the model input from the same element of the frame. */
+template <typename T>
+static void
+_preproc_run (const ml_preproc_s *pp, T *dest, const guint8 *src)
+{
+  const T *table = (const T *) pp->table.data ();
+  const gsize C = pp->channels, HW = pp->width * pp->height;
+  const gsize plane = C * HW;
+  const gsize s_ps = pp->src_channel_last ? C : 1;
+  const gsize s_cs = pp->src_channel_last ? 1 : HW;
+
+  for (gsize n = 0; n < pp->batch; n++) {
+    const guint8 *s = src + n * plane;
+    T *d = dest + n * plane;
+
+    /* Loop in the order of the destination, so that the writes are sequential. */
+    if (pp->dest_channel_last) {
+      for (gsize p = 0; p < HW; p++)
+        for (gsize c = 0; c < C; c++)
+          *d++ = table[c * 256U + s[p * s_ps + c * s_cs]];
+    } else {
+      for (gsize c = 0; c < C; c++) {
+        const T *t = table + c * 256U;
+        const guint8 *sc = s + c * s_cs;
+
+        for (gsize p = 0; p < HW; p++)
+          *d++ = t[sc[p * s_ps]];
+      }
+    }
+  }
+}
+
+/** @brief YUV or resized frame, row by row of the model input. */
+template <typename T>
+static void
+_preproc_run_rows (const ml_preproc_s *pp, T *dest, const guint8 *src)
+{
+  const T *table = (const T *) pp->table.data ();
+  const gsize C = pp->channels, W = pp->width, H = pp->height;
+  const gsize sw = pp->src_width, sh = pp->src_height;
+  const gboolean is_yuv = _preproc_is_yuv (pp);
+  const gsize frame = is_yuv ? sw * sh * 3 / 2 : sw * sh * C;
+  /* The planes of a converted YUV row are contiguous, RGB is read from the frame as is. */
+  const gsize s_ps = (!is_yuv && pp->src_channel_last) ? C : 1;
+  const gsize s_cs = pp->src_channel_last ? 1 : sw * sh;
+  const gsize *x_map = pp->x_map.data ();
+  const guint8 *row[ML_PREPROC_MAX_CHANNELS];
+
+  for (gsize n = 0; n < pp->batch; n++) {
+    const guint8 *f = src + n * frame;
+    T *d = dest + n * C * W * H;
+
+    for (gsize y = 0; y < H; y++) {
+      const gsize sy = pp->y_map[y];
+
+      if (is_yuv) {
+        /* Convert again only if the source row changes */
+        if (y == 0 || pp->y_map[y - 1] != sy)
+          _preproc_yuv_row (pp, f, sy);
+
+        for (gsize c = 0; c < C; c++)
+          row[c] = pp->rgb_row + c * sw;
+      } else {
+        for (gsize c = 0; c < C; c++)
+          row[c] = f + sy * sw * s_ps + c * s_cs;
+      }
+
+      if (pp->dest_channel_last) {
+        T *dr = d + y * W * C;
+
+        for (gsize x = 0; x < W; x++) {
+          const gsize sx = x_map[x] * s_ps;
+
+          for (gsize c = 0; c < C; c++)
+            *dr++ = table[c * 256U + row[c][sx]];
+        }
+      } else {
+        for (gsize c = 0; c < C; c++) {
+          const T *t = table + c * 256U;
+          const guint8 *sr = row[c];
+          T *dr = d + c * W * H + y * W;
+
+          for (gsize x = 0; x < W; x++)
+            dr[x] = t[sr[x_map[x] * s_ps]];
+        }
+      }
+    }
+  }
+}
+
+void
+ml_preproc_run (const ml_preproc_s *pp, void *dest, const void *src)
+{
+  gboolean by_row;
+
+  g_return_if_fail (pp != NULL && dest != NULL && src != NULL);
+
+  by_row = _preproc_is_yuv (pp) || pp->src_width != pp->width || pp->src_height != pp->height;
+
+  ml_tensor_dispatch (pp->type, [&] (auto tag) {
+    typedef typename decltype (tag)::type T;
+
+    if (by_row)
+      _preproc_run_rows<T> (pp, (T *) dest, (const guint8 *) src);
+    else
+      _preproc_run<T> (pp, (T *) dest, (const guint8 *) src);
+    return TRUE;
+  });
+}
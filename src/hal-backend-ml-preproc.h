@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_PREPROC_H__
+#define __HAL_BACKEND_ML_PREPROC_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Max number of channels of the preprocessed input, each with its own mean and std. */
+#define ML_PREPROC_MAX_CHANNELS (16U)
+
+/**
+ * @brief Format of the raw frame.
+ */
+typedef enum {
+  ML_PREPROC_FORMAT_RGB = 0, /**< uint8 channels of the model input, in the data layout */
+  ML_PREPROC_FORMAT_NV12, /**< Y plane, then interleaved UV plane subsampled by 2 */
+  ML_PREPROC_FORMAT_I420, /**< Y, U and V planes, U and V subsampled by 2 */
+} ml_preproc_format_e;
+
+/**
+ * @brief Configuration of the input preprocessing, usually parsed from the custom properties.
+ */
+typedef struct {
+  guint input_index; /**< Index of the preprocessed input tensor */
+  ml_preproc_format_e format; /**< Format of the raw frame */
+  guint width; /**< Width of the raw frame, 0 for the width of the model input */
+  guint height; /**< Height of the raw frame, 0 for the height of the model input */
+  float mean[ML_PREPROC_MAX_CHANNELS]; /**< Mean of each channel, subtracted from the raw value */
+  float std[ML_PREPROC_MAX_CHANNELS]; /**< Std of each channel, the raw value is divided by it */
+  guint num_mean; /**< 0 for no mean, 1 for the same mean for all channels */
+  guint num_std; /**< 0 for no std, 1 for the same std for all channels */
+
+  /* Quantization of the model input, filled by the backend */
+  gboolean quantized; /**< The model input is quantized, q = round (x / scale) + zero_point */
+  float scale;
+  gint32 zero_point;
+} ml_preproc_config_s;
+
+/**
+ * @brief Input preprocessing of a backend.
+ *
+ * Converts a raw uint8 frame to the model input in one pass: YUV to RGB conversion,
+ * nearest-neighbor resize if the frame size differs from the model, normalization with the
+ * mean and std of each channel, quantization with the parameters of the model input, and the
+ * layout transform if the layout of the pipeline differs from the model. Since the source
+ * is uint8, the conversion of each channel after YUV to RGB is a table of 256 values of the
+ * model type.
+ *
+ * The result is written to the buffer of ml_preproc_get_buffer(). SNPE reads it in place as the
+ * user buffer of the input, Vivante copies it to the graph tensor.
+ *
+ * YUV frames are BT.601 limited range, converted to R, G and B channels in this order.
+ */
+typedef struct _ml_preproc_s ml_preproc_s;
+
+/**
+ * @brief Initialize the configuration, no normalization and not quantized.
+ */
+void ml_preproc_config_init (ml_preproc_config_s *config);
+
+/**
+ * @brief Parse the values of each channel separated by ';', e.g. "123.68;116.78;103.94".
+ * @return FALSE if a value is invalid or there are more than ML_PREPROC_MAX_CHANNELS values.
+ */
+gboolean ml_preproc_parse_values (const gchar *str, float *values, guint *num);
+
+/**
+ * @brief Parse the format of the raw frame, RGB, NV12 or I420.
+ */
+gboolean ml_preproc_parse_format (const gchar *str, ml_preproc_format_e *format);
+
+/**
+ * @brief Parse the size of the raw frame, e.g. "1920x1080".
+ */
+gboolean ml_preproc_parse_size (const gchar *str, guint *width, guint *height);
+
+/**
+ * @brief Check if the configuration asks for the preprocessing.
+ */
+gboolean ml_preproc_config_is_enabled (const ml_preproc_config_s *config);
+
+/**
+ * @brief Create the preprocessing of the model input.
+ * @param info The model input tensor, with the dimension in model_layout.
+ * @param model_layout Layout of the model input. ANY or NONE is treated as channel-last.
+ * @param data_layout Layout of the raw frame. ANY or NONE is the same as the model.
+ * @return The preprocessing, NULL if the configuration does not match the tensor.
+ *         YUV formats require 3 channels, and an even width and height of the frame.
+ */
+ml_preproc_s *ml_preproc_new (const ml_preproc_config_s *config, const GstTensorInfo *info,
+    tensor_layout model_layout, tensor_layout data_layout);
+
+/**
+ * @brief Free the preprocessing and its buffer.
+ */
+void ml_preproc_free (ml_preproc_s *pp);
+
+/**
+ * @brief Get the tensor info of the raw frame accepted by the preprocessing.
+ *        uint8 in the data layout, or [width, height * 3 / 2, 1, N] for YUV formats.
+ */
+void ml_preproc_get_input_info (const ml_preproc_s *pp, GstTensorInfo *info);
+
+/**
+ * @brief Get the buffer for the preprocessed input, in the type and layout of the model.
+ */
+void *ml_preproc_get_buffer (const ml_preproc_s *pp);
+
+/**
+ * @brief Preprocess the raw frame into the model input.
+ * @note The buffers must not overlap.
+ */
+void ml_preproc_run (const ml_preproc_s *pp, void *dest, const void *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_PREPROC_H__ */
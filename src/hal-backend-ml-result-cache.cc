@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <list>
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-copy.h"
+#include "hal-backend-ml-result-cache.h"
+
+/** @brief Mixes the hash of each input into the key. */
+#define RESULT_CACHE_KEY_PRIME (0x9E3779B185EBCA87ULL)
+
+/**
+ * @brief Cached outputs of an input.
+ */
+typedef struct {
+  guint64 key;
+  void *buffer; /* all outputs back to back, then all inputs to verify a hit */
+} ml_result_cache_entry_s;
+
+struct _ml_result_cache_s {
+  std::mutex lock;
+  guint capacity; /* max number of entries */
+  guint stats_interval;
+  std::vector<gsize> input_sizes;
+  std::vector<gsize> output_sizes;
+  std::vector<gsize> output_offsets; /* offset of each output in the buffer of an entry */
+  std::vector<gsize> input_offsets; /* offset of each input in the buffer of an entry */
+  gsize entry_size;
+  std::list<ml_result_cache_entry_s> entries; /* the most recently used first */
+  std::unordered_map<guint64, std::list<ml_result_cache_entry_s>::iterator> index;
+  guint64 hits;
+  guint64 misses;
+  guint64 collisions;
+  guint64 evictions;
+};
+
+void
+ml_result_cache_config_init (ml_result_cache_config_s *config)
+{
+  g_return_if_fail (config != NULL);
+
+  memset (config, 0, sizeof (*config));
+}
+
+gboolean
+ml_result_cache_parse_size (const gchar *str, gsize *size)
+{
+  gchar *end = NULL;
+  guint64 value, unit = 1;
+
+  g_return_val_if_fail (str != NULL && size != NULL, FALSE);
+
+  value = g_ascii_strtoull (str, &end, 10);
+  if (end == str)
+    return FALSE;
+
+  switch (g_ascii_toupper (*end)) {
+    case '\0':
+      break;
+    case 'K':
+      unit = 1ULL << 10;
+      break;
+    case 'M':
+      unit = 1ULL << 20;
+      break;
+    case 'G':
+      unit = 1ULL << 30;
+      break;
+    default:
+      return FALSE;
+  }
+
+  if (*end != '\0' && end[1] != '\0')
+    return FALSE;
+
+  if (value > G_MAXSIZE / unit)
+    return FALSE;
+
+  *size = (gsize) (value * unit);
+  return TRUE;
+}
+
+gboolean
+ml_result_cache_config_is_enabled (const ml_result_cache_config_s *config)
+{
+  return (config && config->max_entries > 0);
+}
+
+ml_result_cache_s *
+ml_result_cache_new (const ml_result_cache_config_s *config,
+    const ml_tensors_info_s *input_info, const ml_tensors_info_s *output_info)
+{
+  ml_result_cache_s *cache;
+  guint capacity;
+
+  g_return_val_if_fail (config != NULL && input_info != NULL && output_info != NULL, NULL);
+
+  if (!ml_result_cache_config_is_enabled (config))
+    return NULL;
+
+  cache = new ml_result_cache_s ();
+  cache->stats_interval = config->stats_interval;
+  cache->entry_size = 0;
+
+  for (guint i = 0; i < output_info->num_tensors; i++) {
+    gsize size = gst_tensor_info_get_size (ml_tensors_info_get_nth_info (output_info, i));
+
+    cache->output_sizes.push_back (size);
+    cache->output_offsets.push_back (cache->entry_size);
+    /* Keep each output aligned for the copy engine. */
+    cache->entry_size += (size + 63) & ~((gsize) 63);
+  }
+
+  for (guint i = 0; i < input_info->num_tensors; i++) {
+    gsize size = gst_tensor_info_get_size (ml_tensors_info_get_nth_info (input_info, i));
+
+    cache->input_sizes.push_back (size);
+    cache->input_offsets.push_back (cache->entry_size);
+    cache->entry_size += (size + 63) & ~((gsize) 63);
+  }
+
+  capacity = config->max_entries;
+  if (config->max_bytes > 0 && cache->entry_size > 0)
+    capacity = (guint) MIN ((gsize) capacity, config->max_bytes / cache->entry_size);
+
+  if (capacity == 0) {
+    g_critical ("[result cache] The memory limit (%zu) is smaller than a result (%zu).",
+        config->max_bytes, cache->entry_size);
+    ml_result_cache_free (cache);
+    return NULL;
+  }
+
+  cache->capacity = capacity;
+  cache->index.reserve (capacity);
+  g_info ("[result cache] Up to %u results of %zu bytes.", capacity, cache->entry_size);
+
+  return cache;
+}
+
+void
+ml_result_cache_free (ml_result_cache_s *cache)
+{
+  if (!cache)
+    return;
+
+  ml_result_cache_clear (cache);
+  delete cache;
+}
+
+/** @brief Hash of all inputs. */
+static guint64
+_result_cache_key (const ml_result_cache_s *cache, const GstTensorMemory *input)
+{
+  guint64 key = 0;
+
+  for (gsize i = 0; i < cache->input_sizes.size (); i++)
+    key = (key ^ ml_hash_data (input[i].data, cache->input_sizes[i])) * RESULT_CACHE_KEY_PRIME;
+
+  return key;
+}
+
+/** @brief Check if the entry is the result of the inputs, the key may collide. */
+static gboolean
+_result_cache_entry_matches (const ml_result_cache_s *cache,
+    const ml_result_cache_entry_s *entry, const GstTensorMemory *input)
+{
+  for (gsize i = 0; i < cache->input_sizes.size (); i++) {
+    if (memcmp ((const guint8 *) entry->buffer + cache->input_offsets[i], input[i].data,
+            cache->input_sizes[i])
+        != 0)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/** @brief Log the counters every stats_interval lookups. Called with lock. */
+static void
+_result_cache_log_stats (const ml_result_cache_s *cache)
+{
+  guint64 lookups = cache->hits + cache->misses;
+
+  if (cache->stats_interval == 0 || lookups % cache->stats_interval != 0)
+    return;
+
+  g_info ("[result cache] %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses (%.1f%%), %"
+      G_GUINT64_FORMAT " collisions, %" G_GUINT64_FORMAT " evictions, %zu results.",
+      cache->hits, cache->misses, 100.0 * cache->hits / lookups, cache->collisions,
+      cache->evictions, cache->entries.size ());
+}
+
+gboolean
+ml_result_cache_lookup (ml_result_cache_s *cache, const GstTensorMemory *input,
+    GstTensorMemory *output, guint64 *key)
+{
+  guint64 k;
+
+  g_return_val_if_fail (cache != NULL && input != NULL && output != NULL && key != NULL, FALSE);
+
+  /* Hash the inputs before the lock, the lookups of other threads do not wait for it. */
+  k = _result_cache_key (cache, input);
+  *key = k;
+
+  std::lock_guard<std::mutex> guard (cache->lock);
+  auto it = cache->index.find (k);
+
+  if (it == cache->index.end ()) {
+    cache->misses++;
+    _result_cache_log_stats (cache);
+    return FALSE;
+  }
+
+  /* Other inputs with the same key are a miss, and are not cached while the entry stays. */
+  if (!_result_cache_entry_matches (cache, &(*it->second), input)) {
+    cache->misses++;
+    cache->collisions++;
+    _result_cache_log_stats (cache);
+    return FALSE;
+  }
+
+  /* Move to the front, the most recently used. */
+  cache->entries.splice (cache->entries.begin (), cache->entries, it->second);
+
+  for (gsize i = 0; i < cache->output_sizes.size (); i++) {
+    ml_copy (output[i].data, (const guint8 *) it->second->buffer + cache->output_offsets[i],
+        cache->output_sizes[i]);
+  }
+
+  cache->hits++;
+  _result_cache_log_stats (cache);
+  return TRUE;
+}
+
+void
+ml_result_cache_insert (ml_result_cache_s *cache, guint64 key, const GstTensorMemory *input,
+    const GstTensorMemory *output)
+{
+  void *buffer = NULL;
+
+  g_return_if_fail (cache != NULL && input != NULL && output != NULL);
+
+  std::lock_guard<std::mutex> guard (cache->lock);
+
+  /* Inserted by another invoke with the same inputs */
+  if (cache->index.find (key) != cache->index.end ())
+    return;
+
+  if (cache->entries.size () >= cache->capacity) {
+    ml_result_cache_entry_s &lru = cache->entries.back ();
+
+    buffer = lru.buffer;
+    cache->index.erase (lru.key);
+    cache->entries.pop_back ();
+    cache->evictions++;
+  } else {
+    buffer = ml_alloc (cache->entry_size, ML_ALLOC_FLAG_NONE, NULL);
+    if (!buffer) {
+      g_warning ("[result cache] Failed to allocate the buffer of a result.");
+      return;
+    }
+  }
+
+  for (gsize i = 0; i < cache->output_sizes.size (); i++) {
+    ml_copy ((guint8 *) buffer + cache->output_offsets[i], output[i].data, cache->output_sizes[i]);
+  }
+
+  for (gsize i = 0; i < cache->input_sizes.size (); i++) {
+    ml_copy ((guint8 *) buffer + cache->input_offsets[i], input[i].data, cache->input_sizes[i]);
+  }
+
+  cache->entries.push_front ({ key, buffer });
+  cache->index[key] = cache->entries.begin ();
+}
+
+void
+ml_result_cache_clear (ml_result_cache_s *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  std::lock_guard<std::mutex> guard (cache->lock);
+
+  for (ml_result_cache_entry_s &entry : cache->entries)
+    ml_alloc_free (entry.buffer);
+
+  cache->entries.clear ();
+  cache->index.clear ();
+}
+
+void
+ml_result_cache_get_stats (ml_result_cache_s *cache, ml_result_cache_stats_s *stats)
+{
+  g_return_if_fail (cache != NULL && stats != NULL);
+
+  std::lock_guard<std::mutex> guard (cache->lock);
+
+  stats->hits = cache->hits;
+  stats->misses = cache->misses;
+  stats->collisions = cache->collisions;
+  stats->evictions = cache->evictions;
+  stats->entries = (guint) cache->entries.size ();
+  stats->bytes = cache->entries.size () * cache->entry_size;
+}
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_RESULT_CACHE_H__
+#define __HAL_BACKEND_ML_RESULT_CACHE_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Configuration of the result cache, usually parsed from the custom properties.
+ */
+typedef struct {
+  guint max_entries; /**< Max number of cached results, 0 for no cache */
+  gsize max_bytes; /**< Max memory of the cached outputs, 0 for no limit besides max_entries */
+  guint stats_interval; /**< Log the counters every N lookups, 0 for never */
+} ml_result_cache_config_s;
+
+/**
+ * @brief Statistics of the result cache.
+ */
+typedef struct {
+  guint64 hits;
+  guint64 misses;
+  guint64 collisions; /**< Misses of the inputs with the key of another cached result */
+  guint64 evictions;
+  guint entries; /**< Number of cached results */
+  gsize bytes; /**< Memory of the cached results, the outputs and their inputs */
+} ml_result_cache_stats_s;
+
+/**
+ * @brief LRU cache of the outputs of a backend, keyed by the content of the inputs.
+ *
+ * For fixed cameras and static scenes, the same inputs give the same outputs, so a hit
+ * copies the cached outputs and skips the accelerator. The key is ml_hash_data() of all input
+ * tensors, and the inputs are kept with the outputs, so a hit is verified byte by byte and only
+ * byte-identical inputs hit even if the key collides. A lookup reads the inputs once on a miss
+ * and twice on a hit. All outputs and inputs of a result are kept in one buffer, and the buffer
+ * of the least recently used result is reused for a new one. Thread-safe.
+ */
+typedef struct _ml_result_cache_s ml_result_cache_s;
+
+/**
+ * @brief Initialize the configuration, no cache.
+ */
+void ml_result_cache_config_init (ml_result_cache_config_s *config);
+
+/**
+ * @brief Parse a size in bytes with an optional K, M or G suffix, e.g. "64M".
+ */
+gboolean ml_result_cache_parse_size (const gchar *str, gsize *size);
+
+/**
+ * @brief Check if the configuration asks for the cache.
+ */
+gboolean ml_result_cache_config_is_enabled (const ml_result_cache_config_s *config);
+
+/**
+ * @brief Create the result cache of a backend.
+ * @param input_info The input tensors of invoke.
+ * @param output_info The output tensors of invoke.
+ * @return The cache, NULL if the memory limit is smaller than a result.
+ */
+ml_result_cache_s *ml_result_cache_new (const ml_result_cache_config_s *config,
+    const ml_tensors_info_s *input_info, const ml_tensors_info_s *output_info);
+
+/**
+ * @brief Free the cache and the cached results.
+ */
+void ml_result_cache_free (ml_result_cache_s *cache);
+
+/**
+ * @brief Look up the result of the inputs. On a hit, the cached outputs are copied to the output buffers.
+ * @param key The key of the inputs, to insert the result after a miss.
+ * @return TRUE on a hit.
+ */
+gboolean ml_result_cache_lookup (ml_result_cache_s *cache, const GstTensorMemory *input,
+    GstTensorMemory *output, guint64 *key);
+
+/**
+ * @brief Insert the outputs of the inputs with the key, evicting the least recently used result if full.
+ * @param input The inputs of the lookup, kept to verify the hits.
+ */
+void ml_result_cache_insert (ml_result_cache_s *cache, guint64 key, const GstTensorMemory *input,
+    const GstTensorMemory *output);
+
+/**
+ * @brief Drop all cached results. The counters are kept.
+ */
+void ml_result_cache_clear (ml_result_cache_s *cache);
+
+/**
+ * @brief Get the statistics of the cache.
+ */
+void ml_result_cache_get_stats (ml_result_cache_s *cache, ml_result_cache_stats_s *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_RESULT_CACHE_H__ */
@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-roi.h"
+
+/** @brief Horizontal weights are 7 bits, so a weighted pixel fits in int16. */
+#define ROI_X_ONE (128U)
+
+/** @brief Vertical weights are 15 bits, the same for the unsigned SSE2 and the signed NEON high multiply. */
+#define ROI_Y_ONE (32768U)
+
+struct _ml_roi_s {
+  tensor_dim input_dimension; /* the frame */
+  gsize planes; /* channels of a channel-first input, 1 otherwise */
+  gsize pixel_values; /* values of a pixel of a plane */
+  gsize width;
+  gsize height;
+  gsize batch;
+  gsize frame_width;
+  gsize frame_height;
+  std::vector<gsize> x0; /* left source pixel of each column of the ROI */
+  std::vector<gsize> x1; /* right source pixel of each column of the ROI */
+  std::vector<guint16> wx; /* weight of the right source pixel */
+  std::vector<guint16> rows[2]; /* two source rows resized horizontally */
+  void *buffer;
+};
+
+void
+ml_roi_config_init (ml_roi_config_s *config)
+{
+  g_return_if_fail (config != NULL);
+
+  memset (config, 0, sizeof (*config));
+}
+
+gboolean
+ml_roi_config_is_enabled (const ml_roi_config_s *config)
+{
+  return (config && config->width > 0 && config->height > 0);
+}
+
+ml_roi_s *
+ml_roi_new (const ml_roi_config_s *config, tensor_layout model_layout,
+    const GstTensorInfo *info, tensor_layout layout)
+{
+  ml_roi_s *roi;
+  const uint32_t *dim;
+  gsize channels, width, height, batch = 1;
+  guint w;
+
+  g_return_val_if_fail (config != NULL && info != NULL, NULL);
+
+  if (!ml_roi_config_is_enabled (config))
+    return NULL;
+
+  if (layout == _NNS_LAYOUT_ANY || layout == _NNS_LAYOUT_NONE)
+    layout = model_layout;
+
+  if (info->type != _NNS_UINT8) {
+    g_critical ("[roi] The batched input should be uint8 (%d).", (int) info->type);
+    return NULL;
+  }
+
+  dim = info->dimension;
+  if (dim[0] == 0 || dim[1] == 0 || dim[2] == 0) {
+    g_critical ("[roi] The batched input should be an image.");
+    return NULL;
+  }
+
+  if (layout == _NNS_LAYOUT_NCHW) {
+    width = dim[0];
+    height = dim[1];
+    channels = dim[2];
+  } else {
+    channels = dim[0];
+    width = dim[1];
+    height = dim[2];
+  }
+
+  for (guint i = 3; i < NNS_TENSOR_RANK_LIMIT && dim[i] > 0; i++)
+    batch *= dim[i];
+
+  roi = new ml_roi_s ();
+  roi->width = width;
+  roi->height = height;
+  roi->batch = batch;
+  roi->frame_width = config->width;
+  roi->frame_height = config->height;
+  if (layout == _NNS_LAYOUT_NCHW) {
+    roi->planes = channels;
+    roi->pixel_values = 1;
+  } else {
+    roi->planes = 1;
+    roi->pixel_values = channels;
+  }
+
+  roi->x0.resize (width);
+  roi->x1.resize (width);
+  roi->wx.resize (width);
+  roi->rows[0].resize (width * roi->pixel_values);
+  roi->rows[1].resize (width * roi->pixel_values);
+
+  /* The frame is the batched input with the frame size and one batch. */
+  memset (roi->input_dimension, 0, sizeof (tensor_dim));
+  w = (layout == _NNS_LAYOUT_NCHW) ? 0 : 1;
+  roi->input_dimension[w] = config->width;
+  roi->input_dimension[w + 1] = config->height;
+  roi->input_dimension[(layout == _NNS_LAYOUT_NCHW) ? 2 : 0] = (uint32_t) channels;
+  roi->input_dimension[3] = 1;
+
+  roi->buffer = ml_alloc (gst_tensor_info_get_size (info), ML_ALLOC_FLAG_NONE, NULL);
+  if (!roi->buffer) {
+    g_critical ("[roi] Failed to allocate the buffer of the batched input.");
+    ml_roi_free (roi);
+    return NULL;
+  }
+
+  return roi;
+}
+
+void
+ml_roi_free (ml_roi_s *roi)
+{
+  if (!roi)
+    return;
+
+  ml_alloc_free (roi->buffer);
+  delete roi;
+}
+
+guint
+ml_roi_get_batch (const ml_roi_s *roi)
+{
+  g_return_val_if_fail (roi != NULL, 0);
+
+  return (guint) roi->batch;
+}
+
+void
+ml_roi_get_input_info (const ml_roi_s *roi, GstTensorInfo *info)
+{
+  g_return_if_fail (roi != NULL && info != NULL);
+
+  memcpy (info->dimension, roi->input_dimension, sizeof (tensor_dim));
+}
+
+void
+ml_roi_get_boxes_info (const ml_roi_s *roi, GstTensorInfo *info)
+{
+  g_return_if_fail (roi != NULL && info != NULL);
+
+  info->type = _NNS_FLOAT32;
+  memset (info->dimension, 0, sizeof (tensor_dim));
+  info->dimension[0] = ML_ROI_VALUES;
+  info->dimension[1] = (uint32_t) roi->batch;
+}
+
+void *
+ml_roi_get_buffer (const ml_roi_s *roi)
+{
+  g_return_val_if_fail (roi != NULL, NULL);
+
+  return roi->buffer;
+}
+
+/**
+ * @brief Source pixel of a destination pixel, sampled at the pixel centers and clamped to the frame.
+ * @return The fraction of the distance to the next source pixel.
+ */
+static inline float
+_roi_map (gsize i, float begin, float scale, gsize frame, gsize *index)
+{
+  float s = begin + ((float) i + 0.5f) * scale - 0.5f;
+  float f;
+
+  s = CLAMP (s, 0.0f, (float) (frame - 1));
+  f = floorf (s);
+  *index = (gsize) f;
+
+  return s - f;
+}
+
+/** @brief Resize a source row horizontally, weighted values of 15 bits. */
+static void
+_roi_resize_row (const ml_roi_s *roi, guint16 *dest, const guint8 *src)
+{
+  const gsize n = roi->pixel_values;
+
+  for (gsize x = 0; x < roi->width; x++) {
+    const guint8 *a = src + roi->x0[x] * n;
+    const guint8 *b = src + roi->x1[x] * n;
+    const guint w = roi->wx[x];
+
+    for (gsize c = 0; c < n; c++)
+      dest[x * n + c] = (guint16) (a[c] * (ROI_X_ONE - w) + b[c] * w);
+  }
+}
+
+/** @brief Blend two horizontally resized rows into a row of the ROI. */
+static void
+_roi_blend_rows (guint8 *dest, const guint16 *r0, const guint16 *r1, guint w1, gsize n)
+{
+  const guint w0 = ROI_Y_ONE - w1;
+  gsize i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  /* vqdmulh doubles the product, so the weights are halved to fit in int16. */
+  const int16x8_t f0 = vdupq_n_s16 ((int16_t) (w0 / 2));
+  const int16x8_t f1 = vdupq_n_s16 ((int16_t) (w1 / 2));
+
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t a = vqdmulhq_s16 (vreinterpretq_s16_u16 (vld1q_u16 (r0 + i)), f0);
+    int16x8_t b = vqdmulhq_s16 (vreinterpretq_s16_u16 (vld1q_u16 (r1 + i)), f1);
+    uint16x8_t s = vrshrq_n_u16 (vreinterpretq_u16_s16 (vaddq_s16 (a, b)), 6);
+
+    vst1_u8 (dest + i, vqmovn_u16 (s));
+  }
+#elif defined(__SSE2__)
+  const __m128i f0 = _mm_set1_epi16 ((short) w0);
+  const __m128i f1 = _mm_set1_epi16 ((short) w1);
+  const __m128i half = _mm_set1_epi16 (32);
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_mulhi_epu16 (_mm_loadu_si128 ((const __m128i *) (r0 + i)), f0);
+    __m128i b = _mm_mulhi_epu16 (_mm_loadu_si128 ((const __m128i *) (r1 + i)), f1);
+    __m128i s = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (a, b), half), 6);
+
+    _mm_storel_epi64 ((__m128i *) (dest + i), _mm_packus_epi16 (s, s));
+  }
+#endif
+
+  for (; i < n; i++) {
+    guint s = ((r0[i] * w0) >> 16) + ((r1[i] * w1) >> 16);
+
+    dest[i] = (guint8) MIN ((s + 32) >> 6, 255U);
+  }
+}
+
+/** @brief Crop and resize a ROI of each plane, the rows of the frame are resized once. */
+static void
+_roi_resize (ml_roi_s *roi, guint8 *dest, const guint8 *frame, float top, float scale_y)
+{
+  const gsize src_row = roi->frame_width * roi->pixel_values;
+  const gsize dest_row = roi->width * roi->pixel_values;
+
+  for (gsize p = 0; p < roi->planes; p++) {
+    const guint8 *src = frame + p * src_row * roi->frame_height;
+    guint16 *rows[2] = { roi->rows[0].data (), roi->rows[1].data () };
+    gssize cached[2] = { -1, -1 };
+
+    for (gsize y = 0; y < roi->height; y++) {
+      gsize y0, y1;
+      float f = _roi_map (y, top, scale_y, roi->frame_height, &y0);
+      guint w1 = (guint) lrintf (f * (ROI_Y_ONE / 2)) * 2;
+
+      y1 = MIN (y0 + 1, roi->frame_height - 1);
+
+      if (cached[0] != (gssize) y0) {
+        if (cached[1] == (gssize) y0) {
+          std::swap (rows[0], rows[1]);
+          std::swap (cached[0], cached[1]);
+        } else {
+          _roi_resize_row (roi, rows[0], src + y0 * src_row);
+          cached[0] = (gssize) y0;
+        }
+      }
+
+      if (cached[1] != (gssize) y1) {
+        _roi_resize_row (roi, rows[1], src + y1 * src_row);
+        cached[1] = (gssize) y1;
+      }
+
+      _roi_blend_rows (dest + (p * roi->height + y) * dest_row, rows[0], rows[1], w1, dest_row);
+    }
+  }
+}
+
+guint
+ml_roi_run (ml_roi_s *roi, void *dest, const void *frame, const void *boxes)
+{
+  const float *box = (const float *) boxes;
+  gsize size;
+  guint count = 0;
+
+  g_return_val_if_fail (roi != NULL && dest != NULL && frame != NULL && boxes != NULL, 0);
+
+  size = roi->width * roi->height * roi->pixel_values * roi->planes;
+
+  for (gsize b = 0; b < roi->batch; b++, box += ML_ROI_VALUES) {
+    guint8 *d = (guint8 *) dest + b * size;
+    float left = CLAMP (box[0], 0.0f, (float) roi->frame_width);
+    float top = CLAMP (box[1], 0.0f, (float) roi->frame_height);
+    float right = CLAMP (box[2], 0.0f, (float) roi->frame_width);
+    float bottom = CLAMP (box[3], 0.0f, (float) roi->frame_height);
+    float scale_x, scale_y;
+
+    /* Also true for NaN */
+    if (!(right > left) || !(bottom > top)) {
+      memset (d, 0, size);
+      continue;
+    }
+
+    scale_x = (right - left) / (float) roi->width;
+    scale_y = (bottom - top) / (float) roi->height;
+
+    for (gsize x = 0; x < roi->width; x++) {
+      float f = _roi_map (x, left, scale_x, roi->frame_width, &roi->x0[x]);
+
+      roi->x1[x] = MIN (roi->x0[x] + 1, roi->frame_width - 1);
+      roi->wx[x] = (guint16) lrintf (f * ROI_X_ONE);
+    }
+
+    _roi_resize (roi, d, (const guint8 *) frame, top, scale_y);
+    count++;
+  }
+
+  return count;
+}
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_ROI_H__
+#define __HAL_BACKEND_ML_ROI_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Number of values of a ROI, x1, y1, x2 and y2. */
+#define ML_ROI_VALUES (4U)
+
+/**
+ * @brief Configuration of the ROI batch, usually parsed from the custom properties.
+ */
+typedef struct {
+  guint input_index; /**< Index of the batched input tensor */
+  guint width; /**< Width of the frame, 0 for no ROI batch */
+  guint height; /**< Height of the frame, 0 for no ROI batch */
+} ml_roi_config_s;
+
+/**
+ * @brief ROI batch of a backend.
+ *
+ * Assembles the batched input of a second-stage model from a frame and a list of ROIs, so
+ * the model runs once for all the ROIs of a frame. Each ROI is cropped and resized with
+ * bilinear interpolation to the model input size, straight into its batch of the input.
+ * The horizontal pass is a table of source pixels and weights for the ROI, and the vertical
+ * pass blends two rows with SSE2 or NEON.
+ *
+ * The input is uint8, [C, W, H, B] in a channel-last layout or [W, H, C, B] in NCHW, and the
+ * frame is the same with the frame size and one batch. The ROIs are float32 [4, B], the corners
+ * x1, y1, x2 and y2 of each ROI in the pixels of the frame, e.g. the detections of the first
+ * stage. A ROI is clipped to the frame, and its batch is zero-filled if it is empty, so fewer
+ * ROIs than the batch are padded with empty ones. The outputs of the model are per ROI, in the
+ * order of the batch.
+ */
+typedef struct _ml_roi_s ml_roi_s;
+
+/**
+ * @brief Initialize the configuration, no ROI batch.
+ */
+void ml_roi_config_init (ml_roi_config_s *config);
+
+/**
+ * @brief Check if the configuration asks for the ROI batch.
+ */
+gboolean ml_roi_config_is_enabled (const ml_roi_config_s *config);
+
+/**
+ * @brief Create the ROI batch of the model input.
+ * @param model_layout The native layout of the model.
+ * @param info The batched input tensor.
+ * @param layout Layout of the input tensor. ANY or NONE is the same as the model.
+ * @return The ROI batch, NULL if the configuration does not match the tensor.
+ */
+ml_roi_s *ml_roi_new (const ml_roi_config_s *config, tensor_layout model_layout,
+    const GstTensorInfo *info, tensor_layout layout);
+
+/**
+ * @brief Free the ROI batch and its buffers.
+ */
+void ml_roi_free (ml_roi_s *roi);
+
+/**
+ * @brief Get the number of ROIs of the batch.
+ */
+guint ml_roi_get_batch (const ml_roi_s *roi);
+
+/**
+ * @brief Set the dimension of the frame to the tensor info. The type and name are kept.
+ */
+void ml_roi_get_input_info (const ml_roi_s *roi, GstTensorInfo *info);
+
+/**
+ * @brief Set the type and dimension of the ROIs to the tensor info. The name is kept.
+ */
+void ml_roi_get_boxes_info (const ml_roi_s *roi, GstTensorInfo *info);
+
+/**
+ * @brief Get the buffer for the batched input.
+ */
+void *ml_roi_get_buffer (const ml_roi_s *roi);
+
+/**
+ * @brief Crop and resize the ROIs of the frame into the batched input.
+ * @param boxes float32 [4, B].
+ * @return The number of ROIs which are not empty.
+ * @note The buffers must not overlap.
+ */
+guint ml_roi_run (ml_roi_s *roi, void *dest, const void *frame, const void *boxes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_ROI_H__ */
@@ -2,7 +2,10 @@
 
 #include <fstream>
 #include <glib.h>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 #include <hal-common-interface.h>
@@ -19,28 +22,88 @@
 #include <SNPE/SNPEBuilder.h>
 #include <SNPE/SNPEUtil.h>
 
+#include "hal-backend-ml-buffer-pool.h"
+#include "hal-backend-ml-detect.h"
+#include "hal-backend-ml-layout.h"
+#include "hal-backend-ml-postproc.h"
+#include "hal-backend-ml-preproc.h"
+#include "hal-backend-ml-trace.h"
 #include "hal-backend-ml-util.h"
 
 
 struct snpe_handle_s {
   char *model_path;
-  GstTensorsInfo inputInfo; /**< Input tensors metadata */
-  GstTensorsInfo outputInfo; /**< Output tensors metadata */
+  ml_tensors_info_s inputInfo; /**< Input tensors metadata */
+  ml_tensors_info_s outputInfo; /**< Output tensors metadata */
 
   Snpe_SNPE_Handle_t snpe_h;
   Snpe_UserBufferMap_Handle_t inputMap_h;
   Snpe_UserBufferMap_Handle_t outputMap_h;
   std::vector<Snpe_IUserBuffer_Handle_t> user_buffers;
+  ml_model_info_s *model_info; /**< Model info shared with the callers of get_model_info */
+  ml_layout_stage_s *input_layout; /**< NHWC to the input layout of the pipeline, NULL if not needed */
+  ml_layout_stage_s *output_layout; /**< NHWC to the output layout of the pipeline, NULL if not needed */
+  ml_preproc_s *preproc; /**< Raw uint8 frame to the model input, NULL if not needed */
+  guint preproc_index; /**< Index of the preprocessed input */
+  ml_postproc_s *postproc; /**< Model output to the class indices, NULL if not needed */
+  guint postproc_index; /**< Index of the post-processed output */
+  ml_detect_s *detect; /**< Box and score outputs to the detections, NULL if not needed */
+  guint detect_box_index; /**< Index of the box output, the detections */
+  guint detect_score_index; /**< Index of the score output, the number of detections */
+  gchar *anchors_path; /**< Anchors file of the SSD detection */
+
+  bool use_output_pool; /**< Allocate the output buffers in invoke (allocate_in_invoke) */
+  ml_buffer_pool_s *output_pool; /**< Kept until the last output is released, outputs may be still in use after reconfigure and deinit */
+
+  std::mutex lock; /**< Held by invoke, RELOAD_MODEL swaps the model between invokes */
+  gchar *reload_custom_properties; /**< Custom properties of the last configure, for the reloaded model */
+  tensors_layout reload_input_layout; /**< Input layout of the last configure */
+  tensors_layout reload_output_layout; /**< Output layout of the last configure */
 
   snpe_handle_s ()
       : model_path (nullptr), snpe_h (nullptr), inputMap_h (nullptr),
-        outputMap_h (nullptr)
+        outputMap_h (nullptr), model_info (nullptr), input_layout (nullptr),
+        output_layout (nullptr), preproc (nullptr), preproc_index (0),
+        postproc (nullptr), postproc_index (0), detect (nullptr), detect_box_index (0),
+        detect_score_index (0), anchors_path (nullptr), use_output_pool (false),
+        reload_custom_properties (nullptr)
   {
-    gst_tensors_info_init (&inputInfo);
-    gst_tensors_info_init (&outputInfo);
+    ml_tensors_info_init (&inputInfo);
+    ml_tensors_info_init (&outputInfo);
+    output_pool = ml_buffer_pool_new (ML_BUFFER_POOL_DEFAULT_MAX_CACHED);
+    memset (reload_input_layout, 0, sizeof (tensors_layout));
+    memset (reload_output_layout, 0, sizeof (tensors_layout));
   }
 
-  ~snpe_handle_s () { clear (); }
+  ~snpe_handle_s ()
+  {
+    clear ();
+    ml_buffer_pool_free (output_pool);
+    g_free (reload_custom_properties);
+  }
+
+  /** @brief Swap the models. The output pool and the properties of the last configure are kept. */
+  void swap_model (snpe_handle_s &other)
+  {
+    std::swap (model_path, other.model_path);
+    std::swap (inputInfo, other.inputInfo);
+    std::swap (outputInfo, other.outputInfo);
+    std::swap (snpe_h, other.snpe_h);
+    std::swap (inputMap_h, other.inputMap_h);
+    std::swap (outputMap_h, other.outputMap_h);
+    std::swap (user_buffers, other.user_buffers);
+    std::swap (model_info, other.model_info);
+    std::swap (input_layout, other.input_layout);
+    std::swap (output_layout, other.output_layout);
+    std::swap (preproc, other.preproc);
+    std::swap (preproc_index, other.preproc_index);
+    std::swap (postproc, other.postproc);
+    std::swap (postproc_index, other.postproc_index);
+    std::swap (detect, other.detect);
+    std::swap (detect_box_index, other.detect_box_index);
+    std::swap (detect_score_index, other.detect_score_index);
+    std::swap (anchors_path, other.anchors_path);
+  }
 
   void clear ()
   {
@@ -59,14 +122,33 @@ struct snpe_handle_s {
 
     g_free (model_path);
 
-    gst_tensors_info_free (&inputInfo);
-    gst_tensors_info_free (&outputInfo);
+    ml_tensors_info_free (&inputInfo);
+    ml_tensors_info_free (&outputInfo);
+    ml_model_info_unref (model_info);
+    ml_layout_stage_free (input_layout);
+    ml_layout_stage_free (output_layout);
+    ml_preproc_free (preproc);
+    ml_postproc_free (postproc);
+    ml_detect_free (detect);
+    g_free (anchors_path);
 
     /* Reset to default */
     model_path = nullptr;
     snpe_h = nullptr;
     inputMap_h = nullptr;
     outputMap_h = nullptr;
+    model_info = nullptr;
+    input_layout = nullptr;
+    output_layout = nullptr;
+    preproc = nullptr;
+    preproc_index = 0;
+    postproc = nullptr;
+    postproc_index = 0;
+    detect = nullptr;
+    detect_box_index = 0;
+    detect_score_index = 0;
+    anchors_path = nullptr;
+    use_output_pool = false;
   }
 };
 
@@ -90,6 +172,20 @@ _trim_string (const std::string &str)
   return str.substr (start, end - start + 1);
 }
 
+/** @brief Get the TF8 encoding of a tensor, real = (q - stepExactly0) * quantizedStepSize. */
+static void
+_get_tf8_params (snpe_handle_s *snpe, const char *name, float *scale, gint32 *zero_point)
+{
+  Snpe_IBufferAttributes_Handle_t bufferAttributesOpt
+      = Snpe_SNPE_GetInputOutputBufferAttributes (snpe->snpe_h, name);
+  Snpe_UserBufferEncoding_Handle_t ubeTfNHandle
+      = Snpe_IBufferAttributes_GetEncoding_Ref (bufferAttributesOpt);
+
+  *zero_point = (gint32) Snpe_UserBufferEncodingTfN_GetStepExactly0 (ubeTfNHandle);
+  *scale = Snpe_UserBufferEncodingTfN_GetQuantizedStepSize (ubeTfNHandle);
+  Snpe_IBufferAttributes_Delete (bufferAttributesOpt);
+}
+
 /** @brief Set the environment variable. */
 static void
 set_environment_var_adsp ()
@@ -134,6 +230,16 @@ ml_snpe_init (void **backend_private)
   return HAL_ML_ERROR_NONE;
 }
 
+/** @brief Deletes the handle once the last output of the pool is released. */
+static void
+_snpe_handle_delete (gpointer data)
+{
+  snpe_handle_s *snpe = (snpe_handle_s *) data;
+
+  snpe->output_pool = nullptr; /* freed already */
+  delete snpe;
+}
+
 static int
 ml_snpe_deinit (void *backend_private)
 {
@@ -144,7 +250,9 @@ ml_snpe_deinit (void *backend_private)
     return HAL_ML_ERROR_INVALID_PARAMETER;
   }
 
-  delete snpe;
+  /* DESTROY_NOTIFY of the outputs still in use needs the handle. */
+  snpe->clear ();
+  ml_buffer_pool_free_full (snpe->output_pool, _snpe_handle_delete, snpe);
 
   return HAL_ML_ERROR_NONE;
 }
@@ -160,11 +268,19 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
     return HAL_ML_ERROR_INVALID_PARAMETER;
   }
 
+  ML_TRACE_SCOPE ("snpe:configure_instance");
+
   if (snpe->model_path) {
     g_critical ("[snpe backend] invalid state, clear old data.");
     snpe->clear ();
   }
 
+  /* RELOAD_MODEL builds the new model with the same properties. */
+  g_free (snpe->reload_custom_properties);
+  snpe->reload_custom_properties = g_strdup (prop->custom_properties);
+  memcpy (snpe->reload_input_layout, prop->input_layout, sizeof (tensors_layout));
+  memcpy (snpe->reload_output_layout, prop->output_layout, sizeof (tensors_layout));
+
   snpe->model_path = g_strdup (prop->model_files[0]);
 
   Snpe_DlVersion_Handle_t lib_version_h = NULL;
@@ -175,6 +291,14 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
   Snpe_StringList_Handle_t outputstrListHandle = NULL;
   std::vector<Snpe_UserBufferEncoding_ElementType_t> inputTypeVec;
   std::vector<Snpe_UserBufferEncoding_ElementType_t> outputTypeVec;
+  ml_preproc_config_s preproc_config;
+  ml_postproc_config_s postproc_config;
+  ml_detect_config_s detect_config;
+  tensors_layout input_layout, output_layout;
+
+  ml_preproc_config_init (&preproc_config);
+  ml_postproc_config_init (&postproc_config);
+  ml_detect_config_init (&detect_config);
 
   auto _clean_handles = [&] () {
     if (lib_version_h)
@@ -283,8 +407,9 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
     Snpe_UserBufferMap_Add (bufferMapHandle, tensorName, iub);
   };
 
-  auto parse_custom_prop = [&runtime, &outputstrListHandle, &inputTypeVec,
-                               &outputTypeVec, &perfProfile] (const char *custom_prop) {
+  auto parse_custom_prop = [snpe, &runtime, &outputstrListHandle, &inputTypeVec, &outputTypeVec,
+                               &perfProfile, &preproc_config, &postproc_config,
+                               &detect_config] (const char *custom_prop) {
     if (!custom_prop)
       return;
 
@@ -386,6 +511,54 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
 
           if (_valid)
             g_info ("Set performance profile to %s", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "OutputPool") == 0) {
+          snpe->use_output_pool = (g_ascii_strcasecmp (option[1], "true") == 0);
+        } else if (g_ascii_strcasecmp (option[0], "InputMean") == 0) {
+          if (!ml_preproc_parse_values (option[1], preproc_config.mean, &preproc_config.num_mean))
+            g_warning ("Ignore invalid input mean (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "InputStd") == 0) {
+          if (!ml_preproc_parse_values (option[1], preproc_config.std, &preproc_config.num_std))
+            g_warning ("Ignore invalid input std (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "PreprocessInput") == 0) {
+          preproc_config.input_index = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "InputFormat") == 0) {
+          if (!ml_preproc_parse_format (option[1], &preproc_config.format))
+            g_warning ("Ignore unknown input format (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "InputSize") == 0) {
+          if (!ml_preproc_parse_size (option[1], &preproc_config.width, &preproc_config.height))
+            g_warning ("Ignore invalid input size (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "PostProcess") == 0) {
+          /* the post-processing string may contain ':' */
+          gchar *_pp_str = g_strjoinv (":", &option[1]);
+          if (!ml_postproc_parse (_pp_str, &postproc_config))
+            g_warning ("Ignore invalid post-processing (%s).", _pp_str);
+          g_free (_pp_str);
+        } else if (g_ascii_strcasecmp (option[0], "PostProcessOutput") == 0) {
+          postproc_config.output_index = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "Detection") == 0) {
+          if (!ml_detect_parse_box_type (option[1], &detect_config.box_type))
+            g_warning ("Ignore unknown box type of the detection (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "DetectionOutputs") == 0) {
+          gchar **indices = g_strsplit (option[1], ";", -1);
+          if (g_strv_length (indices) == 2) {
+            detect_config.box_index = (guint) g_ascii_strtoull (indices[0], NULL, 10);
+            detect_config.score_index = (guint) g_ascii_strtoull (indices[1], NULL, 10);
+          } else {
+            g_warning ("Ignore invalid outputs of the detection (%s).", option[1]);
+          }
+          g_strfreev (indices);
+        } else if (g_ascii_strcasecmp (option[0], "ScoreThreshold") == 0) {
+          detect_config.score_threshold = (float) g_ascii_strtod (option[1], NULL);
+        } else if (g_ascii_strcasecmp (option[0], "IouThreshold") == 0) {
+          detect_config.iou_threshold = (float) g_ascii_strtod (option[1], NULL);
+        } else if (g_ascii_strcasecmp (option[0], "MaxDetections") == 0) {
+          detect_config.max_detections = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "BackgroundClass") == 0) {
+          detect_config.background_class = (gint) g_ascii_strtoll (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "Anchors") == 0) {
+          g_free (snpe->anchors_path);
+          snpe->anchors_path = g_strdup (option[1]);
+          detect_config.anchors_path = snpe->anchors_path;
         } else {
           g_warning ("Unknown option (%s).", options[op]);
         }
@@ -435,7 +608,9 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
       throw std::invalid_argument (err_msg);
     }
 
+    ML_TRACE_BEGIN ("snpe:open_container");
     container_h = Snpe_DlContainer_Open (snpe->model_path);
+    ML_TRACE_END ("snpe:open_container");
     if (!container_h)
       throw std::runtime_error (
           "Failed to open the model file " + std::string (snpe->model_path));
@@ -463,20 +638,24 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
     if (Snpe_SNPEBuilder_SetPerformanceProfile (snpebuilder_h, perfProfile) != SNPE_SUCCESS)
       throw std::runtime_error ("Failed to set performance profile");
 
+    ML_TRACE_BEGIN ("snpe:builder_build");
     snpe->snpe_h = Snpe_SNPEBuilder_Build (snpebuilder_h);
+    ML_TRACE_END ("snpe:builder_build");
     if (!snpe->snpe_h)
       throw std::runtime_error ("Failed to build SNPE handle");
 
     /* set inputTensorsInfo and inputMap */
+    ML_TRACE_SCOPE ("snpe:setup_user_buffers");
     snpe->inputMap_h = Snpe_UserBufferMap_Create ();
     inputstrListHandle = Snpe_SNPE_GetInputTensorNames (snpe->snpe_h);
     if (!snpe->inputMap_h || !inputstrListHandle)
       throw std::runtime_error ("Error while setting Input tensors");
 
-    snpe->inputInfo.num_tensors = Snpe_StringList_Size (inputstrListHandle);
+    if (!ml_tensors_info_alloc (&snpe->inputInfo, Snpe_StringList_Size (inputstrListHandle)))
+      throw std::runtime_error ("Invalid number of input tensors");
     for (size_t i = 0; i < snpe->inputInfo.num_tensors; i++) {
       GstTensorInfo *info
-          = gst_tensors_info_get_nth_info (std::addressof (snpe->inputInfo), i);
+          = ml_tensors_info_get_nth_info (std::addressof (snpe->inputInfo), i);
       const char *inputName = Snpe_StringList_At (inputstrListHandle, i);
       info->name = g_strdup (inputName);
 
@@ -498,10 +677,11 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
     if (!snpe->outputMap_h || !outputstrListHandle)
       throw std::runtime_error ("Error while setting Output tensors");
 
-    snpe->outputInfo.num_tensors = Snpe_StringList_Size (outputstrListHandle);
+    if (!ml_tensors_info_alloc (&snpe->outputInfo, Snpe_StringList_Size (outputstrListHandle)))
+      throw std::runtime_error ("Invalid number of output tensors");
     for (size_t i = 0; i < snpe->outputInfo.num_tensors; i++) {
       GstTensorInfo *info
-          = gst_tensors_info_get_nth_info (std::addressof (snpe->outputInfo), i);
+          = ml_tensors_info_get_nth_info (std::addressof (snpe->outputInfo), i);
       const char *outputName = Snpe_StringList_At (outputstrListHandle, i);
       info->name = g_strdup (outputName);
 
@@ -513,6 +693,91 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
       handleTensor (outputName, info, snpe->outputMap_h, outputType);
     }
 
+    memcpy (input_layout, prop->input_layout, sizeof (tensors_layout));
+
+    /* Normalize and quantize the raw frame into the user buffer of the input */
+    if (ml_preproc_config_is_enabled (&preproc_config)) {
+      guint index = preproc_config.input_index;
+      GstTensorInfo *info = ml_tensors_info_get_nth_info (&snpe->inputInfo, index);
+
+      if (!info)
+        throw std::invalid_argument ("Invalid index of the preprocessed input");
+
+      if (info->type == _NNS_UINT8) {
+        preproc_config.quantized = TRUE;
+        _get_tf8_params (snpe, info->name, &preproc_config.scale, &preproc_config.zero_point);
+      }
+
+      snpe->preproc_index = index;
+      snpe->preproc = ml_preproc_new (&preproc_config, info, _NNS_LAYOUT_NHWC, input_layout[index]);
+      if (!snpe->preproc)
+        throw std::invalid_argument ("Failed to set up the input preprocessing");
+
+      ml_preproc_get_input_info (snpe->preproc, info);
+      input_layout[index] = _NNS_LAYOUT_ANY;
+    }
+
+    memcpy (output_layout, prop->output_layout, sizeof (tensors_layout));
+
+    /* Reduce the output into the class indices, the user buffer is the model output */
+    if (ml_postproc_config_is_enabled (&postproc_config)) {
+      guint index = postproc_config.output_index;
+      GstTensorInfo *info = ml_tensors_info_get_nth_info (&snpe->outputInfo, index);
+
+      if (!info)
+        throw std::invalid_argument ("Invalid index of the post-processed output");
+
+      snpe->postproc_index = index;
+      snpe->postproc = ml_postproc_new (&postproc_config, info);
+      if (!snpe->postproc)
+        throw std::invalid_argument ("Failed to set up the output post-processing");
+
+      ml_postproc_get_output_info (snpe->postproc, info);
+      output_layout[index] = _NNS_LAYOUT_ANY;
+    }
+
+    /* Decode the boxes and scores into the detections, the user buffers are the model outputs */
+    if (ml_detect_config_is_enabled (&detect_config)) {
+      guint box_index = detect_config.box_index;
+      guint score_index = detect_config.score_index;
+      GstTensorInfo *box_info = ml_tensors_info_get_nth_info (&snpe->outputInfo, box_index);
+      GstTensorInfo *score_info = ml_tensors_info_get_nth_info (&snpe->outputInfo, score_index);
+
+      if (!box_info || !score_info || box_index == score_index
+          || (snpe->postproc && (snpe->postproc_index == box_index
+                                    || snpe->postproc_index == score_index)))
+        throw std::invalid_argument ("Invalid outputs of the detection");
+
+      if (box_info->type == _NNS_UINT8) {
+        detect_config.box_quantized = TRUE;
+        _get_tf8_params (snpe, box_info->name, &detect_config.box_scale,
+            &detect_config.box_zero_point);
+      }
+
+      if (score_info->type == _NNS_UINT8) {
+        detect_config.score_quantized = TRUE;
+        _get_tf8_params (snpe, score_info->name, &detect_config.score_scale,
+            &detect_config.score_zero_point);
+      }
+
+      snpe->detect_box_index = box_index;
+      snpe->detect_score_index = score_index;
+      snpe->detect = ml_detect_new (&detect_config, box_info, score_info);
+      if (!snpe->detect)
+        throw std::invalid_argument ("Failed to set up the detection");
+
+      ml_detect_get_output_info (snpe->detect, box_info, score_info);
+      output_layout[box_index] = _NNS_LAYOUT_ANY;
+      output_layout[score_index] = _NNS_LAYOUT_ANY;
+    }
+
+    /* SNPE tensors are NHWC. Transform in invoke if the pipeline asks for NCHW. */
+    if (!ml_layout_stage_create (&snpe->inputInfo, _NNS_LAYOUT_NHWC,
+            input_layout, TRUE, &snpe->input_layout)
+        || !ml_layout_stage_create (&snpe->outputInfo, _NNS_LAYOUT_NHWC,
+            output_layout, FALSE, &snpe->output_layout))
+      throw std::runtime_error ("Failed to set up the layout transform");
+
     _clean_handles ();
   } catch (const std::exception &e) {
     _clean_handles ();
@@ -520,6 +785,8 @@ ml_snpe_configure_instance (void *backend_private, const void *prop_)
     return HAL_ML_ERROR_RUNTIME_ERROR;
   }
 
+  snpe->model_info = ml_model_info_new (&snpe->inputInfo, &snpe->outputInfo);
+
   return HAL_ML_ERROR_NONE;
 }
 
@@ -535,21 +802,75 @@ ml_snpe_invoke (void *backend_private, const void *input_, void *output_)
     return HAL_ML_ERROR_INVALID_PARAMETER;
   }
 
+  ML_TRACE_SCOPE ("snpe:invoke");
+
+  /* RELOAD_MODEL swaps the model between invokes. */
+  std::lock_guard<std::mutex> guard (snpe->lock);
+
+  if (snpe->use_output_pool
+      && !ml_buffer_pool_acquire_tensors (snpe->output_pool, &snpe->outputInfo, output)) {
+    g_critical ("[snpe backend] Failed to get the output buffers from the pool.");
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
+
+  ML_TRACE_BEGIN ("snpe:set_buffers");
   for (unsigned int i = 0; i < snpe->inputInfo.num_tensors; i++) {
     GstTensorInfo *info
-        = gst_tensors_info_get_nth_info (std::addressof (snpe->inputInfo), i);
+        = ml_tensors_info_get_nth_info (std::addressof (snpe->inputInfo), i);
     auto iub = Snpe_UserBufferMap_GetUserBuffer_Ref (snpe->inputMap_h, info->name);
-    Snpe_IUserBuffer_SetBufferAddress (iub, input[i].data);
+    const ml_layout_transform_s *layout = ml_layout_stage_get (snpe->input_layout, i);
+    void *data = input[i].data;
+
+    /* Zero-copy unless the input is preprocessed or the layout differs */
+    if (snpe->preproc && i == snpe->preproc_index) {
+      data = ml_preproc_get_buffer (snpe->preproc);
+      ml_preproc_run (snpe->preproc, data, input[i].data);
+    } else if (layout) {
+      data = ml_layout_stage_get_buffer (snpe->input_layout, i);
+      ml_layout_transform_run (layout, data, input[i].data);
+    }
+
+    Snpe_IUserBuffer_SetBufferAddress (iub, data);
   }
 
   for (unsigned int i = 0; i < snpe->outputInfo.num_tensors; i++) {
     GstTensorInfo *info
-        = gst_tensors_info_get_nth_info (std::addressof (snpe->outputInfo), i);
+        = ml_tensors_info_get_nth_info (std::addressof (snpe->outputInfo), i);
     auto iub = Snpe_UserBufferMap_GetUserBuffer_Ref (snpe->outputMap_h, info->name);
-    Snpe_IUserBuffer_SetBufferAddress (iub, output[i].data);
+    void *data = ml_layout_stage_get_buffer (snpe->output_layout, i);
+
+    if (snpe->postproc && i == snpe->postproc_index)
+      data = ml_postproc_get_buffer (snpe->postproc);
+    else if (snpe->detect && i == snpe->detect_box_index)
+      data = ml_detect_get_box_buffer (snpe->detect);
+    else if (snpe->detect && i == snpe->detect_score_index)
+      data = ml_detect_get_score_buffer (snpe->detect);
+
+    Snpe_IUserBuffer_SetBufferAddress (iub, data ? data : output[i].data);
   }
 
+  ML_TRACE_END ("snpe:set_buffers");
+
+  ML_TRACE_BEGIN ("snpe:execute");
   Snpe_SNPE_ExecuteUserBuffers (snpe->snpe_h, snpe->inputMap_h, snpe->outputMap_h);
+  ML_TRACE_END ("snpe:execute");
+
+  for (unsigned int i = 0; i < snpe->outputInfo.num_tensors; i++) {
+    const ml_layout_transform_s *layout = ml_layout_stage_get (snpe->output_layout, i);
+
+    if (snpe->postproc && i == snpe->postproc_index)
+      ml_postproc_run (snpe->postproc, output[i].data, ml_postproc_get_buffer (snpe->postproc));
+    else if (layout)
+      ml_layout_transform_run (layout, output[i].data,
+          ml_layout_stage_get_buffer (snpe->output_layout, i));
+  }
+
+  if (snpe->detect) {
+    ML_TRACE_SCOPE ("snpe:detect");
+    ml_detect_run (snpe->detect, output[snpe->detect_box_index].data,
+        output[snpe->detect_score_index].data, ml_detect_get_box_buffer (snpe->detect),
+        ml_detect_get_score_buffer (snpe->detect));
+  }
 
   return HAL_ML_ERROR_NONE;
 }
@@ -558,10 +879,11 @@ static int
 ml_snpe_get_framework_info (void *backend_private, void *fw_info)
 {
   GstTensorFilterFrameworkInfo *info = (GstTensorFilterFrameworkInfo *) fw_info;
+  snpe_handle_s *snpe = (snpe_handle_s *) backend_private;
 
   info->name = "snpe";
   info->allow_in_place = FALSE;
-  info->allocate_in_invoke = FALSE;
+  info->allocate_in_invoke = (snpe && snpe->use_output_pool) ? TRUE : FALSE;
   info->run_without_model = FALSE;
   info->verify_model_path = FALSE;
 
@@ -581,19 +903,101 @@ ml_snpe_get_model_info (void *backend_private, int ops_, void *in_info_, void *o
     return HAL_ML_ERROR_INVALID_PARAMETER;
   }
 
+  /* RELOAD_MODEL swaps the model and frees the old info. */
+  std::lock_guard<std::mutex> guard (snpe->lock);
+
   if (ops == GET_IN_OUT_INFO) {
-    gst_tensors_info_copy (in_info, &snpe->inputInfo);
-    gst_tensors_info_copy (out_info, &snpe->outputInfo);
+    ml_tensors_info_to_gst (in_info, &snpe->inputInfo);
+    ml_tensors_info_to_gst (out_info, &snpe->outputInfo);
 
     return HAL_ML_ERROR_NONE;
   }
 
+  if (ops == ML_GET_IN_OUT_INFO_BORROWED) {
+    if (!snpe->model_info || !in_info_) {
+      g_critical ("[snpe backend] The model info is not available.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    *(ml_model_info_s **) in_info_ = ml_model_info_ref (snpe->model_info);
+    return HAL_ML_ERROR_NONE;
+  }
+
   return HAL_ML_ERROR_NOT_SUPPORTED;
 }
 
+/**
+ * @brief Build the new model with the properties of the last configure while the current model
+ *        keeps running, and swap them between invokes. The inputs and outputs of the new model
+ *        should be the same, the caps of the pipeline are not negotiated again.
+ */
+static int
+_snpe_reload_model (snpe_handle_s *snpe, const GstTensorFilterFrameworkEventData *data)
+{
+  GstTensorFilterProperties prop;
+  int status;
+
+  if (!data || !data->model_files || data->num_models < 1 || !snpe->model_path) {
+    g_critical ("[snpe backend] Invalid model files to reload, or the model is not configured yet.");
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  memset (&prop, 0, sizeof (prop));
+  prop.model_files = data->model_files;
+  prop.num_models = data->num_models;
+  prop.custom_properties = snpe->reload_custom_properties;
+  memcpy (prop.input_layout, snpe->reload_input_layout, sizeof (tensors_layout));
+  memcpy (prop.output_layout, snpe->reload_output_layout, sizeof (tensors_layout));
+
+  /* The old model, or the new one if rejected, is released with this handle out of the lock. */
+  std::unique_ptr<snpe_handle_s> next (new snpe_handle_s ());
+
+  ML_TRACE_BEGIN ("snpe:reload");
+  status = ml_snpe_configure_instance (next.get (), &prop);
+  ML_TRACE_END ("snpe:reload");
+
+  if (status != HAL_ML_ERROR_NONE)
+    return status;
+
+  if (!ml_tensors_info_is_equal (&next->inputInfo, &snpe->inputInfo)
+      || !ml_tensors_info_is_equal (&next->outputInfo, &snpe->outputInfo)
+      || next->use_output_pool != snpe->use_output_pool) {
+    g_critical ("[snpe backend] The inputs or outputs of the new model %s are different, keep the current model.",
+        data->model_files[0]);
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard (snpe->lock);
+    snpe->swap_model (*next);
+  }
+
+  g_info ("[snpe backend] Reloaded the model %s.", snpe->model_path);
+  return HAL_ML_ERROR_NONE;
+}
+
 static int
 ml_snpe_event_handler (void *backend_private, int ops_, void *data_)
 {
+  event_ops ops = (event_ops) ops_;
+  GstTensorFilterFrameworkEventData *data = (GstTensorFilterFrameworkEventData *) data_;
+  snpe_handle_s *snpe = (snpe_handle_s *) backend_private;
+
+  /* Outputs may outlive a reconfigure without OutputPool, so release them whatever the option is now. */
+  if (ops == DESTROY_NOTIFY && snpe) {
+    /* The handle may be deleted by the release of the last output after deinit. */
+    if (data && ml_buffer_pool_release (snpe->output_pool, data->data))
+      return HAL_ML_ERROR_NONE;
+
+    if (snpe->use_output_pool) {
+      g_critical ("[snpe backend] The buffer to be destroyed is not from the output pool.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+  }
+
+  if (ops == RELOAD_MODEL && snpe)
+    return _snpe_reload_model (snpe, data);
+
   return HAL_ML_ERROR_NOT_SUPPORTED;
 }
 
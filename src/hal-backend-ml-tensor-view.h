@@ -0,0 +1,481 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_TENSOR_VIEW_H__
+#define __HAL_BACKEND_ML_TENSOR_VIEW_H__
+
+#ifndef __cplusplus
+#error "hal-backend-ml-tensor-view.h is a C++ header."
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <glib.h>
+#include <limits>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+#include "hal-backend-ml-util.h"
+
+/**
+ * @brief Half precision float, stored as bits. Convert with ml_tensor_to_float() and ml_tensor_from_float().
+ */
+typedef struct {
+  uint16_t bits;
+} ml_float16_s;
+
+/**
+ * @brief bfloat16, stored as bits. Convert buffers with ml_bf16_to_fp32() and ml_fp32_to_bf16().
+ */
+typedef struct {
+  uint16_t bits;
+} ml_bfloat16_s;
+
+/**
+ * @brief Element traits of each tensor_type, resolved at compile time.
+ */
+template <tensor_type T> struct ml_tensor_traits;
+
+/**
+ * @brief tensor_type of the C type of an element.
+ */
+template <typename C> struct ml_tensor_type_of;
+
+#define ML_TENSOR_TRAITS(ttype, ctype, float_, signed_)          \
+  template <> struct ml_tensor_traits<ttype> {                    \
+    typedef ctype type;                                           \
+    static constexpr tensor_type tensor = ttype;                  \
+    static constexpr gsize size = sizeof (ctype);                 \
+    static constexpr bool is_float = float_;                      \
+    static constexpr bool is_signed = signed_;                    \
+  };                                                              \
+  template <> struct ml_tensor_type_of<ctype> {                   \
+    static constexpr tensor_type value = ttype;                   \
+  }
+
+ML_TENSOR_TRAITS (_NNS_INT32, int32_t, false, true);
+ML_TENSOR_TRAITS (_NNS_UINT32, uint32_t, false, false);
+ML_TENSOR_TRAITS (_NNS_INT16, int16_t, false, true);
+ML_TENSOR_TRAITS (_NNS_UINT16, uint16_t, false, false);
+ML_TENSOR_TRAITS (_NNS_INT8, int8_t, false, true);
+ML_TENSOR_TRAITS (_NNS_UINT8, uint8_t, false, false);
+ML_TENSOR_TRAITS (_NNS_FLOAT64, double, true, true);
+ML_TENSOR_TRAITS (_NNS_FLOAT32, float, true, true);
+ML_TENSOR_TRAITS (_NNS_INT64, int64_t, false, true);
+ML_TENSOR_TRAITS (_NNS_UINT64, uint64_t, false, false);
+ML_TENSOR_TRAITS (_NNS_FLOAT16, ml_float16_s, true, true);
+ML_TENSOR_TRAITS (_NNS_BFLOAT16, ml_bfloat16_s, true, true);
+
+#undef ML_TENSOR_TRAITS
+
+/**
+ * @brief Tag to pass an element type to a generic lambda. Use `typename decltype (tag)::type`.
+ */
+template <typename C> struct ml_tensor_tag {
+  typedef C type;
+};
+
+/* ===================================================================
+ * Element conversion
+ * ===================================================================
+ */
+static inline float
+ml_float16_to_float (ml_float16_s h)
+{
+  uint32_t sign = ((uint32_t) h.bits & 0x8000U) << 16;
+  uint32_t exp = (h.bits >> 10) & 0x1fU;
+  uint32_t mant = h.bits & 0x3ffU;
+  uint32_t bits;
+  float f;
+
+  if (exp == 0) {
+    if (mant == 0) {
+      bits = sign;
+    } else {
+      /* subnormal, normalize it */
+      int e = -1;
+      do {
+        e++;
+        mant <<= 1;
+      } while (!(mant & 0x400U));
+      bits = sign | ((uint32_t) (127 - 15 - e) << 23) | ((mant & 0x3ffU) << 13);
+    }
+  } else if (exp == 0x1f) {
+    bits = sign | 0x7f800000U | (mant << 13);
+  } else {
+    bits = sign | ((exp + 112U) << 23) | (mant << 13);
+  }
+
+  memcpy (&f, &bits, sizeof (f));
+  return f;
+}
+
+/** @brief Convert to half precision, rounding to nearest even. */
+static inline ml_float16_s
+ml_float_to_float16 (float f)
+{
+  uint32_t x, sign, exp, mant, half, rem;
+  int32_t e;
+
+  memcpy (&x, &f, sizeof (x));
+  sign = (x >> 16) & 0x8000U;
+  exp = (x >> 23) & 0xffU;
+  mant = x & 0x7fffffU;
+
+  if (exp == 0xff)
+    return { (uint16_t) (sign | 0x7c00U | (mant ? 0x200U : 0U)) };
+
+  e = (int32_t) exp - 127 + 15;
+  if (e >= 0x1f)
+    return { (uint16_t) (sign | 0x7c00U) };
+
+  if (e <= 0) {
+    guint shift;
+
+    if (e < -10)
+      return { (uint16_t) sign };
+
+    mant |= 0x800000U;
+    shift = (guint) (14 - e);
+    half = mant >> shift;
+    rem = mant & ((1U << shift) - 1U);
+    if (rem > (1U << (shift - 1)) || (rem == (1U << (shift - 1)) && (half & 1U)))
+      half++;
+    return { (uint16_t) (sign | half) };
+  }
+
+  half = sign | ((uint32_t) e << 10) | (mant >> 13);
+  rem = mant & 0x1fffU;
+  /* carry into the exponent is correct, and becomes inf at the largest value */
+  if (rem > 0x1000U || (rem == 0x1000U && (half & 1U)))
+    half++;
+  return { (uint16_t) half };
+}
+
+static inline float
+ml_bfloat16_to_float (ml_bfloat16_s b)
+{
+  float f;
+
+  ml_bf16_to_fp32 (&f, &b.bits, 1);
+  return f;
+}
+
+static inline ml_bfloat16_s
+ml_float_to_bfloat16 (float f)
+{
+  ml_bfloat16_s b;
+
+  ml_fp32_to_bf16 (&b.bits, &f, 1);
+  return b;
+}
+
+template <typename C>
+static inline float
+ml_tensor_to_float (C v)
+{
+  return static_cast<float> (v);
+}
+
+static inline float
+ml_tensor_to_float (ml_float16_s v)
+{
+  return ml_float16_to_float (v);
+}
+
+static inline float
+ml_tensor_to_float (ml_bfloat16_s v)
+{
+  return ml_bfloat16_to_float (v);
+}
+
+template <typename C>
+static inline double
+ml_tensor_to_double (C v)
+{
+  return static_cast<double> (v);
+}
+
+static inline double
+ml_tensor_to_double (ml_float16_s v)
+{
+  return ml_float16_to_float (v);
+}
+
+static inline double
+ml_tensor_to_double (ml_bfloat16_s v)
+{
+  return ml_bfloat16_to_float (v);
+}
+
+template <typename C, typename R>
+static inline C
+_ml_tensor_from_real (R v, std::true_type /* integral */)
+{
+  R r = std::nearbyint (v);
+
+  if (std::isnan (r))
+    return 0;
+  if (r <= (R) std::numeric_limits<C>::min ())
+    return std::numeric_limits<C>::min ();
+  if (r >= (R) std::numeric_limits<C>::max ())
+    return std::numeric_limits<C>::max ();
+  return static_cast<C> (r);
+}
+
+template <typename C, typename R>
+static inline C
+_ml_tensor_from_real (R v, std::false_type /* floating point */)
+{
+  return static_cast<C> (v);
+}
+
+/**
+ * @brief Convert a float to the element type. Integers are rounded to nearest and saturated.
+ */
+template <typename C>
+static inline C
+ml_tensor_from_float (float v)
+{
+  return _ml_tensor_from_real<C, float> (v, std::is_integral<C> ());
+}
+
+template <>
+inline ml_float16_s
+ml_tensor_from_float<ml_float16_s> (float v)
+{
+  return ml_float_to_float16 (v);
+}
+
+template <>
+inline ml_bfloat16_s
+ml_tensor_from_float<ml_bfloat16_s> (float v)
+{
+  return ml_float_to_bfloat16 (v);
+}
+
+/**
+ * @brief Convert a double to the element type. Integers are rounded to nearest and saturated.
+ */
+template <typename C>
+static inline C
+ml_tensor_from_double (double v)
+{
+  return _ml_tensor_from_real<C, double> (v, std::is_integral<C> ());
+}
+
+template <>
+inline ml_float16_s
+ml_tensor_from_double<ml_float16_s> (double v)
+{
+  return ml_float_to_float16 ((float) v);
+}
+
+template <>
+inline ml_bfloat16_s
+ml_tensor_from_double<ml_bfloat16_s> (double v)
+{
+  return ml_float_to_bfloat16 ((float) v);
+}
+
+/* ===================================================================
+ * Typed tensor view
+ * ===================================================================
+ */
+/**
+ * @brief Typed view of a tensor buffer. Dimensions follow the nnstreamer order, the
+ *        innermost first. Strides are in elements, so permuted views need no copy.
+ *        Use a const element type for read-only buffers.
+ */
+template <typename C> struct ml_tensor_view {
+  C *data;
+  guint rank;
+  uint32_t dim[NNS_TENSOR_RANK_LIMIT];
+  gsize stride[NNS_TENSOR_RANK_LIMIT];
+
+  ml_tensor_view () : data (nullptr), rank (0)
+  {
+    memset (dim, 0, sizeof (dim));
+    memset (stride, 0, sizeof (stride));
+  }
+
+  /** @brief Contiguous view of the buffer. */
+  ml_tensor_view (C *data_, const tensor_dim dimension) : data (data_), rank (0)
+  {
+    gsize s = 1;
+
+    memset (dim, 0, sizeof (dim));
+    memset (stride, 0, sizeof (stride));
+
+    /* Same as gst_tensor_get_element_count(), the rank ends at the first zero. */
+    for (guint i = 0; i < NNS_TENSOR_RANK_LIMIT && dimension[i] > 0; i++) {
+      dim[i] = dimension[i];
+      stride[i] = s;
+      s *= dimension[i];
+      rank = i + 1;
+    }
+  }
+
+  gsize count () const
+  {
+    gsize n = (rank > 0) ? 1 : 0;
+
+    for (guint i = 0; i < rank; i++)
+      n *= dim[i];
+    return n;
+  }
+
+  bool is_contiguous () const
+  {
+    gsize s = 1;
+
+    for (guint i = 0; i < rank; i++) {
+      if (stride[i] != s)
+        return false;
+      s *= dim[i];
+    }
+    return true;
+  }
+
+  /** @brief Element at the index of each axis, innermost first. */
+  template <typename... I> C &at (I... idx) const
+  {
+    const gsize index[] = { (gsize) idx... };
+    gsize offset = 0;
+
+    static_assert (sizeof... (I) <= NNS_TENSOR_RANK_LIMIT, "Too many indices");
+    for (guint i = 0; i < sizeof... (I); i++)
+      offset += index[i] * stride[i];
+    return data[offset];
+  }
+
+  /** @brief Element at the offset, valid only for a contiguous view. */
+  C &operator[] (gsize i) const
+  {
+    return data[i];
+  }
+
+  /** @brief View with the axes reordered, order[i] is the axis of this view placed at i. */
+  ml_tensor_view permute (const guint *order) const
+  {
+    ml_tensor_view v = *this;
+
+    for (guint i = 0; i < rank; i++) {
+      v.dim[i] = dim[order[i]];
+      v.stride[i] = stride[order[i]];
+    }
+    return v;
+  }
+};
+
+/**
+ * @brief Get the typed view of a tensor memory.
+ * @return The view, with NULL data if the type of the info does not match.
+ */
+template <typename C>
+static inline ml_tensor_view<C>
+ml_tensor_view_from (const GstTensorInfo *info, C *data)
+{
+  typedef typename std::remove_const<C>::type elem_type;
+
+  if (info->type != ml_tensor_type_of<elem_type>::value) {
+    g_critical ("Tensor type mismatch (%d, expected %d).", (int) info->type,
+        (int) ml_tensor_type_of<elem_type>::value);
+    return ml_tensor_view<C> ();
+  }
+
+  return ml_tensor_view<C> (data, info->dimension);
+}
+
+/* ===================================================================
+ * Dispatch
+ * ===================================================================
+ */
+/**
+ * @brief Call the generic function with the element type of the tensor_type, so that
+ *        a kernel written once is instantiated and optimized for each type.
+ *
+ *   ml_tensor_dispatch (info->type, [&] (auto tag) {
+ *     typedef typename decltype (tag)::type T;
+ *     ...
+ *   });
+ *
+ * @return The return value of the function, default-constructed if the type is invalid.
+ */
+template <typename F>
+static inline auto
+ml_tensor_dispatch (tensor_type type, F &&f) -> decltype (f (ml_tensor_tag<uint8_t> ()))
+{
+  typedef decltype (f (ml_tensor_tag<uint8_t> ())) ret_type;
+
+  switch (type) {
+    case _NNS_INT32:
+      return f (ml_tensor_tag<int32_t> ());
+    case _NNS_UINT32:
+      return f (ml_tensor_tag<uint32_t> ());
+    case _NNS_INT16:
+      return f (ml_tensor_tag<int16_t> ());
+    case _NNS_UINT16:
+      return f (ml_tensor_tag<uint16_t> ());
+    case _NNS_INT8:
+      return f (ml_tensor_tag<int8_t> ());
+    case _NNS_UINT8:
+      return f (ml_tensor_tag<uint8_t> ());
+    case _NNS_FLOAT64:
+      return f (ml_tensor_tag<double> ());
+    case _NNS_FLOAT32:
+      return f (ml_tensor_tag<float> ());
+    case _NNS_INT64:
+      return f (ml_tensor_tag<int64_t> ());
+    case _NNS_UINT64:
+      return f (ml_tensor_tag<uint64_t> ());
+    case _NNS_FLOAT16:
+      return f (ml_tensor_tag<ml_float16_s> ());
+    case _NNS_BFLOAT16:
+      return f (ml_tensor_tag<ml_bfloat16_s> ());
+    default:
+      /* Packed types have no element type, use hal-backend-ml-int4.h. */
+      g_critical ("Invalid tensor type (%d).", type);
+      return ret_type ();
+  }
+}
+
+/**
+ * @brief Convert the elements from one type to another. Integers are saturated.
+ *        Packed 4-bit types are not supported, use hal-backend-ml-int4.h.
+ * @return FALSE if a type is invalid.
+ */
+static inline gboolean
+ml_tensor_convert (void *dest, tensor_type dest_type, const void *src, tensor_type src_type, gsize count)
+{
+  if (dest_type == src_type && dest_type != _NNS_END && dest_type < _NNS_INTERNAL_END) {
+    memcpy (dest, src, (count * ml_tensor_get_element_bits (src_type) + 7) / 8);
+    return TRUE;
+  }
+
+  if (src_type == _NNS_BFLOAT16 && dest_type == _NNS_FLOAT32) {
+    ml_bf16_to_fp32 ((float *) dest, (const guint16 *) src, count);
+    return TRUE;
+  }
+
+  if (src_type == _NNS_FLOAT32 && dest_type == _NNS_BFLOAT16) {
+    ml_fp32_to_bf16 ((guint16 *) dest, (const float *) src, count);
+    return TRUE;
+  }
+
+  return ml_tensor_dispatch (src_type, [&] (auto stag) {
+    typedef typename decltype (stag)::type S;
+
+    return ml_tensor_dispatch (dest_type, [&] (auto dtag) {
+      typedef typename decltype (dtag)::type D;
+      const S *s = (const S *) src;
+      D *d = (D *) dest;
+
+      for (gsize i = 0; i < count; i++)
+        d[i] = ml_tensor_from_double<D> (ml_tensor_to_double (s[i]));
+      return TRUE;
+    });
+  });
+}
+
+#endif /* __HAL_BACKEND_ML_TENSOR_VIEW_H__ */
@@ -0,0 +1,424 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <glib.h>
+#include <string.h>
+#include <vector>
+
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-copy.h"
+#include "hal-backend-ml-tile.h"
+
+/**
+ * @brief Output of the tiles.
+ */
+typedef struct {
+  tensor_dim dimension; /* merged output */
+  gsize size; /* bytes of the output of a tile */
+  guint scale; /* tile size divided by the output size, 0 if stacked */
+  gsize planes; /* channels of a channel-first map, 1 otherwise */
+  gsize pixel_size; /* bytes of a pixel of a plane */
+  gsize width;
+  gsize height;
+  void *buffer;
+} ml_tile_output_s;
+
+struct _ml_tile_s {
+  tensor_dim input_dimension; /* the frame */
+  gsize planes; /* channels of a channel-first input, 1 otherwise */
+  gsize pixel_size; /* bytes of a pixel of a plane */
+  gsize tile_width;
+  gsize tile_height;
+  gsize frame_width;
+  gsize frame_height;
+  std::vector<gsize> x; /* origin of each column of tiles */
+  std::vector<gsize> y; /* origin of each row of tiles */
+  std::vector<ml_tile_output_s> outputs;
+  void *buffer;
+};
+
+void
+ml_tile_config_init (ml_tile_config_s *config)
+{
+  g_return_if_fail (config != NULL);
+
+  memset (config, 0, sizeof (*config));
+  config->merge = ML_TILE_MERGE_BATCH;
+}
+
+gboolean
+ml_tile_parse_merge (const gchar *str, ml_tile_merge_e *merge)
+{
+  g_return_val_if_fail (str != NULL && merge != NULL, FALSE);
+
+  if (g_ascii_strcasecmp (str, "BATCH") == 0)
+    *merge = ML_TILE_MERGE_BATCH;
+  else if (g_ascii_strcasecmp (str, "STITCH") == 0)
+    *merge = ML_TILE_MERGE_STITCH;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+ml_tile_config_is_enabled (const ml_tile_config_s *config)
+{
+  return (config && config->width > 0 && config->height > 0);
+}
+
+/**
+ * @brief Get the channels, width and height of an image tensor.
+ * @return The product of the outer dimensions, 0 if the tensor is not an image.
+ */
+static gsize
+_tile_get_image (const uint32_t *dim, tensor_layout layout, gsize *channels, gsize *width, gsize *height)
+{
+  gsize batch = 1;
+
+  if (dim[0] == 0 || dim[1] == 0 || dim[2] == 0)
+    return 0;
+
+  if (layout == _NNS_LAYOUT_NCHW) {
+    *width = dim[0];
+    *height = dim[1];
+    *channels = dim[2];
+  } else {
+    *channels = dim[0];
+    *width = dim[1];
+    *height = dim[2];
+  }
+
+  for (guint i = 3; i < NNS_TENSOR_RANK_LIMIT && dim[i] > 0; i++)
+    batch *= dim[i];
+
+  return batch;
+}
+
+/** @brief Set the width and height of an image tensor. */
+static void
+_tile_set_image (uint32_t *dim, tensor_layout layout, gsize width, gsize height)
+{
+  guint w = (layout == _NNS_LAYOUT_NCHW) ? 0 : 1;
+
+  dim[w] = (uint32_t) width;
+  dim[w + 1] = (uint32_t) height;
+}
+
+/** @brief Origins of the tiles along a side of the frame, the last one at the edge. */
+static void
+_tile_fill_origins (std::vector<gsize> &origins, gsize frame, gsize tile, gsize overlap)
+{
+  const gsize stride = tile - overlap;
+  const gsize count = 1 + (frame - tile + stride - 1) / stride;
+
+  origins.resize (count);
+  for (gsize i = 0; i < count; i++)
+    origins[i] = MIN (i * stride, frame - tile);
+}
+
+/** @brief Part of the frame filled by the nth tile, split at the middle of the overlaps. */
+static void
+_tile_get_part (const std::vector<gsize> &origins, gsize frame, gsize tile, guint n,
+    gsize *begin, gsize *end)
+{
+  *begin = (n == 0) ? 0 : (origins[n - 1] + tile + origins[n]) / 2;
+  *end = (n + 1 == origins.size ()) ? frame : (origins[n] + tile + origins[n + 1]) / 2;
+}
+
+/** @brief Stack the outputs of the tiles in the outermost dimension, or a new one. */
+static gboolean
+_tile_stack (uint32_t *dim, guint count)
+{
+  guint rank = 0;
+
+  while (rank < NNS_TENSOR_RANK_LIMIT && dim[rank] > 0)
+    rank++;
+
+  if (rank > 0 && dim[rank - 1] == 1)
+    dim[rank - 1] = count;
+  else if (rank < NNS_TENSOR_RANK_LIMIT)
+    dim[rank] = count;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/** @brief Set up the stitch of an output, FALSE if it is not a map of the tile. */
+static gboolean
+_tile_setup_stitch (const ml_tile_s *tile, ml_tile_output_s *out, const GstTensorInfo *info,
+    tensor_layout layout)
+{
+  gsize channels, width, height, scale;
+
+  if (ml_tensor_get_element_bits (info->type) < 8
+      || _tile_get_image (info->dimension, layout, &channels, &width, &height) != 1)
+    return FALSE;
+
+  if (tile->tile_width % width != 0 || tile->tile_height % height != 0)
+    return FALSE;
+
+  scale = tile->tile_width / width;
+  if (tile->tile_height / height != scale)
+    return FALSE;
+
+  for (gsize o : tile->x) {
+    if (o % scale != 0)
+      return FALSE;
+  }
+  for (gsize o : tile->y) {
+    if (o % scale != 0)
+      return FALSE;
+  }
+
+  out->scale = (guint) scale;
+  out->width = width;
+  out->height = height;
+  if (layout == _NNS_LAYOUT_NCHW) {
+    out->planes = channels;
+    out->pixel_size = gst_tensor_get_element_size (info->type);
+  } else {
+    out->planes = 1;
+    out->pixel_size = channels * gst_tensor_get_element_size (info->type);
+  }
+
+  _tile_set_image (out->dimension, layout, tile->frame_width / scale, tile->frame_height / scale);
+  return TRUE;
+}
+
+ml_tile_s *
+ml_tile_new (const ml_tile_config_s *config, tensor_layout model_layout,
+    const GstTensorInfo *input_info, tensor_layout input_layout,
+    const ml_tensors_info_s *output_info, const tensor_layout *output_layout)
+{
+  ml_tile_s *tile;
+  gsize channels, width, height;
+
+  g_return_val_if_fail (config != NULL && input_info != NULL && output_info != NULL, NULL);
+
+  if (!ml_tile_config_is_enabled (config))
+    return NULL;
+
+  if (input_layout == _NNS_LAYOUT_ANY || input_layout == _NNS_LAYOUT_NONE)
+    input_layout = model_layout;
+
+  if (ml_tensor_get_element_bits (input_info->type) < 8) {
+    g_critical ("[tile] Unsupported type of the input tensor (%d).", (int) input_info->type);
+    return NULL;
+  }
+
+  if (_tile_get_image (input_info->dimension, input_layout, &channels, &width, &height) != 1) {
+    g_critical ("[tile] The tiled input should be an image with one batch.");
+    return NULL;
+  }
+
+  if (config->width < width || config->height < height) {
+    g_critical ("[tile] The frame (%ux%u) is smaller than the tile (%zux%zu).", config->width,
+        config->height, width, height);
+    return NULL;
+  }
+
+  if (config->overlap >= width || config->overlap >= height) {
+    g_critical ("[tile] The overlap (%u) should be smaller than the tile (%zux%zu).",
+        config->overlap, width, height);
+    return NULL;
+  }
+
+  tile = new ml_tile_s ();
+  tile->tile_width = width;
+  tile->tile_height = height;
+  tile->frame_width = config->width;
+  tile->frame_height = config->height;
+  if (input_layout == _NNS_LAYOUT_NCHW) {
+    tile->planes = channels;
+    tile->pixel_size = gst_tensor_get_element_size (input_info->type);
+  } else {
+    tile->planes = 1;
+    tile->pixel_size = channels * gst_tensor_get_element_size (input_info->type);
+  }
+
+  memcpy (tile->input_dimension, input_info->dimension, sizeof (tensor_dim));
+  _tile_set_image (tile->input_dimension, input_layout, tile->frame_width, tile->frame_height);
+
+  _tile_fill_origins (tile->x, tile->frame_width, width, config->overlap);
+  _tile_fill_origins (tile->y, tile->frame_height, height, config->overlap);
+
+  tile->buffer = ml_alloc (gst_tensor_info_get_size (input_info), ML_ALLOC_FLAG_NONE, NULL);
+  if (!tile->buffer) {
+    g_critical ("[tile] Failed to allocate the buffer of the input tensor.");
+    ml_tile_free (tile);
+    return NULL;
+  }
+
+  tile->outputs.resize (output_info->num_tensors);
+  for (guint i = 0; i < output_info->num_tensors; i++) {
+    const GstTensorInfo *info = ml_tensors_info_get_nth_info (output_info, i);
+    ml_tile_output_s *out = &tile->outputs[i];
+    tensor_layout layout = output_layout ? output_layout[i] : _NNS_LAYOUT_ANY;
+
+    if (layout == _NNS_LAYOUT_ANY || layout == _NNS_LAYOUT_NONE)
+      layout = model_layout;
+
+    memcpy (out->dimension, info->dimension, sizeof (tensor_dim));
+    out->size = gst_tensor_info_get_size (info);
+
+    if (config->merge == ML_TILE_MERGE_STITCH && _tile_setup_stitch (tile, out, info, layout)) {
+      g_info ("[tile] Stitch the output tensor #%u, scale 1/%u.", i, out->scale);
+    } else if (!_tile_stack (out->dimension, ml_tile_get_count (tile))) {
+      g_critical ("[tile] Failed to stack the output tensor #%u.", i);
+      ml_tile_free (tile);
+      return NULL;
+    }
+
+    out->buffer = ml_alloc (out->size, ML_ALLOC_FLAG_NONE, NULL);
+    if (!out->buffer) {
+      g_critical ("[tile] Failed to allocate the buffer of the output tensor #%u.", i);
+      ml_tile_free (tile);
+      return NULL;
+    }
+  }
+
+  g_info ("[tile] %zux%zu tiles of %zux%zu in the frame of %zux%zu.", tile->x.size (),
+      tile->y.size (), width, height, tile->frame_width, tile->frame_height);
+
+  return tile;
+}
+
+void
+ml_tile_free (ml_tile_s *tile)
+{
+  if (!tile)
+    return;
+
+  for (ml_tile_output_s &out : tile->outputs)
+    ml_alloc_free (out.buffer);
+  ml_alloc_free (tile->buffer);
+  delete tile;
+}
+
+guint
+ml_tile_get_count (const ml_tile_s *tile)
+{
+  g_return_val_if_fail (tile != NULL, 0);
+
+  return (guint) (tile->x.size () * tile->y.size ());
+}
+
+void
+ml_tile_get_origin (const ml_tile_s *tile, guint index, guint *x, guint *y)
+{
+  g_return_if_fail (tile != NULL && index < ml_tile_get_count (tile));
+
+  if (x)
+    *x = (guint) tile->x[index % tile->x.size ()];
+  if (y)
+    *y = (guint) tile->y[index / tile->x.size ()];
+}
+
+void
+ml_tile_get_input_info (const ml_tile_s *tile, GstTensorInfo *info)
+{
+  g_return_if_fail (tile != NULL && info != NULL);
+
+  memcpy (info->dimension, tile->input_dimension, sizeof (tensor_dim));
+}
+
+void
+ml_tile_get_output_info (const ml_tile_s *tile, ml_tensors_info_s *info)
+{
+  g_return_if_fail (tile != NULL && info != NULL && info->num_tensors == tile->outputs.size ());
+
+  for (guint i = 0; i < info->num_tensors; i++) {
+    GstTensorInfo *tinfo = ml_tensors_info_get_nth_info (info, i);
+
+    memcpy (tinfo->dimension, tile->outputs[i].dimension, sizeof (tensor_dim));
+  }
+}
+
+void *
+ml_tile_get_input_buffer (const ml_tile_s *tile)
+{
+  g_return_val_if_fail (tile != NULL, NULL);
+
+  return tile->buffer;
+}
+
+void *
+ml_tile_get_output_buffer (const ml_tile_s *tile, guint index)
+{
+  g_return_val_if_fail (tile != NULL && index < tile->outputs.size (), NULL);
+
+  return tile->outputs[index].buffer;
+}
+
+/** @brief Copy a rectangle of each plane, row by row. */
+static void
+_tile_copy_rect (guint8 *dest, gsize dest_row, gsize dest_plane, const guint8 *src,
+    gsize src_row, gsize src_plane, gsize row_size, gsize rows, gsize planes)
+{
+  for (gsize p = 0; p < planes; p++) {
+    guint8 *d = dest + p * dest_plane;
+    const guint8 *s = src + p * src_plane;
+
+    for (gsize r = 0; r < rows; r++)
+      memcpy (d + r * dest_row, s + r * src_row, row_size);
+  }
+}
+
+void
+ml_tile_extract (const ml_tile_s *tile, guint index, void *dest, const void *frame)
+{
+  guint x, y;
+
+  g_return_if_fail (tile != NULL && dest != NULL && frame != NULL);
+  g_return_if_fail (index < ml_tile_get_count (tile));
+
+  ml_tile_get_origin (tile, index, &x, &y);
+
+  const gsize src_row = tile->frame_width * tile->pixel_size;
+  const gsize dest_row = tile->tile_width * tile->pixel_size;
+
+  _tile_copy_rect ((guint8 *) dest, dest_row, dest_row * tile->tile_height,
+      (const guint8 *) frame + y * src_row + x * tile->pixel_size, src_row,
+      src_row * tile->frame_height, dest_row, tile->tile_height, tile->planes);
+}
+
+void
+ml_tile_merge (const ml_tile_s *tile, guint index, guint output, void *dest, const void *src)
+{
+  gsize x0, x1, y0, y1;
+
+  g_return_if_fail (tile != NULL && dest != NULL && src != NULL);
+  g_return_if_fail (index < ml_tile_get_count (tile) && output < tile->outputs.size ());
+
+  const ml_tile_output_s *out = &tile->outputs[output];
+
+  if (out->scale == 0) {
+    ml_copy ((guint8 *) dest + index * out->size, src, out->size);
+    return;
+  }
+
+  const guint col = index % tile->x.size ();
+  const guint row = index / tile->x.size ();
+  const gsize s = out->scale;
+
+  _tile_get_part (tile->x, tile->frame_width, tile->tile_width, col, &x0, &x1);
+  _tile_get_part (tile->y, tile->frame_height, tile->tile_height, row, &y0, &y1);
+
+  /* Both sides of a split are rounded down, so the parts of the tiles do not overlap. */
+  x0 /= s;
+  x1 /= s;
+  y0 /= s;
+  y1 /= s;
+
+  const gsize dest_width = tile->frame_width / s;
+  const gsize dest_row = dest_width * out->pixel_size;
+  const gsize src_row = out->width * out->pixel_size;
+  const gsize sx = x0 - tile->x[col] / s;
+  const gsize sy = y0 - tile->y[row] / s;
+
+  _tile_copy_rect ((guint8 *) dest + y0 * dest_row + x0 * out->pixel_size, dest_row,
+      dest_row * (tile->frame_height / s),
+      (const guint8 *) src + sy * src_row + sx * out->pixel_size, src_row,
+      src_row * out->height, (x1 - x0) * out->pixel_size, y1 - y0, out->planes);
+}
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_TILE_H__
+#define __HAL_BACKEND_ML_TILE_H__
+
+#include <glib.h>
+
+#include "hal-backend-ml-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Merge of the outputs of the tiles.
+ */
+typedef enum {
+  ML_TILE_MERGE_BATCH = 0, /**< Outputs of the tiles stacked in the outermost dimension */
+  ML_TILE_MERGE_STITCH, /**< Spatial outputs stitched into the output of the whole frame */
+} ml_tile_merge_e;
+
+/**
+ * @brief Configuration of the tiling, usually parsed from the custom properties.
+ */
+typedef struct {
+  guint input_index; /**< Index of the tiled input tensor */
+  guint width; /**< Width of the frame, 0 for no tiling */
+  guint height; /**< Height of the frame, 0 for no tiling */
+  guint overlap; /**< Pixels shared by the adjacent tiles */
+  ml_tile_merge_e merge;
+} ml_tile_config_s;
+
+/**
+ * @brief Tiling of a backend.
+ *
+ * Splits a frame larger than the model input into overlapping tiles of the model input size,
+ * and runs the model once per tile. The tiles of a row are spaced by the tile width minus the
+ * overlap, and the last one is moved back to the right edge of the frame, so every tile is
+ * inside the frame. The same goes for the rows. Tiles are ordered row by row.
+ *
+ * The tiled input is an image, [C, W, H, 1] in a channel-last layout or [W, H, C, 1] in NCHW,
+ * and the other inputs are given to every tile as they are. The outputs of the tiles are
+ * stacked in a new outermost dimension, or its size if it is 1 (the batch). With
+ * ML_TILE_MERGE_STITCH, an output of a tile whose width and height are the tile size divided
+ * by the same integer, e.g. a segmentation map, is stitched into the map of the whole frame
+ * instead. Each tile fills its part of the map, split at the middle of the overlap with its
+ * neighbors. The other outputs are stacked.
+ */
+typedef struct _ml_tile_s ml_tile_s;
+
+/**
+ * @brief Initialize the configuration, no tiling.
+ */
+void ml_tile_config_init (ml_tile_config_s *config);
+
+/**
+ * @brief Parse the merge of the outputs, BATCH or STITCH.
+ */
+gboolean ml_tile_parse_merge (const gchar *str, ml_tile_merge_e *merge);
+
+/**
+ * @brief Check if the configuration asks for the tiling.
+ */
+gboolean ml_tile_config_is_enabled (const ml_tile_config_s *config);
+
+/**
+ * @brief Create the tiling of the model.
+ * @param model_layout The native layout of the model.
+ * @param input_info The input tensor of a tile, its width and height are the tile size.
+ * @param input_layout Layout of the input tensor. ANY or NONE is the same as the model.
+ * @param output_info The output tensors of a tile.
+ * @param output_layout Layout of each output tensor. ANY or NONE is the same as the model.
+ * @return The tiling, NULL if the configuration does not match the tensors.
+ *         The frame should not be smaller than the tile, and the overlap should be smaller than it.
+ */
+ml_tile_s *ml_tile_new (const ml_tile_config_s *config, tensor_layout model_layout,
+    const GstTensorInfo *input_info, tensor_layout input_layout,
+    const ml_tensors_info_s *output_info, const tensor_layout *output_layout);
+
+/**
+ * @brief Free the tiling and its buffers.
+ */
+void ml_tile_free (ml_tile_s *tile);
+
+/**
+ * @brief Get the number of tiles of a frame.
+ */
+guint ml_tile_get_count (const ml_tile_s *tile);
+
+/**
+ * @brief Get the position of the top-left pixel of the nth tile in the frame.
+ */
+void ml_tile_get_origin (const ml_tile_s *tile, guint index, guint *x, guint *y);
+
+/**
+ * @brief Set the dimension of the frame to the tensor info. The type and name are kept.
+ */
+void ml_tile_get_input_info (const ml_tile_s *tile, GstTensorInfo *info);
+
+/**
+ * @brief Set the dimension of the merged outputs to the tensors info. The types and names are kept.
+ */
+void ml_tile_get_output_info (const ml_tile_s *tile, ml_tensors_info_s *info);
+
+/**
+ * @brief Get the buffer for the input of a tile.
+ */
+void *ml_tile_get_input_buffer (const ml_tile_s *tile);
+
+/**
+ * @brief Get the buffer for the nth output of a tile.
+ */
+void *ml_tile_get_output_buffer (const ml_tile_s *tile, guint index);
+
+/**
+ * @brief Copy the nth tile of the frame.
+ * @note The buffers must not overlap.
+ */
+void ml_tile_extract (const ml_tile_s *tile, guint index, void *dest, const void *frame);
+
+/**
+ * @brief Merge the output of the nth tile into the merged output.
+ * @param output Index of the output tensor.
+ */
+void ml_tile_merge (const ml_tile_s *tile, guint index, guint output, void *dest, const void *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_BACKEND_ML_TILE_H__ */
@@ -0,0 +1,245 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <atomic>
+#include <glib.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hal-ml-interface.h>
+
+#include "hal-backend-ml-trace.h"
+
+/** @brief Number of events kept per thread. Must be a power of two. */
+#define ML_TRACE_RING_SIZE (8192U)
+
+volatile gint ml_trace_active = 0;
+
+/** @brief Bumped by ml_trace_reset (), each thread drops its older events at its next event. */
+static std::atomic<guint64> g_trace_generation (0);
+
+/**
+ * @brief A recorded event. The sequence is odd while the owner thread writes the event,
+ *        and 2 * (index + 1) once the event of the index is complete.
+ */
+typedef struct {
+  std::atomic<guint64> seq;
+  const char *name;
+  guint64 ts_ns;
+  guint32 tid;
+  char phase; /* 'B' or 'E' */
+} ml_trace_event_s;
+
+/**
+ * @brief Per-thread ring buffer. Only the owner thread writes into it, so recording
+ *        does not take any lock. Rings are never freed; a ring released by an exited
+ *        thread is reused by the next new thread.
+ */
+typedef struct _ml_trace_ring_s {
+  std::atomic<guint64> head; /* total number of recorded events */
+  std::atomic<guint64> tail; /* index of the first event since the last reset */
+  std::atomic<guint64> generation; /* reset generation of the events since tail */
+  std::atomic<gboolean> in_use;
+  struct _ml_trace_ring_s *next;
+  ml_trace_event_s events[ML_TRACE_RING_SIZE];
+} ml_trace_ring_s;
+
+static std::atomic<ml_trace_ring_s *> g_trace_rings (nullptr);
+
+/** @brief Releases the ring of the thread at thread exit. */
+struct ml_trace_ring_holder {
+  ml_trace_ring_s *ring = nullptr;
+
+  ~ml_trace_ring_holder ()
+  {
+    if (ring)
+      ring->in_use.store (FALSE, std::memory_order_release);
+  }
+};
+
+static thread_local ml_trace_ring_holder t_trace_ring;
+
+/** @brief Get the ring of the calling thread. Reuse a released one if possible. */
+static ml_trace_ring_s *
+_trace_get_ring (void)
+{
+  ml_trace_ring_s *ring = t_trace_ring.ring;
+
+  if (G_LIKELY (ring != nullptr))
+    return ring;
+
+  for (ring = g_trace_rings.load (std::memory_order_acquire); ring; ring = ring->next) {
+    gboolean expected = FALSE;
+    if (ring->in_use.compare_exchange_strong (expected, TRUE))
+      break;
+  }
+
+  if (!ring) {
+    ring = new ml_trace_ring_s ();
+    ring->head.store (0);
+    ring->tail.store (0);
+    ring->generation.store (g_trace_generation.load (std::memory_order_acquire));
+    ring->in_use.store (TRUE);
+    ring->next = g_trace_rings.load (std::memory_order_relaxed);
+    while (!g_trace_rings.compare_exchange_weak (ring->next, ring))
+      ;
+  }
+
+  t_trace_ring.ring = ring;
+  return ring;
+}
+
+static inline guint64
+_trace_now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (guint64) ts.tv_sec * 1000000000ULL + (guint64) ts.tv_nsec;
+}
+
+static void
+_trace_record (const char *name, char phase)
+{
+  static thread_local guint32 tid = 0;
+  ml_trace_ring_s *ring = _trace_get_ring ();
+  guint64 head = ring->head.load (std::memory_order_relaxed);
+  guint64 generation = g_trace_generation.load (std::memory_order_acquire);
+  ml_trace_event_s *ev = &ring->events[head & (ML_TRACE_RING_SIZE - 1)];
+
+  if (G_UNLIKELY (tid == 0))
+    tid = (guint32) syscall (SYS_gettid);
+
+  /* Reset by another thread, only the owner moves the tail. */
+  if (G_UNLIKELY (ring->generation.load (std::memory_order_relaxed) != generation)) {
+    ring->tail.store (head, std::memory_order_relaxed);
+    ring->generation.store (generation, std::memory_order_release);
+  }
+
+  ev->seq.store (2 * head + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence (std::memory_order_release);
+
+  ev->name = name;
+  ev->ts_ns = _trace_now_ns ();
+  ev->tid = tid;
+  ev->phase = phase;
+
+  ev->seq.store (2 * (head + 1), std::memory_order_release);
+  ring->head.store (head + 1, std::memory_order_release);
+}
+
+void
+ml_trace_set_enabled (gboolean enabled)
+{
+  g_atomic_int_set (&ml_trace_active, enabled ? 1 : 0);
+}
+
+void
+ml_trace_begin (const char *name)
+{
+  _trace_record (name, 'B');
+}
+
+void
+ml_trace_end (const char *name)
+{
+  _trace_record (name, 'E');
+}
+
+void
+ml_trace_reset (void)
+{
+  /* The rings are written by their owner threads only, each one drops its events lazily. */
+  g_trace_generation.fetch_add (1, std::memory_order_acq_rel);
+}
+
+int
+ml_trace_dump (const char *path)
+{
+  ml_trace_ring_s *ring;
+  FILE *fp;
+  gboolean first = TRUE;
+  pid_t pid = getpid ();
+
+  if (!path)
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+
+  fp = fopen (path, "w");
+  if (!fp) {
+    g_critical ("[trace] Failed to open trace file '%s'.", path);
+    return HAL_ML_ERROR_IO_ERROR;
+  }
+
+  fprintf (fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  for (ring = g_trace_rings.load (std::memory_order_acquire); ring; ring = ring->next) {
+    guint64 generation = ring->generation.load (std::memory_order_acquire);
+    guint64 tail = ring->tail.load (std::memory_order_relaxed);
+    guint64 head = ring->head.load (std::memory_order_acquire);
+    guint64 start = (head > ML_TRACE_RING_SIZE) ? head - ML_TRACE_RING_SIZE : 0;
+    guint depth = 0;
+
+    /* All events of the ring are older than the last reset. */
+    if (generation != g_trace_generation.load (std::memory_order_acquire))
+      continue;
+
+    for (guint64 i = MAX (start, tail); i < head; i++) {
+      const ml_trace_event_s *slot = &ring->events[i & (ML_TRACE_RING_SIZE - 1)];
+      guint64 seq = slot->seq.load (std::memory_order_acquire);
+      const char *name = slot->name;
+      guint64 ts_ns = slot->ts_ns;
+      guint32 tid = slot->tid;
+      char phase = slot->phase;
+
+      /* Skip the slot if the owner thread is overwriting it or has overwritten it meanwhile. */
+      std::atomic_thread_fence (std::memory_order_acquire);
+      if (seq != 2 * (i + 1) || slot->seq.load (std::memory_order_relaxed) != seq)
+        continue;
+
+      /* The begin of an end may be dropped with the older events. */
+      if (phase == 'E' && depth == 0)
+        continue;
+      depth = (phase == 'B') ? depth + 1 : depth - 1;
+
+      fprintf (fp, "%s\n{\"name\":\"%s\",\"cat\":\"hal-ml\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+          first ? "" : ",", name, phase, ts_ns / 1000.0, (int) pid, tid);
+      first = FALSE;
+    }
+  }
+
+  fprintf (fp, "\n]}\n");
+
+  if (fclose (fp) != 0) {
+    g_critical ("[trace] Failed to write trace file '%s'.", path);
+    return HAL_ML_ERROR_IO_ERROR;
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Enables tracing from the environment at load time and writes the trace at unload.
+ */
+static struct ml_trace_env_s {
+  gchar *path;
+
+  ml_trace_env_s () : path (nullptr)
+  {
+    const gchar *env = g_getenv ("HAL_ML_TRACE");
+
+    if (env && env[0] != '\0') {
+      path = g_strdup (env);
+      ml_trace_set_enabled (TRUE);
+    }
+  }
+
+  ~ml_trace_env_s ()
+  {
+    if (path) {
+      ml_trace_set_enabled (FALSE);
+      ml_trace_dump (path);
+      g_free (path);
+    }
+  }
+} g_trace_env;
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef __HAL_BACKEND_ML_TRACE_H__
+#define __HAL_BACKEND_ML_TRACE_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Global switch of the tracer. Read it through the ML_TRACE_* macros only.
+ * @note Tracing is enabled at load time if the environment variable HAL_ML_TRACE
+ *       is set to the path of the output file. The events are dumped into the file
+ *       when the backend library is unloaded.
+ */
+extern volatile gint ml_trace_active;
+
+/**
+ * @brief Enable or disable event recording. Recorded events are kept.
+ */
+void ml_trace_set_enabled (gboolean enabled);
+
+/**
+ * @brief Record the begin/end of a duration event for the calling thread.
+ * @param name Event name. Only the pointer is stored, so it must be a string literal.
+ */
+void ml_trace_begin (const char *name);
+void ml_trace_end (const char *name);
+
+/**
+ * @brief Write all recorded events into the given file in Chrome trace JSON format.
+ *        The result can be opened with chrome://tracing or ui.perfetto.dev.
+ * @return HAL_ML_ERROR_NONE if OK.
+ */
+int ml_trace_dump (const char *path);
+
+/**
+ * @brief Drop all recorded events. Each thread drops its own events at its next event,
+ *        and the dump skips them until then.
+ */
+void ml_trace_reset (void);
+
+#ifdef __cplusplus
+}
+
+/**
+ * @brief Records a begin event at construction and the matching end event at destruction.
+ */
+class ml_trace_scope
+{
+  public:
+  explicit ml_trace_scope (const char *name) : name_ (nullptr)
+  {
+    if (G_UNLIKELY (ml_trace_active)) {
+      name_ = name;
+      ml_trace_begin (name);
+    }
+  }
+
+  ~ml_trace_scope ()
+  {
+    if (G_UNLIKELY (name_ != nullptr))
+      ml_trace_end (name_);
+  }
+
+  private:
+  const char *name_;
+};
+
+#define _ML_TRACE_CONCAT_(a, b) a##b
+#define _ML_TRACE_CONCAT(a, b) _ML_TRACE_CONCAT_ (a, b)
+
+/** @brief Trace the remaining part of the current block. */
+#define ML_TRACE_SCOPE(name) \
+  ml_trace_scope _ML_TRACE_CONCAT (_ml_trace_scope_, __LINE__) (name)
+#endif /* __cplusplus */
+
+#define ML_TRACE_BEGIN(name)            \
+  do {                                  \
+    if (G_UNLIKELY (ml_trace_active))   \
+      ml_trace_begin (name);            \
+  } while (0)
+
+#define ML_TRACE_END(name)              \
+  do {                                  \
+    if (G_UNLIKELY (ml_trace_active))   \
+      ml_trace_end (name);              \
+  } while (0)
+
+#endif /* __HAL_BACKEND_ML_TRACE_H__ */
@@ -1,6 +1,13 @@
 /* SPDX-License-Identifier: Apache-2.0 */
 
 #include <glib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "hal-backend-ml-util.h"
 
@@ -80,15 +87,110 @@ static const guint tensor_element_size[] = {
   [_NNS_UINT64] = 8,
   [_NNS_FLOAT16] = 2,
   [_NNS_END] = 0,
+  [_NNS_BFLOAT16] = 2,
+  [_NNS_INT4] = 1, /* packed, the byte holding an element */
+  [_NNS_UINT4] = 1,
 };
 
 gsize gst_tensor_get_element_size (tensor_type type)
 {
-  g_return_val_if_fail (type >= 0 && type <= _NNS_END, 0);
+  g_return_val_if_fail (type >= 0 && type < _NNS_INTERNAL_END, 0);
 
   return tensor_element_size[type];
 }
 
+gsize ml_tensor_get_element_bits (tensor_type type)
+{
+  g_return_val_if_fail (type >= 0 && type < _NNS_INTERNAL_END, 0);
+
+  if (type == _NNS_INT4 || type == _NNS_UINT4)
+    return 4;
+
+  return tensor_element_size[type] * 8;
+}
+
+static const gchar *tensor_element_typename[] = {
+  [_NNS_INT32] = "int32",
+  [_NNS_UINT32] = "uint32",
+  [_NNS_INT16] = "int16",
+  [_NNS_UINT16] = "uint16",
+  [_NNS_INT8] = "int8",
+  [_NNS_UINT8] = "uint8",
+  [_NNS_FLOAT64] = "float64",
+  [_NNS_FLOAT32] = "float32",
+  [_NNS_INT64] = "int64",
+  [_NNS_UINT64] = "uint64",
+  [_NNS_FLOAT16] = "float16",
+  [_NNS_END] = NULL,
+  [_NNS_BFLOAT16] = "bfloat16",
+  [_NNS_INT4] = "int4",
+  [_NNS_UINT4] = "uint4",
+};
+
+tensor_type ml_tensor_type_to_gst (tensor_type type)
+{
+  switch (type) {
+    case _NNS_BFLOAT16:
+    case _NNS_INT4:
+    case _NNS_UINT4:
+      /* nnstreamer does not define them, the backends convert them on copy and do not report them. */
+      return _NNS_END;
+    default:
+      return type;
+  }
+}
+
+tensor_type gst_tensor_get_type (const gchar * typestr)
+{
+  guint i;
+
+  if (!typestr)
+    return _NNS_END;
+
+  for (i = 0; i < _NNS_INTERNAL_END; i++) {
+    if (tensor_element_typename[i] && g_ascii_strcasecmp (typestr, tensor_element_typename[i]) == 0)
+      return (tensor_type) i;
+  }
+
+  return _NNS_END;
+}
+
+guint gst_tensor_parse_dimension (const gchar * dimstr, tensor_dim dim)
+{
+  guint rank = 0;
+  gchar **strv;
+  guint i, num;
+
+  g_return_val_if_fail (dim != NULL, 0);
+
+  for (i = 0; i < NNS_TENSOR_RANK_LIMIT; i++)
+    dim[i] = 0;
+
+  if (!dimstr)
+    return 0;
+
+  strv = g_strsplit (dimstr, ":", NNS_TENSOR_RANK_LIMIT);
+  num = g_strv_length (strv);
+
+  for (i = 0; i < num; i++) {
+    gchar *str = g_strstrip (strv[i]);
+    gint64 val;
+
+    if (str[0] == '\0')
+      break;
+
+    val = g_ascii_strtoll (str, NULL, 10);
+    if (val <= 0 || val > G_MAXUINT32)
+      break;
+
+    dim[i] = (uint32_t) val;
+    rank = i + 1;
+  }
+
+  g_strfreev (strv);
+  return rank;
+}
+
 gulong gst_tensor_get_element_count (const tensor_dim dim)
 {
   gulong count = 1;
@@ -110,8 +212,9 @@ gsize gst_tensor_info_get_size (const GstTensorInfo * info)
 
   g_return_val_if_fail (info != NULL, 0);
 
-  data_size = gst_tensor_get_element_count (info->dimension) *
-      gst_tensor_get_element_size (info->type);
+  /* Packed types round up to the byte. */
+  data_size = (gst_tensor_get_element_count (info->dimension) *
+      ml_tensor_get_element_bits (info->type) + 7) / 8;
 
   return data_size;
 }
@@ -182,3 +285,381 @@ void gst_tensors_info_copy (GstTensorsInfo * dest, const GstTensorsInfo * src)
     gst_tensor_info_copy (_dest, _src);
   }
 }
+
+void ml_tensors_info_init (ml_tensors_info_s * info)
+{
+  g_return_if_fail (info != NULL);
+
+  info->num_tensors = 0;
+  info->format = _NNS_TENSOR_FORMAT_STATIC;
+  info->info = NULL;
+}
+
+void ml_tensors_info_free (ml_tensors_info_s * info)
+{
+  guint i;
+
+  g_return_if_fail (info != NULL);
+
+  for (i = 0; i < info->num_tensors; i++)
+    g_free (info->info[i].name);
+
+  g_free (info->info);
+  ml_tensors_info_init (info);
+}
+
+/**
+ * @brief Free the old data and allocate the list for the given number of tensors.
+ */
+gboolean ml_tensors_info_alloc (ml_tensors_info_s * info, guint num)
+{
+  guint i;
+
+  g_return_val_if_fail (info != NULL, FALSE);
+
+  ml_tensors_info_free (info);
+
+  if (num > NNS_TENSOR_SIZE_LIMIT) {
+    g_critical ("Failed to allocate the information, invalid number of tensors %u (max %d).",
+        num, NNS_TENSOR_SIZE_LIMIT);
+    return FALSE;
+  }
+
+  if (num > 0) {
+    info->info = g_new (GstTensorInfo, num);
+    for (i = 0; i < num; i++)
+      gst_tensor_info_init (&info->info[i]);
+  }
+
+  info->num_tensors = num;
+  return TRUE;
+}
+
+GstTensorInfo * ml_tensors_info_get_nth_info (const ml_tensors_info_s * info, guint index)
+{
+  g_return_val_if_fail (info != NULL, NULL);
+
+  if (G_UNLIKELY (index >= info->num_tensors)) {
+    g_critical ("Failed to get the information, invalid index %u (num %u).",
+        index, info->num_tensors);
+    return NULL;
+  }
+
+  return &info->info[index];
+}
+
+void ml_tensors_info_copy (ml_tensors_info_s * dest, const ml_tensors_info_s * src)
+{
+  guint i;
+
+  g_return_if_fail (dest != NULL);
+  g_return_if_fail (src != NULL);
+
+  if (!ml_tensors_info_alloc (dest, src->num_tensors))
+    return;
+
+  dest->format = src->format;
+  for (i = 0; i < src->num_tensors; i++)
+    gst_tensor_info_copy (&dest->info[i], &src->info[i]);
+}
+
+gboolean ml_tensors_info_is_equal (const ml_tensors_info_s * a, const ml_tensors_info_s * b)
+{
+  guint i, d;
+
+  g_return_val_if_fail (a != NULL, FALSE);
+  g_return_val_if_fail (b != NULL, FALSE);
+
+  if (a->num_tensors != b->num_tensors || a->format != b->format)
+    return FALSE;
+
+  for (i = 0; i < a->num_tensors; i++) {
+    if (a->info[i].type != b->info[i].type)
+      return FALSE;
+
+    for (d = 0; d < NNS_TENSOR_RANK_LIMIT; d++) {
+      guint da = a->info[i].dimension[d] ? a->info[i].dimension[d] : 1;
+      guint db = b->info[i].dimension[d] ? b->info[i].dimension[d] : 1;
+
+      if (da != db)
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+void ml_tensors_info_from_gst (ml_tensors_info_s * dest, const GstTensorsInfo * src)
+{
+  guint i;
+
+  g_return_if_fail (dest != NULL);
+  g_return_if_fail (src != NULL);
+
+  if (!ml_tensors_info_alloc (dest, src->num_tensors))
+    return;
+
+  dest->format = src->format;
+  for (i = 0; i < src->num_tensors; i++) {
+    const GstTensorInfo *_src = (i < NNS_TENSOR_MEMORY_MAX) ?
+        &src->info[i] : (src->extra ? &src->extra[i - NNS_TENSOR_MEMORY_MAX] : NULL);
+
+    if (_src)
+      gst_tensor_info_copy (&dest->info[i], _src);
+  }
+}
+
+/**
+ * @brief Copy to GstTensorsInfo. Like gst_tensors_info_copy(), dest is initialized and not freed.
+ */
+void ml_tensors_info_to_gst (GstTensorsInfo * dest, const ml_tensors_info_s * src)
+{
+  guint i;
+
+  g_return_if_fail (dest != NULL);
+  g_return_if_fail (src != NULL);
+
+  gst_tensors_info_init (dest);
+  dest->num_tensors = src->num_tensors;
+  dest->format = src->format;
+
+  for (i = 0; i < src->num_tensors; i++) {
+    GstTensorInfo *_dest = gst_tensors_info_get_nth_info (dest, i);
+
+    gst_tensor_info_copy (_dest, &src->info[i]);
+    _dest->type = ml_tensor_type_to_gst (_dest->type);
+  }
+}
+
+/**
+ * @brief Fill GstTensorsInfo with interned names. Only the extra list is allocated for >16 tensors.
+ */
+static void ml_model_info_fill (GstTensorsInfo * dest, const ml_tensors_info_s * src)
+{
+  guint i, j;
+
+  gst_tensors_info_init (dest);
+  dest->num_tensors = src->num_tensors;
+  dest->format = src->format;
+
+  for (i = 0; i < src->num_tensors; i++) {
+    GstTensorInfo *_dest = gst_tensors_info_get_nth_info (dest, i);
+
+    _dest->name = (gchar *) g_intern_string (src->info[i].name);
+    _dest->type = ml_tensor_type_to_gst (src->info[i].type);
+    for (j = 0; j < NNS_TENSOR_RANK_LIMIT; j++)
+      _dest->dimension[j] = src->info[i].dimension[j];
+  }
+}
+
+ml_model_info_s * ml_model_info_new (const ml_tensors_info_s * input, const ml_tensors_info_s * output)
+{
+  ml_model_info_s *info;
+
+  g_return_val_if_fail (input != NULL, NULL);
+  g_return_val_if_fail (output != NULL, NULL);
+
+  info = g_new0 (ml_model_info_s, 1);
+  info->refcount = 1;
+  ml_model_info_fill (&info->input, input);
+  ml_model_info_fill (&info->output, output);
+
+  return info;
+}
+
+ml_model_info_s * ml_model_info_ref (ml_model_info_s * info)
+{
+  g_return_val_if_fail (info != NULL, NULL);
+
+  g_atomic_int_inc (&info->refcount);
+  return info;
+}
+
+void ml_model_info_unref (ml_model_info_s * info)
+{
+  if (!info)
+    return;
+
+  if (!g_atomic_int_dec_and_test (&info->refcount))
+    return;
+
+  /* names are interned, do not free */
+  g_free (info->input.extra);
+  g_free (info->output.extra);
+  g_free (info);
+}
+
+static inline guint16
+_fp32_to_bf16 (guint32 bits)
+{
+  /* Keep NaN quiet, rounding may carry it to inf. */
+  if ((bits & 0x7fffffffU) > 0x7f800000U)
+    return (guint16) ((bits >> 16) | 0x40U);
+
+  return (guint16) ((bits + 0x7fffU + ((bits >> 16) & 1U)) >> 16);
+}
+
+void
+ml_bf16_to_fp32 (float * dest, const guint16 * src, gsize count)
+{
+  gsize i = 0;
+
+  g_return_if_fail (count == 0 || (dest != NULL && src != NULL));
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; i + 8 <= count; i += 8) {
+    uint16x8_t v = vld1q_u16 (src + i);
+
+    vst1q_f32 (dest + i, vreinterpretq_f32_u32 (vshll_n_u16 (vget_low_u16 (v), 16)));
+    vst1q_f32 (dest + i + 4, vreinterpretq_f32_u32 (vshll_n_u16 (vget_high_u16 (v), 16)));
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128 ();
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+
+    _mm_storeu_ps (dest + i, _mm_castsi128_ps (_mm_unpacklo_epi16 (zero, v)));
+    _mm_storeu_ps (dest + i + 4, _mm_castsi128_ps (_mm_unpackhi_epi16 (zero, v)));
+  }
+#endif
+
+  for (; i < count; i++) {
+    guint32 bits = (guint32) src[i] << 16;
+
+    memcpy (&dest[i], &bits, sizeof (bits));
+  }
+}
+
+void
+ml_fp32_to_bf16 (guint16 * dest, const float * src, gsize count)
+{
+  gsize i = 0;
+
+  g_return_if_fail (count == 0 || (dest != NULL && src != NULL));
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const uint32x4_t one = vdupq_n_u32 (1U);
+  const uint32x4_t bias = vdupq_n_u32 (0x7fffU);
+  const uint32x4_t quiet = vdupq_n_u32 (0x400000U);
+
+  for (; i + 8 <= count; i += 8) {
+    uint16x4_t h[2];
+
+    for (guint k = 0; k < 2; k++) {
+      uint32x4_t x = vreinterpretq_u32_f32 (vld1q_f32 (src + i + k * 4));
+      uint32x4_t lsb = vandq_u32 (vshrq_n_u32 (x, 16), one);
+      uint32x4_t rounded = vaddq_u32 (vaddq_u32 (x, bias), lsb);
+      uint32x4_t is_nan = vmvnq_u32 (vceqq_f32 (vreinterpretq_f32_u32 (x), vreinterpretq_f32_u32 (x)));
+
+      h[k] = vshrn_n_u32 (vbslq_u32 (is_nan, vorrq_u32 (x, quiet), rounded), 16);
+    }
+    vst1q_u16 (dest + i, vcombine_u16 (h[0], h[1]));
+  }
+#elif defined(__SSE2__)
+  const __m128i one = _mm_set1_epi32 (1);
+  const __m128i bias = _mm_set1_epi32 (0x7fff);
+  const __m128i quiet = _mm_set1_epi32 (0x400000);
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i h[2];
+
+    for (guint k = 0; k < 2; k++) {
+      __m128 f = _mm_loadu_ps (src + i + k * 4);
+      __m128i x = _mm_castps_si128 (f);
+      __m128i lsb = _mm_and_si128 (_mm_srli_epi32 (x, 16), one);
+      __m128i rounded = _mm_add_epi32 (_mm_add_epi32 (x, bias), lsb);
+      __m128i is_nan = _mm_castps_si128 (_mm_cmpunord_ps (f, f));
+      __m128i r = _mm_or_si128 (_mm_and_si128 (is_nan, _mm_or_si128 (x, quiet)),
+          _mm_andnot_si128 (is_nan, rounded));
+
+      /* SSE2 has no unsigned pack, the arithmetic shift keeps the low 16 bits through the signed pack. */
+      h[k] = _mm_srai_epi32 (r, 16);
+    }
+    _mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (h[0], h[1]));
+  }
+#endif
+
+  for (; i < count; i++) {
+    guint32 bits;
+
+    memcpy (&bits, &src[i], sizeof (bits));
+    dest[i] = _fp32_to_bf16 (bits);
+  }
+}
+
+#define ML_HASH_PRIME1 (0x9E3779B185EBCA87ULL)
+#define ML_HASH_PRIME2 (0xC2B2AE3D27D4EB4FULL)
+#define ML_HASH_PRIME3 (0x165667B19E3779F9ULL)
+#define ML_HASH_PRIME4 (0x85EBCA77C2B2AE63ULL)
+#define ML_HASH_PRIME5 (0x27D4EB2F165667C5ULL)
+
+static inline guint64
+_hash_rotl (guint64 x, guint r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline guint64
+_hash_round (guint64 acc, guint64 v)
+{
+  acc += v * ML_HASH_PRIME2;
+  return _hash_rotl (acc, 31) * ML_HASH_PRIME1;
+}
+
+static inline guint64
+_hash_merge (guint64 hash, guint64 acc)
+{
+  hash ^= _hash_round (0, acc);
+  return hash * ML_HASH_PRIME1 + ML_HASH_PRIME4;
+}
+
+guint64
+ml_hash_data (const void * data, gsize size)
+{
+  const guint8 *p = (const guint8 *) data;
+  guint64 hash, v;
+  gsize i = 0;
+
+  g_return_val_if_fail (size == 0 || data != NULL, 0);
+
+  if (size >= 32) {
+    guint64 acc[4] = { ML_HASH_PRIME1 + ML_HASH_PRIME2, ML_HASH_PRIME2, 0,
+      (guint64) 0 - ML_HASH_PRIME1 };
+
+    for (; i + 32 <= size; i += 32) {
+      for (guint k = 0; k < 4; k++) {
+        memcpy (&v, p + i + k * 8, sizeof (v));
+        acc[k] = _hash_round (acc[k], v);
+      }
+    }
+
+    hash = _hash_rotl (acc[0], 1) + _hash_rotl (acc[1], 7) + _hash_rotl (acc[2], 12)
+        + _hash_rotl (acc[3], 18);
+    for (guint k = 0; k < 4; k++)
+      hash = _hash_merge (hash, acc[k]);
+  } else {
+    hash = ML_HASH_PRIME5;
+  }
+
+  hash += (guint64) size;
+
+  for (; i + 8 <= size; i += 8) {
+    memcpy (&v, p + i, sizeof (v));
+    hash ^= _hash_round (0, v);
+    hash = _hash_rotl (hash, 27) * ML_HASH_PRIME1 + ML_HASH_PRIME4;
+  }
+
+  for (; i < size; i++) {
+    hash ^= p[i] * ML_HASH_PRIME5;
+    hash = _hash_rotl (hash, 11) * ML_HASH_PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= ML_HASH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= ML_HASH_PRIME3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
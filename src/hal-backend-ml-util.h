@@ -1,5 +1,8 @@
 /* SPDX-License-Identifier: Apache-2.0 */
 
+#ifndef __HAL_BACKEND_ML_UTIL_H__
+#define __HAL_BACKEND_ML_UTIL_H__
+
 #include <glib.h>
 
 #include "tensor_typedef.h"
@@ -14,6 +17,8 @@ void gst_tensor_info_free (GstTensorInfo * info);
 void gst_tensors_info_init (GstTensorsInfo * info);
 void gst_tensors_info_free (GstTensorsInfo * info);
 gsize gst_tensor_get_element_size (tensor_type type);
+tensor_type gst_tensor_get_type (const gchar * typestr);
+guint gst_tensor_parse_dimension (const gchar * dimstr, tensor_dim dim);
 gulong gst_tensor_get_element_count (const tensor_dim dim);
 gsize gst_tensor_info_get_size (const GstTensorInfo * info);
 GstTensorInfo * gst_tensors_info_get_nth_info (GstTensorsInfo * info, guint index);
@@ -21,6 +26,87 @@ void gst_tensor_info_copy_n (GstTensorInfo * dest, const GstTensorInfo * src, co
 void gst_tensor_info_copy (GstTensorInfo * dest, const GstTensorInfo * src);
 void gst_tensors_info_copy (GstTensorsInfo * dest, const GstTensorsInfo * src);
 
+/**
+ * @brief Get the number of bits of an element. Less than 8 for packed types, whose
+ *        gst_tensor_get_element_size() is the byte holding an element.
+ */
+gsize ml_tensor_get_element_bits (tensor_type type);
+
+/**
+ * @brief Get the type reported to the framework. The types after _NNS_END are not defined by
+ *        nnstreamer and are reported as _NNS_END (invalid).
+ */
+tensor_type ml_tensor_type_to_gst (tensor_type type);
+
+/**
+ * @brief Compact tensors info used in the backends, sized to the number of tensors.
+ *        GstTensorsInfo has 16 entries inline and allocates 240 extra entries for the 17th tensor.
+ *        Convert at the API boundary with ml_tensors_info_from_gst() and ml_tensors_info_to_gst().
+ */
+typedef struct {
+  guint num_tensors; /**< The number of tensors */
+  tensor_format format; /**< tensor stream type */
+  GstTensorInfo *info; /**< The list of tensor info, num_tensors entries */
+} ml_tensors_info_s;
+
+void ml_tensors_info_init (ml_tensors_info_s * info);
+void ml_tensors_info_free (ml_tensors_info_s * info);
+gboolean ml_tensors_info_alloc (ml_tensors_info_s * info, guint num);
+GstTensorInfo * ml_tensors_info_get_nth_info (const ml_tensors_info_s * info, guint index);
+void ml_tensors_info_copy (ml_tensors_info_s * dest, const ml_tensors_info_s * src);
+
+/**
+ * @brief Checks if the tensors have the same types and dimensions. The names are not compared,
+ *        and the dimensions beyond the rank are regarded as 1.
+ */
+gboolean ml_tensors_info_is_equal (const ml_tensors_info_s * a, const ml_tensors_info_s * b);
+
+void ml_tensors_info_from_gst (ml_tensors_info_s * dest, const GstTensorsInfo * src);
+void ml_tensors_info_to_gst (GstTensorsInfo * dest, const ml_tensors_info_s * src);
+
+/**
+ * @brief Operation of get_model_info to borrow the model info without copy.
+ *        in_info is a pointer to ml_model_info_s *, which is set to the shared model info
+ *        with a new reference. out_info is not used. Release it with ml_model_info_unref().
+ *        GET_IN_OUT_INFO still deep-copies the info for compatibility.
+ */
+#define ML_GET_IN_OUT_INFO_BORROWED (0x100)
+
+/**
+ * @brief Immutable, refcounted model info shared by the backend and the callers.
+ *        Tensor names are interned strings. Do not modify or free the fields.
+ */
+typedef struct {
+  gint refcount;
+  GstTensorsInfo input; /**< Input tensors info */
+  GstTensorsInfo output; /**< Output tensors info */
+} ml_model_info_s;
+
+ml_model_info_s * ml_model_info_new (const ml_tensors_info_s * input, const ml_tensors_info_s * output);
+ml_model_info_s * ml_model_info_ref (ml_model_info_s * info);
+void ml_model_info_unref (ml_model_info_s * info);
+
+/**
+ * @brief Convert bfloat16 elements to float32. Vectorized with SSE2 or NEON if available.
+ * @note The buffers must not overlap.
+ */
+void ml_bf16_to_fp32 (float * dest, const guint16 * src, gsize count);
+
+/**
+ * @brief Convert float32 elements to bfloat16, rounding to nearest even. NaN stays NaN.
+ *        Vectorized with SSE2 or NEON if available.
+ * @note The buffers must not overlap.
+ */
+void ml_fp32_to_bf16 (guint16 * dest, const float * src, gsize count);
+
+/**
+ * @brief Fast 64-bit hash of a buffer, to detect changed data (XXH64 rounds over 4 independent
+ *        lanes, so it runs at the speed of memory). Not a cryptographic hash.
+ */
+guint64 ml_hash_data (const void * data, gsize size);
+
 #ifdef __cplusplus
 }
 #endif
+
+#endif /* __HAL_BACKEND_ML_UTIL_H__ */
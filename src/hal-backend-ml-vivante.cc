@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: Apache-2.0 */
 
 #include <dlfcn.h>
+#include <math.h>
 #include <glib.h>
 #include <json-glib/json-glib.h>
 
@@ -9,9 +10,61 @@
 
 #include <ovx/vsi_nn_pub.h>
 
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-buffer-pool.h"
+#include "hal-backend-ml-copy.h"
+#include "hal-backend-ml-detect.h"
+#include "hal-backend-ml-int4.h"
+#include "hal-backend-ml-layout.h"
+#include "hal-backend-ml-postproc.h"
+#include "hal-backend-ml-preproc.h"
+#include "hal-backend-ml-result-cache.h"
+#include "hal-backend-ml-roi.h"
+#include "hal-backend-ml-tile.h"
+#include "hal-backend-ml-trace.h"
 #include "hal-backend-ml-util.h"
 
 
+/**
+ * @brief Upload of an input tensor to the graph.
+ */
+typedef enum {
+  VIVANTE_UPLOAD_ALWAYS = 0,
+  VIVANTE_UPLOAD_CHANGED, /* skipped if the data is the same as the last upload */
+  VIVANTE_UPLOAD_ONCE, /* sticky, uploaded by the first invoke only */
+} vivante_upload_e;
+
+/**
+ * @brief Upload state of an input tensor.
+ */
+typedef struct {
+  vivante_upload_e mode;
+  gsize size; /* size of the input from the pipeline */
+  gboolean uploaded;
+  guint64 hash; /* hash of the last upload of a static input */
+  const void *data; /* buffer of the last upload, or of the last input found the same */
+  void *shadow; /* copy of the last upload, to verify a hash match from another buffer */
+} vivante_input_state_s;
+
+/**
+ * @brief Hidden state of a recurrent model, the output of a run is fed back to the input of the next run.
+ */
+typedef struct {
+  guint output; /* index of the graph output */
+  guint input; /* index of the graph input */
+  gsize size; /* size of the graph tensors */
+} vivante_state_s;
+
+/**
+ * @brief Kept while the instance is alive, across the reloads of the model.
+ */
+typedef struct {
+  GMutex lock; /* held by invoke, the model is swapped between invokes */
+  gchar *custom_properties; /* of the last configure, for the reloaded model */
+  tensors_layout input_layout;
+  tensors_layout output_layout;
+} vivante_reload_s;
+
 /**
  * @brief Private handle for the Vivante instance.
  */
@@ -19,18 +72,53 @@ typedef struct _vivante_handle_s {
   char *model_path; /* .nb file path */
   char *so_path; /* .so file path (for .so based model loading) */
   char *json_path; /* .json file path (for JSON based model loading) */
+  char *anchors_path; /* anchors file of the SSD detection */
   gboolean use_json_for_graph;
   gboolean has_post_process; /** @deprecated Do not use it. */
 
   gboolean convert_output_fp32; /* Convert all output tensor into fp32 */
-
-  GstTensorsInfo inputInfo;
-  GstTensorsInfo outputInfo;
+  gboolean use_output_pool; /* Allocate the output buffers in invoke (allocate_in_invoke) */
+  ml_buffer_pool_s *output_pool; /* Kept until the last output is released, outputs may be still in use after reconfigure and deinit */
+  vivante_reload_s *reload; /* Kept while the instance is alive, NULL in the handle of a model being reloaded */
+
+  ml_tensors_info_s inputInfo;
+  ml_tensors_info_s outputInfo;
+  ml_model_info_s *model_info; /* shared with the callers of get_model_info */
+
+  tensor_layout model_layout; /* native layout of the graph tensors */
+  ml_layout_stage_s *input_layout; /* to the input layout of the pipeline, NULL if not needed */
+  ml_layout_stage_s *output_layout; /* to the output layout of the pipeline, NULL if not needed */
+  ml_preproc_s *preproc; /* raw uint8 frame to the model input, NULL if not needed */
+  guint preproc_index; /* index of the preprocessed input */
+  ml_postproc_s *postproc; /* model output to the class indices, NULL if not needed */
+  guint postproc_index; /* index of the post-processed output */
+  ml_detect_s *detect; /* box and score outputs to the detections, NULL if not needed */
+  guint detect_box_index; /* index of the box output, the detections */
+  guint detect_score_index; /* index of the score output, the number of detections */
+  ml_tile_s *tile; /* frame to the tiles of the model input, NULL if not needed */
+  guint tile_index; /* index of the tiled input */
+  ml_roi_s *roi; /* frame and ROIs to the batched model input, NULL if not needed */
+  guint roi_index; /* index of the batched input, the ROIs are the last input */
+  vivante_input_state_s *input_state; /* upload of each input, NULL if all inputs are uploaded always */
+  guint num_input_state; /* number of the graph inputs in input_state */
+  ml_result_cache_s *result_cache; /* outputs of the recent inputs, NULL if not needed */
+  vivante_state_s *states; /* state outputs fed back to the inputs, NULL if not stateful */
+  guint num_states;
+  void *state_buffer; /* staging of the reset, and of the feedback if not from handles, the size of the largest state */
+  void **state_memory; /* memory of the state tensors created from handles, freed after the graph */
+  guint num_state_memory;
+  tensor_type *input_convert; /* graph type of each graph input converted on copy, _NNS_END if copied as is, NULL if none */
+  tensor_type *output_convert; /* graph type of each graph output converted on copy, _NNS_END if copied as is, NULL if none */
+  void *convert_buffer; /* staging of the converted tensors in the graph type, the size of the largest one */
+  gint state_reset; /* the next invoke zeroes the states */
+  guint *input_map; /* graph index of each input of the pipeline, NULL if not stateful */
+  guint *output_map; /* graph index of each output of the pipeline, NULL if not stateful */
 
   vsi_nn_graph_t *graph;
 
   /* Handles for JSON based model loading */
   vsi_nn_context_t ctx;
+  gchar **node_models; /* NBG file of each node, if the JSON has 'nodes' */
 
   /* Handles for .so based model loading */
   void *dl_handle; /* dlopened model so */
@@ -44,7 +132,8 @@ typedef struct _vivante_handle_s {
  * ===================================================================
  */
 static void _json_release_neural_network (vivante_handle_s *self);
-static int _json_create_neural_network (vivante_handle_s *self);
+static int _json_create_neural_network (vivante_handle_s *self, const guint *state_outputs,
+    guint num_state_outputs, const guint *state_inputs, guint num_state_inputs);
 static int _so_create_neural_network (vivante_handle_s *self);
 
 /* ===================================================================
@@ -58,7 +147,12 @@ vivante_vsi_type_from_string (const gchar *vsi_type_str)
   if (!vsi_type_str)
     return VSI_NN_TYPE_NONE;
 
-  /** @todo Add 4-bit types when available */
+#if defined(HAVE_VSI_NN_TYPE_INT4)
+  if (g_ascii_strcasecmp (vsi_type_str, "VSI_NN_TYPE_INT4") == 0)
+    return VSI_NN_TYPE_INT4;
+  if (g_ascii_strcasecmp (vsi_type_str, "VSI_NN_TYPE_UINT4") == 0)
+    return VSI_NN_TYPE_UINT4;
+#endif
   if (g_ascii_strcasecmp (vsi_type_str, "VSI_NN_TYPE_INT8") == 0)
     return VSI_NN_TYPE_INT8;
   if (g_ascii_strcasecmp (vsi_type_str, "VSI_NN_TYPE_UINT8") == 0)
@@ -117,6 +211,12 @@ static tensor_type
 convert_to_tensor_type (vsi_nn_type_e vsi_type)
 {
   switch (vsi_type) {
+#if defined(HAVE_VSI_NN_TYPE_INT4)
+    case VSI_NN_TYPE_INT4:
+      return _NNS_INT4;
+    case VSI_NN_TYPE_UINT4:
+      return _NNS_UINT4;
+#endif
     case VSI_NN_TYPE_BOOL8:
     case VSI_NN_TYPE_INT8:
       return _NNS_INT8;
@@ -135,8 +235,9 @@ convert_to_tensor_type (vsi_nn_type_e vsi_type)
     case VSI_NN_TYPE_UINT64:
       return _NNS_UINT64;
     case VSI_NN_TYPE_FLOAT16:
-    case VSI_NN_TYPE_BFLOAT16:
       return _NNS_FLOAT16;
+    case VSI_NN_TYPE_BFLOAT16:
+      return _NNS_BFLOAT16;
     case VSI_NN_TYPE_FLOAT32:
       return _NNS_FLOAT32;
     case VSI_NN_TYPE_FLOAT64:
@@ -214,12 +315,344 @@ _helper_parse_tensor_attributes (JsonObject *tensor_obj, vsi_nn_tensor_attr_t *v
   return HAL_ML_ERROR_NONE;
 }
 
-/** @brief Creates and sets up the neural network graph using a JSON definition file. */
+/** @brief Gets the quantization parameters of a tensor from its dtype, real = (q - zero_point) * scale. */
+static void
+_helper_get_quant_params (const vsi_nn_dtype_t *dtype, gboolean *quantized, float *scale, gint32 *zero_point)
+{
+  switch (dtype->qnt_type) {
+    case VSI_NN_QNT_TYPE_AFFINE_ASYMMETRIC:
+    case VSI_NN_QNT_TYPE_AFFINE_SYMMETRIC:
+      *quantized = TRUE;
+      *scale = dtype->scale;
+      *zero_point = dtype->zero_point;
+      break;
+    case VSI_NN_QNT_TYPE_DFP:
+      *quantized = TRUE;
+      *scale = ldexpf (1.0f, -dtype->fl);
+      *zero_point = 0;
+      break;
+    default:
+      /** @todo Per-channel quantization */
+      *quantized = FALSE;
+      break;
+  }
+}
+
+#if defined(HAVE_VSI_NN_PRE_PROCESS)
+/** @brief Converts the source format string of a pre-process from JSON to its enum. */
+static gboolean
+vivante_source_format_from_string (const gchar *format_str, vsi_nn_preprocess_source_format_e *format)
+{
+  if (g_ascii_strcasecmp (format_str, "TENSOR") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_TENSOR;
+  else if (g_ascii_strcasecmp (format_str, "GRAY") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_IMAGE_GRAY;
+  else if (g_ascii_strcasecmp (format_str, "RGB") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_IMAGE_RGB;
+  else if (g_ascii_strcasecmp (format_str, "RGB888_PLANAR") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_IMAGE_RGB888_PLANAR;
+  else if (g_ascii_strcasecmp (format_str, "BGRA") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_IMAGE_BGRA;
+  else if (g_ascii_strcasecmp (format_str, "YUV420") == 0 || g_ascii_strcasecmp (format_str, "I420") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_IMAGE_YUV420;
+  else if (g_ascii_strcasecmp (format_str, "YUV444") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_IMAGE_YUV444;
+  else if (g_ascii_strcasecmp (format_str, "NV12") == 0)
+    *format = VSI_NN_SOURCE_FORMAT_IMAGE_NV12;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * @brief Inserts the pre-process nodes declared in the 'preprocess' array of JSON ahead of
+ *        the graph inputs. Each pre-process replaces its graph input with the source tensor.
+ */
+static int
+_json_add_preprocess (vivante_handle_s *self, JsonArray *preprocess_array)
+{
+  for (guint i = 0; i < json_array_get_length (preprocess_array); ++i) {
+    JsonObject *obj = json_array_get_object_element (preprocess_array, i);
+    vsi_nn_preprocess_base_t preprocess[5];
+    vsi_nn_preprocess_source_layout_e layout = VSI_NN_SOURCE_LAYOUT_NHWC;
+    vsi_nn_preprocess_source_format_e format = VSI_NN_SOURCE_FORMAT_IMAGE_RGB;
+    vsi_nn_preprocess_image_size_t size;
+    vsi_nn_process_mean_and_scale_t mean_and_scale;
+    float mean[4] = { 0.0f, };
+    vsi_bool reverse_channel;
+    JsonArray *array;
+    guint input, count = 0;
+
+    if (!obj) {
+      g_critical ("[vivante] Pre-process #%u in JSON is not an object.", i);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    input = (guint) json_object_get_int_member_with_default (obj, "input", 0);
+    if (input >= self->graph->input.num) {
+      g_critical ("[vivante] Invalid input index of pre-process #%u: %u", i, input);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    if (json_object_has_member (obj, "source_layout")) {
+      const gchar *layout_str = json_object_get_string_member (obj, "source_layout");
+
+      if (g_ascii_strcasecmp (layout_str, "NCHW") == 0) {
+        layout = VSI_NN_SOURCE_LAYOUT_NCHW;
+      } else if (g_ascii_strcasecmp (layout_str, "NHWC") != 0) {
+        g_critical ("[vivante] Unknown source layout of pre-process #%u: %s", i, layout_str);
+        return HAL_ML_ERROR_INVALID_PARAMETER;
+      }
+    }
+    preprocess[count].type = VSI_NN_PREPROCESS_SOURCE_LAYOUT;
+    preprocess[count++].param = &layout;
+
+    if (json_object_has_member (obj, "source_format")) {
+      const gchar *format_str = json_object_get_string_member (obj, "source_format");
+
+      if (!vivante_source_format_from_string (format_str, &format)) {
+        g_critical ("[vivante] Unknown source format of pre-process #%u: %s", i, format_str);
+        return HAL_ML_ERROR_INVALID_PARAMETER;
+      }
+    }
+    preprocess[count].type = VSI_NN_PREPROCESS_SET_SOURCE_FORMAT;
+    preprocess[count++].param = &format;
+
+    // Optional: size of the source image [w, h, c], resized to the graph input
+    array = json_object_get_array_member (obj, "source_size");
+    if (array) {
+      const gchar *resize = json_object_get_string_member_with_default (obj, "resize", "BILINEAR");
+
+      if (json_array_get_length (array) < 2) {
+        g_critical ("[vivante] 'source_size' of pre-process #%u should be [w, h] or [w, h, c].", i);
+        return HAL_ML_ERROR_INVALID_PARAMETER;
+      }
+
+      size.w = json_array_get_int_element (array, 0);
+      size.h = json_array_get_int_element (array, 1);
+      size.c = (json_array_get_length (array) > 2) ? json_array_get_int_element (array, 2) : 3;
+
+      preprocess[count].type = (g_ascii_strcasecmp (resize, "NEAREST") == 0)
+                                   ? VSI_NN_PREPROCESS_IMAGE_RESIZE_NEAREST
+                                   : VSI_NN_PREPROCESS_IMAGE_RESIZE_BILINEAR;
+      preprocess[count++].param = &size;
+    }
+
+    // Optional: (x - mean[c]) * scale
+    array = json_object_get_array_member (obj, "mean");
+    if (array || json_object_has_member (obj, "scale")) {
+      guint len = array ? json_array_get_length (array) : 0;
+
+      if (len > G_N_ELEMENTS (mean)) {
+        g_critical ("[vivante] Too many 'mean' values of pre-process #%u: %u", i, len);
+        return HAL_ML_ERROR_INVALID_PARAMETER;
+      }
+
+      for (guint j = 0; j < len; ++j)
+        mean[j] = (float) json_array_get_double_element (array, j);
+
+      mean_and_scale.channel_mean = mean;
+      mean_and_scale.channel_len = (int32_t) MAX (len, 1U);
+      mean_and_scale.scale = (float) json_object_get_double_member_with_default (obj, "scale", 1.0);
+
+      preprocess[count].type = VSI_NN_PREPROCESS_MEAN_AND_SCALE;
+      preprocess[count++].param = &mean_and_scale;
+    }
+
+    if (json_object_get_boolean_member_with_default (obj, "reverse_channel", FALSE)) {
+      reverse_channel = TRUE;
+      preprocess[count].type = VSI_NN_PREPROCESS_REVERSE_CHANNEL;
+      preprocess[count++].param = &reverse_channel;
+    }
+
+    if (vsi_nn_AddGraphPreProcess (self->graph, input, preprocess, count) != VSI_SUCCESS) {
+      g_critical ("[vivante] Failed to add pre-process #%u to the input tensor #%u.", i, input);
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+
+    g_info ("[vivante] Added pre-process #%u to the input tensor #%u.", i, input);
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+#endif
+
+/**
+ * @brief Adds the tensors in the JSON array to the graph, and maps their 'id' to the VSI tensor id.
+ *        The tensors marked in from_handle (nullable) are created from the memory of the backend,
+ *        so that their handles can be swapped.
+ */
+static int
+_json_add_tensors (vivante_handle_s *self, JsonArray *array, const gchar *kind,
+    gboolean is_virtual, vsi_nn_tensor_id_t *ids, GHashTable *id_table, const gboolean *from_handle)
+{
+  for (guint i = 0; i < json_array_get_length (array); ++i) {
+    vsi_nn_tensor_attr_t tensor_attr;
+    vsi_nn_tensor_id_t vsi_id;
+
+    // parse attr data from json
+    JsonObject *tensor_obj = json_array_get_object_element (array, i);
+    if (_helper_parse_tensor_attributes (tensor_obj, &tensor_attr) != HAL_ML_ERROR_NONE) {
+      g_critical ("[vivante] Failed to parse tensor attributes from JSON");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+    tensor_attr.vtl = is_virtual;
+
+    // Add the tensor to the graph
+#if defined(HAVE_VSI_NN_SWAP_TENSOR_HANDLE)
+    if (from_handle && from_handle[i]) {
+      /* Page aligned, as the driver requires for the memory of a handle. */
+      void *memory = ml_alloc (vsi_nn_GetTensorSize (tensor_attr.size, tensor_attr.dim_num,
+                                   tensor_attr.dtype.vx_type),
+          ML_ALLOC_FLAG_PREFAULT, NULL);
+
+      if (!memory) {
+        g_critical ("[vivante] Failed to allocate the memory of %s tensor #%u", kind, i);
+        return HAL_ML_ERROR_RUNTIME_ERROR;
+      }
+
+      self->state_memory[self->num_state_memory++] = memory;
+      vsi_id = vsi_nn_AddTensorFromHandle (
+          self->graph, VSI_NN_TENSOR_ID_AUTO, &tensor_attr, (uint8_t *) memory);
+    } else
+#endif
+    {
+      vsi_id = vsi_nn_AddTensor (self->graph, VSI_NN_TENSOR_ID_AUTO, &tensor_attr, NULL);
+    }
+
+    if (vsi_id == VSI_NN_TENSOR_ID_NA) {
+      g_critical ("[vivante] Failed to add %s tensor #%u", kind, i);
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+
+    g_info ("[vivante] Added %s tensor #%u with id %u", kind, i, vsi_id);
+    if (ids)
+      ids[i] = vsi_id;
+
+    if (id_table && json_object_has_member (tensor_obj, "id")) {
+      gint64 json_id = json_object_get_int_member (tensor_obj, "id");
+
+      if (g_hash_table_contains (id_table, GINT_TO_POINTER ((gint) json_id))) {
+        g_critical ("[vivante] Duplicated tensor id in JSON: %" G_GINT64_FORMAT, json_id);
+        return HAL_ML_ERROR_INVALID_PARAMETER;
+      }
+
+      g_hash_table_insert (id_table, GINT_TO_POINTER ((gint) json_id), GUINT_TO_POINTER (vsi_id));
+    }
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/** @brief Sets the tensors of a node from the JSON array of tensor ids. */
+static int
+_json_set_node_tensors (JsonArray *array, vsi_nn_tensor_id_t *tensors, GHashTable *id_table)
+{
+  for (guint i = 0; i < json_array_get_length (array); ++i) {
+    gint json_id = (gint) json_array_get_int_element (array, i);
+    gpointer vsi_id;
+
+    if (!g_hash_table_lookup_extended (id_table, GINT_TO_POINTER (json_id), NULL, &vsi_id)) {
+      g_critical ("[vivante] Unknown tensor id of a node in JSON: %d", json_id);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    tensors[i] = (vsi_nn_tensor_id_t) GPOINTER_TO_UINT (vsi_id);
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Adds the NBG nodes in the 'nodes' array of JSON, wired by the tensor ids. The tensors
+ *        between the nodes are virtual, so the intermediates stay on the device.
+ */
+static int
+_json_add_nbg_nodes (vivante_handle_s *self, JsonArray *nodes_array, GHashTable *id_table)
+{
+  const guint num_nodes = json_array_get_length (nodes_array);
+
+  self->node_models = g_new0 (gchar *, num_nodes + 1);
+
+  for (guint i = 0; i < num_nodes; ++i) {
+    JsonObject *node_obj = json_array_get_object_element (nodes_array, i);
+    JsonArray *inputs, *outputs;
+    const gchar *model;
+    vsi_nn_node_t *node;
+    int status;
+
+    inputs = node_obj ? json_object_get_array_member (node_obj, "inputs") : NULL;
+    outputs = node_obj ? json_object_get_array_member (node_obj, "outputs") : NULL;
+    if (!inputs || !outputs || json_array_get_length (outputs) == 0) {
+      g_critical ("[vivante] Node #%u in JSON must contain 'inputs' and 'outputs' arrays.", i);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    // The model of the first node is the model file by default, relative paths are from the JSON file.
+    model = json_object_get_string_member_with_default (node_obj, "model", NULL);
+    if (!model && i == 0) {
+      self->node_models[i] = g_strdup (self->model_path);
+    } else if (!model) {
+      g_critical ("[vivante] Node #%u in JSON must contain 'model'.", i);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    } else if (g_path_is_absolute (model)) {
+      self->node_models[i] = g_strdup (model);
+    } else {
+      gchar *json_dir = g_path_get_dirname (self->json_path);
+
+      self->node_models[i] = g_build_filename (json_dir, model, NULL);
+      g_free (json_dir);
+    }
+    if (!g_file_test (self->node_models[i], G_FILE_TEST_IS_REGULAR)) {
+      g_critical ("[vivante] Invalid model file of node #%u: %s", i, self->node_models[i]);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    node = vsi_nn_AddNode (self->graph, VSI_NN_OP_NBG,
+        json_array_get_length (inputs), json_array_get_length (outputs), NULL);
+    if (!node) {
+      g_critical ("[vivante] Failed to add NBG node #%u to graph.", i);
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+    node->uid = i;
+    node->nn_param.nbg.type = VSI_NN_NBG_FILE;
+    node->nn_param.nbg.url = self->node_models[i];
+
+    status = _json_set_node_tensors (inputs, node->input.tensors, id_table);
+    if (status == HAL_ML_ERROR_NONE)
+      status = _json_set_node_tensors (outputs, node->output.tensors, id_table);
+    if (status != HAL_ML_ERROR_NONE)
+      return status;
+
+    g_info ("[vivante] Added NBG node #%u (%s)", i, self->node_models[i]);
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Gets the number of virtual tensors of the graph. With 'nodes', the tensors in
+ *        'virtual_tensors', otherwise one for each output of the single NBG node.
+ */
+static guint
+_json_get_virtual_tensors_num (JsonArray *output_array, JsonArray *nodes_array, JsonArray *virtual_array)
+{
+  if (nodes_array)
+    return virtual_array ? json_array_get_length (virtual_array) : 0;
+
+  return json_array_get_length (output_array);
+}
+
+/**
+ * @brief Creates and sets up the neural network graph using a JSON definition file.
+ *        The state inputs and outputs are created from handles, to be swapped after each run.
+ */
 static int
-_json_create_neural_network (vivante_handle_s *self)
+_json_create_neural_network (vivante_handle_s *self, const guint *state_outputs,
+    guint num_state_outputs, const guint *state_inputs, guint num_state_inputs)
 {
-  const guint node_num = 1U; /* single NBG node */
-  const guint const_tensors_num = 0U; /** @todo support this */
+  guint node_num = 1U; /* NBG nodes, and the pre-process nodes if declared */
 
   gchar *json_string = NULL;
   GError *err = NULL;
@@ -227,11 +660,19 @@ _json_create_neural_network (vivante_handle_s *self)
   JsonNode *root_node = NULL;
   JsonObject *root_obj = NULL;
   JsonArray *input_array = NULL, *output_array = NULL;
+  JsonArray *nodes_array = NULL, *virtual_array = NULL;
+  GHashTable *id_table = NULL;
+  gboolean *input_handle = NULL, *output_handle = NULL;
+#if defined(HAVE_VSI_NN_PRE_PROCESS)
+  JsonArray *preprocess_array = NULL;
+#endif
   guint input_tensors_num = 0, output_tensors_num = 0;
   guint normal_tensors_num = 0, virtual_tensors_num = 0;
   vsi_nn_node_t *node = NULL;
   int ret = HAL_ML_ERROR_RUNTIME_ERROR;
 
+  ML_TRACE_SCOPE ("vivante:json_create_neural_network");
+
   self->ctx = vsi_nn_CreateContext ();
   if (!self->ctx) {
     g_critical ("[vivante] Failed to create VSI context.");
@@ -245,12 +686,15 @@ _json_create_neural_network (vivante_handle_s *self)
     goto cleanup;
   }
 
+  ML_TRACE_BEGIN ("vivante:parse_json");
   parser = json_parser_new ();
   if (!json_parser_load_from_data (parser, json_string, -1, &err)) {
+    ML_TRACE_END ("vivante:parse_json");
     g_critical ("[vivante] Failed to parse JSON: %s", err ? err->message : "Unknown error");
     ret = HAL_ML_ERROR_INVALID_PARAMETER;
     goto cleanup;
   }
+  ML_TRACE_END ("vivante:parse_json");
 
   root_node = json_parser_get_root (parser);
   if (!root_node || !JSON_NODE_HOLDS_OBJECT (root_node)) {
@@ -271,11 +715,48 @@ _json_create_neural_network (vivante_handle_s *self)
   input_tensors_num = json_array_get_length (input_array);
   output_tensors_num = json_array_get_length (output_array);
 
+  // Optional: pre-process nodes on NPU, ahead of the NBG node
+  if (json_object_has_member (root_obj, "preprocess")) {
+#if defined(HAVE_VSI_NN_PRE_PROCESS)
+    preprocess_array = json_object_get_array_member (root_obj, "preprocess");
+    if (!preprocess_array) {
+      g_critical ("[vivante] 'preprocess' in JSON should be an array.");
+      ret = HAL_ML_ERROR_INVALID_PARAMETER;
+      goto cleanup;
+    }
+    node_num += json_array_get_length (preprocess_array);
+#else
+    g_critical ("[vivante] 'preprocess' in JSON is not supported by this ovxlib.");
+    ret = HAL_ML_ERROR_NOT_SUPPORTED;
+    goto cleanup;
+#endif
+  }
+
+  // The weights are in the NBG files, no tensor of the graph has data from JSON
+  if (json_object_has_member (root_obj, "const_tensors")) {
+    g_critical ("[vivante] 'const_tensors' in JSON is not supported, the constants should be in the NBG.");
+    ret = HAL_ML_ERROR_NOT_SUPPORTED;
+    goto cleanup;
+  }
+
+  // Optional: NBG nodes wired by tensor ids, with virtual tensors between them
+  if (json_object_has_member (root_obj, "nodes")) {
+    nodes_array = json_object_get_array_member (root_obj, "nodes");
+    if (!nodes_array || json_array_get_length (nodes_array) == 0) {
+      g_critical ("[vivante] 'nodes' in JSON should be a non-empty array.");
+      ret = HAL_ML_ERROR_INVALID_PARAMETER;
+      goto cleanup;
+    }
+
+    virtual_array = json_object_get_array_member (root_obj, "virtual_tensors");
+    node_num += json_array_get_length (nodes_array) - 1;
+  }
+
   normal_tensors_num = input_tensors_num + output_tensors_num;
-  virtual_tensors_num = output_tensors_num;
+  virtual_tensors_num = _json_get_virtual_tensors_num (output_array, nodes_array, virtual_array);
 
   self->graph = vsi_nn_CreateGraph (self->ctx,
-      normal_tensors_num + virtual_tensors_num + const_tensors_num, node_num);
+      normal_tensors_num + virtual_tensors_num, node_num);
   if (!self->graph) {
     g_critical ("[vivante] Failed to create VSI graph.");
     goto cleanup;
@@ -287,40 +768,55 @@ _json_create_neural_network (vivante_handle_s *self)
     goto cleanup;
   }
 
-  node = vsi_nn_AddNode (
-      self->graph, VSI_NN_OP_NBG, input_tensors_num, output_tensors_num, NULL);
-  if (!node) {
-    g_critical ("[vivante] Failed to add NBG node to graph.");
-    goto cleanup;
-  }
-  node->uid = 0;
-  node->nn_param.nbg.type = VSI_NN_NBG_FILE;
-  node->nn_param.nbg.url = self->model_path;
+  id_table = g_hash_table_new (g_direct_hash, g_direct_equal);
 
-  // Set up input tensors
-  for (guint i = 0; i < input_tensors_num; ++i) {
-    vsi_nn_tensor_attr_t tensor_attr;
+  /* The indices are checked when the states are set up, the tensors are copied if not from handles. */
+  input_handle = g_new0 (gboolean, input_tensors_num);
+  output_handle = g_new0 (gboolean, output_tensors_num);
+  for (guint k = 0; k < num_state_inputs; k++) {
+    if (state_inputs[k] < input_tensors_num)
+      input_handle[state_inputs[k]] = TRUE;
+  }
+  for (guint k = 0; k < num_state_outputs; k++) {
+    if (state_outputs[k] < output_tensors_num)
+      output_handle[state_outputs[k]] = TRUE;
+  }
+  self->state_memory = g_new0 (void *, num_state_inputs + num_state_outputs);
+
+  // Set up input and output tensors
+  ret = _json_add_tensors (self, input_array, "input", FALSE, self->graph->input.tensors, id_table, input_handle);
+  if (ret == HAL_ML_ERROR_NONE)
+    ret = _json_add_tensors (self, output_array, "output", FALSE, self->graph->output.tensors, id_table, output_handle);
+  if (ret == HAL_ML_ERROR_NONE && virtual_array)
+    ret = _json_add_tensors (self, virtual_array, "virtual", TRUE, NULL, id_table, NULL);
+  if (ret != HAL_ML_ERROR_NONE)
+    goto cleanup;
 
-    // parse attr data from json
-    JsonObject *tensor_obj = json_array_get_object_element (input_array, i);
-    if (_helper_parse_tensor_attributes (tensor_obj, &tensor_attr) != HAL_ML_ERROR_NONE) {
-      g_critical ("[vivante] Failed to parse tensor attributes from JSON");
+  if (nodes_array) {
+    ret = _json_add_nbg_nodes (self, nodes_array, id_table);
+    if (ret != HAL_ML_ERROR_NONE)
       goto cleanup;
-    }
-
-    // Add the tensor to the graph
-    vsi_nn_tensor_id_t vsi_input_id
-        = vsi_nn_AddTensor (self->graph, VSI_NN_TENSOR_ID_AUTO, &tensor_attr, NULL);
-    if (vsi_input_id == VSI_NN_TENSOR_ID_NA) {
-      g_critical ("[vivante] Failed to add input tensor #%u", i);
+  } else {
+    // Single NBG node from all inputs to all outputs
+    node = vsi_nn_AddNode (
+        self->graph, VSI_NN_OP_NBG, input_tensors_num, output_tensors_num, NULL);
+    if (!node) {
+      g_critical ("[vivante] Failed to add NBG node to graph.");
+      ret = HAL_ML_ERROR_RUNTIME_ERROR;
       goto cleanup;
     }
-
-    g_info ("[vivante] Added input tensor #%u with id %u", i, vsi_input_id);
-    node->input.tensors[i] = vsi_input_id;
-    self->graph->input.tensors[i] = vsi_input_id;
+    node->uid = 0;
+    node->nn_param.nbg.type = VSI_NN_NBG_FILE;
+    node->nn_param.nbg.url = self->model_path;
+
+    for (guint i = 0; i < input_tensors_num; ++i)
+      node->input.tensors[i] = self->graph->input.tensors[i];
+    for (guint i = 0; i < output_tensors_num; ++i)
+      node->output.tensors[i] = self->graph->output.tensors[i];
   }
 
+  ret = HAL_ML_ERROR_RUNTIME_ERROR;
+
   for (guint i = 0; i < input_tensors_num; ++i) {
     g_info ("[vivante] Print input tensor #%u (%u):", i, self->graph->input.tensors[i]);
     vsi_nn_tensor_t *tensor
@@ -328,30 +824,6 @@ _json_create_neural_network (vivante_handle_s *self)
     vsi_nn_PrintTensor (tensor, self->graph->input.tensors[i]);
   }
 
-  // Set up output tensors
-  for (guint i = 0; i < output_tensors_num; ++i) {
-    vsi_nn_tensor_attr_t tensor_attr;
-
-    // parse attr data from json
-    JsonObject *tensor_obj = json_array_get_object_element (output_array, i);
-    if (_helper_parse_tensor_attributes (tensor_obj, &tensor_attr) != HAL_ML_ERROR_NONE) {
-      g_critical ("[vivante] Failed to parse tensor attributes from JSON");
-      goto cleanup;
-    }
-
-    // Add the tensor to the graph
-    vsi_nn_tensor_id_t vsi_output_id
-        = vsi_nn_AddTensor (self->graph, VSI_NN_TENSOR_ID_AUTO, &tensor_attr, NULL);
-    if (vsi_output_id == VSI_NN_TENSOR_ID_NA) {
-      g_critical ("[vivante] Failed to add output tensor #%u", i);
-      goto cleanup;
-    }
-
-    g_info ("[vivante] Added output tensor #%u with id %u", i, vsi_output_id);
-    node->output.tensors[i] = vsi_output_id;
-    self->graph->output.tensors[i] = vsi_output_id;
-  }
-
   for (guint i = 0; i < output_tensors_num; ++i) {
     g_info ("[vivante] Print output tensor #%u (%u):", i, self->graph->output.tensors[i]);
     vsi_nn_tensor_t *tensor
@@ -359,11 +831,24 @@ _json_create_neural_network (vivante_handle_s *self)
     vsi_nn_PrintTensor (tensor, self->graph->output.tensors[i]);
   }
 
+#if defined(HAVE_VSI_NN_PRE_PROCESS)
+  if (preprocess_array) {
+    ret = _json_add_preprocess (self, preprocess_array);
+    if (ret != HAL_ML_ERROR_NONE)
+      goto cleanup;
+
+    ret = HAL_ML_ERROR_RUNTIME_ERROR;
+  }
+#endif
+
   // setup graph
+  ML_TRACE_BEGIN ("vivante:setup_graph");
   if (vsi_nn_SetupGraph (self->graph, FALSE) != VSI_SUCCESS) {
+    ML_TRACE_END ("vivante:setup_graph");
     g_critical ("[vivante] Failed to setup VSI graph.");
     goto cleanup;
   }
+  ML_TRACE_END ("vivante:setup_graph");
 
   ret = HAL_ML_ERROR_NONE;
 
@@ -373,6 +858,9 @@ cleanup:
 
   g_clear_error (&err);
   g_clear_pointer (&json_string, g_free);
+  g_clear_pointer (&id_table, g_hash_table_destroy);
+  g_free (input_handle);
+  g_free (output_handle);
   g_clear_object (&parser);
   return ret;
 }
@@ -389,6 +877,17 @@ _json_release_neural_network (vivante_handle_s *self)
     vsi_nn_ReleaseContext (&self->ctx);
     self->ctx = NULL;
   }
+
+  /* The NBG nodes refer to the paths until the graph is released. */
+  g_strfreev (self->node_models);
+  self->node_models = NULL;
+
+  /* So do the state tensors to their memory. */
+  for (guint i = 0; i < self->num_state_memory; i++)
+    ml_alloc_free (self->state_memory[i]);
+  g_free (self->state_memory);
+  self->state_memory = NULL;
+  self->num_state_memory = 0;
 }
 
 /* ===================================================================
@@ -444,18 +943,23 @@ _init_vivante_handle (vivante_handle_s *vivante)
 {
   memset (vivante, 0, sizeof (vivante_handle_s));
 
-  gst_tensors_info_init (&vivante->inputInfo);
-  gst_tensors_info_init (&vivante->outputInfo);
+  ml_tensors_info_init (&vivante->inputInfo);
+  ml_tensors_info_init (&vivante->outputInfo);
 
   vivante->use_json_for_graph = TRUE;
   vivante->has_post_process = FALSE;
   vivante->convert_output_fp32 = FALSE;
+  /* ovxlib sizes are WHCN */
+  vivante->model_layout = _NNS_LAYOUT_NCHW;
 }
 
 /** @brief Close model and clear internal data in handle. */
 static void
 _clear_vivante_handle (vivante_handle_s *vivante)
 {
+  ml_buffer_pool_s *output_pool = vivante->output_pool;
+  vivante_reload_s *reload = vivante->reload;
+
   if (vivante->use_json_for_graph) {
     _json_release_neural_network (vivante);
   } else {
@@ -467,14 +971,36 @@ _clear_vivante_handle (vivante_handle_s *vivante)
     }
   }
 
-  gst_tensors_info_free (&vivante->inputInfo);
-  gst_tensors_info_free (&vivante->outputInfo);
+  ml_tensors_info_free (&vivante->inputInfo);
+  ml_tensors_info_free (&vivante->outputInfo);
+  ml_model_info_unref (vivante->model_info);
+  ml_layout_stage_free (vivante->input_layout);
+  ml_layout_stage_free (vivante->output_layout);
+  ml_preproc_free (vivante->preproc);
+  ml_postproc_free (vivante->postproc);
+  ml_detect_free (vivante->detect);
+  ml_tile_free (vivante->tile);
+  ml_roi_free (vivante->roi);
+  for (guint i = 0; vivante->input_state && i < vivante->num_input_state; i++)
+    ml_alloc_free (vivante->input_state[i].shadow);
+  g_free (vivante->input_state);
+  ml_result_cache_free (vivante->result_cache);
+  g_free (vivante->states);
+  ml_alloc_free (vivante->state_buffer);
+  g_free (vivante->input_convert);
+  g_free (vivante->output_convert);
+  ml_alloc_free (vivante->convert_buffer);
+  g_free (vivante->input_map);
+  g_free (vivante->output_map);
 
   g_free (vivante->model_path);
   g_free (vivante->json_path);
   g_free (vivante->so_path);
+  g_free (vivante->anchors_path);
 
   _init_vivante_handle (vivante);
+  vivante->output_pool = output_pool;
+  vivante->reload = reload;
 }
 
 /* ===================================================================
@@ -487,6 +1013,9 @@ ml_vivante_init (void **backend_private)
   vivante_handle_s *vivante = g_new0 (vivante_handle_s, 1);
 
   _init_vivante_handle (vivante);
+  vivante->output_pool = ml_buffer_pool_new (ML_BUFFER_POOL_DEFAULT_MAX_CACHED);
+  vivante->reload = g_new0 (vivante_reload_s, 1);
+  g_mutex_init (&vivante->reload->lock);
 
   *backend_private = vivante;
   return HAL_ML_ERROR_NONE;
@@ -503,68 +1032,743 @@ ml_vivante_deinit (void *backend_private)
   }
 
   _clear_vivante_handle (vivante);
-  g_free (vivante);
+  g_mutex_clear (&vivante->reload->lock);
+  g_free (vivante->reload->custom_properties);
+  g_clear_pointer (&vivante->reload, g_free);
+
+  /* DESTROY_NOTIFY of the outputs still in use needs the handle. */
+  ml_buffer_pool_free_full (vivante->output_pool, g_free, vivante);
 
   return HAL_ML_ERROR_NONE;
 }
 
-static int
-ml_vivante_configure_instance (void *backend_private, const void *prop_)
+/**
+ * @brief Checks if the graph tensor is a state input or output.
+ */
+static gboolean
+_is_state_tensor (vivante_handle_s *vivante, guint index, gboolean is_input)
 {
-  const GstTensorFilterProperties *prop = (const GstTensorFilterProperties *) prop_;
-  vivante_handle_s *vivante = (vivante_handle_s *) backend_private;
-  gboolean _convert_output_fp32 = FALSE;
-
-  if (!vivante || !prop) {
-    g_critical ("[vivante] invalid backend_private");
-    return HAL_ML_ERROR_INVALID_PARAMETER;
+  for (guint k = 0; k < vivante->num_states; k++) {
+    if (index == (is_input ? vivante->states[k].input : vivante->states[k].output))
+      return TRUE;
   }
 
-  if (vivante->model_path) {
-    g_critical ("[vivante] invalid state, clear old data.");
-    _clear_vivante_handle (vivante);
-  }
+  return FALSE;
+}
 
-  vivante->model_path = g_strdup (prop->model_files[0]);
-  // Default loading strategy: if more than one model file is given, assume .so loading.
-  if (prop->num_models > 1) {
-    vivante->use_json_for_graph = FALSE;
-  }
+/**
+ * @brief Parses the indices of the tensors separated by ';'.
+ */
+static gboolean
+_parse_indices (const gchar *str, guint *indices, guint *num)
+{
+  gchar **tokens = g_strsplit (str, ";", -1);
+  gboolean ret = TRUE;
+
+  *num = 0;
+  for (guint i = 0; tokens[i]; i++) {
+    gchar *end = NULL;
+    gchar *s = g_strstrip (tokens[i]);
+    guint64 index = g_ascii_strtoull (s, &end, 10);
+
+    if (end == s || *end != '\0' || index >= NNS_TENSOR_SIZE_LIMIT || i >= NNS_TENSOR_SIZE_LIMIT) {
+      ret = FALSE;
+      break;
+    }
 
-  /* Parse custom properties */
-  if (prop->custom_properties) {
-    gchar **options = g_strsplit (prop->custom_properties, ",", -1);
+    indices[(*num)++] = (guint) index;
+  }
 
-    for (guint op = 0; op < g_strv_length (options); ++op) {
-      gchar **option = g_strsplit (options[op], ":", -1);
+  g_strfreev (tokens);
+  return ret;
+}
 
-      if (g_strv_length (option) > 1) {
-        g_strstrip (option[0]);
-        g_strstrip (option[1]);
+/**
+ * @brief Parses the indices of the inputs separated by ';' and sets their upload.
+ */
+static gboolean
+_parse_input_upload (const gchar *str, vivante_upload_e mode, vivante_upload_e *upload)
+{
+  guint indices[NNS_TENSOR_SIZE_LIMIT];
+  guint num;
 
-        if (g_ascii_strcasecmp (option[0], "json") == 0) {
-          vivante->use_json_for_graph = TRUE;
-          vivante->json_path = g_strdup (option[1]);
-          g_info ("[vivante] Using JSON for graph setup: %s", vivante->json_path);
-        } else if (g_ascii_strcasecmp (option[0], "OutputType") == 0) {
-          /* @todo let each output tensor has different outputtype */
-          gchar *type = option[1];
-          if (g_ascii_strcasecmp (type, "FLOAT32") == 0 || g_ascii_strcasecmp (type, "FP32") == 0) {
-            g_info ("[vivante] Convert output to fp32!");
-            _convert_output_fp32 = TRUE;
-          } else {
-            g_warning ("Ignore unsupported output type (%s)", option[1]);
-          }
-        } else {
-          g_warning ("Unknown option (%s).", options[op]);
-        }
-      }
+  if (!_parse_indices (str, indices, &num))
+    return FALSE;
 
-      g_strfreev (option);
-    }
+  for (guint i = 0; i < num; i++)
+    upload[indices[i]] = mode;
 
-    g_strfreev (options);
-  }
+  return TRUE;
+}
+
+/**
+ * @brief Checks if the custom properties ask to reset the states, "ResetState:true".
+ */
+static gboolean
+_parse_reset_state (const gchar *custom_properties)
+{
+  gchar **options = g_strsplit (custom_properties, ",", -1);
+  gboolean reset = FALSE;
+
+  for (guint op = 0; options[op]; ++op) {
+    gchar **option = g_strsplit (options[op], ":", -1);
+
+    if (g_strv_length (option) > 1) {
+      g_strstrip (option[0]);
+      g_strstrip (option[1]);
+
+      if (g_ascii_strcasecmp (option[0], "ResetState") == 0)
+        reset = (g_ascii_strcasecmp (option[1], "true") == 0);
+    }
+
+    g_strfreev (option);
+  }
+
+  g_strfreev (options);
+  return reset;
+}
+
+/**
+ * @brief Sets up the upload of the static and sticky inputs, which are not uploaded again
+ *        until they change (static) or at all (sticky).
+ */
+static int
+_setup_input_upload (vivante_handle_s *vivante, const vivante_upload_e *upload)
+{
+  for (guint i = vivante->graph->input.num; i < NNS_TENSOR_SIZE_LIMIT; i++) {
+    if (upload[i] != VIVANTE_UPLOAD_ALWAYS) {
+      g_critical ("[vivante] Invalid index of the static input (%u).", i);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+  }
+
+  for (guint i = 0; i < vivante->graph->input.num; i++) {
+    if (upload[i] == VIVANTE_UPLOAD_ALWAYS)
+      continue;
+
+    /* The tiled and batched inputs are assembled again for each run. */
+    if ((vivante->tile && i == vivante->tile_index) || (vivante->roi && i == vivante->roi_index)) {
+      g_critical ("[vivante] The input #%u is tiled or batched, it cannot be static.", i);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    if (!vivante->input_state) {
+      vivante->input_state = g_new0 (vivante_input_state_s, vivante->graph->input.num);
+      vivante->num_input_state = vivante->graph->input.num;
+    }
+
+    vivante->input_state[i].mode = upload[i];
+    vivante->input_state[i].size
+        = gst_tensor_info_get_size (ml_tensors_info_get_nth_info (&vivante->inputInfo, i));
+
+    /* A hash match from another buffer is verified with the copy, it may be another frame. */
+    if (upload[i] == VIVANTE_UPLOAD_CHANGED) {
+      vivante->input_state[i].shadow
+          = ml_alloc (vivante->input_state[i].size, ML_ALLOC_FLAG_NONE, NULL);
+      if (!vivante->input_state[i].shadow) {
+        g_critical ("[vivante] Failed to allocate the copy of the static input #%u.", i);
+        return HAL_ML_ERROR_RUNTIME_ERROR;
+      }
+    }
+    g_info ("[vivante] The input #%u is %s.", i,
+        (upload[i] == VIVANTE_UPLOAD_ONCE) ? "sticky" : "static");
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/** @brief Size of a graph tensor in bytes. */
+static gsize
+_get_graph_tensor_size (vsi_nn_tensor_t *tensor)
+{
+  tensor_type type = convert_to_tensor_type (tensor->attr.dtype.vx_type);
+
+  return (vsi_nn_GetElementNum (tensor) * ml_tensor_get_element_bits (type) + 7) / 8;
+}
+
+/**
+ * @brief Type of a graph tensor in the pipeline. nnstreamer does not define bfloat16 and the
+ *        packed 4-bit types, they are converted to float32 and 8-bit on copy. With fp32, all
+ *        outputs are converted to float32.
+ */
+static tensor_type
+_get_pipeline_type (tensor_type type, gboolean fp32)
+{
+  if (type == _NNS_BFLOAT16 || fp32)
+    return _NNS_FLOAT32;
+  if (type == _NNS_INT4)
+    return _NNS_INT8;
+  if (type == _NNS_UINT4)
+    return _NNS_UINT8;
+
+  return type;
+}
+
+/**
+ * @brief Checks if a graph tensor is converted on copy by the backend, as nnstreamer does not define its type.
+ */
+static gboolean
+_is_converted_type (tensor_type type)
+{
+  return type == _NNS_BFLOAT16 || type == _NNS_INT4 || type == _NNS_UINT4;
+}
+
+/**
+ * @brief Converts a graph output to the type of the pipeline, bfloat16 to float32 and packed
+ *        4-bit to 8-bit, or dequantized to float32 with fp32.
+ */
+static gboolean
+_convert_from_graph (void *dest, const void *src, tensor_type type, gsize count, gboolean fp32,
+    float scale, gint32 zero_point)
+{
+  switch (type) {
+    case _NNS_BFLOAT16:
+      ml_bf16_to_fp32 ((float *) dest, (const guint16 *) src, count);
+      return TRUE;
+    case _NNS_INT4:
+    case _NNS_UINT4:
+      if (fp32)
+        return ml_int4_dequantize ((float *) dest, type, (const guint8 *) src, count, scale, zero_point);
+      return ml_int4_unpack (dest, type, (const guint8 *) src, count);
+    default:
+      return FALSE;
+  }
+}
+
+/**
+ * @brief Converts an input of the pipeline to the graph type, float32 to bfloat16 and 8-bit to
+ *        packed 4-bit, saturated.
+ */
+static gboolean
+_convert_to_graph (void *dest, const void *src, tensor_type type, gsize count)
+{
+  switch (type) {
+    case _NNS_BFLOAT16:
+      ml_fp32_to_bf16 ((guint16 *) dest, (const float *) src, count);
+      return TRUE;
+    case _NNS_INT4:
+    case _NNS_UINT4:
+      return ml_int4_pack ((guint8 *) dest, type, src, count);
+    default:
+      return FALSE;
+  }
+}
+
+/**
+ * @brief Finds the graph tensors converted on copy, and allocates the staging of their graph data.
+ */
+static int
+_setup_conversion (vivante_handle_s *vivante)
+{
+  gsize max_size = 0;
+
+  for (guint i = 0; i < vivante->graph->input.num; i++) {
+    vsi_nn_tensor_t *tensor = vsi_nn_GetTensor (vivante->graph, vivante->graph->input.tensors[i]);
+    tensor_type type = convert_to_tensor_type (tensor->attr.dtype.vx_type);
+
+    if (!_is_converted_type (type))
+      continue;
+
+    if (!vivante->input_convert) {
+      vivante->input_convert = g_new (tensor_type, vivante->graph->input.num);
+      for (guint k = 0; k < vivante->graph->input.num; k++)
+        vivante->input_convert[k] = _NNS_END;
+    }
+
+    vivante->input_convert[i] = type;
+    max_size = MAX (max_size, _get_graph_tensor_size (tensor));
+  }
+
+  for (guint i = 0; i < vivante->graph->output.num; i++) {
+    vsi_nn_tensor_t *tensor = vsi_nn_GetTensor (vivante->graph, vivante->graph->output.tensors[i]);
+    tensor_type type = convert_to_tensor_type (tensor->attr.dtype.vx_type);
+
+    if (!_is_converted_type (type))
+      continue;
+
+    if (!vivante->output_convert) {
+      vivante->output_convert = g_new (tensor_type, vivante->graph->output.num);
+      for (guint k = 0; k < vivante->graph->output.num; k++)
+        vivante->output_convert[k] = _NNS_END;
+    }
+
+    vivante->output_convert[i] = type;
+    max_size = MAX (max_size, _get_graph_tensor_size (tensor));
+  }
+
+  if (max_size == 0)
+    return HAL_ML_ERROR_NONE;
+
+  vivante->convert_buffer = ml_alloc (max_size, ML_ALLOC_FLAG_NONE, NULL);
+  if (!vivante->convert_buffer) {
+    g_critical ("[vivante] Failed to allocate the buffer of the converted tensors.");
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Removes the state inputs from the info of the pipeline, and maps each input of the
+ *        pipeline to the graph. The other options keep the indices of the graph tensors.
+ */
+static int
+_hide_state_inputs (vivante_handle_s *vivante)
+{
+  ml_tensors_info_s in_info;
+  guint n = 0;
+
+  ml_tensors_info_init (&in_info);
+
+  if (vivante->inputInfo.num_tensors <= vivante->num_states
+      || !ml_tensors_info_alloc (&in_info, vivante->inputInfo.num_tensors - vivante->num_states)) {
+    g_critical ("[vivante] A stateful model needs an input besides the states.");
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  vivante->input_map = g_new0 (guint, in_info.num_tensors);
+
+  in_info.format = vivante->inputInfo.format;
+  for (guint i = 0; i < vivante->inputInfo.num_tensors; i++) {
+    if (_is_state_tensor (vivante, i, TRUE))
+      continue;
+
+    gst_tensor_info_copy (ml_tensors_info_get_nth_info (&in_info, n),
+        ml_tensors_info_get_nth_info (&vivante->inputInfo, i));
+    vivante->input_map[n++] = i;
+  }
+
+  ml_tensors_info_free (&vivante->inputInfo);
+  vivante->inputInfo = in_info;
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Gets the layouts of the graph tensors from the layouts of the pipeline. The tensors of
+ *        the pipeline are the selected graph tensors in the given order, or all but the excluded
+ *        ones. The graph tensors not in the pipeline are ANY.
+ */
+static void
+_get_graph_layouts (const tensor_layout *layout, guint num_tensors, const guint *selected,
+    guint num_selected, const guint *excluded, guint num_excluded, tensor_layout *graph_layout)
+{
+  guint n = 0;
+
+  for (guint i = 0; i < NNS_TENSOR_SIZE_LIMIT; i++)
+    graph_layout[i] = _NNS_LAYOUT_ANY;
+
+  /* The invalid indices fail in the setup of the states and outputs. */
+  for (guint i = 0; i < num_selected; i++) {
+    if (selected[i] < num_tensors)
+      graph_layout[selected[i]] = layout[i];
+  }
+
+  if (num_selected > 0)
+    return;
+
+  for (guint i = 0; i < num_tensors; i++) {
+    gboolean is_excluded = FALSE;
+
+    for (guint k = 0; k < num_excluded; k++)
+      is_excluded |= (excluded[k] == i);
+
+    if (!is_excluded)
+      graph_layout[i] = layout[n++];
+  }
+}
+
+/**
+ * @brief Sets up the outputs of the pipeline, the selected graph outputs in the given order or
+ *        all but the states, and maps each of them to the graph. The others are not copied.
+ */
+static int
+_setup_output_map (vivante_handle_s *vivante, const guint *selected, guint num_selected)
+{
+  guint map[NNS_TENSOR_SIZE_LIMIT];
+  ml_tensors_info_s out_info;
+  guint num = 0;
+
+  if (num_selected == 0 && !vivante->states)
+    return HAL_ML_ERROR_NONE;
+
+  for (guint i = 0; i < num_selected; i++) {
+    for (guint j = 0; j < i; j++) {
+      if (selected[j] == selected[i]) {
+        g_critical ("[vivante] The output #%u is selected twice.", selected[i]);
+        return HAL_ML_ERROR_INVALID_PARAMETER;
+      }
+    }
+
+    if (selected[i] >= vivante->outputInfo.num_tensors || _is_state_tensor (vivante, selected[i], FALSE)) {
+      g_critical ("[vivante] Invalid index of the selected output (%u).", selected[i]);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    map[num++] = selected[i];
+  }
+
+  if (num_selected == 0) {
+    for (guint i = 0; i < vivante->outputInfo.num_tensors; i++) {
+      if (!_is_state_tensor (vivante, i, FALSE))
+        map[num++] = i;
+    }
+  }
+
+  /* The detections are written to both outputs. */
+  if (vivante->detect) {
+    gboolean has_box = FALSE, has_score = FALSE;
+
+    for (guint i = 0; i < num; i++) {
+      has_box |= (map[i] == vivante->detect_box_index);
+      has_score |= (map[i] == vivante->detect_score_index);
+    }
+
+    if (!has_box || !has_score) {
+      g_critical ("[vivante] The box and score outputs of the detection should be selected.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+  }
+
+  ml_tensors_info_init (&out_info);
+  if (num == 0 || !ml_tensors_info_alloc (&out_info, num)) {
+    g_critical ("[vivante] No output of the pipeline besides the states.");
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  out_info.format = vivante->outputInfo.format;
+  for (guint i = 0; i < num; i++)
+    gst_tensor_info_copy (ml_tensors_info_get_nth_info (&out_info, i),
+        ml_tensors_info_get_nth_info (&vivante->outputInfo, map[i]));
+
+  vivante->output_map = g_new (guint, num);
+  memcpy (vivante->output_map, map, sizeof (guint) * num);
+
+  ml_tensors_info_free (&vivante->outputInfo);
+  vivante->outputInfo = out_info;
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Sets up the hidden states of a recurrent model. The k-th state output is fed back to
+ *        the k-th state input. The state inputs are hidden from the pipeline here, and the
+ *        state outputs by the output map.
+ */
+static int
+_setup_states (vivante_handle_s *vivante, const guint *outputs, guint num_outputs,
+    const guint *inputs, guint num_inputs, const vivante_upload_e *upload)
+{
+  gsize max_size = 0;
+
+  if (num_outputs != num_inputs) {
+    g_critical ("[vivante] The numbers of the state outputs (%u) and inputs (%u) are different.",
+        num_outputs, num_inputs);
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  if (num_inputs == 0)
+    return HAL_ML_ERROR_NONE;
+
+  /* The state of a tile or ROI would be fed to the next one. */
+  if (vivante->tile || vivante->roi) {
+    g_critical ("[vivante] The states cannot be used with the tiling or the ROI batch.");
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  vivante->states = g_new0 (vivante_state_s, num_inputs);
+
+  for (guint k = 0; k < num_inputs; k++) {
+    guint out = outputs[k];
+    guint in = inputs[k];
+    vsi_nn_tensor_t *o_tensor, *i_tensor;
+    gboolean o_quantized = FALSE, i_quantized = FALSE;
+    float o_scale = 1.0f, i_scale = 1.0f;
+    gint32 o_zero_point = 0, i_zero_point = 0;
+
+    if (out >= vivante->graph->output.num || in >= vivante->graph->input.num
+        || _is_state_tensor (vivante, out, FALSE) || _is_state_tensor (vivante, in, TRUE)) {
+      g_critical ("[vivante] Invalid state from the output #%u to the input #%u.", out, in);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    if ((vivante->preproc && in == vivante->preproc_index) || upload[in] != VIVANTE_UPLOAD_ALWAYS) {
+      g_critical ("[vivante] The input #%u is preprocessed or static, it cannot be a state.", in);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    if ((vivante->postproc && out == vivante->postproc_index)
+        || (vivante->detect && (out == vivante->detect_box_index || out == vivante->detect_score_index))) {
+      g_critical ("[vivante] The output #%u is post-processed, it cannot be a state.", out);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    /* The state is copied as is, without conversion. */
+    o_tensor = vsi_nn_GetTensor (vivante->graph, vivante->graph->output.tensors[out]);
+    i_tensor = vsi_nn_GetTensor (vivante->graph, vivante->graph->input.tensors[in]);
+    _helper_get_quant_params (&o_tensor->attr.dtype, &o_quantized, &o_scale, &o_zero_point);
+    _helper_get_quant_params (&i_tensor->attr.dtype, &i_quantized, &i_scale, &i_zero_point);
+
+    if (o_tensor->attr.dtype.vx_type != i_tensor->attr.dtype.vx_type
+        || vsi_nn_GetElementNum (o_tensor) != vsi_nn_GetElementNum (i_tensor)
+        || o_quantized != i_quantized || o_scale != i_scale || o_zero_point != i_zero_point) {
+      g_critical ("[vivante] The state output #%u does not match the input #%u in type, size or quantization.",
+          out, in);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    vivante->states[k].output = out;
+    vivante->states[k].input = in;
+    vivante->states[k].size = _get_graph_tensor_size (i_tensor);
+    vivante->num_states++;
+    max_size = MAX (max_size, vivante->states[k].size);
+
+    g_info ("[vivante] The output #%u is fed back to the input #%u.", out, in);
+  }
+
+  vivante->state_buffer = ml_alloc (max_size, ML_ALLOC_FLAG_NONE, NULL);
+  if (!vivante->state_buffer) {
+    g_critical ("[vivante] Failed to allocate the buffer of the states.");
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
+
+  g_atomic_int_set (&vivante->state_reset, TRUE);
+
+  return _hide_state_inputs (vivante);
+}
+
+/**
+ * @brief Sets up the detection post-processing of the box and score outputs, and replaces
+ *        their info with the detections and the number of them.
+ */
+static int
+_setup_detection (vivante_handle_s *vivante, ml_detect_config_s *config, tensors_layout output_layout)
+{
+  GstTensorInfo *box_info, *score_info;
+
+  if (!ml_detect_config_is_enabled (config))
+    return HAL_ML_ERROR_NONE;
+
+  box_info = ml_tensors_info_get_nth_info (&vivante->outputInfo, config->box_index);
+  score_info = ml_tensors_info_get_nth_info (&vivante->outputInfo, config->score_index);
+  if (!box_info || !score_info || config->box_index == config->score_index
+      || (vivante->postproc && (vivante->postproc_index == config->box_index
+                                   || vivante->postproc_index == config->score_index))) {
+    g_critical ("[vivante] Invalid outputs of the detection (%u, %u).", config->box_index,
+        config->score_index);
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  /* Converted to fp32 in invoke, otherwise the scores are thresholded as stored. */
+  if (!vivante->convert_output_fp32) {
+    _helper_get_quant_params (&vsi_nn_GetTensor (vivante->graph,
+                                  vivante->graph->output.tensors[config->box_index])->attr.dtype,
+        &config->box_quantized, &config->box_scale, &config->box_zero_point);
+    _helper_get_quant_params (&vsi_nn_GetTensor (vivante->graph,
+                                  vivante->graph->output.tensors[config->score_index])->attr.dtype,
+        &config->score_quantized, &config->score_scale, &config->score_zero_point);
+  }
+
+  vivante->detect_box_index = config->box_index;
+  vivante->detect_score_index = config->score_index;
+  vivante->detect = ml_detect_new (config, box_info, score_info);
+  if (!vivante->detect) {
+    g_critical ("[vivante] Failed to set up the detection of the output tensors #%u and #%u.",
+        config->box_index, config->score_index);
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  ml_detect_get_output_info (vivante->detect, box_info, score_info);
+  output_layout[config->box_index] = _NNS_LAYOUT_ANY;
+  output_layout[config->score_index] = _NNS_LAYOUT_ANY;
+
+  return HAL_ML_ERROR_NONE;
+}
+
+static int
+ml_vivante_configure_instance (void *backend_private, const void *prop_)
+{
+  const GstTensorFilterProperties *prop = (const GstTensorFilterProperties *) prop_;
+  vivante_handle_s *vivante = (vivante_handle_s *) backend_private;
+  gboolean _convert_output_fp32 = FALSE;
+  ml_preproc_config_s preproc_config;
+  ml_postproc_config_s postproc_config;
+  ml_detect_config_s detect_config;
+  ml_tile_config_s tile_config;
+  ml_roi_config_s roi_config;
+  ml_result_cache_config_s result_cache_config;
+  guint state_outputs[NNS_TENSOR_SIZE_LIMIT], state_inputs[NNS_TENSOR_SIZE_LIMIT];
+  guint num_state_outputs = 0, num_state_inputs = 0;
+  guint selected_outputs[NNS_TENSOR_SIZE_LIMIT];
+  guint num_selected_outputs = 0;
+  vivante_upload_e upload[NNS_TENSOR_SIZE_LIMIT] = { VIVANTE_UPLOAD_ALWAYS };
+  tensors_layout frame_layout, input_layout, output_layout;
+  int status;
+
+  if (!vivante || !prop) {
+    g_critical ("[vivante] invalid backend_private");
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  ML_TRACE_SCOPE ("vivante:configure_instance");
+
+  if (vivante->model_path) {
+    g_critical ("[vivante] invalid state, clear old data.");
+    _clear_vivante_handle (vivante);
+  }
+
+  /* RELOAD_MODEL builds the new model with the same properties. */
+  if (vivante->reload) {
+    g_free (vivante->reload->custom_properties);
+    vivante->reload->custom_properties = g_strdup (prop->custom_properties);
+    memcpy (vivante->reload->input_layout, prop->input_layout, sizeof (tensors_layout));
+    memcpy (vivante->reload->output_layout, prop->output_layout, sizeof (tensors_layout));
+  }
+
+  vivante->model_path = g_strdup (prop->model_files[0]);
+  // Default loading strategy: if more than one model file is given, assume .so loading.
+  if (prop->num_models > 1) {
+    vivante->use_json_for_graph = FALSE;
+  }
+
+  ml_preproc_config_init (&preproc_config);
+  ml_postproc_config_init (&postproc_config);
+  ml_detect_config_init (&detect_config);
+  ml_tile_config_init (&tile_config);
+  ml_roi_config_init (&roi_config);
+  ml_result_cache_config_init (&result_cache_config);
+
+  /* Parse custom properties */
+  if (prop->custom_properties) {
+    gchar **options = g_strsplit (prop->custom_properties, ",", -1);
+
+    for (guint op = 0; op < g_strv_length (options); ++op) {
+      gchar **option = g_strsplit (options[op], ":", -1);
+
+      if (g_strv_length (option) > 1) {
+        g_strstrip (option[0]);
+        g_strstrip (option[1]);
+
+        if (g_ascii_strcasecmp (option[0], "json") == 0) {
+          vivante->use_json_for_graph = TRUE;
+          vivante->json_path = g_strdup (option[1]);
+          g_info ("[vivante] Using JSON for graph setup: %s", vivante->json_path);
+        } else if (g_ascii_strcasecmp (option[0], "OutputType") == 0) {
+          /* @todo let each output tensor has different outputtype */
+          gchar *type = option[1];
+          if (g_ascii_strcasecmp (type, "FLOAT32") == 0 || g_ascii_strcasecmp (type, "FP32") == 0) {
+            g_info ("[vivante] Convert output to fp32!");
+            _convert_output_fp32 = TRUE;
+          } else {
+            g_warning ("Ignore unsupported output type (%s)", option[1]);
+          }
+        } else if (g_ascii_strcasecmp (option[0], "OutputPool") == 0) {
+          vivante->use_output_pool = (g_ascii_strcasecmp (option[1], "true") == 0);
+        } else if (g_ascii_strcasecmp (option[0], "ModelLayout") == 0) {
+          if (g_ascii_strcasecmp (option[1], "NCHW") == 0) {
+            vivante->model_layout = _NNS_LAYOUT_NCHW;
+          } else if (g_ascii_strcasecmp (option[1], "NHWC") == 0) {
+            vivante->model_layout = _NNS_LAYOUT_NHWC;
+          } else if (g_ascii_strcasecmp (option[1], "ANY") == 0) {
+            vivante->model_layout = _NNS_LAYOUT_ANY;
+          } else {
+            g_warning ("Unknown model layout (%s), set NCHW as default.", option[1]);
+          }
+        } else if (g_ascii_strcasecmp (option[0], "InputMean") == 0) {
+          if (!ml_preproc_parse_values (option[1], preproc_config.mean, &preproc_config.num_mean))
+            g_warning ("Ignore invalid input mean (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "InputStd") == 0) {
+          if (!ml_preproc_parse_values (option[1], preproc_config.std, &preproc_config.num_std))
+            g_warning ("Ignore invalid input std (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "PreprocessInput") == 0) {
+          preproc_config.input_index = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "InputFormat") == 0) {
+          if (!ml_preproc_parse_format (option[1], &preproc_config.format))
+            g_warning ("Ignore unknown input format (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "InputSize") == 0) {
+          if (!ml_preproc_parse_size (option[1], &preproc_config.width, &preproc_config.height))
+            g_warning ("Ignore invalid input size (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "PostProcess") == 0) {
+          /* the post-processing string may contain ':' */
+          gchar *_pp_str = g_strjoinv (":", &option[1]);
+          if (!ml_postproc_parse (_pp_str, &postproc_config))
+            g_warning ("Ignore invalid post-processing (%s).", _pp_str);
+          g_free (_pp_str);
+        } else if (g_ascii_strcasecmp (option[0], "PostProcessOutput") == 0) {
+          postproc_config.output_index = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "Detection") == 0) {
+          if (!ml_detect_parse_box_type (option[1], &detect_config.box_type))
+            g_warning ("Ignore unknown box type of the detection (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "DetectionOutputs") == 0) {
+          gchar **indices = g_strsplit (option[1], ";", -1);
+          if (g_strv_length (indices) == 2) {
+            detect_config.box_index = (guint) g_ascii_strtoull (indices[0], NULL, 10);
+            detect_config.score_index = (guint) g_ascii_strtoull (indices[1], NULL, 10);
+          } else {
+            g_warning ("Ignore invalid outputs of the detection (%s).", option[1]);
+          }
+          g_strfreev (indices);
+        } else if (g_ascii_strcasecmp (option[0], "ScoreThreshold") == 0) {
+          detect_config.score_threshold = (float) g_ascii_strtod (option[1], NULL);
+        } else if (g_ascii_strcasecmp (option[0], "IouThreshold") == 0) {
+          detect_config.iou_threshold = (float) g_ascii_strtod (option[1], NULL);
+        } else if (g_ascii_strcasecmp (option[0], "MaxDetections") == 0) {
+          detect_config.max_detections = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "BackgroundClass") == 0) {
+          detect_config.background_class = (gint) g_ascii_strtoll (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "Anchors") == 0) {
+          g_free (vivante->anchors_path);
+          vivante->anchors_path = g_strdup (option[1]);
+          detect_config.anchors_path = vivante->anchors_path;
+        } else if (g_ascii_strcasecmp (option[0], "Tiling") == 0) {
+          if (!ml_preproc_parse_size (option[1], &tile_config.width, &tile_config.height))
+            g_warning ("Ignore invalid frame size of the tiling (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "TileOverlap") == 0) {
+          tile_config.overlap = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "TileInput") == 0) {
+          tile_config.input_index = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "TileMerge") == 0) {
+          if (!ml_tile_parse_merge (option[1], &tile_config.merge))
+            g_warning ("Ignore unknown merge of the tiles (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "RoiFrame") == 0) {
+          if (!ml_preproc_parse_size (option[1], &roi_config.width, &roi_config.height))
+            g_warning ("Ignore invalid frame size of the ROI batch (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "RoiInput") == 0) {
+          roi_config.input_index = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "StaticInputs") == 0) {
+          if (!_parse_input_upload (option[1], VIVANTE_UPLOAD_CHANGED, upload))
+            g_warning ("Ignore invalid static inputs (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "StickyInputs") == 0) {
+          if (!_parse_input_upload (option[1], VIVANTE_UPLOAD_ONCE, upload))
+            g_warning ("Ignore invalid sticky inputs (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "ResultCache") == 0) {
+          result_cache_config.max_entries = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "ResultCacheMemory") == 0) {
+          if (!ml_result_cache_parse_size (option[1], &result_cache_config.max_bytes))
+            g_warning ("Ignore invalid memory limit of the result cache (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "ResultCacheStats") == 0) {
+          result_cache_config.stats_interval = (guint) g_ascii_strtoull (option[1], NULL, 10);
+        } else if (g_ascii_strcasecmp (option[0], "OutputTensor") == 0) {
+          if (!_parse_indices (option[1], selected_outputs, &num_selected_outputs))
+            g_warning ("Ignore invalid selection of the outputs (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "StateOutputs") == 0) {
+          if (!_parse_indices (option[1], state_outputs, &num_state_outputs))
+            g_warning ("Ignore invalid state outputs (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "StateInputs") == 0) {
+          if (!_parse_indices (option[1], state_inputs, &num_state_inputs))
+            g_warning ("Ignore invalid state inputs (%s).", option[1]);
+        } else if (g_ascii_strcasecmp (option[0], "ResetState") == 0) {
+          /* For the CUSTOM_PROP event, the states start from zero anyway. */
+        } else {
+          g_warning ("Unknown option (%s).", options[op]);
+        }
+      }
+
+      g_strfreev (option);
+    }
+
+    g_strfreev (options);
+  }
 
   /* Load model based on the determined strategy JSON vs so */
   if (vivante->use_json_for_graph) {
@@ -573,7 +1777,8 @@ ml_vivante_configure_instance (void *backend_private, const void *prop_)
       return HAL_ML_ERROR_INVALID_PARAMETER;
     }
 
-    int status = _json_create_neural_network (vivante);
+    int status = _json_create_neural_network (
+        vivante, state_outputs, num_state_outputs, state_inputs, num_state_inputs);
     if (status != HAL_ML_ERROR_NONE) {
       g_critical ("[vivante] Failed to create VSI graph.");
       return status;
@@ -593,76 +1798,446 @@ ml_vivante_configure_instance (void *backend_private, const void *prop_)
   }
 
   /* setting input and output tensors info */
-  vivante->inputInfo.num_tensors = vivante->graph->input.num;
+  if (!ml_tensors_info_alloc (&vivante->inputInfo, vivante->graph->input.num)) {
+    g_critical ("[vivante] Invalid number of input tensors (%u).", vivante->graph->input.num);
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
   for (unsigned int i = 0; i < vivante->graph->input.num; i++) {
     vsi_nn_tensor_t *i_tensor
         = vsi_nn_GetTensor (vivante->graph, vivante->graph->input.tensors[i]);
-    GstTensorInfo *info = gst_tensors_info_get_nth_info (&vivante->inputInfo, i);
+    GstTensorInfo *info = ml_tensors_info_get_nth_info (&vivante->inputInfo, i);
 
-    info->type = convert_to_tensor_type (i_tensor->attr.dtype.vx_type);
+    info->type = _get_pipeline_type (convert_to_tensor_type (i_tensor->attr.dtype.vx_type), FALSE);
     info->name = g_strdup_printf ("%i", vivante->graph->input.tensors[i]);
     for (unsigned int j = 0; j < i_tensor->attr.dim_num; ++j) {
       info->dimension[j] = i_tensor->attr.size[j];
     }
   }
 
-  vivante->outputInfo.num_tensors = vivante->graph->output.num;
+  if (!ml_tensors_info_alloc (&vivante->outputInfo, vivante->graph->output.num)) {
+    g_critical ("[vivante] Invalid number of output tensors (%u).", vivante->graph->output.num);
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
   for (unsigned int i = 0; i < vivante->graph->output.num; i++) {
     vsi_nn_tensor_t *o_tensor
         = vsi_nn_GetTensor (vivante->graph, vivante->graph->output.tensors[i]);
-    GstTensorInfo *info = gst_tensors_info_get_nth_info (&vivante->outputInfo, i);
+    GstTensorInfo *info = ml_tensors_info_get_nth_info (&vivante->outputInfo, i);
 
     info->type = convert_to_tensor_type (o_tensor->attr.dtype.vx_type);
 
     /* Output tensors should be converted into fp32 */
-    if (_convert_output_fp32 && info->type != _NNS_FLOAT32) {
-      info->type = _NNS_FLOAT32;
+    if (_convert_output_fp32 && info->type != _NNS_FLOAT32)
       vivante->convert_output_fp32 = TRUE;
-    }
+    info->type = _get_pipeline_type (info->type, _convert_output_fp32);
     info->name = g_strdup_printf ("%i", vivante->graph->output.tensors[i]);
     for (unsigned int j = 0; j < o_tensor->attr.dim_num; ++j) {
       info->dimension[j] = o_tensor->attr.size[j];
     }
   }
 
+  status = _setup_conversion (vivante);
+  if (status != HAL_ML_ERROR_NONE)
+    return status;
+
+  /* The layouts of the pipeline skip the state inputs, the stages are in the order of the graph.
+     The layouts of the frames are kept for the tiling and the ROI batch. */
+  _get_graph_layouts (prop->input_layout, vivante->graph->input.num, NULL, 0, state_inputs,
+      num_state_inputs, frame_layout);
+  memcpy (input_layout, frame_layout, sizeof (tensors_layout));
+
+  if (ml_preproc_config_is_enabled (&preproc_config)) {
+    guint index = preproc_config.input_index;
+    GstTensorInfo *info = ml_tensors_info_get_nth_info (&vivante->inputInfo, index);
+
+    if (!info) {
+      g_critical ("[vivante] Invalid index of the preprocessed input (%u).", index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    _helper_get_quant_params (
+        &vsi_nn_GetTensor (vivante->graph, vivante->graph->input.tensors[index])->attr.dtype,
+        &preproc_config.quantized, &preproc_config.scale, &preproc_config.zero_point);
+
+    vivante->preproc_index = index;
+    vivante->preproc = ml_preproc_new (&preproc_config, info, vivante->model_layout, input_layout[index]);
+    if (!vivante->preproc) {
+      g_critical ("[vivante] Failed to set up the preprocessing of the input tensor #%u.", index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    /* The preprocessing transforms the layout as well, and the input is a raw frame. */
+    ml_preproc_get_input_info (vivante->preproc, info);
+    input_layout[index] = _NNS_LAYOUT_ANY;
+  }
+
+  /* The layouts of the pipeline are of the selected outputs, or of all but the state outputs. */
+  _get_graph_layouts (prop->output_layout, vivante->graph->output.num, selected_outputs,
+      num_selected_outputs, state_outputs, num_state_outputs, output_layout);
+
+  if (ml_postproc_config_is_enabled (&postproc_config)) {
+    guint index = postproc_config.output_index;
+    GstTensorInfo *info = ml_tensors_info_get_nth_info (&vivante->outputInfo, index);
+
+    if (!info) {
+      g_critical ("[vivante] Invalid index of the post-processed output (%u).", index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    vivante->postproc_index = index;
+    vivante->postproc = ml_postproc_new (&postproc_config, info);
+    if (!vivante->postproc) {
+      g_critical ("[vivante] Failed to set up the post-processing of the output tensor #%u.", index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    /* The output is the class indices, no layout to transform. */
+    ml_postproc_get_output_info (vivante->postproc, info);
+    output_layout[index] = _NNS_LAYOUT_ANY;
+  }
+
+  status = _setup_detection (vivante, &detect_config, output_layout);
+  if (status != HAL_ML_ERROR_NONE)
+    return status;
+
+  if (!ml_layout_stage_create (&vivante->inputInfo, vivante->model_layout,
+          input_layout, TRUE, &vivante->input_layout)
+      || !ml_layout_stage_create (&vivante->outputInfo, vivante->model_layout,
+          output_layout, FALSE, &vivante->output_layout)) {
+    g_critical ("[vivante] Failed to set up the layout transform.");
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
+
+  /* The infos are in the layout of the pipeline now, the tiles are cut from the frame after all. */
+  if (ml_tile_config_is_enabled (&tile_config)) {
+    guint index = tile_config.input_index;
+    GstTensorInfo *info = ml_tensors_info_get_nth_info (&vivante->inputInfo, index);
+
+    if (!info || (vivante->preproc && index == vivante->preproc_index
+                     && preproc_config.format != ML_PREPROC_FORMAT_RGB)) {
+      g_critical ("[vivante] Invalid input of the tiling (%u), it should be an RGB image.", index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    /* The boxes of the tiles would be stacked in the coordinates of each tile. */
+    if (vivante->detect) {
+      g_critical ("[vivante] The detection cannot be used with the tiling.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    vivante->tile_index = index;
+    vivante->tile = ml_tile_new (&tile_config, vivante->model_layout, info,
+        frame_layout[index], &vivante->outputInfo, output_layout);
+    if (!vivante->tile) {
+      g_critical ("[vivante] Failed to set up the tiling of the input tensor #%u.", index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    ml_tile_get_input_info (vivante->tile, info);
+    ml_tile_get_output_info (vivante->tile, &vivante->outputInfo);
+  }
+
+  if (ml_roi_config_is_enabled (&roi_config)) {
+    guint index = roi_config.input_index;
+    GstTensorInfo *info = ml_tensors_info_get_nth_info (&vivante->inputInfo, index);
+    ml_tensors_info_s in_info;
+
+    if (!info || vivante->tile
+        || (vivante->preproc && index == vivante->preproc_index
+            && preproc_config.format != ML_PREPROC_FORMAT_RGB)) {
+      g_critical ("[vivante] Invalid input of the ROI batch (%u), it should be an RGB image and not tiled.",
+          index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    vivante->roi_index = index;
+    vivante->roi = ml_roi_new (&roi_config, vivante->model_layout, info, frame_layout[index]);
+    if (!vivante->roi) {
+      g_critical ("[vivante] Failed to set up the ROI batch of the input tensor #%u.", index);
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    ml_roi_get_input_info (vivante->roi, info);
+
+    /* The ROIs are an extra input after the inputs of the graph. */
+    ml_tensors_info_init (&in_info);
+    if (!ml_tensors_info_alloc (&in_info, vivante->inputInfo.num_tensors + 1)) {
+      g_critical ("[vivante] Failed to add the input of the ROIs.");
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+
+    in_info.format = vivante->inputInfo.format;
+    for (guint i = 0; i < vivante->inputInfo.num_tensors; i++)
+      gst_tensor_info_copy (ml_tensors_info_get_nth_info (&in_info, i),
+          ml_tensors_info_get_nth_info (&vivante->inputInfo, i));
+
+    info = ml_tensors_info_get_nth_info (&in_info, vivante->inputInfo.num_tensors);
+    ml_roi_get_boxes_info (vivante->roi, info);
+    info->name = g_strdup ("roi");
+
+    ml_tensors_info_free (&vivante->inputInfo);
+    vivante->inputInfo = in_info;
+  }
+
+  status = _setup_input_upload (vivante, upload);
+  if (status != HAL_ML_ERROR_NONE)
+    return status;
+
+  status = _setup_states (vivante, state_outputs, num_state_outputs, state_inputs, num_state_inputs, upload);
+  if (status != HAL_ML_ERROR_NONE)
+    return status;
+
+  status = _setup_output_map (vivante, selected_outputs, num_selected_outputs);
+  if (status != HAL_ML_ERROR_NONE)
+    return status;
+
+  /* Keyed by the inputs of invoke, so the results of the tiled and batched inputs are cached as a whole. */
+  if (ml_result_cache_config_is_enabled (&result_cache_config)) {
+    /* The outputs of a stateful model depend on the previous inputs. */
+    if (vivante->states) {
+      g_critical ("[vivante] The result cache cannot be used with the states.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+
+    vivante->result_cache = ml_result_cache_new (&result_cache_config, &vivante->inputInfo, &vivante->outputInfo);
+    if (!vivante->result_cache)
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  vivante->model_info = ml_model_info_new (&vivante->inputInfo, &vivante->outputInfo);
+
   return HAL_ML_ERROR_NONE;
 }
 
+/**
+ * @brief Checks if the input should be uploaded. A static input is uploaded if the hash of its
+ *        data differs from the last upload, and a sticky one if it has never been uploaded.
+ *        The same buffer with the same hash is skipped at the cost of the hash, another buffer
+ *        with the same hash is compared with the copy of the last upload.
+ */
+static gboolean
+_input_needs_upload (vivante_handle_s *vivante, guint index, const void *data)
+{
+  vivante_input_state_s *state;
+  guint64 hash;
+
+  if (!vivante->input_state)
+    return TRUE;
+
+  state = &vivante->input_state[index];
+  switch (state->mode) {
+    case VIVANTE_UPLOAD_CHANGED:
+      hash = ml_hash_data (data, state->size);
+      if (state->uploaded && hash == state->hash
+          && (data == state->data || memcmp (state->shadow, data, state->size) == 0)) {
+        state->data = data;
+        return FALSE;
+      }
+
+      state->hash = hash;
+      state->data = data;
+      ml_copy (state->shadow, data, state->size);
+      break;
+    case VIVANTE_UPLOAD_ONCE:
+      if (state->uploaded)
+        return FALSE;
+      break;
+    default:
+      return TRUE;
+  }
+
+  /* Reset if the upload fails. */
+  state->uploaded = TRUE;
+  return TRUE;
+}
+
+/**
+ * @brief Zeroes the state inputs. A quantized zero is the zero point.
+ */
 static int
-ml_vivante_invoke (void *backend_private, const void *input_, void *output_)
+_reset_states (vivante_handle_s *vivante)
 {
-  const GstTensorMemory *input = (const GstTensorMemory *) input_;
-  GstTensorMemory *output = (GstTensorMemory *) output_;
-  vivante_handle_s *vivante = (vivante_handle_s *) backend_private;
+  for (guint k = 0; k < vivante->num_states; k++) {
+    vsi_nn_tensor_t *tensor
+        = vsi_nn_GetTensor (vivante->graph, vivante->graph->input.tensors[vivante->states[k].input]);
+    gsize size = vivante->states[k].size;
+    gboolean quantized = FALSE;
+    float scale = 1.0f;
+    gint32 zero_point = 0;
+
+    _helper_get_quant_params (&tensor->attr.dtype, &quantized, &scale, &zero_point);
+    memset (vivante->state_buffer, 0, size);
+
+    if (quantized && zero_point != 0) {
+      switch (tensor->attr.dtype.vx_type) {
+        case VSI_NN_TYPE_UINT8:
+        case VSI_NN_TYPE_INT8:
+          memset (vivante->state_buffer, (int) zero_point, size);
+          break;
+        case VSI_NN_TYPE_UINT16:
+        case VSI_NN_TYPE_INT16:
+          for (gsize e = 0; e < size / sizeof (guint16); e++)
+            ((guint16 *) vivante->state_buffer)[e] = (guint16) zero_point;
+          break;
+        default:
+          break;
+      }
+    }
 
-  if (!vivante) {
-    g_critical ("[vivante] invalid backend_private");
-    return HAL_ML_ERROR_INVALID_PARAMETER;
+    if (vsi_nn_CopyDataToTensor (vivante->graph, tensor, (uint8_t *) vivante->state_buffer) != VSI_SUCCESS) {
+      g_critical ("[vivante] Failed to reset the state input #%u.", vivante->states[k].input);
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Feeds the state outputs of the run back to the state inputs of the next run. The tensors
+ *        created from handles swap their memory, so the next run overwrites the previous state.
+ *        The others, of the .so and the pre-processed inputs, are copied.
+ */
+static int
+_feed_states (vivante_handle_s *vivante)
+{
+  ML_TRACE_SCOPE ("vivante:state");
+
+  for (guint k = 0; k < vivante->num_states; k++) {
+    vsi_nn_tensor_t *out_tensor
+        = vsi_nn_GetTensor (vivante->graph, vivante->graph->output.tensors[vivante->states[k].output]);
+    vsi_nn_tensor_t *in_tensor
+        = vsi_nn_GetTensor (vivante->graph, vivante->graph->input.tensors[vivante->states[k].input]);
+
+#if defined(HAVE_VSI_NN_SWAP_TENSOR_HANDLE)
+    if (out_tensor->is_created_from_handle && in_tensor->is_created_from_handle) {
+      if (vsi_nn_SwapTensorHandle (in_tensor, out_tensor) != VSI_SUCCESS) {
+        g_critical ("[vivante] Failed to swap the state output #%u with the input.", vivante->states[k].output);
+        return HAL_ML_ERROR_RUNTIME_ERROR;
+      }
+      continue;
+    }
+#endif
+
+    if (vsi_nn_CopyTensorToBuffer (vivante->graph, out_tensor, vivante->state_buffer) != VSI_SUCCESS) {
+      g_critical ("[vivante] Failed to copy the state output #%u.", vivante->states[k].output);
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+    if (vsi_nn_CopyDataToTensor (vivante->graph, in_tensor, (uint8_t *) vivante->state_buffer) != VSI_SUCCESS) {
+      g_critical ("[vivante] Failed to feed the state output #%u back.", vivante->states[k].output);
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
   }
 
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Runs the graph once, from the input to the output buffers.
+ */
+static int
+_invoke_graph (vivante_handle_s *vivante, const GstTensorMemory *input, GstTensorMemory *output)
+{
+  /* The state inputs are kept in the graph, zeroed on the first run and by ResetState. */
+  if (vivante->states && g_atomic_int_compare_and_exchange (&vivante->state_reset, TRUE, FALSE)) {
+    if (_reset_states (vivante) != HAL_ML_ERROR_NONE) {
+      g_atomic_int_set (&vivante->state_reset, TRUE);
+      return HAL_ML_ERROR_RUNTIME_ERROR;
+    }
+  }
+
+  ML_TRACE_BEGIN ("vivante:copy_in");
   for (unsigned int i = 0; i < vivante->graph->input.num; i++) {
     vsi_nn_tensor_t *tensor
         = vsi_nn_GetTensor (vivante->graph, vivante->graph->input.tensors[i]);
-    if (vsi_nn_CopyDataToTensor (vivante->graph, tensor, (uint8_t *) input[i].data) != VSI_SUCCESS) {
+    const ml_layout_transform_s *layout = ml_layout_stage_get (vivante->input_layout, i);
+    void *data = input[i].data;
+
+    if (_is_state_tensor (vivante, i, TRUE) || !_input_needs_upload (vivante, i, data))
+      continue;
+
+    /* The graph tensors are not created from handles, the converted input is staged and copied by vsi_nn_CopyDataToTensor. */
+    if (vivante->preproc && i == vivante->preproc_index) {
+      data = ml_preproc_get_buffer (vivante->preproc);
+      ml_preproc_run (vivante->preproc, data, input[i].data);
+    } else if (layout) {
+      data = ml_layout_stage_get_buffer (vivante->input_layout, i);
+      ml_layout_transform_run (layout, data, input[i].data);
+    }
+
+    if (vivante->input_convert && vivante->input_convert[i] != _NNS_END) {
+      _convert_to_graph (vivante->convert_buffer, data, vivante->input_convert[i],
+          vsi_nn_GetElementNum (tensor));
+      data = vivante->convert_buffer;
+    }
+
+    if (vsi_nn_CopyDataToTensor (vivante->graph, tensor, (uint8_t *) data) != VSI_SUCCESS) {
+      if (vivante->input_state)
+        vivante->input_state[i].uploaded = FALSE;
+      ML_TRACE_END ("vivante:copy_in");
       g_critical ("[vivante] Failed to copy data to tensor");
       return HAL_ML_ERROR_RUNTIME_ERROR;
     }
   }
+  ML_TRACE_END ("vivante:copy_in");
 
+  ML_TRACE_BEGIN ("vivante:run");
   if (vsi_nn_RunGraph (vivante->graph) != VSI_SUCCESS) {
+    ML_TRACE_END ("vivante:run");
     g_critical ("[vivante] Failed to run graph");
     return HAL_ML_ERROR_RUNTIME_ERROR;
   }
 
   if (vivante->has_post_process)
     vivante->model_specific_vnn_PostProcessNeuralNetwork (vivante->graph);
+  ML_TRACE_END ("vivante:run");
+
+  if (vivante->states && _feed_states (vivante) != HAL_ML_ERROR_NONE) {
+    g_atomic_int_set (&vivante->state_reset, TRUE);
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
 
+  ML_TRACE_SCOPE ("vivante:copy_out");
   for (unsigned int i = 0; i < vivante->graph->output.num; i++) {
     vsi_nn_tensor_t *out_tensor
         = vsi_nn_GetTensor (vivante->graph, vivante->graph->output.tensors[i]);
-
-    /* Convert to fp32 */
-    if (vivante->convert_output_fp32) {
+    const ml_layout_transform_s *layout = ml_layout_stage_get (vivante->output_layout, i);
+    void *detect_buffer = NULL;
+
+    /* A state or an output not selected, not copied nor converted. */
+    if (!output[i].data)
+      continue;
+
+    /* The box and score outputs are decoded after all outputs are copied. */
+    if (vivante->detect && i == vivante->detect_box_index)
+      detect_buffer = ml_detect_get_box_buffer (vivante->detect);
+    else if (vivante->detect && i == vivante->detect_score_index)
+      detect_buffer = ml_detect_get_score_buffer (vivante->detect);
+
+    /* Converted by the backend, then copied as the others. */
+    if (vivante->output_convert && vivante->output_convert[i] != _NNS_END) {
+      void *dest = output[i].data;
+      gboolean quantized = FALSE;
+      float scale = 1.0f;
+      gint32 zero_point = 0;
+
+      if (detect_buffer)
+        dest = detect_buffer;
+      else if (vivante->postproc && i == vivante->postproc_index)
+        dest = ml_postproc_get_buffer (vivante->postproc);
+      else if (layout)
+        dest = ml_layout_stage_get_buffer (vivante->output_layout, i);
+
+      _helper_get_quant_params (&out_tensor->attr.dtype, &quantized, &scale, &zero_point);
+      vsi_nn_CopyTensorToBuffer (vivante->graph, out_tensor, vivante->convert_buffer);
+      _convert_from_graph (dest, vivante->convert_buffer, vivante->output_convert[i],
+          vsi_nn_GetElementNum (out_tensor), vivante->convert_output_fp32, scale, zero_point);
+
+      if (!detect_buffer && vivante->postproc && i == vivante->postproc_index)
+        ml_postproc_run (vivante->postproc, output[i].data, dest);
+      else if (!detect_buffer && layout)
+        ml_layout_transform_run (layout, output[i].data, dest);
+    } else if (vivante->convert_output_fp32) {
+      /* Convert to fp32 */
       float *fp32_data = vsi_nn_ConvertTensorToFloat32Data (vivante->graph, out_tensor);
       if (fp32_data == NULL) {
         g_critical ("[vivante] Failed to convert output tensor to FP32.");
@@ -670,25 +2245,198 @@ ml_vivante_invoke (void *backend_private, const void *input_, void *output_)
       }
 
       vsi_size_t num_elements = vsi_nn_GetElementNum (out_tensor);
-      memcpy (output[i].data, fp32_data, num_elements * sizeof (float));
+      if (detect_buffer)
+        ml_copy (detect_buffer, fp32_data, num_elements * sizeof (float));
+      else if (vivante->postproc && i == vivante->postproc_index)
+        ml_postproc_run (vivante->postproc, output[i].data, fp32_data);
+      else if (layout)
+        ml_layout_transform_run (layout, output[i].data, fp32_data);
+      else
+        ml_copy (output[i].data, fp32_data, num_elements * sizeof (float));
       vsi_nn_Free (fp32_data);
+    } else if (detect_buffer) {
+      vsi_nn_CopyTensorToBuffer (vivante->graph, out_tensor, detect_buffer);
+    } else if (vivante->postproc && i == vivante->postproc_index) {
+      void *staging = ml_postproc_get_buffer (vivante->postproc);
+
+      vsi_nn_CopyTensorToBuffer (vivante->graph, out_tensor, staging);
+      ml_postproc_run (vivante->postproc, output[i].data, staging);
+    } else if (layout) {
+      void *staging = ml_layout_stage_get_buffer (vivante->output_layout, i);
+
+      vsi_nn_CopyTensorToBuffer (vivante->graph, out_tensor, staging);
+      ml_layout_transform_run (layout, output[i].data, staging);
     } else {
       /* Do not check return value of vsi_nnCopyTensorToBuffer. It returns error in normal case */
       vsi_nn_CopyTensorToBuffer (vivante->graph, out_tensor, output[i].data);
     }
   }
 
+  if (vivante->detect) {
+    ML_TRACE_SCOPE ("vivante:detect");
+    ml_detect_run (vivante->detect, output[vivante->detect_box_index].data,
+        output[vivante->detect_score_index].data, ml_detect_get_box_buffer (vivante->detect),
+        ml_detect_get_score_buffer (vivante->detect));
+  }
+
+  return HAL_ML_ERROR_NONE;
+}
+
+/**
+ * @brief Runs the graph for each tile of the frame, and merges the outputs of the tiles.
+ */
+static int
+_invoke_tiles (vivante_handle_s *vivante, const GstTensorMemory *input, GstTensorMemory *output)
+{
+  GstTensorMemory tile_input[NNS_TENSOR_SIZE_LIMIT];
+  GstTensorMemory tile_output[NNS_TENSOR_SIZE_LIMIT];
+  guint count = ml_tile_get_count (vivante->tile);
+
+  memcpy (tile_input, input, sizeof (GstTensorMemory) * vivante->graph->input.num);
+  tile_input[vivante->tile_index].data = ml_tile_get_input_buffer (vivante->tile);
+
+  /* The outputs not selected are not merged either. */
+  for (unsigned int i = 0; i < vivante->graph->output.num; i++)
+    tile_output[i].data = output[i].data ? ml_tile_get_output_buffer (vivante->tile, i) : NULL;
+
+  for (guint t = 0; t < count; t++) {
+    int status;
+
+    ml_tile_extract (vivante->tile, t, tile_input[vivante->tile_index].data,
+        input[vivante->tile_index].data);
+
+    status = _invoke_graph (vivante, tile_input, tile_output);
+    if (status != HAL_ML_ERROR_NONE)
+      return status;
+
+    ML_TRACE_SCOPE ("vivante:tile_merge");
+    for (unsigned int i = 0; i < vivante->graph->output.num; i++) {
+      if (output[i].data)
+        ml_tile_merge (vivante->tile, t, i, output[i].data, tile_output[i].data);
+    }
+  }
+
   return HAL_ML_ERROR_NONE;
 }
 
+/**
+ * @brief Crops and resizes the ROIs of the frame into the batched input, and runs the graph once.
+ */
+static int
+_invoke_rois (vivante_handle_s *vivante, const GstTensorMemory *input, GstTensorMemory *output)
+{
+  GstTensorMemory roi_input[NNS_TENSOR_SIZE_LIMIT];
+  void *batch = ml_roi_get_buffer (vivante->roi);
+
+  ML_TRACE_BEGIN ("vivante:roi");
+  ml_roi_run (vivante->roi, batch, input[vivante->roi_index].data,
+      input[vivante->graph->input.num].data);
+  ML_TRACE_END ("vivante:roi");
+
+  memcpy (roi_input, input, sizeof (GstTensorMemory) * vivante->graph->input.num);
+  roi_input[vivante->roi_index].data = batch;
+
+  return _invoke_graph (vivante, roi_input, output);
+}
+
+/**
+ * @brief Places the tensors of the pipeline at their indices in the graph. The others, the
+ *        states and the outputs not selected, are left empty.
+ */
+static void
+_map_to_graph (const guint *map, guint num, guint graph_num, const GstTensorMemory *src,
+    GstTensorMemory *dest)
+{
+  memset (dest, 0, sizeof (GstTensorMemory) * graph_num);
+
+  for (guint i = 0; i < num; i++)
+    dest[map[i]] = src[i];
+}
+
+/**
+ * @brief Runs the model with the tensors of the pipeline.
+ */
+static int
+_invoke_model (vivante_handle_s *vivante, const GstTensorMemory *input, GstTensorMemory *output)
+{
+  GstTensorMemory graph_input[NNS_TENSOR_SIZE_LIMIT];
+  GstTensorMemory graph_output[NNS_TENSOR_SIZE_LIMIT];
+  const GstTensorMemory *in = input;
+  GstTensorMemory *out = output;
+  int status;
+
+  if (vivante->use_output_pool
+      && !ml_buffer_pool_acquire_tensors (vivante->output_pool, &vivante->outputInfo, output)) {
+    g_critical ("[vivante] Failed to get the output buffers from the pool.");
+    return HAL_ML_ERROR_RUNTIME_ERROR;
+  }
+
+  /* Same inputs as a recent invoke, skip the graph. */
+  guint64 cache_key = 0;
+  if (vivante->result_cache
+      && ml_result_cache_lookup (vivante->result_cache, input, output, &cache_key))
+    return HAL_ML_ERROR_NONE;
+
+  if (vivante->input_map) {
+    _map_to_graph (vivante->input_map, vivante->inputInfo.num_tensors, vivante->graph->input.num,
+        input, graph_input);
+    in = graph_input;
+  }
+
+  if (vivante->output_map) {
+    _map_to_graph (vivante->output_map, vivante->outputInfo.num_tensors, vivante->graph->output.num,
+        output, graph_output);
+    out = graph_output;
+  }
+
+  if (vivante->tile)
+    status = _invoke_tiles (vivante, in, out);
+  else if (vivante->roi)
+    status = _invoke_rois (vivante, in, out);
+  else
+    status = _invoke_graph (vivante, in, out);
+
+  if (status == HAL_ML_ERROR_NONE && vivante->result_cache)
+    ml_result_cache_insert (vivante->result_cache, cache_key, input, output);
+
+  if (status != HAL_ML_ERROR_NONE && vivante->use_output_pool)
+    ml_buffer_pool_release_tensors (vivante->output_pool, vivante->outputInfo.num_tensors, output);
+
+  return status;
+}
+
+static int
+ml_vivante_invoke (void *backend_private, const void *input_, void *output_)
+{
+  const GstTensorMemory *input = (const GstTensorMemory *) input_;
+  GstTensorMemory *output = (GstTensorMemory *) output_;
+  vivante_handle_s *vivante = (vivante_handle_s *) backend_private;
+  int status;
+
+  if (!vivante) {
+    g_critical ("[vivante] invalid backend_private");
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  ML_TRACE_SCOPE ("vivante:invoke");
+
+  /* RELOAD_MODEL swaps the model between invokes. */
+  g_mutex_lock (&vivante->reload->lock);
+  status = _invoke_model (vivante, input, output);
+  g_mutex_unlock (&vivante->reload->lock);
+
+  return status;
+}
+
 static int
 ml_vivante_get_framework_info (void *backend_private, void *fw_info)
 {
   GstTensorFilterFrameworkInfo *info = (GstTensorFilterFrameworkInfo *) fw_info;
+  vivante_handle_s *vivante = (vivante_handle_s *) backend_private;
 
   info->name = "vivante";
   info->allow_in_place = FALSE;
-  info->allocate_in_invoke = FALSE;
+  info->allocate_in_invoke = (vivante && vivante->use_output_pool) ? TRUE : FALSE;
   info->run_without_model = FALSE;
   info->verify_model_path = FALSE;
 
@@ -699,18 +2447,139 @@ static int
 ml_vivante_get_model_info (void *backend_private, int ops, void *in_info, void *out_info)
 {
   vivante_handle_s *vivante = (vivante_handle_s *) backend_private;
+  int status = HAL_ML_ERROR_NONE;
+
   if (!vivante)
     return HAL_ML_ERROR_INVALID_PARAMETER;
 
-  gst_tensors_info_copy ((GstTensorsInfo *) in_info, &vivante->inputInfo);
-  gst_tensors_info_copy ((GstTensorsInfo *) out_info, &vivante->outputInfo);
+  /* RELOAD_MODEL swaps the model and frees the old info. */
+  g_mutex_lock (&vivante->reload->lock);
 
-  return HAL_ML_ERROR_NONE;
+  if (ops == ML_GET_IN_OUT_INFO_BORROWED) {
+    if (!vivante->model_info || !in_info) {
+      g_critical ("[vivante] The model info is not available.");
+      status = HAL_ML_ERROR_INVALID_PARAMETER;
+    } else {
+      *(ml_model_info_s **) in_info = ml_model_info_ref (vivante->model_info);
+    }
+  } else {
+    ml_tensors_info_to_gst ((GstTensorsInfo *) in_info, &vivante->inputInfo);
+    ml_tensors_info_to_gst ((GstTensorsInfo *) out_info, &vivante->outputInfo);
+  }
+
+  g_mutex_unlock (&vivante->reload->lock);
+
+  return status;
 }
 
+/**
+ * @brief Swaps the models of the handles. The output pool and the reload state stay with the instance.
+ */
+static void
+_swap_model (vivante_handle_s *vivante, vivante_handle_s *next)
+{
+  vivante_handle_s old = *vivante;
+
+  *vivante = *next;
+  *next = old;
+
+  vivante->output_pool = old.output_pool;
+  vivante->reload = old.reload;
+  next->output_pool = NULL;
+  next->reload = NULL;
+}
+
+/**
+ * @brief Builds the new model with the properties of the last configure while the current
+ *        model keeps running, and swaps them between invokes. The inputs and outputs of the
+ *        new model should be the same, the caps of the pipeline are not negotiated again.
+ */
 static int
-ml_vivante_event_handler (void *backend_private, int ops, void *data)
+_reload_model (vivante_handle_s *vivante, const GstTensorFilterFrameworkEventData *data)
 {
+  GstTensorFilterProperties prop;
+  vivante_handle_s *next;
+  int status;
+
+  if (!data || !data->model_files || data->num_models < 1 || !vivante->model_path) {
+    g_critical ("[vivante] Invalid model files to reload, or the model is not configured yet.");
+    return HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  memset (&prop, 0, sizeof (prop));
+  prop.model_files = data->model_files;
+  prop.num_models = data->num_models;
+  prop.custom_properties = vivante->reload->custom_properties;
+  memcpy (prop.input_layout, vivante->reload->input_layout, sizeof (tensors_layout));
+  memcpy (prop.output_layout, vivante->reload->output_layout, sizeof (tensors_layout));
+
+  next = g_new0 (vivante_handle_s, 1);
+  _init_vivante_handle (next);
+
+  ML_TRACE_BEGIN ("vivante:reload");
+  status = ml_vivante_configure_instance (next, &prop);
+  ML_TRACE_END ("vivante:reload");
+
+  if (status == HAL_ML_ERROR_NONE
+      && (!ml_tensors_info_is_equal (&next->inputInfo, &vivante->inputInfo)
+          || !ml_tensors_info_is_equal (&next->outputInfo, &vivante->outputInfo)
+          || next->use_output_pool != vivante->use_output_pool)) {
+    g_critical ("[vivante] The inputs or outputs of the new model %s are different, keep the current model.",
+        data->model_files[0]);
+    status = HAL_ML_ERROR_INVALID_PARAMETER;
+  }
+
+  if (status == HAL_ML_ERROR_NONE) {
+    g_mutex_lock (&vivante->reload->lock);
+    _swap_model (vivante, next);
+    g_mutex_unlock (&vivante->reload->lock);
+
+    g_info ("[vivante] Reloaded the model %s.", vivante->model_path);
+  }
+
+  /* The old model, or the new one if rejected, is released out of the lock. */
+  _clear_vivante_handle (next);
+  g_free (next);
+
+  return status;
+}
+
+static int
+ml_vivante_event_handler (void *backend_private, int ops, void *data_)
+{
+  vivante_handle_s *vivante = (vivante_handle_s *) backend_private;
+  GstTensorFilterFrameworkEventData *data = (GstTensorFilterFrameworkEventData *) data_;
+
+  /* Outputs may outlive a reconfigure without OutputPool, so release them whatever the option is now. */
+  if ((event_ops) ops == DESTROY_NOTIFY && vivante) {
+    /* The handle may be freed by the release of the last output after deinit. */
+    if (data && ml_buffer_pool_release (vivante->output_pool, data->data))
+      return HAL_ML_ERROR_NONE;
+
+    if (vivante->use_output_pool) {
+      g_critical ("[vivante] The buffer to be destroyed is not from the output pool.");
+      return HAL_ML_ERROR_INVALID_PARAMETER;
+    }
+  }
+
+  /* The states are zeroed by the next invoke. The model may be swapped by a reload. */
+  if ((event_ops) ops == CUSTOM_PROP && vivante && data && data->custom_properties
+      && _parse_reset_state (data->custom_properties)) {
+    gboolean has_states;
+
+    g_mutex_lock (&vivante->reload->lock);
+    has_states = (vivante->states != NULL);
+    if (has_states)
+      g_atomic_int_set (&vivante->state_reset, TRUE);
+    g_mutex_unlock (&vivante->reload->lock);
+
+    if (has_states)
+      return HAL_ML_ERROR_NONE;
+  }
+
+  if ((event_ops) ops == RELOAD_MODEL && vivante)
+    return _reload_model (vivante, data);
+
   return HAL_ML_ERROR_NOT_SUPPORTED;
 }
 
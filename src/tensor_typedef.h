@@ -135,6 +135,17 @@ typedef enum _nns_tensor_type
   _NNS_FLOAT16, /**< added with nnstreamer 2.1.1-devel. If you add any operators (e.g., tensor_transform) to float16, it will either be not supported or be too inefficient. */
 
   _NNS_END,
+
+  /**
+   * Types of the HAL backends only, not defined by nnstreamer. They are placed after _NNS_END
+   * so that the values above stay the same as nnstreamer, and never reach the framework:
+   * the backends convert them on copy, and ml_tensor_type_to_gst() reports them as _NNS_END.
+   */
+  _NNS_BFLOAT16, /**< bfloat16, the upper half of float32. Convert with ml_bf16_to_fp32() and ml_fp32_to_bf16(). */
+  _NNS_INT4, /**< 4-bit signed integer, two elements packed in a byte (even element in the low nibble). */
+  _NNS_UINT4, /**< 4-bit unsigned integer, packed as _NNS_INT4. */
+
+  _NNS_INTERNAL_END,
 } tensor_type;
 
 /**
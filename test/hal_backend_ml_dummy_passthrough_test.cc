@@ -9,6 +9,8 @@
 #include "hal-backend-ml-util.h"
 #include "hal_backend_ml_test_util.h"
 #include "hal-backend-ml-util.cc"
+#include "hal-backend-ml-result-cache.h"
+#include "hal-backend-ml-trace.h"
 #include "hal_backend_ml_test_wrapper.h"
 #include "hal-backend-ml-dummy-passthrough.cc"
 
@@ -122,6 +124,90 @@ TEST_F(MLBackendTest, DummyPassthrough_get_model_info) {
     EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
 }
 
+TEST_F(MLBackendTest, DummyPassthrough_get_model_info_many_tensors) {
+    void* hal_data = nullptr;
+    const guint num = 40;
+    GstTensorsInfo in_info = {0};
+    GstTensorsInfo out_info = {0};
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    gst_tensors_info_init(&prop.input_meta);
+    prop.input_meta.num_tensors = num;
+    for (guint i = 0; i < num; i++) {
+        GstTensorInfo *info = gst_tensors_info_get_nth_info(&prop.input_meta, i);
+        info->type = _NNS_UINT8;
+        info->dimension[0] = i + 1;
+        info->name = g_strdup_printf("tensor%u", i);
+    }
+    prop.output_meta = prop.input_meta;
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    // The backend keeps the info compact, and converts it to GstTensorsInfo at the boundary
+    pass_handle_s *pass = (pass_handle_s *) hal_data;
+    EXPECT_EQ(num, pass->inputInfo.num_tensors);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_model_info(hal_data, GET_IN_OUT_INFO, &in_info, &out_info));
+    ASSERT_EQ(num, out_info.num_tensors);
+    EXPECT_EQ(num, gst_tensors_info_get_nth_info(&out_info, num - 1)->dimension[0]);
+    EXPECT_STREQ("tensor39", gst_tensors_info_get_nth_info(&out_info, num - 1)->name);
+
+    gst_tensors_info_free(&in_info);
+    gst_tensors_info_free(&out_info);
+    gst_tensors_info_free(&prop.input_meta);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
+
+TEST_F(MLBackendTest, DummyPassthrough_get_model_info_borrowed) {
+    void* hal_data = nullptr;
+    ml_model_info_s *info1 = nullptr;
+    ml_model_info_s *info2 = nullptr;
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    gst_tensors_info_init(&prop.input_meta);
+    prop.input_meta.num_tensors = 1;
+    prop.input_meta.info[0].type = _NNS_UINT8;
+    prop.input_meta.info[0].dimension[0] = 16;
+    prop.input_meta.info[0].name = (gchar *) "input";
+    prop.output_meta = prop.input_meta;
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+
+    // Not configured yet
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_dummy_passthrough_get_model_info(hal_data, ML_GET_IN_OUT_INFO_BORROWED, &info1, nullptr));
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    // The same shared info is returned, with interned names
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_model_info(hal_data, ML_GET_IN_OUT_INFO_BORROWED, &info1, nullptr));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_model_info(hal_data, ML_GET_IN_OUT_INFO_BORROWED, &info2, nullptr));
+    EXPECT_EQ(info1, info2);
+    EXPECT_EQ(1U, info1->output.num_tensors);
+    EXPECT_EQ(16U, info1->output.info[0].dimension[0]);
+    EXPECT_EQ(g_intern_string("input"), info1->input.info[0].name);
+    ml_model_info_unref(info2);
+
+    // The borrowed info stays valid after reconfigure
+    prop.custom_properties = "OutputDim:8";
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+    EXPECT_EQ(16U, info1->output.info[0].dimension[0]);
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_model_info(hal_data, ML_GET_IN_OUT_INFO_BORROWED, &info2, nullptr));
+    EXPECT_NE(info1, info2);
+    EXPECT_EQ(8U, info2->output.info[0].dimension[0]);
+
+    ml_model_info_unref(info1);
+    ml_model_info_unref(info2);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
+
 // ===================================================================
 // Event Handler Tests
 // ===================================================================
@@ -212,3 +298,347 @@ TEST_F(MLBackendTest, DummyPassthrough_multiple_inferences) {
 
     EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
 }
+
+// ===================================================================
+// Synthetic Accelerator Mode Tests
+// ===================================================================
+
+TEST_F(MLBackendTest, DummyPassthrough_synthetic_output_info) {
+    void* hal_data = nullptr;
+    GstTensorsInfo in_info = {0};
+    GstTensorsInfo out_info = {0};
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    prop.custom_properties = "OutputDim:10:2:1:1;4,OutputType:float32;int8";
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_model_info(hal_data, GET_IN_OUT_INFO, &in_info, &out_info));
+
+    ASSERT_EQ(2U, out_info.num_tensors);
+    EXPECT_EQ(_NNS_FLOAT32, out_info.info[0].type);
+    EXPECT_EQ(80U, gst_tensor_info_get_size(&out_info.info[0]));
+    EXPECT_EQ(_NNS_INT8, out_info.info[1].type);
+    EXPECT_EQ(4U, gst_tensor_info_get_size(&out_info.info[1]));
+
+    gst_tensors_info_free(&in_info);
+    gst_tensors_info_free(&out_info);
+
+    // Packed types are not defined by nnstreamer
+    prop.custom_properties = "OutputDim:10:2:1:1,OutputType:int4";
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
+
+TEST_F(MLBackendTest, DummyPassthrough_synthetic_service_time) {
+    void* hal_data = nullptr;
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorsInfo in_info = {0};
+    GstTensorsInfo out_info = {0};
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    prop.custom_properties = "ServiceTime:20000,Jitter:1000,JitterDist:exponential,ServiceMode:busy,QueueDepth:1";
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_model_info(hal_data, GET_IN_OUT_INFO, &in_info, &out_info));
+
+    allocate_and_load_test_buffers(input, output, &in_info, &out_info, test_config);
+
+    // Exponential jitter is always added to the fixed service time
+    gint64 start = g_get_monotonic_time();
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+    EXPECT_GE(g_get_monotonic_time() - start, 20000);
+
+    free_test_buffers(input, output, &in_info, &out_info);
+
+    gst_tensors_info_free(&in_info);
+    gst_tensors_info_free(&out_info);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
+
+// ===================================================================
+// In-place and Zero-copy Tests
+// ===================================================================
+
+TEST_F(MLBackendTest, DummyPassthrough_zero_copy) {
+    void* hal_data = nullptr;
+    guint8 data[16] = {0};
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorFilterFrameworkInfo fw_info = {0};
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    gst_tensors_info_init(&prop.input_meta);
+    prop.input_meta.num_tensors = 1;
+    prop.input_meta.info[0].type = _NNS_UINT8;
+    prop.input_meta.info[0].dimension[0] = 16;
+    prop.output_meta = prop.input_meta;
+    prop.custom_properties = "ZeroCopy:true";
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    // Alias of InPlace, the output never refers to the input owned by the framework
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_framework_info(hal_data, &fw_info));
+    EXPECT_TRUE(fw_info.allow_in_place);
+    EXPECT_FALSE(fw_info.allocate_in_invoke);
+
+    input[0].data = output[0].data = data;
+    input[0].size = output[0].size = sizeof(data);
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
+
+TEST_F(MLBackendTest, DummyPassthrough_in_place) {
+    void* hal_data = nullptr;
+    guint8 data[16] = {0};
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorFilterFrameworkInfo fw_info = {0};
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    gst_tensors_info_init(&prop.input_meta);
+    prop.input_meta.num_tensors = 1;
+    prop.input_meta.info[0].type = _NNS_UINT8;
+    prop.input_meta.info[0].dimension[0] = 16;
+    prop.output_meta = prop.input_meta;
+    prop.custom_properties = "InPlace:true";
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_framework_info(hal_data, &fw_info));
+    EXPECT_TRUE(fw_info.allow_in_place);
+    EXPECT_FALSE(fw_info.allocate_in_invoke);
+
+    input[0].data = output[0].data = data;
+    input[0].size = output[0].size = sizeof(data);
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
+
+// ===================================================================
+// Output Buffer Pool Tests
+// ===================================================================
+
+TEST_F(MLBackendTest, DummyPassthrough_output_pool) {
+    void* hal_data = nullptr;
+    guint8 in_data[1000];
+    guint8 other[16];
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorFilterFrameworkInfo fw_info = {0};
+    GstTensorFilterFrameworkEventData event_data;
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    gst_tensors_info_init(&prop.input_meta);
+    prop.input_meta.num_tensors = 1;
+    prop.input_meta.info[0].type = _NNS_UINT8;
+    prop.input_meta.info[0].dimension[0] = sizeof(in_data);
+    prop.output_meta = prop.input_meta;
+    prop.custom_properties = "OutputPool:true";
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_framework_info(hal_data, &fw_info));
+    EXPECT_TRUE(fw_info.allocate_in_invoke);
+
+    for (guint i = 0; i < sizeof(in_data); i++)
+        in_data[i] = (guint8) i;
+    input[0].data = in_data;
+    input[0].size = sizeof(in_data);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+    ASSERT_NE(output[0].data, nullptr);
+    EXPECT_EQ(output[0].size, sizeof(in_data));
+    EXPECT_EQ(0, ((guintptr) output[0].data) % 64);
+    EXPECT_EQ(0, memcmp(output[0].data, in_data, sizeof(in_data)));
+
+    // The released buffer is recycled for the next frame
+    void *first = output[0].data;
+    event_data.data = first;
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+    EXPECT_EQ(output[0].data, first);
+
+    // Buffers not from the pool, or already released, are rejected
+    event_data.data = other;
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+    event_data.data = output[0].data;
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+
+    // Outputs still held downstream are released after a reconfigure without the pool
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+    event_data.data = output[0].data;
+    prop.custom_properties = NULL;
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+    EXPECT_EQ(HAL_ML_ERROR_NOT_SUPPORTED, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+
+    // Outputs still held downstream are released after deinit, the last one frees the handle
+    prop.custom_properties = "OutputPool:true";
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+    first = output[0].data;
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+    EXPECT_NE(output[0].data, first);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+    event_data.data = first;
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+    event_data.data = output[0].data;
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_event_handler(hal_data, DESTROY_NOTIFY, &event_data));
+}
+
+TEST_F(MLBackendTest, DummyPassthrough_result_cache) {
+    void* hal_data = nullptr;
+    guint8 a[1000], b[1000], c[1000];
+    guint8 out_data[1000];
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    ml_result_cache_stats_s stats;
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    GstTensorFilterProperties prop = test_config->base;
+    gst_tensors_info_init(&prop.input_meta);
+    prop.input_meta.num_tensors = 1;
+    prop.input_meta.info[0].type = _NNS_UINT8;
+    prop.input_meta.info[0].dimension[0] = sizeof(a);
+    prop.output_meta = prop.input_meta;
+
+    // The memory limit is smaller than a result
+    prop.custom_properties = "ResultCache:2,ResultCacheMemory:512";
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    prop.custom_properties = "ResultCache:2,ResultCacheMemory:64K";
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+    ml_result_cache_s *cache = ((pass_handle_s *) hal_data)->result_cache;
+    ASSERT_NE(cache, nullptr);
+
+    memset(a, 1, sizeof(a));
+    memset(b, 2, sizeof(b));
+    memset(c, 3, sizeof(c));
+    output[0].data = out_data;
+    output[0].size = sizeof(out_data);
+
+    // A, B, A (hit), C evicts B, A (hit), B evicts C
+    guint8 *frames[] = { a, b, a, c, a, b };
+    for (guint8 *frame : frames) {
+        input[0].data = frame;
+        input[0].size = sizeof(a);
+        memset(out_data, 0, sizeof(out_data));
+
+        EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+        EXPECT_EQ(0, memcmp(out_data, frame, sizeof(out_data)));
+    }
+
+    ml_result_cache_get_stats(cache, &stats);
+    EXPECT_EQ(stats.hits, 2U);
+    EXPECT_EQ(stats.misses, 4U);
+    EXPECT_EQ(stats.evictions, 2U);
+    EXPECT_EQ(stats.entries, 2U);
+
+    // The cached result is returned on a hit, not the input
+    guint64 key;
+    input[0].data = a;
+    memset(out_data, 0, sizeof(out_data));
+    ASSERT_TRUE(ml_result_cache_lookup(cache, input, output, &key));
+    EXPECT_EQ(0, memcmp(out_data, a, sizeof(out_data)));
+    input[0].data = c;
+    EXPECT_FALSE(ml_result_cache_lookup(cache, input, output, &key));
+
+    ml_result_cache_clear(cache);
+    ml_result_cache_get_stats(cache, &stats);
+    EXPECT_EQ(stats.entries, 0U);
+    EXPECT_EQ(stats.bytes, 0U);
+
+    // The result of C inserted with the key of A, as if the keys collide, is a miss for A
+    input[0].data = a;
+    ASSERT_FALSE(ml_result_cache_lookup(cache, input, output, &key));
+    input[0].data = c;
+    ml_result_cache_insert(cache, key, input, output);
+    input[0].data = a;
+    EXPECT_FALSE(ml_result_cache_lookup(cache, input, output, &key));
+    ml_result_cache_get_stats(cache, &stats);
+    EXPECT_EQ(stats.collisions, 1U);
+    EXPECT_EQ(stats.entries, 1U);
+
+    // The memory limit is smaller than a result
+    prop.custom_properties = "ResultCache:2,ResultCacheMemory:1";
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_dummy_passthrough_configure_instance(hal_data, &prop));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
+
+// ===================================================================
+// Tracing Tests
+// ===================================================================
+
+TEST_F(MLBackendTest, DummyPassthrough_trace_dump) {
+    void* hal_data = nullptr;
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorsInfo in_info = {0};
+    GstTensorsInfo out_info = {0};
+    gchar *trace_json = nullptr;
+    const gchar *trace_path = "/tmp/hal-backend-ml-dummy-trace.json";
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    ml_trace_reset();
+    ml_trace_set_enabled(TRUE);
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_init(&hal_data));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_configure_instance(hal_data, &test_config->base));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_get_model_info(hal_data, GET_IN_OUT_INFO, &in_info, &out_info));
+
+    allocate_and_load_test_buffers(input, output, &in_info, &out_info, test_config);
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_invoke(hal_data, input, output));
+    free_test_buffers(input, output, &in_info, &out_info);
+
+    ml_trace_set_enabled(FALSE);
+
+    // Events are written in Chrome trace format
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_trace_dump(trace_path));
+    ASSERT_TRUE(g_file_get_contents(trace_path, &trace_json, NULL, NULL));
+    EXPECT_NE(nullptr, strstr(trace_json, "\"traceEvents\""));
+    EXPECT_NE(nullptr, strstr(trace_json, "\"name\":\"dummy:invoke\",\"cat\":\"hal-ml\",\"ph\":\"B\""));
+    EXPECT_NE(nullptr, strstr(trace_json, "\"name\":\"dummy:invoke\",\"cat\":\"hal-ml\",\"ph\":\"E\""));
+
+    g_free(trace_json);
+
+    // Reset drops the events of all threads, even before they record again
+    ml_trace_reset();
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_trace_dump(trace_path));
+    ASSERT_TRUE(g_file_get_contents(trace_path, &trace_json, NULL, NULL));
+    EXPECT_EQ(nullptr, strstr(trace_json, "\"name\":\"dummy:invoke\""));
+
+    g_free(trace_json);
+    remove(trace_path);
+
+    gst_tensors_info_free(&in_info);
+    gst_tensors_info_free(&out_info);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_dummy_passthrough_deinit(hal_data));
+}
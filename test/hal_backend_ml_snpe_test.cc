@@ -136,6 +136,39 @@ TEST_F(MLBackendTest, Snpe_event_handler_not_supported) {
     EXPECT_EQ(HAL_ML_ERROR_NONE, ml_snpe_deinit(hal_data));
 }
 
+TEST_F(MLBackendTest, Snpe_reload_model) {
+    void* hal_data = nullptr;
+    GstTensorFilterFrameworkEventData data = {};
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorsInfo in_info = {0};
+    GstTensorsInfo out_info = {0};
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_snpe_init(&hal_data));
+
+    // Nothing to reload before configure
+    data.model_files = test_config->base.model_files;
+    data.num_models = test_config->base.num_models;
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_snpe_event_handler(hal_data, RELOAD_MODEL, &data));
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_snpe_configure_instance(hal_data, &test_config->base));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_snpe_get_model_info(hal_data, GET_IN_OUT_INFO, &in_info, &out_info));
+    allocate_and_load_test_buffers(input, output, &in_info, &out_info, test_config);
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_snpe_invoke(hal_data, input, output));
+
+    // The same model again, the new one serves the next invoke
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_snpe_event_handler(hal_data, RELOAD_MODEL, &data));
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_snpe_invoke(hal_data, input, output));
+
+    free_test_buffers(input, output, &in_info, &out_info);
+    gst_tensors_info_free(&in_info);
+    gst_tensors_info_free(&out_info);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_snpe_deinit(hal_data));
+}
+
 // ===================================================================
 // Error Handling Tests - NULL Parameters
 // ===================================================================
@@ -6,6 +6,7 @@
 #include "nnstreamer_plugin_api_filter.h"
 #include <glib.h>
 #include <gtest/gtest.h>
+#include "hal-backend-ml-alloc.h"
 #include "hal-backend-ml-util.h"
 
 #ifdef __cplusplus
@@ -76,6 +77,34 @@ protected:
 
 #endif // __cplusplus
 
+/**
+ * @brief Test buffers are allocated like the buffers of the output pool, the large ones are
+ *        prefaulted and use huge pages if possible.
+ */
+static inline guint
+test_buffer_alloc_flags (gsize size)
+{
+  if (size < ML_ALLOC_MMAP_THRESHOLD)
+    return ML_ALLOC_FLAG_NONE;
+
+  return ML_ALLOC_FLAG_HUGEPAGE | ML_ALLOC_FLAG_PREFAULT;
+}
+
+/**
+ * @brief Free a test buffer. A buffer not from ml_alloc() fails the test, ml_alloc_free() only logs it.
+ */
+static inline void
+free_test_buffer (void *data)
+{
+  ml_alloc_info_s info;
+
+  if (!data)
+    return;
+
+  EXPECT_TRUE (ml_alloc_get_info (data, &info)) << "The buffer " << data << " is not allocated with ml_alloc.";
+  ml_alloc_free (data);
+}
+
 /**
  * @brief Allocate and load test buffers for inference
  *
@@ -97,7 +126,7 @@ allocate_and_load_test_buffers (GstTensorMemory *input, GstTensorMemory *output,
   for (guint i = 0; i < in_info->num_tensors; i++) {
     GstTensorInfo *info = gst_tensors_info_get_nth_info (in_info, i);
     input[i].size = gst_tensor_info_get_size (info);
-    input[i].data = g_malloc (input[i].size);
+    input[i].data = ml_alloc (input[i].size, test_buffer_alloc_flags (input[i].size), NULL);
     ASSERT_NE (input[i].data, nullptr);
 
     /* Load raw data from file if provided */
@@ -125,7 +154,7 @@ allocate_and_load_test_buffers (GstTensorMemory *input, GstTensorMemory *output,
   for (guint i = 0; i < out_info->num_tensors; i++) {
     GstTensorInfo *info = gst_tensors_info_get_nth_info (out_info, i);
     output[i].size = gst_tensor_info_get_size (info);
-    output[i].data = g_malloc0 (output[i].size);
+    output[i].data = ml_alloc (output[i].size, test_buffer_alloc_flags (output[i].size), NULL);
     ASSERT_NE (output[i].data, nullptr);
   }
 }
@@ -148,20 +177,16 @@ free_test_buffers (GstTensorMemory *input, GstTensorMemory *output,
   /* Free input buffers */
   if (input) {
     for (guint i = 0; i < in_info->num_tensors; i++) {
-      if (input[i].data) {
-        g_free (input[i].data);
-        input[i].data = nullptr;
-      }
+      free_test_buffer (input[i].data);
+      input[i].data = nullptr;
     }
   }
 
   /* Free output buffers */
   if (output) {
     for (guint i = 0; i < out_info->num_tensors; i++) {
-      if (output[i].data) {
-        g_free (output[i].data);
-        output[i].data = nullptr;
-      }
+      free_test_buffer (output[i].data);
+      output[i].data = nullptr;
     }
   }
 }
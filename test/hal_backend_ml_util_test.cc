@@ -0,0 +1,1049 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#define TESTING 1
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include <glib.h>
+#include "hal-backend-ml-util.h"
+#include "hal-backend-ml-util.cc"
+#include "hal-backend-ml-alloc.h"
+#include "hal-backend-ml-buffer-pool.h"
+#include "hal-backend-ml-copy.h"
+#include "hal-backend-ml-detect.h"
+#include "hal-backend-ml-int4.h"
+#include "hal-backend-ml-layout.h"
+#include "hal-backend-ml-postproc.h"
+#include "hal-backend-ml-preproc.h"
+#include "hal-backend-ml-result-cache.h"
+#include "hal-backend-ml-roi.h"
+#include "hal-backend-ml-tensor-view.h"
+#include "hal-backend-ml-tile.h"
+
+// ===================================================================
+// Copy Engine Tests
+// ===================================================================
+
+TEST(MLUtilTest, CopyEngineLargeBuffer) {
+    ml_copy_config_s config;
+    ml_copy_get_config(&config);
+    EXPECT_GT(config.llc_size, 0U);
+    EXPECT_GT(config.nontemporal_threshold, 0U);
+
+    // Larger than both thresholds, with unaligned start and odd size
+    gsize size = MAX(config.parallel_threshold == G_MAXSIZE ? 0 : config.parallel_threshold,
+        config.nontemporal_threshold) + 4099;
+    std::vector<guint8> src(size + 1);
+    std::vector<guint8> dest(size + 1, 0);
+    for (gsize i = 0; i < src.size(); i++)
+        src[i] = (guint8) (i * 31 + 7);
+
+    ml_copy(dest.data() + 1, src.data() + 1, size);
+    EXPECT_EQ(0, memcmp(dest.data() + 1, src.data() + 1, size));
+    EXPECT_EQ(0, dest[0]);
+}
+
+// ===================================================================
+// Buffer Pool Tests
+// ===================================================================
+
+TEST(MLUtilTest, BufferPoolSizeClass) {
+    ml_buffer_pool_s *pool = ml_buffer_pool_new(2);
+    guint outstanding, cached;
+    guint64 allocated;
+
+    // Sizes in the same class share the buffers
+    void *a = ml_buffer_pool_acquire(pool, 5000);
+    ASSERT_NE(a, nullptr);
+    EXPECT_TRUE(ml_buffer_pool_release(pool, a));
+    void *b = ml_buffer_pool_acquire(pool, 5100);
+    EXPECT_EQ(a, b);
+
+    // Large buffers are page aligned
+    void *c = ml_buffer_pool_acquire(pool, 1024 * 1024 + 1);
+    ASSERT_NE(c, nullptr);
+    EXPECT_EQ(0, ((guintptr) c) % 4096);
+
+    ml_buffer_pool_get_stats(pool, &outstanding, &cached, &allocated);
+    EXPECT_EQ(2U, outstanding);
+    EXPECT_EQ(0U, cached);
+    EXPECT_EQ(2U, allocated);
+
+    EXPECT_TRUE(ml_buffer_pool_release(pool, b));
+    EXPECT_TRUE(ml_buffer_pool_release(pool, c));
+    EXPECT_FALSE(ml_buffer_pool_release(pool, c));
+
+    ml_buffer_pool_get_stats(pool, &outstanding, &cached, &allocated);
+    EXPECT_EQ(0U, outstanding);
+    EXPECT_EQ(2U, cached);
+
+    ml_buffer_pool_free(pool);
+}
+
+static void
+_count_pool_destroy(gpointer data)
+{
+    (*(guint *) data)++;
+}
+
+TEST(MLUtilTest, BufferPoolFreeDeferred) {
+    ml_buffer_pool_s *pool = ml_buffer_pool_new(2);
+    guint destroyed = 0;
+
+    // Freed at once without outstanding buffers
+    ml_buffer_pool_free_full(pool, _count_pool_destroy, &destroyed);
+    EXPECT_EQ(1U, destroyed);
+
+    // Kept until the last outstanding buffer is released
+    pool = ml_buffer_pool_new(2);
+    void *a = ml_buffer_pool_acquire(pool, 5000);
+    void *b = ml_buffer_pool_acquire(pool, 100000);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+
+    destroyed = 0;
+    ml_buffer_pool_free_full(pool, _count_pool_destroy, &destroyed);
+    EXPECT_EQ(0U, destroyed);
+    EXPECT_TRUE(ml_buffer_pool_release(pool, a));
+    EXPECT_EQ(0U, destroyed);
+    EXPECT_TRUE(ml_buffer_pool_release(pool, b));
+    EXPECT_EQ(1U, destroyed);
+}
+
+// ===================================================================
+// Allocator Tests
+// ===================================================================
+
+TEST(MLUtilTest, AllocLargeBuffer) {
+    const gsize size = 12 * 1024 * 1024 + 100;
+    ml_alloc_info_s info;
+    ml_alloc_info_s queried;
+
+    guint8 *data = (guint8 *) ml_alloc(size, ML_ALLOC_FLAG_HUGEPAGE | ML_ALLOC_FLAG_LOCK | ML_ALLOC_FLAG_PREFAULT, &info);
+    ASSERT_NE(data, nullptr);
+
+    // Huge pages and lock depend on the system, but the buffer is always mapped and prefaulted
+    EXPECT_TRUE(info.mapped);
+    EXPECT_TRUE(info.prefaulted);
+    EXPECT_GE(info.size, size);
+    EXPECT_EQ(0U, info.size % info.page_size);
+    EXPECT_EQ(0, ((guintptr) data) % info.page_size);
+    EXPECT_EQ(0, data[0]);
+    EXPECT_EQ(0, data[size - 1]);
+
+    ASSERT_TRUE(ml_alloc_get_info(data, &queried));
+    EXPECT_EQ(info.size, queried.size);
+    EXPECT_EQ(info.hugetlb, queried.hugetlb);
+
+    memset(data, 0xff, size);
+    ml_alloc_free(data);
+    EXPECT_FALSE(ml_alloc_get_info(data, &queried));
+
+    // Small buffers come from the heap
+    data = (guint8 *) ml_alloc(100, ML_ALLOC_FLAG_NONE, &info);
+    ASSERT_NE(data, nullptr);
+    EXPECT_FALSE(info.mapped);
+    EXPECT_EQ(0, ((guintptr) data) % 64);
+    ml_alloc_free(data);
+}
+
+// ===================================================================
+// Tensors Info Tests
+// ===================================================================
+
+TEST(MLUtilTest, TensorsInfoCompact) {
+    ml_tensors_info_s info, copied;
+
+    ml_tensors_info_init(&info);
+    ml_tensors_info_init(&copied);
+
+    EXPECT_FALSE(ml_tensors_info_alloc(&info, NNS_TENSOR_SIZE_LIMIT + 1));
+    ASSERT_TRUE(ml_tensors_info_alloc(&info, 20));
+    ml_tensors_info_get_nth_info(&info, 19)->name = g_strdup("last");
+    ml_tensors_info_get_nth_info(&info, 19)->type = _NNS_FLOAT32;
+    EXPECT_EQ(nullptr, ml_tensors_info_get_nth_info(&info, 20));
+
+    ml_tensors_info_copy(&copied, &info);
+    EXPECT_EQ(20U, copied.num_tensors);
+    EXPECT_STREQ("last", copied.info[19].name);
+    EXPECT_EQ(_NNS_FLOAT32, copied.info[19].type);
+
+    // Same types and dimensions, the names and the trailing 1s do not matter
+    EXPECT_TRUE(ml_tensors_info_is_equal(&copied, &info));
+    g_free(copied.info[19].name);
+    copied.info[19].name = g_strdup("renamed");
+    copied.info[19].dimension[0] = 1;
+    EXPECT_TRUE(ml_tensors_info_is_equal(&copied, &info));
+    copied.info[19].dimension[1] = 2;
+    EXPECT_FALSE(ml_tensors_info_is_equal(&copied, &info));
+
+    ml_tensors_info_free(&info);
+    ml_tensors_info_free(&copied);
+    EXPECT_EQ(0U, copied.num_tensors);
+    EXPECT_EQ(nullptr, copied.info);
+}
+
+// ===================================================================
+// Typed Tensor View Tests
+// ===================================================================
+
+TEST(MLUtilTest, TensorTraitsAndDispatch) {
+    static_assert(ml_tensor_traits<_NNS_FLOAT32>::size == 4, "float32 size");
+    static_assert(std::is_same<ml_tensor_traits<_NNS_INT16>::type, int16_t>::value, "int16 type");
+    static_assert(ml_tensor_type_of<uint8_t>::value == _NNS_UINT8, "uint8 type");
+
+    // Dispatch instantiates the function for each type, same as the runtime table
+    for (int t = 0; t < _NNS_INTERNAL_END; t++) {
+        if (ml_tensor_get_element_bits((tensor_type) t) < 8)
+            continue;
+
+        gsize size = ml_tensor_dispatch((tensor_type) t, [] (auto tag) {
+            return (gsize) sizeof(typename decltype(tag)::type);
+        });
+        EXPECT_EQ(gst_tensor_get_element_size((tensor_type) t), size);
+    }
+
+    EXPECT_EQ(0U, ml_tensor_dispatch(_NNS_END, [] (auto) { return 1U; }));
+}
+
+TEST(MLUtilTest, TensorConvert) {
+    float src[4] = { -300.0f, 1.5f, 2.5f, 1e10f };
+    int8_t s8[4];
+    uint8_t u8[4];
+    ml_float16_s f16[4];
+    float back[4];
+
+    // Integers are rounded to nearest even and saturated
+    ASSERT_TRUE(ml_tensor_convert(s8, _NNS_INT8, src, _NNS_FLOAT32, 4));
+    EXPECT_EQ(-128, s8[0]);
+    EXPECT_EQ(2, s8[1]);
+    EXPECT_EQ(2, s8[2]);
+    EXPECT_EQ(127, s8[3]);
+
+    ASSERT_TRUE(ml_tensor_convert(u8, _NNS_UINT8, src, _NNS_FLOAT32, 4));
+    EXPECT_EQ(0, u8[0]);
+    EXPECT_EQ(255, u8[3]);
+
+    // Float16 overflows to inf
+    ASSERT_TRUE(ml_tensor_convert(f16, _NNS_FLOAT16, src, _NNS_FLOAT32, 4));
+    ASSERT_TRUE(ml_tensor_convert(back, _NNS_FLOAT32, f16, _NNS_FLOAT16, 4));
+    EXPECT_FLOAT_EQ(-300.0f, back[0]);
+    EXPECT_FLOAT_EQ(1.5f, back[1]);
+    EXPECT_TRUE(std::isinf(back[3]));
+
+    // All finite float16 values survive the round trip
+    for (guint32 bits = 0; bits < 0x10000U; bits++) {
+        ml_float16_s h = { (uint16_t) bits };
+        float f = ml_float16_to_float(h);
+
+        if (!std::isnan(f)) {
+            ASSERT_EQ(bits, ml_float_to_float16(f).bits);
+        }
+    }
+
+    EXPECT_FALSE(ml_tensor_convert(s8, _NNS_INT8, src, _NNS_END, 4));
+}
+
+TEST(MLUtilTest, TensorView) {
+    uint8_t data[2 * 3 * 4];
+    GstTensorInfo info;
+    const guint order[3] = { 2, 1, 0 };
+
+    for (guint i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t) i;
+
+    gst_tensor_info_init(&info);
+    info.type = _NNS_UINT8;
+    info.dimension[0] = 2;
+    info.dimension[1] = 3;
+    info.dimension[2] = 4;
+
+    auto view = ml_tensor_view_from(&info, (const uint8_t *) data);
+    ASSERT_NE(view.data, nullptr);
+    EXPECT_EQ(3U, view.rank);
+    EXPECT_EQ(sizeof(data), view.count());
+    EXPECT_TRUE(view.is_contiguous());
+    EXPECT_EQ(1 + 2 * 2 + 3 * 6, view.at(1, 2, 3));
+
+    // Permuted view without copy
+    auto permuted = view.permute(order);
+    EXPECT_EQ(4U, permuted.dim[0]);
+    EXPECT_EQ(2U, permuted.dim[2]);
+    EXPECT_FALSE(permuted.is_contiguous());
+    EXPECT_EQ(view.at(1, 2, 3), permuted.at(3, 2, 1));
+
+    // Type mismatch
+    auto invalid = ml_tensor_view_from(&info, (float *) nullptr);
+    EXPECT_EQ(invalid.data, nullptr);
+}
+
+// ===================================================================
+// Bfloat16 Tests
+// ===================================================================
+
+TEST(MLUtilTest, Bf16Convert) {
+    float src[19];
+    guint16 bf16[19];
+    float back[19];
+
+    EXPECT_EQ(2U, gst_tensor_get_element_size(_NNS_BFLOAT16));
+    EXPECT_EQ(_NNS_BFLOAT16, gst_tensor_get_type("bfloat16"));
+
+    // The values of nnstreamer are kept, and bfloat16 never reaches the framework
+    EXPECT_EQ(11, (int) _NNS_END);
+    EXPECT_EQ(_NNS_END, ml_tensor_type_to_gst(_NNS_BFLOAT16));
+    EXPECT_EQ(_NNS_FLOAT32, ml_tensor_type_to_gst(_NNS_FLOAT32));
+
+    ml_tensors_info_s info;
+    GstTensorsInfo gst_info;
+    ml_tensors_info_init(&info);
+    ASSERT_TRUE(ml_tensors_info_alloc(&info, 1));
+    ml_tensors_info_get_nth_info(&info, 0)->type = _NNS_BFLOAT16;
+    ml_tensors_info_get_nth_info(&info, 0)->dimension[0] = 4;
+    ml_tensors_info_to_gst(&gst_info, &info);
+    EXPECT_EQ(_NNS_END, gst_info.info[0].type);
+    gst_tensors_info_free(&gst_info);
+    ml_tensors_info_free(&info);
+
+    // Odd length to cover both the vector and the scalar paths
+    for (guint i = 0; i < 16; i++)
+        src[i] = (float) i - 8.0f;
+    src[16] = 1.00390625f;  // halfway, rounds down to even
+    src[17] = 1.01171875f;  // halfway, rounds up to even
+    src[18] = NAN;
+
+    ml_fp32_to_bf16(bf16, src, 19);
+    ml_bf16_to_fp32(back, bf16, 19);
+
+    for (guint i = 0; i < 16; i++)
+        EXPECT_FLOAT_EQ(src[i], back[i]);
+    EXPECT_FLOAT_EQ(1.0f, back[16]);
+    EXPECT_FLOAT_EQ(1.015625f, back[17]);
+    EXPECT_TRUE(std::isnan(back[18]));
+
+    // Same result through the typed conversion
+    ml_bfloat16_s typed[19];
+    ASSERT_TRUE(ml_tensor_convert(typed, _NNS_BFLOAT16, src, _NNS_FLOAT32, 19));
+    EXPECT_EQ(0, memcmp(typed, bf16, sizeof(bf16)));
+}
+
+// ===================================================================
+// Packed Int4 Tests
+// ===================================================================
+
+TEST(MLUtilTest, Int4PackUnpack) {
+    const guint count = 1001;  // odd, and not a multiple of the vector width
+    std::vector<gint8> s8(count), s8_back(count);
+    std::vector<guint8> u8(count), u8_back(count);
+    std::vector<guint8> packed((count + 1) / 2);
+    std::vector<float> deq(count);
+    GstTensorInfo info;
+
+    gst_tensor_info_init(&info);
+    info.type = _NNS_INT4;
+    info.dimension[0] = count;
+    EXPECT_EQ(4U, ml_tensor_get_element_bits(_NNS_INT4));
+    EXPECT_EQ((count + 1) / 2, gst_tensor_info_get_size(&info));
+    EXPECT_EQ(_NNS_UINT4, gst_tensor_get_type("uint4"));
+    EXPECT_EQ(_NNS_END, ml_tensor_type_to_gst(_NNS_INT4));
+    EXPECT_EQ(_NNS_END, ml_tensor_type_to_gst(_NNS_UINT4));
+
+    for (guint i = 0; i < count; i++) {
+        s8[i] = (gint8) ((gint) (i % 16) - 8);
+        u8[i] = (guint8) (i % 16);
+    }
+
+    ASSERT_TRUE(ml_int4_pack(packed.data(), _NNS_INT4, s8.data(), count));
+    EXPECT_EQ(0x98, packed[0]);  // -8 in the low nibble, -7 in the high nibble
+    ASSERT_TRUE(ml_int4_unpack(s8_back.data(), _NNS_INT4, packed.data(), count));
+    EXPECT_EQ(s8, s8_back);
+
+    // Dequantize with the table
+    ASSERT_TRUE(ml_int4_dequantize(deq.data(), _NNS_INT4, packed.data(), count, 0.5f, -2));
+    for (guint i = 0; i < count; i++)
+        ASSERT_FLOAT_EQ((s8[i] + 2) * 0.5f, deq[i]);
+
+    ASSERT_TRUE(ml_int4_pack(packed.data(), _NNS_UINT4, u8.data(), count));
+    ASSERT_TRUE(ml_int4_unpack(u8_back.data(), _NNS_UINT4, packed.data(), count));
+    EXPECT_EQ(u8, u8_back);
+
+    // Out of range values are saturated
+    for (guint i = 0; i < count; i++)
+        s8[i] = (i & 1) ? 100 : -100;
+    ASSERT_TRUE(ml_int4_pack(packed.data(), _NNS_INT4, s8.data(), count));
+    ASSERT_TRUE(ml_int4_unpack(s8_back.data(), _NNS_INT4, packed.data(), count));
+    EXPECT_EQ(-8, s8_back[0]);
+    EXPECT_EQ(7, s8_back[1]);
+    EXPECT_EQ(-8, s8_back[count - 1]);
+
+    EXPECT_FALSE(ml_int4_unpack(s8_back.data(), _NNS_INT8, packed.data(), count));
+}
+
+// ===================================================================
+// Layout Transform Tests
+// ===================================================================
+
+TEST(MLUtilTest, LayoutTransform) {
+    // Model tensor in NCHW, [W, H, C, N]
+    const guint W = 37, H = 5, C = 3, N = 2;
+    ml_tensors_info_s info;
+    tensors_layout layout = { _NNS_LAYOUT_NHWC };
+    ml_layout_stage_s *stage = nullptr;
+    std::vector<float> nhwc(W * H * C * N), back(W * H * C * N);
+
+    ml_tensors_info_init(&info);
+    ASSERT_TRUE(ml_tensors_info_alloc(&info, 1));
+    GstTensorInfo *tinfo = ml_tensors_info_get_nth_info(&info, 0);
+    tinfo->type = _NNS_FLOAT32;
+    tinfo->dimension[0] = W;
+    tinfo->dimension[1] = H;
+    tinfo->dimension[2] = C;
+    tinfo->dimension[3] = N;
+
+    ASSERT_TRUE(ml_layout_stage_create(&info, _NNS_LAYOUT_NCHW, layout, TRUE, &stage));
+    ASSERT_NE(stage, nullptr);
+
+    // Reported in the layout of the pipeline, [C, W, H, N]
+    EXPECT_EQ(C, tinfo->dimension[0]);
+    EXPECT_EQ(W, tinfo->dimension[1]);
+    EXPECT_EQ(H, tinfo->dimension[2]);
+    EXPECT_EQ(N, tinfo->dimension[3]);
+
+    for (guint i = 0; i < nhwc.size(); i++)
+        nhwc[i] = (float) i;
+
+    const ml_layout_transform_s *t = ml_layout_stage_get(stage, 0);
+    float *nchw = (float *) ml_layout_stage_get_buffer(stage, 0);
+    ASSERT_NE(t, nullptr);
+    ASSERT_NE(nchw, nullptr);
+    ml_layout_transform_run(t, nchw, nhwc.data());
+
+    for (guint n = 0; n < N; n++)
+        for (guint c = 0; c < C; c++)
+            for (guint h = 0; h < H; h++)
+                for (guint w = 0; w < W; w++)
+                    ASSERT_EQ(nhwc[((n * H + h) * W + w) * C + c], nchw[((n * C + c) * H + h) * W + w]);
+
+    // And back to NHWC
+    ml_layout_transform_s rev;
+    GstTensorInfo model_info = *tinfo;
+    ml_layout_permute_dimension(model_info.dimension, _NNS_LAYOUT_NHWC, _NNS_LAYOUT_NCHW);
+    ASSERT_TRUE(ml_layout_transform_init(&rev, &model_info, _NNS_LAYOUT_NCHW, _NNS_LAYOUT_NCHW, _NNS_LAYOUT_NHWC));
+    ml_layout_transform_run(&rev, back.data(), nchw);
+    EXPECT_EQ(nhwc, back);
+
+    ml_layout_stage_free(stage);
+
+    // No stage if the layout is not given
+    layout[0] = _NNS_LAYOUT_ANY;
+    ASSERT_TRUE(ml_layout_stage_create(&info, _NNS_LAYOUT_NCHW, layout, TRUE, &stage));
+    EXPECT_EQ(stage, nullptr);
+    EXPECT_EQ(ml_layout_stage_get(stage, 0), nullptr);
+
+    ml_tensors_info_free(&info);
+}
+
+// ===================================================================
+// Input Preprocess Tests
+// ===================================================================
+
+TEST(MLUtilTest, InputPreprocess) {
+    // Model input in NCHW int8, [W, H, C, N], raw frame in NHWC uint8
+    const guint W = 7, H = 5, C = 3, N = 2;
+    const float mean[C] = { 123.68f, 116.78f, 103.94f };
+    ml_preproc_config_s config;
+    GstTensorInfo info, raw;
+
+    ml_preproc_config_init(&config);
+    EXPECT_FALSE(ml_preproc_config_is_enabled(&config));
+    ASSERT_TRUE(ml_preproc_parse_values("123.68; 116.78;103.94", config.mean, &config.num_mean));
+    ASSERT_TRUE(ml_preproc_parse_values("58.4", config.std, &config.num_std));
+    EXPECT_EQ(3U, config.num_mean);
+    EXPECT_EQ(1U, config.num_std);
+    EXPECT_TRUE(ml_preproc_config_is_enabled(&config));
+
+    float values[ML_PREPROC_MAX_CHANNELS];
+    guint num = 0;
+    EXPECT_FALSE(ml_preproc_parse_values("1;abc", values, &num));
+
+    config.quantized = TRUE;
+    config.scale = 0.02f;
+    config.zero_point = 3;
+
+    gst_tensor_info_init(&info);
+    info.type = _NNS_INT8;
+    info.dimension[0] = W;
+    info.dimension[1] = H;
+    info.dimension[2] = C;
+    info.dimension[3] = N;
+
+    ml_preproc_s *pp = ml_preproc_new(&config, &info, _NNS_LAYOUT_NCHW, _NNS_LAYOUT_NHWC);
+    ASSERT_NE(pp, nullptr);
+
+    gst_tensor_info_init(&raw);
+    ml_preproc_get_input_info(pp, &raw);
+    EXPECT_EQ(_NNS_UINT8, raw.type);
+    EXPECT_EQ(C, raw.dimension[0]);
+    EXPECT_EQ(W, raw.dimension[1]);
+    EXPECT_EQ(H, raw.dimension[2]);
+    EXPECT_EQ(N, raw.dimension[3]);
+
+    std::vector<guint8> frame(W * H * C * N);
+    for (guint i = 0; i < frame.size(); i++)
+        frame[i] = (guint8) (i * 37);
+
+    int8_t *q = (int8_t *) ml_preproc_get_buffer(pp);
+    ASSERT_NE(q, nullptr);
+    ml_preproc_run(pp, q, frame.data());
+
+    for (guint n = 0; n < N; n++) {
+        for (guint c = 0; c < C; c++) {
+            for (guint p = 0; p < W * H; p++) {
+                float x = (frame[(n * W * H + p) * C + c] - mean[c]) / 58.4f / 0.02f + 3.0f;
+                int expected = CLAMP ((int) lrintf (x), -128, 127);
+
+                ASSERT_EQ(expected, q[(n * C + c) * W * H + p]);
+            }
+        }
+    }
+    ml_preproc_free(pp);
+
+    // Float model input in the same layout as the frame
+    config.quantized = FALSE;
+    info.type = _NNS_FLOAT32;
+    info.dimension[0] = C;
+    info.dimension[1] = W;
+    info.dimension[2] = H;
+
+    pp = ml_preproc_new(&config, &info, _NNS_LAYOUT_NHWC, _NNS_LAYOUT_ANY);
+    ASSERT_NE(pp, nullptr);
+
+    float *f = (float *) ml_preproc_get_buffer(pp);
+    ml_preproc_run(pp, f, frame.data());
+    for (guint i = 0; i < frame.size(); i++)
+        ASSERT_NEAR((frame[i] - mean[i % C]) / 58.4f, f[i], 1e-5);
+    ml_preproc_free(pp);
+
+    // The number of mean values should match the channels
+    config.num_mean = 2;
+    EXPECT_EQ(ml_preproc_new(&config, &info, _NNS_LAYOUT_NHWC, _NNS_LAYOUT_ANY), nullptr);
+}
+
+TEST(MLUtilTest, InputPreprocessYuv) {
+    // NV12 frame resized to the model input in NCHW uint8, [W, H, C]
+    const guint SW = 38, SH = 10, W = 19, H = 5, C = 3;
+    ml_preproc_config_s config;
+    GstTensorInfo info, raw;
+
+    ml_preproc_config_init(&config);
+    ASSERT_TRUE(ml_preproc_parse_format("NV12", &config.format));
+    ASSERT_TRUE(ml_preproc_parse_size("38x10", &config.width, &config.height));
+    EXPECT_FALSE(ml_preproc_parse_size("38", &config.width, &config.height));
+    EXPECT_TRUE(ml_preproc_config_is_enabled(&config));
+
+    gst_tensor_info_init(&info);
+    info.type = _NNS_UINT8;
+    info.dimension[0] = W;
+    info.dimension[1] = H;
+    info.dimension[2] = C;
+    info.dimension[3] = 1;
+
+    ml_preproc_s *pp = ml_preproc_new(&config, &info, _NNS_LAYOUT_NCHW, _NNS_LAYOUT_ANY);
+    ASSERT_NE(pp, nullptr);
+
+    gst_tensor_info_init(&raw);
+    ml_preproc_get_input_info(pp, &raw);
+    EXPECT_EQ(_NNS_UINT8, raw.type);
+    EXPECT_EQ(SW, raw.dimension[0]);
+    EXPECT_EQ(SH * 3 / 2, raw.dimension[1]);
+
+    std::vector<guint8> frame(SW * SH * 3 / 2);
+    for (guint i = 0; i < frame.size(); i++)
+        frame[i] = (guint8) (i * 131 + 7 * (i >> 5));
+
+    guint8 *rgb = (guint8 *) ml_preproc_get_buffer(pp);
+    ml_preproc_run(pp, rgb, frame.data());
+
+    for (guint y = 0; y < H; y++) {
+        for (guint x = 0; x < W; x++) {
+            // Nearest neighbor, 2x downscale
+            const guint sx = 2 * x + 1, sy = 2 * y + 1;
+            const guint8 *uv = frame.data() + SW * SH + (sy / 2) * SW + (sx / 2) * 2;
+            float Y = 1.164f * (frame[sy * SW + sx] - 16);
+            float U = uv[0] - 128.0f, V = uv[1] - 128.0f;
+            float expected[C] = { Y + 1.596f * V, Y - 0.391f * U - 0.813f * V, Y + 2.018f * U };
+
+            for (guint c = 0; c < C; c++)
+                ASSERT_NEAR(CLAMP (expected[c], 0.0f, 255.0f), rgb[(c * H + y) * W + x], 2.0f);
+        }
+    }
+    ml_preproc_free(pp);
+
+    // Neutral chroma of I420 is gray
+    config.format = ML_PREPROC_FORMAT_I420;
+    config.width = W + 1;
+    config.height = H + 1;
+    pp = ml_preproc_new(&config, &info, _NNS_LAYOUT_NCHW, _NNS_LAYOUT_ANY);
+    ASSERT_NE(pp, nullptr);
+
+    std::vector<guint8> gray((W + 1) * (H + 1) * 3 / 2, 128);
+    rgb = (guint8 *) ml_preproc_get_buffer(pp);
+    ml_preproc_run(pp, rgb, gray.data());
+    for (guint i = 0; i < W * H; i++) {
+        EXPECT_EQ(rgb[i], rgb[W * H + i]);
+        EXPECT_EQ(rgb[i], rgb[2 * W * H + i]);
+    }
+    ml_preproc_free(pp);
+
+    // YUV requires 3 channels and an even size
+    config.width = W;
+    EXPECT_EQ(ml_preproc_new(&config, &info, _NNS_LAYOUT_NCHW, _NNS_LAYOUT_ANY), nullptr);
+}
+
+// ===================================================================
+// Output Postprocess Tests
+// ===================================================================
+
+TEST(MLUtilTest, OutputPostprocessTopK) {
+    const guint C = 1001, N = 2, K = 5;
+    ml_postproc_config_s config;
+
+    ml_postproc_config_init(&config);
+    EXPECT_FALSE(ml_postproc_config_is_enabled(&config));
+    EXPECT_FALSE(ml_postproc_parse("topk:0", &config));
+    EXPECT_FALSE(ml_postproc_parse("topk", &config));
+    EXPECT_FALSE(ml_postproc_parse("softmax", &config));
+    ASSERT_TRUE(ml_postproc_parse("argmax", &config));
+    EXPECT_EQ(config.k, 1U);
+    ASSERT_TRUE(ml_postproc_parse("TopK: 5", &config));
+    EXPECT_EQ(config.type, ML_POSTPROC_TOPK);
+    EXPECT_EQ(config.k, K);
+
+    // Quantized classifier output of 2 batches, [C, N]
+    GstTensorInfo info;
+    gst_tensor_info_init(&info);
+    info.type = _NNS_INT8;
+    info.dimension[0] = C;
+    info.dimension[1] = N;
+
+    ml_postproc_s *pp = ml_postproc_new(&config, &info);
+    ASSERT_NE(pp, nullptr);
+
+    GstTensorInfo out;
+    gst_tensor_info_init(&out);
+    ml_postproc_get_output_info(pp, &out);
+    EXPECT_EQ(out.type, _NNS_UINT32);
+    EXPECT_EQ(out.dimension[0], K);
+    EXPECT_EQ(out.dimension[1], N);
+
+    int8_t *logits = (int8_t *) ml_postproc_get_buffer(pp);
+    ASSERT_NE(logits, nullptr);
+    for (guint i = 0; i < C * N; i++)
+        logits[i] = (int8_t) ((i * 37) % 200 - 128);
+
+    // Scores in blocks and in the tail, ties ordered by the lower index
+    logits[999] = 127;
+    logits[17] = 120;
+    logits[3] = 120;
+    logits[C + 1000] = 127;
+    logits[C + 500] = 126;
+
+    std::vector<guint32> indices(K * N);
+    ml_postproc_run(pp, indices.data(), logits);
+
+    for (guint n = 0; n < N; n++) {
+        std::vector<guint32> order(C);
+        const int8_t *row = logits + n * C;
+
+        for (guint i = 0; i < C; i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](guint32 a, guint32 b) { return row[a] > row[b]; });
+
+        for (guint k = 0; k < K; k++)
+            EXPECT_EQ(indices[n * K + k], order[k]);
+    }
+    EXPECT_EQ(indices[0], 999U);
+    EXPECT_EQ(indices[1], 3U);
+    EXPECT_EQ(indices[2], 17U);
+    EXPECT_EQ(indices[K], 1000U);
+    EXPECT_EQ(indices[K + 1], 500U);
+    ml_postproc_free(pp);
+
+    // Float output
+    std::vector<float> scores = { 0.1f, 0.7f, -1.0f, 0.2f };
+    guint32 argmax = 0;
+    info.type = _NNS_FLOAT32;
+    info.dimension[0] = (guint) scores.size();
+    info.dimension[1] = 1;
+    ASSERT_TRUE(ml_postproc_parse("argmax", &config));
+    pp = ml_postproc_new(&config, &info);
+    ASSERT_NE(pp, nullptr);
+    ml_postproc_run(pp, &argmax, scores.data());
+    EXPECT_EQ(argmax, 1U);
+    ml_postproc_free(pp);
+
+    // K larger than the classes
+    ASSERT_TRUE(ml_postproc_parse("topk:5", &config));
+    EXPECT_EQ(ml_postproc_new(&config, &info), nullptr);
+}
+
+TEST(MLUtilTest, OutputPostprocessDetection) {
+    const guint N = 40, C = 3, M = 4;
+    ml_detect_config_s config;
+
+    ml_detect_config_init(&config);
+    EXPECT_FALSE(ml_detect_config_is_enabled(&config));
+    EXPECT_FALSE(ml_detect_parse_box_type("corners", &config.box_type));
+    ASSERT_TRUE(ml_detect_parse_box_type("cxcywh", &config.box_type));
+    EXPECT_TRUE(ml_detect_config_is_enabled(&config));
+    config.score_threshold = 0.5f;
+    config.iou_threshold = 0.5f;
+    config.max_detections = M;
+
+    // YOLO-like float boxes [N, 4] and uint8 scores [N, C], score = q / 255
+    config.score_quantized = TRUE;
+    config.score_scale = 1.0f / 255.0f;
+    config.score_zero_point = 0;
+
+    GstTensorInfo box_info, score_info;
+    gst_tensor_info_init(&box_info);
+    gst_tensor_info_init(&score_info);
+    box_info.type = _NNS_FLOAT32;
+    box_info.dimension[0] = N;
+    box_info.dimension[1] = 4;
+    score_info.type = _NNS_UINT8;
+    score_info.dimension[0] = N;
+    score_info.dimension[1] = C;
+
+    ml_detect_s *det = ml_detect_new(&config, &box_info, &score_info);
+    ASSERT_NE(det, nullptr);
+
+    float *boxes = (float *) ml_detect_get_box_buffer(det);
+    guint8 *scores = (guint8 *) ml_detect_get_score_buffer(det);
+    ASSERT_NE(boxes, nullptr);
+    ASSERT_NE(scores, nullptr);
+    for (guint i = 0; i < N; i++) {
+        boxes[0 * N + i] = 10.0f * i;
+        boxes[1 * N + i] = 10.0f * i;
+        boxes[2 * N + i] = 8.0f;
+        boxes[3 * N + i] = 8.0f;
+    }
+    memset(scores, 0, N * C);
+
+    // Box 20 overlaps box 21 of the same class and suppresses it, box 22 is of another class
+    scores[1 * N + 20] = 250;
+    boxes[0 * N + 21] = 201.0f;
+    boxes[1 * N + 21] = 201.0f;
+    scores[1 * N + 21] = 200;
+    boxes[0 * N + 22] = 201.0f;
+    boxes[1 * N + 22] = 201.0f;
+    scores[2 * N + 22] = 180;
+    // Box 35 is above the threshold, box 36 is not
+    scores[0 * N + 35] = 128;
+    scores[0 * N + 36] = 127;
+
+    GstTensorInfo out_box = box_info, out_score = score_info;
+    ml_detect_get_output_info(det, &out_box, &out_score);
+    EXPECT_EQ(out_box.type, _NNS_FLOAT32);
+    EXPECT_EQ(out_box.dimension[0], ML_DETECT_VALUES);
+    EXPECT_EQ(out_box.dimension[1], M);
+    EXPECT_EQ(out_score.type, _NNS_UINT32);
+    EXPECT_EQ(out_score.dimension[0], 1U);
+
+    std::vector<float> detections(ML_DETECT_VALUES * M);
+    guint32 count = 0;
+    EXPECT_EQ(ml_detect_run(det, detections.data(), &count, boxes, scores), 3U);
+    EXPECT_EQ(count, 3U);
+
+    const float *d = detections.data();
+    EXPECT_FLOAT_EQ(d[0], 196.0f);
+    EXPECT_FLOAT_EQ(d[1], 196.0f);
+    EXPECT_FLOAT_EQ(d[2], 204.0f);
+    EXPECT_FLOAT_EQ(d[3], 204.0f);
+    EXPECT_NEAR(d[4], 250.0f / 255.0f, 1e-6);
+    EXPECT_FLOAT_EQ(d[5], 1.0f);
+    d += ML_DETECT_VALUES;
+    EXPECT_FLOAT_EQ(d[0], 197.0f);
+    EXPECT_FLOAT_EQ(d[5], 2.0f);
+    d += ML_DETECT_VALUES;
+    EXPECT_FLOAT_EQ(d[0], 346.0f);
+    EXPECT_FLOAT_EQ(d[5], 0.0f);
+    d += ML_DETECT_VALUES;
+    EXPECT_FLOAT_EQ(d[4], 0.0f);
+    EXPECT_FLOAT_EQ(d[5], -1.0f);
+    ml_detect_free(det);
+
+    // SSD boxes [4, N] need the anchors
+    ASSERT_TRUE(ml_detect_parse_box_type("SSD", &config.box_type));
+    box_info.dimension[0] = 4;
+    box_info.dimension[1] = N;
+    EXPECT_EQ(ml_detect_new(&config, &box_info, &score_info), nullptr);
+
+    // Background class out of the classes
+    ASSERT_TRUE(ml_detect_parse_box_type("XYXY", &config.box_type));
+    config.background_class = C;
+    EXPECT_EQ(ml_detect_new(&config, &box_info, &score_info), nullptr);
+}
+
+// ===================================================================
+// Tiling Tests
+// ===================================================================
+
+TEST(MLUtilTest, TilingExtractAndMerge) {
+    const guint FW = 10, FH = 6, TW = 4, TH = 4, C = 3;
+    ml_tile_config_s config;
+
+    ml_tile_config_init(&config);
+    EXPECT_FALSE(ml_tile_config_is_enabled(&config));
+    EXPECT_FALSE(ml_tile_parse_merge("concat", &config.merge));
+    ASSERT_TRUE(ml_tile_parse_merge("stitch", &config.merge));
+    config.width = FW;
+    config.height = FH;
+    config.overlap = 2;
+    EXPECT_TRUE(ml_tile_config_is_enabled(&config));
+
+    // NHWC uint8 input [3, 4, 4, 1]
+    GstTensorInfo in_info;
+    gst_tensor_info_init(&in_info);
+    in_info.type = _NNS_UINT8;
+    in_info.dimension[0] = C;
+    in_info.dimension[1] = TW;
+    in_info.dimension[2] = TH;
+    in_info.dimension[3] = 1;
+
+    // A map at half the tile size [1, 2, 2, 1], and scores [10] which are stacked
+    ml_tensors_info_s out_info;
+    ml_tensors_info_init(&out_info);
+    ASSERT_TRUE(ml_tensors_info_alloc(&out_info, 2));
+    GstTensorInfo *map_info = ml_tensors_info_get_nth_info(&out_info, 0);
+    GstTensorInfo *score_info = ml_tensors_info_get_nth_info(&out_info, 1);
+    map_info->type = _NNS_UINT8;
+    map_info->dimension[0] = 1;
+    map_info->dimension[1] = TW / 2;
+    map_info->dimension[2] = TH / 2;
+    map_info->dimension[3] = 1;
+    score_info->type = _NNS_FLOAT32;
+    score_info->dimension[0] = 10;
+    tensor_layout out_layout[2] = { _NNS_LAYOUT_NHWC, _NNS_LAYOUT_ANY };
+
+    ml_tile_s *tile = ml_tile_new(&config, _NNS_LAYOUT_NHWC, &in_info, _NNS_LAYOUT_NHWC, &out_info, out_layout);
+    ASSERT_NE(tile, nullptr);
+
+    // Columns at 0, 2, 4 and 6, rows at 0 and 2
+    const guint count = ml_tile_get_count(tile);
+    ASSERT_EQ(count, 8U);
+    guint x, y;
+    ml_tile_get_origin(tile, 3, &x, &y);
+    EXPECT_EQ(x, 6U);
+    EXPECT_EQ(y, 0U);
+    ml_tile_get_origin(tile, 5, &x, &y);
+    EXPECT_EQ(x, 2U);
+    EXPECT_EQ(y, 2U);
+
+    GstTensorInfo frame_info = in_info;
+    ml_tile_get_input_info(tile, &frame_info);
+    EXPECT_EQ(frame_info.dimension[0], C);
+    EXPECT_EQ(frame_info.dimension[1], FW);
+    EXPECT_EQ(frame_info.dimension[2], FH);
+
+    ml_tile_get_output_info(tile, &out_info);
+    EXPECT_EQ(map_info->dimension[1], FW / 2);
+    EXPECT_EQ(map_info->dimension[2], FH / 2);
+    EXPECT_EQ(map_info->dimension[3], 1U);
+    EXPECT_EQ(score_info->dimension[0], 10U);
+    EXPECT_EQ(score_info->dimension[1], count);
+
+    std::vector<guint8> frame(C * FW * FH);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = (guint8) i;
+
+    guint8 *tile_input = (guint8 *) ml_tile_get_input_buffer(tile);
+    ml_tile_extract(tile, 5, tile_input, frame.data());
+    for (guint ty = 0; ty < TH; ty++) {
+        for (guint tx = 0; tx < TW; tx++) {
+            for (guint c = 0; c < C; c++) {
+                EXPECT_EQ(tile_input[(ty * TW + tx) * C + c], frame[((2 + ty) * FW + 2 + tx) * C + c]);
+            }
+        }
+    }
+
+    // Each tile writes its index and the position of the pixel in the tile
+    std::vector<guint8> map(gst_tensor_info_get_size(map_info), 0xff);
+    std::vector<float> scores(10 * count);
+    for (guint t = 0; t < count; t++) {
+        guint8 *tile_map = (guint8 *) ml_tile_get_output_buffer(tile, 0);
+        float *tile_scores = (float *) ml_tile_get_output_buffer(tile, 1);
+
+        for (guint i = 0; i < 4; i++)
+            tile_map[i] = (guint8) (t * 16 + i);
+        for (guint i = 0; i < 10; i++)
+            tile_scores[i] = (float) (t * 10 + i);
+
+        ml_tile_merge(tile, t, 0, map.data(), tile_map);
+        ml_tile_merge(tile, t, 1, scores.data(), tile_scores);
+    }
+
+    // Split at the middle of the overlaps: columns 0-1-2-3-3, rows 0-1-1 of the map
+    const guint col_tile[5] = { 0, 1, 2, 3, 3 };
+    const guint row_tile[3] = { 0, 1, 1 };
+    for (guint my = 0; my < FH / 2; my++) {
+        for (guint mx = 0; mx < FW / 2; mx++) {
+            guint t = row_tile[my] * 4 + col_tile[mx];
+            guint ox, oy;
+
+            ml_tile_get_origin(tile, t, &ox, &oy);
+            EXPECT_EQ(map[my * (FW / 2) + mx], t * 16 + (my - oy / 2) * 2 + (mx - ox / 2));
+        }
+    }
+
+    for (guint i = 0; i < 10 * count; i++)
+        EXPECT_FLOAT_EQ(scores[i], (float) i);
+
+    ml_tile_free(tile);
+
+    // The frame should not be smaller than the tile, and the overlap smaller than the tile
+    config.width = TW - 1;
+    EXPECT_EQ(ml_tile_new(&config, _NNS_LAYOUT_NHWC, &in_info, _NNS_LAYOUT_NHWC, &out_info, out_layout), nullptr);
+    config.width = FW;
+    config.overlap = TW;
+    EXPECT_EQ(ml_tile_new(&config, _NNS_LAYOUT_NHWC, &in_info, _NNS_LAYOUT_NHWC, &out_info, out_layout), nullptr);
+
+    ml_tensors_info_free(&out_info);
+}
+
+// ===================================================================
+// ROI Batch Tests
+// ===================================================================
+
+TEST(MLUtilTest, RoiBatchCropAndResize) {
+    const guint FW = 8, FH = 6, W = 4, H = 4, C = 3, B = 3;
+    ml_roi_config_s config;
+
+    ml_roi_config_init(&config);
+    EXPECT_FALSE(ml_roi_config_is_enabled(&config));
+    config.width = FW;
+    config.height = FH;
+    EXPECT_TRUE(ml_roi_config_is_enabled(&config));
+
+    // NHWC uint8 batched input [3, 4, 4, 3]
+    GstTensorInfo info;
+    gst_tensor_info_init(&info);
+    info.type = _NNS_UINT8;
+    info.dimension[0] = C;
+    info.dimension[1] = W;
+    info.dimension[2] = H;
+    info.dimension[3] = B;
+
+    ml_roi_s *roi = ml_roi_new(&config, _NNS_LAYOUT_NHWC, &info, _NNS_LAYOUT_ANY);
+    ASSERT_NE(roi, nullptr);
+    EXPECT_EQ(ml_roi_get_batch(roi), B);
+
+    GstTensorInfo frame_info = info, boxes_info = info;
+    ml_roi_get_input_info(roi, &frame_info);
+    EXPECT_EQ(frame_info.dimension[0], C);
+    EXPECT_EQ(frame_info.dimension[1], FW);
+    EXPECT_EQ(frame_info.dimension[2], FH);
+    EXPECT_EQ(frame_info.dimension[3], 1U);
+    ml_roi_get_boxes_info(roi, &boxes_info);
+    EXPECT_EQ(boxes_info.type, _NNS_FLOAT32);
+    EXPECT_EQ(boxes_info.dimension[0], ML_ROI_VALUES);
+    EXPECT_EQ(boxes_info.dimension[1], B);
+
+    std::vector<guint8> frame(C * FW * FH);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = (guint8) ((i * 37) % 256);
+
+    // A crop of the model size, a ROI resized with bilinear interpolation, and an empty one
+    const float boxes[B * ML_ROI_VALUES] = {
+        2.0f, 1.0f, 6.0f, 5.0f,
+        0.5f, 0.5f, 7.5f, 5.5f,
+        3.0f, 3.0f, 3.0f, 5.0f,
+    };
+    guint8 *batch = (guint8 *) ml_roi_get_buffer(roi);
+    EXPECT_EQ(ml_roi_run(roi, batch, frame.data(), boxes), 2U);
+
+    const guint8 *d = batch;
+    for (guint y = 0; y < H; y++) {
+        for (guint x = 0; x < W; x++) {
+            for (guint c = 0; c < C; c++)
+                EXPECT_EQ(d[(y * W + x) * C + c], frame[((1 + y) * FW + 2 + x) * C + c]);
+        }
+    }
+
+    d = batch + W * H * C;
+    for (guint y = 0; y < H; y++) {
+        for (guint x = 0; x < W; x++) {
+            float sx = std::min(std::max(0.5f + (x + 0.5f) * 7.0f / W - 0.5f, 0.0f), (float) (FW - 1));
+            float sy = std::min(std::max(0.5f + (y + 0.5f) * 5.0f / H - 0.5f, 0.0f), (float) (FH - 1));
+            guint x0 = (guint) sx, y0 = (guint) sy;
+            guint x1 = std::min(x0 + 1, FW - 1), y1 = std::min(y0 + 1, FH - 1);
+            float fx = sx - x0, fy = sy - y0;
+
+            for (guint c = 0; c < C; c++) {
+                float top = frame[(y0 * FW + x0) * C + c] * (1 - fx) + frame[(y0 * FW + x1) * C + c] * fx;
+                float bottom = frame[(y1 * FW + x0) * C + c] * (1 - fx) + frame[(y1 * FW + x1) * C + c] * fx;
+
+                EXPECT_NEAR(d[(y * W + x) * C + c], top * (1 - fy) + bottom * fy, 1.0);
+            }
+        }
+    }
+
+    d = batch + 2 * W * H * C;
+    for (guint i = 0; i < W * H * C; i++)
+        EXPECT_EQ(d[i], 0U);
+
+    ml_roi_free(roi);
+
+    // Only uint8 input
+    info.type = _NNS_FLOAT32;
+    EXPECT_EQ(ml_roi_new(&config, _NNS_LAYOUT_NHWC, &info, _NNS_LAYOUT_ANY), nullptr);
+}
+
+// ===================================================================
+// Hash Tests
+// ===================================================================
+
+TEST(MLUtilTest, HashData) {
+    std::vector<guint8> data(1000);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (guint8) (i * 131);
+
+    // Every size covers the lanes of 32 bytes, the 8-byte and the byte tails
+    for (gsize size = 0; size <= 100; size++) {
+        guint64 hash = ml_hash_data(data.data(), size);
+
+        EXPECT_EQ(hash, ml_hash_data(data.data(), size));
+        if (size > 0) {
+            EXPECT_NE(hash, ml_hash_data(data.data(), size - 1));
+
+            // A flipped bit anywhere changes the hash
+            for (gsize i = 0; i < size; i++) {
+                data[i] ^= 0x10;
+                EXPECT_NE(hash, ml_hash_data(data.data(), size));
+                data[i] ^= 0x10;
+            }
+        }
+    }
+
+    // Same data in another buffer
+    std::vector<guint8> copy(data);
+    EXPECT_EQ(ml_hash_data(data.data(), data.size()), ml_hash_data(copy.data(), copy.size()));
+}
+
+// ===================================================================
+// Result Cache Tests
+// ===================================================================
+
+TEST(MLUtilTest, ResultCacheParseSize) {
+    gsize size = 0;
+
+    EXPECT_TRUE(ml_result_cache_parse_size("4096", &size));
+    EXPECT_EQ(size, 4096U);
+    EXPECT_TRUE(ml_result_cache_parse_size("64k", &size));
+    EXPECT_EQ(size, 64U * 1024U);
+    EXPECT_TRUE(ml_result_cache_parse_size("16M", &size));
+    EXPECT_EQ(size, 16U * 1024U * 1024U);
+    EXPECT_FALSE(ml_result_cache_parse_size("16MB", &size));
+    EXPECT_FALSE(ml_result_cache_parse_size("M", &size));
+}
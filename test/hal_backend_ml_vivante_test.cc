@@ -134,6 +134,246 @@ TEST_F(MLBackendTest, Vivante_event_handler_not_supported) {
     EXPECT_EQ(HAL_ML_ERROR_NONE, ml_vivante_deinit(hal_data));
 }
 
+TEST_F(MLBackendTest, Vivante_reload_model) {
+    void* hal_data = nullptr;
+    GstTensorFilterFrameworkEventData data = {};
+    GstTensorMemory input[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorMemory output[NNS_TENSOR_MEMORY_MAX] = {0};
+    GstTensorsInfo in_info = {0};
+    GstTensorsInfo out_info = {0};
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_vivante_init(&hal_data));
+
+    // Nothing to reload before configure
+    data.model_files = test_config->base.model_files;
+    data.num_models = test_config->base.num_models;
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, ml_vivante_event_handler(hal_data, RELOAD_MODEL, &data));
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_vivante_configure_instance(hal_data, &test_config->base));
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_vivante_get_model_info(hal_data, GET_IN_OUT_INFO, &in_info, &out_info));
+    allocate_and_load_test_buffers(input, output, &in_info, &out_info, test_config);
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_vivante_invoke(hal_data, input, output));
+
+    // The same model again, the new one serves the next invoke
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_vivante_event_handler(hal_data, RELOAD_MODEL, &data));
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_vivante_invoke(hal_data, input, output));
+
+    free_test_buffers(input, output, &in_info, &out_info);
+    gst_tensors_info_free(&in_info);
+    gst_tensors_info_free(&out_info);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_vivante_deinit(hal_data));
+}
+
+TEST_F(MLBackendTest, Vivante_event_handler_reset_state_without_states) {
+    void* hal_data = nullptr;
+    GstTensorFilterFrameworkEventData data = {};
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, ml_vivante_init(&hal_data));
+
+    // Nothing to reset if the model is not stateful
+    data.custom_properties = "ResetState:true";
+    EXPECT_EQ(HAL_ML_ERROR_NOT_SUPPORTED, ml_vivante_event_handler(hal_data, CUSTOM_PROP, &data));
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, ml_vivante_deinit(hal_data));
+}
+
+TEST(VivanteTest, ParseStateOptions) {
+    guint indices[NNS_TENSOR_SIZE_LIMIT];
+    guint num = 0;
+
+    EXPECT_TRUE(_parse_indices("1; 3", indices, &num));
+    ASSERT_EQ(num, 2U);
+    EXPECT_EQ(indices[0], 1U);
+    EXPECT_EQ(indices[1], 3U);
+    EXPECT_FALSE(_parse_indices("1;x", indices, &num));
+
+    EXPECT_TRUE(_parse_reset_state("ResetState:true"));
+    EXPECT_TRUE(_parse_reset_state("json:model.json, ResetState : TRUE"));
+    EXPECT_FALSE(_parse_reset_state("ResetState:false"));
+    EXPECT_FALSE(_parse_reset_state("json:model.json"));
+}
+
+TEST(VivanteTest, SelectOutputs) {
+    vivante_handle_s vivante;
+    guint selected[] = { 2, 0 };
+    guint duplicated[] = { 1, 1 };
+
+    _init_vivante_handle(&vivante);
+    ASSERT_TRUE(ml_tensors_info_alloc(&vivante.outputInfo, 3));
+    for (guint i = 0; i < 3; i++)
+        ml_tensors_info_get_nth_info(&vivante.outputInfo, i)->dimension[0] = 10 + i;
+
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, _setup_output_map(&vivante, duplicated, 2));
+    EXPECT_EQ(HAL_ML_ERROR_NONE, _setup_output_map(&vivante, selected, 2));
+
+    // Only the selected outputs in the given order
+    ASSERT_EQ(vivante.outputInfo.num_tensors, 2U);
+    EXPECT_EQ(ml_tensors_info_get_nth_info(&vivante.outputInfo, 0)->dimension[0], 12U);
+    EXPECT_EQ(ml_tensors_info_get_nth_info(&vivante.outputInfo, 1)->dimension[0], 10U);
+    ASSERT_NE(vivante.output_map, nullptr);
+    EXPECT_EQ(vivante.output_map[0], 2U);
+    EXPECT_EQ(vivante.output_map[1], 0U);
+
+    ml_tensors_info_free(&vivante.outputInfo);
+    g_free(vivante.output_map);
+}
+
+TEST(VivanteTest, GraphLayouts) {
+    tensors_layout layout = { _NNS_LAYOUT_NHWC, _NNS_LAYOUT_NCHW };
+    tensors_layout graph_layout;
+    guint states[] = { 1 };
+
+    // The inputs of the pipeline skip the state input
+    _get_graph_layouts(layout, 3, NULL, 0, states, 1, graph_layout);
+    EXPECT_EQ(graph_layout[0], _NNS_LAYOUT_NHWC);
+    EXPECT_EQ(graph_layout[1], _NNS_LAYOUT_ANY);
+    EXPECT_EQ(graph_layout[2], _NNS_LAYOUT_NCHW);
+
+    _get_graph_layouts(layout, 2, NULL, 0, NULL, 0, graph_layout);
+    EXPECT_EQ(graph_layout[0], _NNS_LAYOUT_NHWC);
+    EXPECT_EQ(graph_layout[1], _NNS_LAYOUT_NCHW);
+}
+
+TEST(VivanteTest, SelectedOutputLayouts) {
+    vivante_handle_s vivante;
+    tensors_layout layout = { _NNS_LAYOUT_NHWC, _NNS_LAYOUT_NCHW };
+    tensors_layout graph_layout;
+    guint selected[] = { 2, 0 };
+    ml_layout_stage_s *stage = NULL;
+
+    _init_vivante_handle(&vivante);
+    ASSERT_TRUE(ml_tensors_info_alloc(&vivante.outputInfo, 3));
+    for (guint i = 0; i < 3; i++) {
+        GstTensorInfo *info = ml_tensors_info_get_nth_info(&vivante.outputInfo, i);
+
+        info->type = _NNS_UINT8;
+        info->dimension[0] = 4;
+        info->dimension[1] = 3;
+        info->dimension[2] = 2;
+        info->dimension[3] = 1;
+    }
+
+    // The first output of the pipeline is the graph output #2
+    _get_graph_layouts(layout, 3, selected, 2, NULL, 0, graph_layout);
+    EXPECT_EQ(graph_layout[0], _NNS_LAYOUT_NCHW);
+    EXPECT_EQ(graph_layout[1], _NNS_LAYOUT_ANY);
+    EXPECT_EQ(graph_layout[2], _NNS_LAYOUT_NHWC);
+
+    // Only the graph output #2 is transformed, NCHW to NHWC
+    ASSERT_TRUE(ml_layout_stage_create(&vivante.outputInfo, _NNS_LAYOUT_NCHW, graph_layout, FALSE, &stage));
+    EXPECT_EQ(ml_layout_stage_get(stage, 0), nullptr);
+    EXPECT_EQ(ml_layout_stage_get(stage, 1), nullptr);
+    EXPECT_NE(ml_layout_stage_get(stage, 2), nullptr);
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, _setup_output_map(&vivante, selected, 2));
+    EXPECT_EQ(ml_tensors_info_get_nth_info(&vivante.outputInfo, 0)->dimension[0], 2U);
+    EXPECT_EQ(ml_tensors_info_get_nth_info(&vivante.outputInfo, 1)->dimension[0], 4U);
+
+    ml_layout_stage_free(stage);
+    ml_tensors_info_free(&vivante.outputInfo);
+    g_free(vivante.output_map);
+}
+
+/** @brief Parses the JSON array in the string, owned by the parser. */
+static JsonArray *
+_parse_json_array(JsonParser *parser, const gchar *str) {
+    if (!json_parser_load_from_data(parser, str, -1, NULL))
+        return NULL;
+
+    return json_node_get_array(json_parser_get_root(parser));
+}
+
+#define TEST_JSON_TENSOR(id) \
+    "{\"id\": " #id ", \"size\": [4, 1], \"dtype\": {\"vx_type\": \"VSI_NN_TYPE_UINT8\"}}"
+
+TEST(VivanteTest, JsonTensorIds) {
+    vivante_handle_s vivante;
+    vsi_nn_tensor_id_t ids[2];
+    vsi_nn_tensor_id_t tensors[2];
+    JsonParser *parser = json_parser_new();
+    GHashTable *id_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    _init_vivante_handle(&vivante);
+    vivante.ctx = vsi_nn_CreateContext();
+    ASSERT_NE(vivante.ctx, nullptr);
+    vivante.graph = vsi_nn_CreateGraph(vivante.ctx, 4, 1);
+    ASSERT_NE(vivante.graph, nullptr);
+
+    EXPECT_EQ(HAL_ML_ERROR_NONE, _json_add_tensors(&vivante,
+        _parse_json_array(parser, "[" TEST_JSON_TENSOR(1) ", " TEST_JSON_TENSOR(2) "]"),
+        "input", FALSE, ids, id_table, NULL));
+    EXPECT_EQ(g_hash_table_size(id_table), 2U);
+
+    // The ids are unique over the inputs, outputs and virtual tensors
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, _json_add_tensors(&vivante,
+        _parse_json_array(parser, "[" TEST_JSON_TENSOR(2) "]"), "virtual", TRUE, NULL, id_table, NULL));
+
+    // The tensors of a node are looked up by the ids
+    EXPECT_EQ(HAL_ML_ERROR_NONE, _json_set_node_tensors(_parse_json_array(parser, "[2, 1]"), tensors, id_table));
+    EXPECT_EQ(tensors[0], ids[1]);
+    EXPECT_EQ(tensors[1], ids[0]);
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER,
+        _json_set_node_tensors(_parse_json_array(parser, "[1, 3]"), tensors, id_table));
+
+    g_hash_table_destroy(id_table);
+    g_object_unref(parser);
+    _clear_vivante_handle(&vivante);
+}
+
+TEST(VivanteTest, JsonNbgNodes) {
+    TestGstTensorFilterProperties* test_config = get_test_config();
+    ASSERT_NE(test_config, nullptr) << "Test configuration not initialized";
+    vivante_handle_s vivante;
+    JsonParser *parser = json_parser_new();
+    GHashTable *id_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    _init_vivante_handle(&vivante);
+    vivante.model_path = g_strdup(test_config->base.model_files[0]);
+    vivante.json_path = g_strdup(test_config->base.model_files[0]);
+    vivante.ctx = vsi_nn_CreateContext();
+    ASSERT_NE(vivante.ctx, nullptr);
+    vivante.graph = vsi_nn_CreateGraph(vivante.ctx, 3, 2);
+    ASSERT_NE(vivante.graph, nullptr);
+
+    ASSERT_EQ(HAL_ML_ERROR_NONE, _json_add_tensors(&vivante,
+        _parse_json_array(parser, "[" TEST_JSON_TENSOR(1) ", " TEST_JSON_TENSOR(2) ", " TEST_JSON_TENSOR(3) "]"),
+        "input", FALSE, NULL, id_table, NULL));
+
+    // Only the first node defaults to the model file
+    EXPECT_EQ(HAL_ML_ERROR_INVALID_PARAMETER, _json_add_nbg_nodes(&vivante,
+        _parse_json_array(parser, "[{\"inputs\": [1], \"outputs\": [2]}, {\"inputs\": [2], \"outputs\": [3]}]"),
+        id_table));
+    ASSERT_NE(vivante.node_models, nullptr);
+    EXPECT_STREQ(vivante.node_models[0], test_config->base.model_files[0]);
+    EXPECT_EQ(vivante.node_models[1], nullptr);
+
+    g_hash_table_destroy(id_table);
+    g_object_unref(parser);
+    _clear_vivante_handle(&vivante);
+}
+
+TEST(VivanteTest, JsonVirtualTensorsNum) {
+    JsonParser *output_parser = json_parser_new();
+    JsonParser *nodes_parser = json_parser_new();
+    JsonParser *virtual_parser = json_parser_new();
+    JsonArray *outputs = _parse_json_array(output_parser, "[" TEST_JSON_TENSOR(3) ", " TEST_JSON_TENSOR(4) "]");
+    JsonArray *nodes = _parse_json_array(nodes_parser, "[{}, {}]");
+    JsonArray *virtuals = _parse_json_array(virtual_parser, "[" TEST_JSON_TENSOR(2) "]");
+
+    // One virtual tensor for each output of the single NBG node
+    EXPECT_EQ(_json_get_virtual_tensors_num(outputs, NULL, NULL), 2U);
+    // Only the declared virtual tensors with 'nodes'
+    EXPECT_EQ(_json_get_virtual_tensors_num(outputs, nodes, virtuals), 1U);
+    EXPECT_EQ(_json_get_virtual_tensors_num(outputs, nodes, NULL), 0U);
+
+    g_object_unref(output_parser);
+    g_object_unref(nodes_parser);
+    g_object_unref(virtual_parser);
+}
+
 // ===================================================================
 // Error Handling Tests - NULL Parameters
 // ===================================================================
@@ -196,6 +436,10 @@ TEST(VivanteTest, VivanteVsiTypeFromString) {
     EXPECT_EQ(VSI_NN_TYPE_FLOAT64, vivante_vsi_type_from_string("VSI_NN_TYPE_FLOAT64"));
     EXPECT_EQ(VSI_NN_TYPE_BFLOAT16, vivante_vsi_type_from_string("VSI_NN_TYPE_BFLOAT16"));
     EXPECT_EQ(VSI_NN_TYPE_BOOL8, vivante_vsi_type_from_string("VSI_NN_TYPE_BOOL8"));
+#if defined(HAVE_VSI_NN_TYPE_INT4)
+    EXPECT_EQ(VSI_NN_TYPE_INT4, vivante_vsi_type_from_string("VSI_NN_TYPE_INT4"));
+    EXPECT_EQ(VSI_NN_TYPE_UINT4, vivante_vsi_type_from_string("VSI_NN_TYPE_UINT4"));
+#endif
     
     // Case insensitive
     EXPECT_EQ(VSI_NN_TYPE_FLOAT32, vivante_vsi_type_from_string("vsi_nn_type_float32"));
@@ -232,14 +476,126 @@ TEST(VivanteTest, ConvertToTensorType) {
     EXPECT_EQ(_NNS_INT64, convert_to_tensor_type(VSI_NN_TYPE_INT64));
     EXPECT_EQ(_NNS_UINT64, convert_to_tensor_type(VSI_NN_TYPE_UINT64));
     EXPECT_EQ(_NNS_FLOAT16, convert_to_tensor_type(VSI_NN_TYPE_FLOAT16));
-    EXPECT_EQ(_NNS_FLOAT16, convert_to_tensor_type(VSI_NN_TYPE_BFLOAT16));
+    EXPECT_EQ(_NNS_BFLOAT16, convert_to_tensor_type(VSI_NN_TYPE_BFLOAT16));
     EXPECT_EQ(_NNS_FLOAT32, convert_to_tensor_type(VSI_NN_TYPE_FLOAT32));
     EXPECT_EQ(_NNS_FLOAT64, convert_to_tensor_type(VSI_NN_TYPE_FLOAT64));
+#if defined(HAVE_VSI_NN_TYPE_INT4)
+    EXPECT_EQ(_NNS_INT4, convert_to_tensor_type(VSI_NN_TYPE_INT4));
+    EXPECT_EQ(_NNS_UINT4, convert_to_tensor_type(VSI_NN_TYPE_UINT4));
+#endif
     
     // Unknown type
     EXPECT_EQ(_NNS_END, convert_to_tensor_type(VSI_NN_TYPE_NONE));
 }
 
+TEST(VivanteTest, ConvertBf16OnCopy) {
+    const float src[5] = {1.0f, -2.5f, 0.0f, 3.0f, 1024.0f};
+    guint16 graph[5];
+    float back[5];
+
+    // bfloat16 is float32 in the pipeline, the other types are kept unless converted to fp32
+    EXPECT_TRUE(_is_converted_type(_NNS_BFLOAT16));
+    EXPECT_FALSE(_is_converted_type(_NNS_FLOAT16));
+    EXPECT_EQ(_NNS_FLOAT32, _get_pipeline_type(_NNS_BFLOAT16, FALSE));
+    EXPECT_EQ(_NNS_UINT8, _get_pipeline_type(_NNS_UINT8, FALSE));
+    EXPECT_EQ(_NNS_FLOAT32, _get_pipeline_type(_NNS_UINT8, TRUE));
+
+    ASSERT_TRUE(_convert_to_graph(graph, src, _NNS_BFLOAT16, 5));
+    ASSERT_TRUE(_convert_from_graph(back, graph, _NNS_BFLOAT16, 5, FALSE, 1.0f, 0));
+    for (guint i = 0; i < 5; i++)
+        EXPECT_FLOAT_EQ(src[i], back[i]);
+
+    // Copied as is by ovxlib
+    EXPECT_FALSE(_convert_from_graph(back, graph, _NNS_FLOAT16, 5, FALSE, 1.0f, 0));
+}
+
+TEST(VivanteTest, ConvertInt4OnCopy) {
+    const gint8 src[5] = {-8, -1, 0, 7, 100};
+    const guint8 usrc[5] = {0, 1, 9, 15, 200};
+    guint8 graph[3];
+    gint8 back[5];
+    guint8 uback[5];
+    float deq[5];
+
+    // Packed 4-bit is 8-bit in the pipeline, or float32 with OutputType:FLOAT32
+    EXPECT_TRUE(_is_converted_type(_NNS_INT4));
+    EXPECT_TRUE(_is_converted_type(_NNS_UINT4));
+    EXPECT_EQ(_NNS_INT8, _get_pipeline_type(_NNS_INT4, FALSE));
+    EXPECT_EQ(_NNS_UINT8, _get_pipeline_type(_NNS_UINT4, FALSE));
+    EXPECT_EQ(_NNS_FLOAT32, _get_pipeline_type(_NNS_INT4, TRUE));
+
+    // Inputs are packed and saturated, outputs are unpacked
+    ASSERT_TRUE(_convert_to_graph(graph, src, _NNS_INT4, 5));
+    ASSERT_TRUE(_convert_from_graph(back, graph, _NNS_INT4, 5, FALSE, 1.0f, 0));
+    EXPECT_EQ(-8, back[0]);
+    EXPECT_EQ(-1, back[1]);
+    EXPECT_EQ(0, back[2]);
+    EXPECT_EQ(7, back[3]);
+    EXPECT_EQ(7, back[4]);
+
+    ASSERT_TRUE(_convert_to_graph(graph, usrc, _NNS_UINT4, 5));
+    ASSERT_TRUE(_convert_from_graph(uback, graph, _NNS_UINT4, 5, FALSE, 1.0f, 0));
+    EXPECT_EQ(0, uback[0]);
+    EXPECT_EQ(9, uback[2]);
+    EXPECT_EQ(15, uback[3]);
+    EXPECT_EQ(15, uback[4]);
+
+    // Dequantized with the quantization of the graph tensor
+    ASSERT_TRUE(_convert_to_graph(graph, src, _NNS_INT4, 5));
+    ASSERT_TRUE(_convert_from_graph(deq, graph, _NNS_INT4, 5, TRUE, 0.5f, -2));
+    EXPECT_FLOAT_EQ(-3.0f, deq[0]);
+    EXPECT_FLOAT_EQ(0.5f, deq[1]);
+    EXPECT_FLOAT_EQ(1.0f, deq[2]);
+    EXPECT_FLOAT_EQ(4.5f, deq[3]);
+}
+
+TEST(VivanteTest, StaticInputUpload) {
+    vivante_handle_s vivante;
+    vivante_input_state_s state = {};
+    guint8 a[64], b[64];
+
+    _init_vivante_handle(&vivante);
+    memset(a, 1, sizeof(a));
+    memset(b, 1, sizeof(b));
+    state.mode = VIVANTE_UPLOAD_CHANGED;
+    state.size = sizeof(a);
+    state.shadow = ml_alloc(state.size, ML_ALLOC_FLAG_NONE, NULL);
+    ASSERT_NE(state.shadow, nullptr);
+    vivante.input_state = &state;
+    vivante.num_input_state = 1;
+
+    EXPECT_TRUE(_input_needs_upload(&vivante, 0, a));
+    EXPECT_FALSE(_input_needs_upload(&vivante, 0, a));
+
+    // The same data in another buffer is verified with the copy
+    EXPECT_FALSE(_input_needs_upload(&vivante, 0, b));
+
+    // Changed in place
+    a[10] = 2;
+    EXPECT_TRUE(_input_needs_upload(&vivante, 0, a));
+    EXPECT_FALSE(_input_needs_upload(&vivante, 0, a));
+    EXPECT_TRUE(_input_needs_upload(&vivante, 0, b));
+
+    ml_alloc_free(state.shadow);
+}
+
+#if defined(HAVE_VSI_NN_PRE_PROCESS)
+TEST(VivanteTest, VivanteSourceFormatFromString) {
+    vsi_nn_preprocess_source_format_e format;
+
+    ASSERT_TRUE(vivante_source_format_from_string("NV12", &format));
+    EXPECT_EQ(VSI_NN_SOURCE_FORMAT_IMAGE_NV12, format);
+    ASSERT_TRUE(vivante_source_format_from_string("i420", &format));
+    EXPECT_EQ(VSI_NN_SOURCE_FORMAT_IMAGE_YUV420, format);
+    ASSERT_TRUE(vivante_source_format_from_string("RGB888_PLANAR", &format));
+    EXPECT_EQ(VSI_NN_SOURCE_FORMAT_IMAGE_RGB888_PLANAR, format);
+    ASSERT_TRUE(vivante_source_format_from_string("Tensor", &format));
+    EXPECT_EQ(VSI_NN_SOURCE_FORMAT_TENSOR, format);
+
+    EXPECT_FALSE(vivante_source_format_from_string("UNKNOWN_FORMAT", &format));
+}
+#endif
+
 // ===================================================================
 // Multiple Inference Tests
 // ===================================================================